@@ -0,0 +1,293 @@
+#define _POSIX_C_SOURCE 200809L
+
+/*
+ * Batched replicator assay.
+ *
+ * Pairs every candidate tape with a fixed panel of partner tapes (uniform
+ * random bytes, or tapes sampled from a soup snapshot) and runs each pair
+ * through bffo_run at random heads on the worker pool.  For each candidate it
+ * reports how often the partner half ends up an exact copy of the candidate,
+ * how often the candidate half survives unchanged, and the expected number of
+ * offspring per interaction (survived + copied).  Candidate cells are tagged
+ * with token ids 1..64 and partner cells with id 0, so partially successful
+ * copies show up in copied_frac even when the chars do not match exactly.
+ *
+ * Usage:
+ *   ./assay [--partners N] [--soup CKPT|TRACE_DIR:EPOCH] [--order ab|ba|both]
+ *           [--seed S] [--threads T] CANDIDATES
+ *
+ * CANDIDATES has one tape per line ('#' starts a comment).  A line may be:
+ *   - a soup_orig stats row or any text containing |tape|: the 64 chars
+ *     between the bars are used, with non-op chars (e.g. ' ') read as 0x00;
+ *   - 128 hex digits: the exact 64 bytes;
+ *   - a bare 64-char instruction string, read like the |tape| form.
+ *
+ * --soup samples partners from a soup: a soup_orig checkpoint file (e.g.
+ * ckpt/epoch_1000.ckpt, 64-bit or compact) or TRACE_DIR:EPOCH, an epoch of
+ * a --trace-dir trace.  Either must have BFFO_HALF_LEN-token tapes.  Output
+ * is TSV on stdout.
+ */
+
+#include "bff_orig.h"
+#include "checkpoint.h"
+#include "pool.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <time.h>
+
+typedef struct {
+    uint8_t chars[BFFO_HALF_LEN];
+} Tape;
+
+typedef struct {
+    uint64_t copies;         /* partner half == candidate, char for char */
+    uint64_t survivals;      /* candidate half unchanged */
+    uint64_t copied_cells;   /* partner-half cells carrying a candidate token */
+    uint64_t steps;
+} AssayResult;
+
+static Tape        *cands    = NULL;
+static uint32_t     ncands   = 0;
+static Tape        *partners = NULL;
+static uint32_t     npartners = 1000;
+static AssayResult *results  = NULL;
+static uint64_t     g_seed   = 1;
+static int          g_order  = 2;     /* 0 = candidate first, 1 = partner first, 2 = alternate */
+static atomic_uint  next_cand;
+
+#define MAX_PARTNERS (1u << 24)       /* a 1 GB panel */
+
+/* -------------------------------------------------------------------------
+ * RNG: SplitMix64 keyed by (seed, candidate, partner) so results do not
+ * depend on thread count or scheduling.
+ * -------------------------------------------------------------------------*/
+static inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* -------------------------------------------------------------------------
+ * Candidate loading
+ * -------------------------------------------------------------------------*/
+static void load_candidates(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); exit(1); }
+    uint32_t cap = 1024;
+    cands = malloc(cap * sizeof(Tape));
+    if (!cands) { perror("candidates"); exit(1); }
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        if (ncands == cap) {
+            Tape *grown = cap <= UINT32_MAX / 2 ? realloc(cands, (size_t)cap * 2 * sizeof(Tape)) : NULL;
+            if (!grown) { perror("candidates"); exit(1); }
+            cands = grown;
+            cap  *= 2;
+        }
+        if (bffo_parse_tape(line, cands[ncands].chars)) ncands++;
+    }
+    fclose(f);
+}
+
+/* -------------------------------------------------------------------------
+ * Partner panel
+ * -------------------------------------------------------------------------*/
+/* The chars of a soup, BFFO_HALF_LEN per tape, from a checkpoint file or
+ * TRACE_DIR:EPOCH.  Exits on error. */
+static uint8_t *load_soup_chars(const char *spec, uint32_t *ntapes_out) {
+    char        dir[4096];
+    const char *colon = strrchr(spec, ':');
+    struct stat st;
+    size_t      ncells;
+    uint8_t    *chars;
+
+    if (colon && (size_t)(colon - spec) < sizeof(dir)) {
+        memcpy(dir, spec, (size_t)(colon - spec));
+        dir[colon - spec] = '\0';
+    }
+    if (colon && (size_t)(colon - spec) < sizeof(dir) && !stat(dir, &st) && S_ISDIR(st.st_mode)) {
+        TraceReader tr;
+        TraceEpoch  ep;
+        if (trace_reader_open(&tr, dir) < 0) { perror(dir); exit(1); }
+        ncells = tr.hdr.ncells;
+        uint64_t *cells = malloc(ncells * sizeof(uint64_t));
+        chars = malloc(ncells);
+        if (!cells || !chars) { perror("soup"); exit(1); }
+        if (trace_read(&tr, atoi(colon + 1), cells, &ep) < 0) {
+            fprintf(stderr, "%s: epoch %s is not in the trace\n", dir, colon + 1);
+            exit(1);
+        }
+        for (size_t n = 0; n < ncells; n++) chars[n] = BFFO_TOKEN_CHAR(cells[n]);
+        free(cells);
+        trace_reader_close(&tr);
+    } else {
+        CheckpointHeader h;
+        if (ckpt_read_header(spec, &h) < 0) { perror(spec); exit(1); }
+        size_t token_bytes = h.token_bytes == 4 ? 4 : 8;
+        ncells = (size_t)h.soup_size * h.half_len;
+        if (h.half_len != BFFO_HALF_LEN || h.soup_bytes != ncells * token_bytes) {
+            fprintf(stderr, "%s: tapes of %u tokens; --soup needs %d\n", spec, h.half_len, BFFO_HALF_LEN);
+            exit(1);
+        }
+        void *cells = malloc(h.soup_bytes);
+        chars = malloc(ncells);
+        if (!cells || !chars) { perror("soup"); exit(1); }
+        if (ckpt_read(spec, &h, cells, h.soup_bytes) < 0) { perror(spec); exit(1); }
+        for (size_t n = 0; n < ncells; n++)
+            chars[n] = token_bytes == 4 ? BFFO_CTOKEN_CHAR(((const uint32_t *)cells)[n])
+                                        : BFFO_TOKEN_CHAR(((const uint64_t *)cells)[n]);
+        free(cells);
+    }
+    *ntapes_out = (uint32_t)(ncells / BFFO_HALF_LEN);
+    if (*ntapes_out == 0) { fprintf(stderr, "%s: no tapes\n", spec); exit(1); }
+    return chars;
+}
+
+static void make_partners(const char *soup_path) {
+    partners = malloc((size_t)npartners * sizeof(Tape));
+    if (!partners) { perror("partners"); exit(1); }
+    uint64_t rng = splitmix64(g_seed ^ 0x5041524eULL);   /* "PARN" */
+
+    if (!soup_path) {
+        for (uint32_t p = 0; p < npartners; p++)
+            for (int j = 0; j < BFFO_HALF_LEN; j++)
+                partners[p].chars[j] = (uint8_t)(rng = splitmix64(rng));
+        return;
+    }
+
+    uint32_t ntapes;
+    uint8_t *chars = load_soup_chars(soup_path, &ntapes);
+    for (uint32_t p = 0; p < npartners; p++) {
+        rng = splitmix64(rng);
+        memcpy(partners[p].chars, chars + (size_t)(rng % ntapes) * BFFO_HALF_LEN, BFFO_HALF_LEN);
+    }
+    free(chars);
+    fprintf(stderr, "Sampled %u partners from %u tapes in %s\n", npartners, ntapes, soup_path);
+}
+
+/* -------------------------------------------------------------------------
+ * Assay job: workers pull candidates off a shared counter
+ * -------------------------------------------------------------------------*/
+static void assay_one(uint32_t c) {
+    const Tape  *cand = &cands[c];
+    AssayResult  r    = {0, 0, 0, 0};
+    uint64_t     tape[BFFO_TAPE_LEN];
+
+    for (uint32_t p = 0; p < npartners; p++) {
+        int cand_first = g_order == 2 ? !(p & 1) : g_order == 0;
+        int cbase = cand_first ? 0 : BFFO_HALF_LEN;
+        int pbase = cand_first ? BFFO_HALF_LEN : 0;
+
+        for (int j = 0; j < BFFO_HALF_LEN; j++) {
+            tape[cbase + j] = BFFO_MAKE_TOKEN(j + 1, 0, cand->chars[j]);
+            tape[pbase + j] = BFFO_MAKE_TOKEN(0, 0, partners[p].chars[j]);
+        }
+
+        uint64_t h = splitmix64(g_seed ^ ((uint64_t)c << 32 | p));
+        uint8_t h0 = (uint8_t)(h & (BFFO_TAPE_LEN - 1));
+        uint8_t h1 = (uint8_t)((h >> 8) & (BFFO_TAPE_LEN - 1));
+        r.steps += bffo_run(tape, h0, h1);
+
+        int copied = 1, survived = 1;
+        for (int j = 0; j < BFFO_HALF_LEN; j++) {
+            copied   &= BFFO_TOKEN_CHAR(tape[pbase + j]) == cand->chars[j];
+            survived &= BFFO_TOKEN_CHAR(tape[cbase + j]) == cand->chars[j];
+            r.copied_cells += BFFO_TOKEN_ID(tape[pbase + j]) != 0;
+        }
+        r.copies    += (uint64_t)copied;
+        r.survivals += (uint64_t)survived;
+    }
+    results[c] = r;
+}
+
+static void assay_job(void *ctx, int tid, int nthreads) {
+    (void)ctx; (void)tid; (void)nthreads;
+    for (;;) {
+        uint32_t c = atomic_fetch_add(&next_cand, 1);
+        if (c >= ncands) break;
+        assay_one(c);
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * -------------------------------------------------------------------------*/
+static int usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--partners N] [--soup CKPT|TRACE_DIR:EPOCH] [--order ab|ba|both] "
+                    "[--seed S] [--threads T] CANDIDATES\n"
+                    "  --partners is 1 to %u\n", prog, MAX_PARTNERS);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    int         nthreads  = 0;
+    const char *soup_path = NULL;
+    const char *cand_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--partners") && i + 1 < argc) {
+            const char   *v = argv[++i];
+            char         *end;
+            unsigned long n = strtoul(v, &end, 10);
+            if (*v < '0' || *v > '9' || *end || n < 1 || n > MAX_PARTNERS) return usage(argv[0]);
+            npartners = (uint32_t)n;
+        }
+        else if (!strcmp(argv[i], "--soup")     && i + 1 < argc) soup_path = argv[++i];
+        else if (!strcmp(argv[i], "--seed")     && i + 1 < argc) g_seed    = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--threads")  && i + 1 < argc) nthreads  = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--order")    && i + 1 < argc) {
+            const char *o = argv[++i];
+            if      (!strcmp(o, "ab"))   g_order = 0;
+            else if (!strcmp(o, "ba"))   g_order = 1;
+            else if (!strcmp(o, "both")) g_order = 2;
+            else return usage(argv[0]);
+        }
+        else if (argv[i][0] != '-' && !cand_path) cand_path = argv[i];
+        else { fprintf(stderr, "Unknown argument: %s\n", argv[i]); return 1; }
+    }
+    if (!cand_path) return usage(argv[0]);
+
+    load_candidates(cand_path);
+    if (ncands == 0) { fprintf(stderr, "No candidate tapes in %s\n", cand_path); return 1; }
+    make_partners(soup_path);
+    results = calloc(ncands, sizeof(AssayResult));
+    if (!results) { perror("results"); return 1; }
+
+    nthreads = pool_start(nthreads);
+    fprintf(stderr, "Assay: %u candidates x %u partners, %d threads\n", ncands, npartners, nthreads);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    atomic_store(&next_cand, 0);
+    pool_run(assay_job, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    pool_stop();
+
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    fprintf(stderr, "%.0f interactions in %.2f s (%.2f M/s)\n",
+            (double)ncands * npartners, secs, (double)ncands * npartners / secs * 1e-6);
+
+    printf("%-8s\t%-10s\t%-10s\t%-10s\t%-11s\t%-10s\t%s\n",
+           "cand", "copy_rate", "survival", "offspring", "copied_frac", "mean_steps", "tape");
+    double np = (double)npartners;
+    for (uint32_t c = 0; c < ncands; c++) {
+        const AssayResult *r = &results[c];
+        char s[BFFO_HALF_LEN + 1];
+        bffo_tape_str(cands[c].chars, s);
+        printf("%-8u\t%-10.4f\t%-10.4f\t%-10.4f\t%-11.4f\t%-10.1f\t|%s|\n",
+               c, r->copies / np, r->survivals / np, (r->copies + r->survivals) / np,
+               r->copied_cells / (np * BFFO_HALF_LEN), r->steps / np, s);
+    }
+
+    free(cands);
+    free(partners);
+    free(results);
+    return 0;
+}
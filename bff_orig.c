@@ -1,5 +1,8 @@
 #include "bff_orig.h"
 
+#include <ctype.h>
+#include <string.h>
+
 /* Lookup table: 1 for valid BFF instruction bytes, 0 otherwise */
 static const uint8_t IS_OP[256] = {
     ['<']=1, ['>']=1, ['{']=1, ['}']=1,
@@ -7,33 +10,99 @@ static const uint8_t IS_OP[256] = {
     ['[']=1, [']']=1,
 };
 
-uint32_t bffo_run(uint64_t tape[BFFO_TAPE_LEN], uint8_t head0, uint8_t head1) {
-    uint8_t  ip    = 0;
-    uint8_t  stack[BFFO_STACK_DEPTH];
-    uint8_t  sp    = 0;
-    uint32_t steps = 0;
+/* Cell access for either token format: tape32 non-NULL means compact tokens */
+static inline __attribute__((always_inline))
+uint8_t cell_char(const uint64_t *tape, const uint32_t *tape32, uint8_t i) {
+    return tape32 ? BFFO_CTOKEN_CHAR(tape32[i]) : BFFO_TOKEN_CHAR(tape[i]);
+}
+
+static inline __attribute__((always_inline))
+void cell_add(uint64_t *tape, uint32_t *tape32, uint8_t i, int d) {
+    if (tape32) tape32[i] = (tape32[i] & ~0xFFu) | ((BFFO_CTOKEN_CHAR(tape32[i]) + d) & 0xFF);
+    else        tape[i]   = (tape[i] & ~0xFFULL) | ((BFFO_TOKEN_CHAR(tape[i]) + d) & 0xFF);
+}
+
+static inline __attribute__((always_inline))
+void cell_copy(uint64_t *tape, uint32_t *tape32, uint8_t dst, uint8_t src) {
+    if (tape32) tape32[dst] = tape32[src];
+    else        tape[dst]   = tape[src];
+}
+
+/*
+ * Interpreter core shared by every entry point below, for a tape of len
+ * cells (a power of two up to BFFO_MAX_TAPE_LEN) and a stack of depth
+ * entries (up to BFFO_STACK_DEPTH).  The tape is tape, or tape32 for
+ * compact tokens (the other is NULL).
+ *
+ * Always inlined so each caller gets its own specialised loop: with
+ * touch == NULL, flow == NULL, log == NULL, stop == BFFO_MAX_STEPS, a
+ * constant token format and constant len and depth the bookkeeping folds
+ * away and bffo_run keeps all state in registers.
+ */
+static inline __attribute__((always_inline))
+uint32_t run_core(uint64_t *tape, uint32_t *tape32, BffoState *st, uint32_t stop, uint32_t *touch,
+                  BffoFlow *flow, BffoStep *log, uint32_t len, uint32_t depth) {
+    const uint32_t half = len / 2;
+    uint8_t  ip     = st->ip;
+    uint8_t  head0  = st->head0;
+    uint8_t  head1  = st->head1;
+    uint8_t  sp     = st->sp;
+    uint8_t *stack  = st->stack;
+    uint32_t steps  = st->steps;
+    uint8_t  halted = 1;
+
+    if (stop > BFFO_MAX_STEPS) stop = BFFO_MAX_STEPS;
+
+    while (steps < stop) {
+        uint8_t op = cell_char(tape, tape32, ip);
+
+        if (touch) {
+            /* Conservative: a cell counts as touched by any instruction that may read it */
+            if (touch[ip] > steps) touch[ip] = steps;
+            if (op == '+' || op == '-' || op == ']' || op == '.' || op == ',')
+                if (touch[head0] > steps) touch[head0] = steps;
+            if (op == '.' || op == ',')
+                if (touch[head1] > steps) touch[head1] = steps;
+        }
+
+        if (log) {
+            BffoStep *e = log++;
+            e->token = tape32 ? tape32[op == ',' ? head1 : head0] : tape[op == ',' ? head1 : head0];
+            e->ip    = ip;
+            e->op    = op;
+            e->head0 = head0;
+            e->head1 = head1;
+            e->sp    = sp;
+            e->top   = sp ? stack[sp - 1] : 0;
+            e->reserved[0] = e->reserved[1] = 0;
+        }
 
-    while (steps < BFFO_MAX_STEPS) {
         steps++;
-        switch (BFFO_TOKEN_CHAR(tape[ip])) {
+        switch (op) {
 
-        case '<': head0 = (head0 - 1) & (BFFO_TAPE_LEN - 1); break;
-        case '>': head0 = (head0 + 1) & (BFFO_TAPE_LEN - 1); break;
-        case '{': head1 = (head1 - 1) & (BFFO_TAPE_LEN - 1); break;
-        case '}': head1 = (head1 + 1) & (BFFO_TAPE_LEN - 1); break;
-        case '+': tape[head0] = (tape[head0] & ~0xFFULL) | ((BFFO_TOKEN_CHAR(tape[head0]) + 1) & 0xFF); break;
-        case '-': tape[head0] = (tape[head0] & ~0xFFULL) | ((BFFO_TOKEN_CHAR(tape[head0]) - 1) & 0xFF); break;
-        case '.': tape[head1] = tape[head0]; break;  /* copy full token head0 → head1 */
-        case ',': tape[head0] = tape[head1]; break;  /* copy full token head1 → head0 */
+        case '<': head0 = (head0 - 1) & (len - 1); break;
+        case '>': head0 = (head0 + 1) & (len - 1); break;
+        case '{': head1 = (head1 - 1) & (len - 1); break;
+        case '}': head1 = (head1 + 1) & (len - 1); break;
+        case '+': cell_add(tape, tape32, head0, 1); break;
+        case '-': cell_add(tape, tape32, head0, -1); break;
+        case '.':                                    /* copy full token head0 → head1 */
+            cell_copy(tape, tape32, head1, head0);
+            if (flow) flow->copies[head0 / half][head1 / half]++;
+            break;
+        case ',':                                    /* copy full token head1 → head0 */
+            cell_copy(tape, tape32, head0, head1);
+            if (flow) flow->copies[head1 / half][head0 / half]++;
+            break;
 
         case '[':
-            if (sp >= BFFO_STACK_DEPTH) return steps;  /* stack overflow: terminate */
+            if (sp >= depth) goto done;                 /* stack overflow: terminate */
             stack[sp++] = ip;                           /* push unconditionally */
             break;
 
         case ']':
-            if (sp == 0) return steps;                  /* empty stack: terminate */
-            if (BFFO_TOKEN_CHAR(tape[head0]) != 0) {
+            if (sp == 0) goto done;                     /* empty stack: terminate */
+            if (cell_char(tape, tape32, head0) != 0) {
                 ip = stack[sp - 1];                     /* loop: jump to '[' */
             } else {
                 sp--;                                   /* exit loop */
@@ -44,10 +113,156 @@ uint32_t bffo_run(uint64_t tape[BFFO_TAPE_LEN], uint8_t head0, uint8_t head1) {
             break;
         }
 
-        if (ip + 1 >= BFFO_TAPE_LEN) return steps;
+        if (ip + 1u >= len) goto done;
         ip++;
     }
-    return steps;  /* step limit reached */
+    halted = steps >= BFFO_MAX_STEPS;                  /* step limit reached, or paused */
+
+done:
+    st->ip     = ip;
+    st->head0  = head0;
+    st->head1  = head1;
+    st->sp     = sp;
+    st->steps  = steps;
+    st->halted = halted;
+    return steps;
+}
+
+void bffo_init(BffoState *st, uint8_t head0, uint8_t head1) {
+    st->steps  = 0;
+    st->ip     = 0;
+    st->head0  = head0 & (BFFO_TAPE_LEN - 1);
+    st->head1  = head1 & (BFFO_TAPE_LEN - 1);
+    st->sp     = 0;
+    st->halted = 0;
+}
+
+uint32_t bffo_run(uint64_t tape[BFFO_TAPE_LEN], uint8_t head0, uint8_t head1) {
+    BffoState st;
+    bffo_init(&st, head0, head1);
+    return run_core(tape, NULL, &st, BFFO_MAX_STEPS, NULL, NULL, NULL, BFFO_TAPE_LEN, BFFO_STACK_DEPTH);
+}
+
+uint32_t bffo_resume(uint64_t tape[BFFO_TAPE_LEN], BffoState *st, uint32_t stop) {
+    if (st->halted) return st->steps;
+    return run_core(tape, NULL, st, stop, NULL, NULL, NULL, BFFO_TAPE_LEN, BFFO_STACK_DEPTH);
+}
+
+uint32_t bffo_run_flow(uint64_t tape[BFFO_TAPE_LEN], uint8_t head0, uint8_t head1, BffoFlow *flow) {
+    BffoState st;
+    bffo_init(&st, head0, head1);
+    return run_core(tape, NULL, &st, BFFO_MAX_STEPS, NULL, flow, NULL, BFFO_TAPE_LEN, BFFO_STACK_DEPTH);
+}
+
+uint32_t bffo_resume_flow(uint64_t tape[BFFO_TAPE_LEN], BffoState *st, uint32_t stop,
+                          BffoFlow *flow) {
+    if (st->halted) return st->steps;
+    return run_core(tape, NULL, st, stop, NULL, flow, NULL, BFFO_TAPE_LEN, BFFO_STACK_DEPTH);
+}
+
+uint32_t bffo_run_touch(uint64_t tape[BFFO_TAPE_LEN], BffoState *st,
+                        uint32_t first_touch[BFFO_TAPE_LEN]) {
+    if (st->halted) return st->steps;
+    return run_core(tape, NULL, st, BFFO_MAX_STEPS, first_touch, NULL, NULL, BFFO_TAPE_LEN, BFFO_STACK_DEPTH);
+}
+
+uint32_t bffo_resume_log(uint64_t tape[BFFO_TAPE_LEN], BffoState *st, uint32_t stop, BffoStep *log) {
+    if (st->halted) return st->steps;
+    return run_core(tape, NULL, st, stop, NULL, NULL, log, BFFO_TAPE_LEN, BFFO_STACK_DEPTH);
+}
+
+void bffo_run_batch(uint64_t *tapes, size_t n, const uint8_t *head0, const uint8_t *head1,
+                    uint32_t *steps, BffoFlow *flow) {
+    for (size_t i = 0; i < n; i++) {
+        uint64_t *tape = tapes + i * BFFO_TAPE_LEN;
+        if (flow) {
+            memset(&flow[i], 0, sizeof(flow[i]));
+            steps[i] = bffo_run_flow(tape, head0[i], head1[i], &flow[i]);
+        } else {
+            steps[i] = bffo_run(tape, head0[i], head1[i]);
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * Runtime-shaped runs (bffo_run_shape)
+ *
+ * One kernel pair per common tape length, generated from run_core: the
+ * paper's limits as constants, and the limits as arguments, each with a
+ * loop per token format.  Any other power-of-two length runs the generic
+ * kernel, with everything at runtime.
+ * -------------------------------------------------------------------------*/
+#define BFFO_KERNELS(L)                                                                        \
+    static uint32_t run_##L(uint64_t *tape, uint32_t *tape32, BffoState *st) {                \
+        if (tape32)                                                                            \
+            return run_core(NULL, tape32, st, BFFO_MAX_STEPS, NULL, NULL, NULL, L, BFFO_STACK_DEPTH); \
+        return run_core(tape, NULL, st, BFFO_MAX_STEPS, NULL, NULL, NULL, L, BFFO_STACK_DEPTH); \
+    }                                                                                          \
+    static uint32_t run_##L##_limits(uint64_t *tape, uint32_t *tape32, BffoState *st,         \
+                                     uint32_t stop, uint32_t depth, BffoFlow *flow) {         \
+        if (tape32) return run_core(NULL, tape32, st, stop, NULL, flow, NULL, L, depth);       \
+        return run_core(tape, NULL, st, stop, NULL, flow, NULL, L, depth);                    \
+    }
+
+BFFO_KERNELS(32)
+BFFO_KERNELS(64)
+BFFO_KERNELS(128)
+BFFO_KERNELS(256)
+
+static uint32_t run_generic(uint64_t *tape, uint32_t *tape32, BffoState *st, uint32_t stop,
+                            uint32_t depth, BffoFlow *flow, uint32_t len) {
+    if (tape32) return run_core(NULL, tape32, st, stop, NULL, flow, NULL, len, depth);
+    return run_core(tape, NULL, st, stop, NULL, flow, NULL, len, depth);
+}
+
+/* bffo_run_shape and bffo_run_shape32: one of tape and tape32 is NULL */
+static uint32_t run_shape(uint64_t *tape, uint32_t *tape32, const BffoShape *sh, uint8_t head0,
+                          uint8_t head1, BffoFlow *flow) {
+    BffoState st;
+    bffo_init(&st, 0, 0);
+    st.head0 = head0 & (sh->tape_len - 1);       /* bffo_init wraps at BFFO_TAPE_LEN */
+    st.head1 = head1 & (sh->tape_len - 1);
+    uint32_t stop  = sh->max_steps ? sh->max_steps : BFFO_MAX_STEPS;
+    uint32_t depth = sh->stack_depth ? sh->stack_depth : BFFO_STACK_DEPTH;
+    int fast = !flow && stop == BFFO_MAX_STEPS && depth == BFFO_STACK_DEPTH;
+
+    switch (sh->tape_len) {
+    case 32:  return fast ? run_32(tape, tape32, &st)  : run_32_limits(tape, tape32, &st, stop, depth, flow);
+    case 64:  return fast ? run_64(tape, tape32, &st)  : run_64_limits(tape, tape32, &st, stop, depth, flow);
+    case 128: return fast ? run_128(tape, tape32, &st) : run_128_limits(tape, tape32, &st, stop, depth, flow);
+    case 256: return fast ? run_256(tape, tape32, &st) : run_256_limits(tape, tape32, &st, stop, depth, flow);
+    default:  return run_generic(tape, tape32, &st, stop, depth, flow, sh->tape_len);
+    }
+}
+
+uint32_t bffo_run_shape(uint64_t *tape, const BffoShape *sh, uint8_t head0, uint8_t head1,
+                        BffoFlow *flow) {
+    return run_shape(tape, NULL, sh, head0, head1, flow);
+}
+
+uint32_t bffo_run_shape32(uint32_t *tape, const BffoShape *sh, uint8_t head0, uint8_t head1,
+                          BffoFlow *flow) {
+    return run_shape(NULL, tape, sh, head0, head1, flow);
+}
+
+int bffo_shape_valid(const BffoShape *sh) {
+    uint32_t n = sh->tape_len;
+    return n >= 2 && n <= BFFO_MAX_TAPE_LEN && !(n & (n - 1)) &&
+           sh->max_steps <= BFFO_MAX_STEPS && sh->stack_depth <= BFFO_STACK_DEPTH;
+}
+
+int bffo_count_ops_n(const uint64_t *half_tape, uint32_t half_len) {
+    int n = 0;
+    for (uint32_t i = 0; i < half_len; i++)
+        n += IS_OP[BFFO_TOKEN_CHAR(half_tape[i])];
+    return n;
+}
+
+int bffo_count_ops_n32(const uint32_t *half_tape, uint32_t half_len) {
+    int n = 0;
+    for (uint32_t i = 0; i < half_len; i++)
+        n += IS_OP[BFFO_CTOKEN_CHAR(half_tape[i])];
+    return n;
 }
 
 int bffo_count_ops(const uint64_t *half_tape) {
@@ -56,3 +271,52 @@ int bffo_count_ops(const uint64_t *half_tape) {
         n += IS_OP[BFFO_TOKEN_CHAR(half_tape[i])];
     return n;
 }
+
+void bffo_count_ops_batch(const uint64_t *half_tapes, size_t n, uint8_t *ops) {
+    for (size_t i = 0; i < n; i++)
+        ops[i] = (uint8_t)bffo_count_ops(half_tapes + i * BFFO_HALF_LEN);
+}
+
+static int hexval(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c = tolower(c);
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+int bffo_parse_tape(const char *line, uint8_t chars[BFFO_HALF_LEN]) {
+    while (isspace((unsigned char)*line)) line++;
+    if (!*line || *line == '#') return 0;
+
+    /* Exact bytes: 2*HALF_LEN hex digits followed by end of line or whitespace */
+    size_t n = strcspn(line, "\r\n");
+    if (n >= 2 * BFFO_HALF_LEN && (n == 2 * BFFO_HALF_LEN || isspace((unsigned char)line[2 * BFFO_HALF_LEN]))) {
+        int ok = 1;
+        for (int j = 0; j < 2 * BFFO_HALF_LEN && ok; j++) ok = hexval(line[j]) >= 0;
+        if (ok) {
+            for (int j = 0; j < BFFO_HALF_LEN; j++)
+                chars[j] = (uint8_t)(hexval(line[2 * j]) << 4 | hexval(line[2 * j + 1]));
+            return 1;
+        }
+    }
+
+    /* Instruction string, optionally between bars */
+    const char *bar = strchr(line, '|');
+    const char *s   = bar ? bar + 1 : line;
+    for (int j = 0; j < BFFO_HALF_LEN; j++) {
+        uint8_t ch = (uint8_t)s[j];
+        if (ch == '\0' || ch == '\n' || (bar && ch == '|')) return 0;
+        chars[j] = IS_OP[ch] ? ch : 0;
+    }
+    return 1;
+}
+
+void bffo_tape_str_n(const uint8_t *chars, uint32_t half_len, char *out) {
+    for (uint32_t j = 0; j < half_len; j++)
+        out[j] = IS_OP[chars[j]] ? (char)chars[j] : ' ';
+    out[half_len] = '\0';
+}
+
+void bffo_tape_str(const uint8_t chars[BFFO_HALF_LEN], char out[BFFO_HALF_LEN + 1]) {
+    bffo_tape_str_n(chars, BFFO_HALF_LEN, out);
+}
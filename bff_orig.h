@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 /* Combined tape length (two 64-byte programs concatenated) */
@@ -10,6 +11,9 @@
 #define BFFO_MAX_STEPS   8192
 /* Maximum bracket nesting depth */
 #define BFFO_STACK_DEPTH  64
+/* Longest tape bffo_run_shape accepts (heads and IP are bytes) */
+#define BFFO_MAX_TAPE_LEN 256
+#define BFFO_MAX_HALF_LEN (BFFO_MAX_TAPE_LEN / 2)
 
 /*
  * Token format: [id:32][epoch:16][reserved:8][char:8]
@@ -25,6 +29,18 @@
                                      | ((uint64_t)(uint16_t)(ep) << 16) \
                                      | (uint8_t)(ch))
 
+/*
+ * Compact token format: [handle:24][char:8]
+ *
+ * Half the size, for compact soups (soup_core.h): the handle indexes a side
+ * table holding the lineage's id and creation epoch (handles.h).  The
+ * interpreter treats both formats alike: +/- change the char byte, copies
+ * move the whole token.
+ */
+#define BFFO_CTOKEN_CHAR(t)          ((uint8_t)((t) & 0xFF))
+#define BFFO_CTOKEN_HANDLE(t)        ((uint32_t)(t) >> 8)
+#define BFFO_MAKE_CTOKEN(h, ch)      (((uint32_t)(h) << 8) | (uint8_t)(ch))
+
 /*
  * Run the original 10-instruction BFF interpreter on a 128-element token tape.
  *
@@ -50,8 +66,141 @@
  */
 uint32_t bffo_run(uint64_t tape[BFFO_TAPE_LEN], uint8_t head0, uint8_t head1);
 
+/*
+ * Interpreter state for runs that are paused and resumed.
+ *
+ * A paused state plus a copy of the tape is a complete checkpoint: resuming
+ * it executes exactly the steps bffo_run would have executed from there.
+ */
+typedef struct {
+    uint32_t steps;                     /* steps executed so far */
+    uint8_t  ip;
+    uint8_t  head0;
+    uint8_t  head1;
+    uint8_t  sp;
+    uint8_t  halted;                    /* 1 once any termination condition fired */
+    uint8_t  stack[BFFO_STACK_DEPTH];
+} BffoState;
+
+/* Fresh state at IP 0 with the given heads. */
+void bffo_init(BffoState *st, uint8_t head0, uint8_t head1);
+
+/*
+ * Continue the run in st on tape until it halts or st->steps reaches stop
+ * (pass BFFO_MAX_STEPS to run to completion).  Returns st->steps.
+ */
+uint32_t bffo_resume(uint64_t tape[BFFO_TAPE_LEN], BffoState *st, uint32_t stop);
+
+/*
+ * Run to completion like bffo_resume, also recording in first_touch[c] the
+ * number of steps executed before cell c was first read or written (by
+ * instruction fetch or by a head).  Cells never touched keep their value, so
+ * callers initialise the array to UINT32_MAX.  Up to that step the run does
+ * not depend on cell c's contents.
+ */
+uint32_t bffo_run_touch(uint64_t tape[BFFO_TAPE_LEN], BffoState *st,
+                        uint32_t first_touch[BFFO_TAPE_LEN]);
+
+/*
+ * Copy flow of one run: copies[s][d] counts '.' and ',' executions that
+ * copied a token from half s into half d (0 = cells 0..63, the first
+ * program A; 1 = cells 64..127, B).  copies[0][1] and copies[1][0] are the
+ * cross-tape flows A->B and B->A, the diagonal the self-copies.
+ */
+typedef struct {
+    uint16_t copies[2][2];
+} BffoFlow;
+
+/*
+ * bffo_run and bffo_resume that also add the run's copies to flow (zeroed
+ * by the caller).  Tape, state and step count are identical to theirs.
+ */
+uint32_t bffo_run_flow(uint64_t tape[BFFO_TAPE_LEN], uint8_t head0, uint8_t head1, BffoFlow *flow);
+uint32_t bffo_resume_flow(uint64_t tape[BFFO_TAPE_LEN], BffoState *st, uint32_t stop,
+                          BffoFlow *flow);
+
+/*
+ * One step of a recorded run: the state the instruction at ip executed in.
+ * Its effect follows from op and these fields (e.g. '+' sets tape[head0]
+ * to token's char + 1; ']' with sp > 0 and a nonzero char jumps to top).
+ */
+typedef struct {
+    uint64_t token;                     /* the token op reads: tape[head1] for ',', else tape[head0] */
+    uint8_t  ip;
+    uint8_t  op;                        /* BFFO_TOKEN_CHAR(tape[ip]) */
+    uint8_t  head0;
+    uint8_t  head1;
+    uint8_t  sp;                        /* stack depth */
+    uint8_t  top;                       /* stack[sp - 1] if sp > 0 */
+    uint8_t  reserved[2];
+} BffoStep;
+
+/*
+ * bffo_resume that also writes one BffoStep per executed step to log, which
+ * must have room for stop - st->steps entries.  Tape, state and step count
+ * are identical to bffo_resume's.
+ */
+uint32_t bffo_resume_log(uint64_t tape[BFFO_TAPE_LEN], BffoState *st, uint32_t stop, BffoStep *log);
+
+/*
+ * bffo_run on n tapes stored back to back (n * BFFO_TAPE_LEN tokens), with
+ * per-tape heads; steps[i] gets each step count.  With flow non-NULL,
+ * flow[i] gets each run's copy flow as bffo_run_flow.
+ */
+void bffo_run_batch(uint64_t *tapes, size_t n, const uint8_t *head0, const uint8_t *head1,
+                    uint32_t *steps, BffoFlow *flow);
+
+/*
+ * Tape length and limits chosen at runtime, for soups other than the paper's
+ * (soup_core.h).  The functions above are the tape_len = BFFO_TAPE_LEN,
+ * max_steps = BFFO_MAX_STEPS, stack_depth = BFFO_STACK_DEPTH case.
+ */
+typedef struct {
+    uint32_t tape_len;                  /* power of two, 2..BFFO_MAX_TAPE_LEN */
+    uint32_t max_steps;                 /* 0 = BFFO_MAX_STEPS; at most that */
+    uint32_t stack_depth;               /* 0 = BFFO_STACK_DEPTH; at most that */
+} BffoShape;
+
+/* 1 if sh is within the limits above. */
+int bffo_shape_valid(const BffoShape *sh);
+
+/*
+ * bffo_run (or bffo_run_flow, with flow non-NULL) on a tape of sh->tape_len
+ * tokens; copies from cells below tape_len / 2 count as half 0.  Tape
+ * lengths 32, 64, 128 and 256 run kernels specialised for that length, and
+ * for the default limits; others a generic kernel.
+ */
+uint32_t bffo_run_shape(uint64_t *tape, const BffoShape *sh, uint8_t head0, uint8_t head1,
+                        BffoFlow *flow);
+
+/* bffo_run_shape on a tape of compact tokens, with the same kernels. */
+uint32_t bffo_run_shape32(uint32_t *tape, const BffoShape *sh, uint8_t head0, uint8_t head1,
+                          BffoFlow *flow);
+
+/* bffo_count_ops for a half tape of half_len tokens. */
+int bffo_count_ops_n(const uint64_t *half_tape, uint32_t half_len);
+int bffo_count_ops_n32(const uint32_t *half_tape, uint32_t half_len);
+
 /*
  * Count the number of valid BFF instruction bytes in a BFFO_HALF_LEN-element tape.
  * Valid instructions: < > { } + - . , [ ]  (10 distinct byte values)
  */
 int bffo_count_ops(const uint64_t *half_tape);
+
+/* bffo_count_ops of n half tapes stored back to back, into ops[0..n). */
+void bffo_count_ops_batch(const uint64_t *half_tapes, size_t n, uint8_t *ops);
+
+/*
+ * Parse a tape written as text into BFFO_HALF_LEN chars.  Accepts 2*HALF_LEN
+ * hex digits (exact bytes), text containing |tape| (as printed in the
+ * soup_orig stats), or a bare instruction string; in the last two forms any
+ * non-instruction char (e.g. ' ') becomes 0x00.  Returns 1 on success, 0 if
+ * the line is blank, a '#' comment, or too short.
+ */
+int bffo_parse_tape(const char *line, uint8_t chars[BFFO_HALF_LEN]);
+
+/* Format chars as a HALF_LEN string: instruction chars as-is, others as ' '. */
+void bffo_tape_str(const uint8_t chars[BFFO_HALF_LEN], char out[BFFO_HALF_LEN + 1]);
+
+/* bffo_tape_str for a half tape of half_len chars (out holds half_len + 1). */
+void bffo_tape_str_n(const uint8_t *chars, uint32_t half_len, char *out);
@@ -0,0 +1,103 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "bgwrite.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BGW_ALIGN 4096
+
+static void *writer_thread(void *arg) {
+    BgWriter *w = arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->count == 0 && !w->stop)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (w->count == 0) break;   /* stop requested and queue drained */
+
+        BgSlot *s = &w->slots[w->head];
+        pthread_mutex_unlock(&w->lock);
+        w->fn(w->ctx, s->buf, s->len, s->tag);
+        pthread_mutex_lock(&w->lock);
+
+        w->head = (w->head + 1) % w->nslots;
+        w->count--;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+int bgw_start(BgWriter *w, int nslots, size_t slot_bytes, bgw_fn fn, void *ctx) {
+    memset(w, 0, sizeof(*w));
+    if (nslots < 1) nslots = 1;
+    if (nslots > BGW_MAX_SLOTS) nslots = BGW_MAX_SLOTS;
+    w->nslots = nslots;
+    w->fn     = fn;
+    w->ctx    = ctx;
+
+    size_t bytes = (slot_bytes + BGW_ALIGN - 1) & ~(size_t)(BGW_ALIGN - 1);
+    for (int i = 0; i < nslots; i++) {
+        if (posix_memalign(&w->slots[i].buf, BGW_ALIGN, bytes)) {
+            while (i--) free(w->slots[i].buf);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    int err = pthread_create(&w->thread, NULL, writer_thread, w);
+    if (err) {
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->cond);
+        for (int i = 0; i < nslots; i++) free(w->slots[i].buf);
+        memset(w, 0, sizeof(*w));
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+void *bgw_acquire(BgWriter *w) {
+    pthread_mutex_lock(&w->lock);
+    if (w->count == w->nslots) {
+        w->stalls++;
+        while (w->count == w->nslots)
+            pthread_cond_wait(&w->cond, &w->lock);
+    }
+    void *buf = w->slots[(w->head + w->count) % w->nslots].buf;
+    pthread_mutex_unlock(&w->lock);
+    return buf;
+}
+
+void bgw_submit(BgWriter *w, size_t len, int tag) {
+    pthread_mutex_lock(&w->lock);
+    BgSlot *s = &w->slots[(w->head + w->count) % w->nslots];
+    s->len = len;
+    s->tag = tag;
+    w->count++;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+void bgw_drain(BgWriter *w) {
+    pthread_mutex_lock(&w->lock);
+    while (w->count > 0)
+        pthread_cond_wait(&w->cond, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+}
+
+void bgw_stop(BgWriter *w) {
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    for (int i = 0; i < w->nslots; i++) free(w->slots[i].buf);
+    memset(w, 0, sizeof(*w));
+}
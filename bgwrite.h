@@ -0,0 +1,55 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Background writer: one thread draining a bounded FIFO of snapshot buffers.
+ *
+ * The producer (the simulation's main thread) takes the next free slot with
+ * bgw_acquire(), copies its snapshot into it and hands it over with
+ * bgw_submit(); the writer thread then calls fn on each slot in submission
+ * order.  With nslots buffers the simulation can run up to nslots epochs
+ * ahead of the disk.  When every slot is still queued bgw_acquire() blocks,
+ * so a slow disk throttles the simulation instead of growing memory.
+ */
+#define BGW_MAX_SLOTS 16
+
+/* Called on the writer thread: buf holds len bytes submitted with tag. */
+typedef void (*bgw_fn)(void *ctx, void *buf, size_t len, int tag);
+
+typedef struct {
+    void   *buf;
+    size_t  len;
+    int     tag;
+} BgSlot;
+
+typedef struct {
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    BgSlot          slots[BGW_MAX_SLOTS];
+    int             nslots;
+    int             head;      /* oldest queued slot */
+    int             count;     /* queued slots, including the one being written */
+    int             stop;
+    bgw_fn          fn;
+    void           *ctx;
+    uint64_t        stalls;    /* bgw_acquire calls that had to wait */
+} BgWriter;
+
+/* Allocate nslots buffers of slot_bytes (page aligned) and start the thread. */
+int   bgw_start(BgWriter *w, int nslots, size_t slot_bytes, bgw_fn fn, void *ctx);
+
+/* Buffer of the next free slot; blocks while all slots are queued. */
+void *bgw_acquire(BgWriter *w);
+
+/* Queue the slot returned by the last bgw_acquire(). */
+void  bgw_submit(BgWriter *w, size_t len, int tag);
+
+/* Block until every queued slot has been written. */
+void  bgw_drain(BgWriter *w);
+
+/* Write out everything queued, stop the thread and free the buffers. */
+void  bgw_stop(BgWriter *w);
@@ -0,0 +1,403 @@
+#define _GNU_SOURCE
+
+#include "bigsoup.h"
+#include "checkpoint.h"
+#include "hugemem.h"
+#include "pool.h"
+#include "soup_core.h"
+#include "soup_stats.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BIG_DEFAULT_BLOCK   (1u << 16)
+#define BIG_DEFAULT_WINDOW  8u
+#define BIG_MAX_CELLS       (1ULL << 32)   /* token ids are 32-bit: the initial ones use ncells */
+
+struct BigSoup {
+    BigSoupParams p;
+    int        fd;
+    uint8_t   *map;               /* header page, then the cells (MAP_SHARED) */
+    size_t     map_bytes;
+    uint64_t  *cells;
+    size_t     block_cells;       /* block_tapes * tape_len */
+    uint32_t   nblocks;
+    uint32_t   nwindows;
+    uint32_t  *order;             /* this epoch's block order: window k is order[k * W ..] */
+    uint32_t  *next_order;        /* the next epoch's, for reading its first window ahead */
+    int        next_epoch;        /* epoch next_order is for, or -1 */
+    HugeMem    stage;             /* one window of cells */
+    SoupCore   win;               /* the window being run, over stage */
+    uint64_t   rng;
+    uint32_t   next_id;
+    int        epoch;
+    int        dirty;             /* cells changed since the last bigsoup_sync() */
+    int        evict;             /* soup larger than mem_budget */
+};
+
+/* -------------------------------------------------------------------------
+ * Blocks
+ * -------------------------------------------------------------------------*/
+static uint64_t *block_at(const BigSoup *b, uint32_t blk) {
+    return b->cells + (size_t)blk * b->block_cells;
+}
+
+static off_t block_offset(const BigSoup *b, uint32_t blk) {
+    return (off_t)CKPT_HEADER_BYTES + (off_t)blk * (off_t)(b->block_cells * sizeof(uint64_t));
+}
+
+/* Epoch e's block order: a function of the seed and e only, so the next
+ * epoch's first window can be read ahead before this epoch ends. */
+static void block_order(const BigSoup *b, int e, uint32_t *order) {
+    uint64_t rng = splitmix64(b->p.seed + (uint64_t)e) | 1;
+    for (uint32_t i = 0; i < b->nblocks; i++) order[i] = i;
+    for (uint32_t i = b->nblocks - 1; i > 0; i--) {
+        uint32_t j = (uint32_t)(xorshift64(&rng) % (i + 1));
+        uint32_t tmp = order[i]; order[i] = order[j]; order[j] = tmp;
+    }
+}
+
+/* What to do with a window's blocks in the file */
+enum { WINDOW_READ_AHEAD, WINDOW_WRITE_BACK, WINDOW_DROP };
+
+static void window_io(const BigSoup *b, const uint32_t *order, uint32_t k, int what) {
+    size_t bytes = b->block_cells * sizeof(uint64_t);
+    for (uint32_t w = 0; w < b->p.window_blocks; w++) {
+        uint32_t blk = order[k * b->p.window_blocks + w];
+        off_t    off = block_offset(b, blk);
+        switch (what) {
+        case WINDOW_READ_AHEAD:
+            madvise(block_at(b, blk), bytes, MADV_WILLNEED);
+            break;
+        case WINDOW_WRITE_BACK:
+            sync_file_range(b->fd, off, (off_t)bytes, SYNC_FILE_RANGE_WRITE);
+            break;
+        case WINDOW_DROP:
+            /* Wait for the write-back, then unmap and evict the clean pages */
+            sync_file_range(b->fd, off, (off_t)bytes,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            madvise(block_at(b, blk), bytes, MADV_DONTNEED);
+            posix_fadvise(b->fd, off, (off_t)bytes, POSIX_FADV_DONTNEED);
+            break;
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * Jobs on the worker pool
+ * -------------------------------------------------------------------------*/
+typedef struct {
+    BigSoup *b;
+    uint32_t k;                   /* window */
+    int      out;                 /* 0: file -> stage, 1: stage -> file in pairing order */
+} CopyJob;
+
+static void copy_job(void *ctx, int tid, int nthreads) {
+    const CopyJob *j = ctx;
+    const BigSoup *b = j->b;
+    uint32_t half = b->win.shape.half_len, bt = b->p.block_tapes;
+    const uint32_t *blocks = b->order + (size_t)j->k * b->p.window_blocks;
+    uint64_t *stage = b->win.cells;
+    unsigned start, end;
+    pool_slice(b->win.shape.ntapes, tid, nthreads, &start, &end);
+    for (uint32_t s = start; s < end; s++) {
+        uint64_t *slot = block_at(b, blocks[s / bt]) + (size_t)(s % bt) * half;
+        if (j->out) memcpy(slot, stage + (size_t)b->win.perm[s] * half, half * sizeof(uint64_t));
+        else        memcpy(stage + (size_t)s * half, slot, half * sizeof(uint64_t));
+    }
+}
+
+/* Fresh tokens: block j's chars from its own stream, ids by cell index */
+static void init_job(void *ctx, int tid, int nthreads) {
+    const BigSoup *b = ctx;
+    unsigned start, end;
+    pool_slice(b->nblocks, tid, nthreads, &start, &end);
+    for (uint32_t blk = start; blk < end; blk++) {
+        uint64_t  rng   = splitmix64(b->p.seed ^ ((uint64_t)blk << 32)) | 1;
+        uint64_t *cells = block_at(b, blk);
+        uint32_t  id    = (uint32_t)((size_t)blk * b->block_cells);
+        for (size_t n = 0; n < b->block_cells; n++)
+            cells[n] = BFFO_MAKE_TOKEN(id++, 0, (uint8_t)(xorshift64(&rng) & 0xFF));
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * Create / open / close
+ * -------------------------------------------------------------------------*/
+static int params_fill(BigSoupParams *p) {
+    if (!p->ntapes) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!p->tape_len)      p->tape_len      = BFFO_HALF_LEN;
+    if (!p->block_tapes)   p->block_tapes   = p->ntapes < BIG_DEFAULT_BLOCK ? p->ntapes : BIG_DEFAULT_BLOCK;
+    if (!p->window_blocks) p->window_blocks = p->ntapes / p->block_tapes < BIG_DEFAULT_WINDOW
+                                              ? p->ntapes / p->block_tapes : BIG_DEFAULT_WINDOW;
+    if (!p->max_steps)     p->max_steps     = BFFO_MAX_STEPS;
+    if (!p->stack_depth)   p->stack_depth   = BFFO_STACK_DEPTH;
+    if (!p->mem_budget)    p->mem_budget    = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE) / 2;
+
+    SoupShape sh = { p->ntapes, p->tape_len };
+    SoupShape wsh = { p->block_tapes * p->window_blocks, p->tape_len };
+    BffoShape bs = { 2 * p->tape_len, p->max_steps, p->stack_depth };
+    uint32_t  bt = p->block_tapes, wb = p->window_blocks;
+    if (!soup_shape_valid(sh) || !bffo_shape_valid(&bs) || p->mutation_rate < 0.0 ||
+        (uint64_t)p->ntapes * p->tape_len >= BIG_MAX_CELLS ||
+        !bt || (bt & (bt - 1)) || (size_t)bt * p->tape_len * sizeof(uint64_t) < 4096 ||
+        !wb || (wb & (wb - 1)) || (uint64_t)bt * wb > p->ntapes || !soup_shape_valid(wsh)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+static void bigsoup_free(BigSoup *b) {
+    if (b->map) munmap(b->map, b->map_bytes);
+    if (b->fd >= 0) close(b->fd);
+    huge_free(&b->stage);
+    free(b->order);
+    free(b->next_order);
+    free(b->win.perm);
+    free(b->win.steps);
+    free(b->win.heads);
+    free(b);
+}
+
+/* Map fd (header page and cells) and allocate the window for b->p. */
+static BigSoup *bigsoup_setup(BigSoup *b) {
+    const BigSoupParams *p = &b->p;
+    uint32_t wtapes = p->block_tapes * p->window_blocks;
+    b->block_cells = (size_t)p->block_tapes * p->tape_len;
+    b->nblocks     = p->ntapes / p->block_tapes;
+    b->nwindows    = b->nblocks / p->window_blocks;
+    b->next_epoch  = -1;
+    b->map_bytes   = CKPT_HEADER_BYTES + (size_t)p->ntapes * p->tape_len * sizeof(uint64_t);
+    b->evict       = b->map_bytes > p->mem_budget;
+    b->map = mmap(NULL, b->map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, b->fd, 0);
+    if (b->map == MAP_FAILED) b->map = NULL;
+    b->order      = malloc(b->nblocks * sizeof(uint32_t));
+    b->next_order = malloc(b->nblocks * sizeof(uint32_t));
+    b->win.perm   = malloc(wtapes * sizeof(uint32_t));
+    b->win.steps  = calloc(wtapes / 2, sizeof(uint32_t));
+    b->win.heads  = malloc(wtapes);
+    huge_alloc(&b->stage, (size_t)wtapes * p->tape_len * sizeof(uint64_t), HUGE_THP);
+    if (!b->map || !b->order || !b->next_order || !b->win.perm || !b->win.steps || !b->win.heads ||
+        !b->stage.ptr) {
+        int err = errno;
+        bigsoup_free(b);
+        errno = err;
+        return NULL;
+    }
+    if (b->evict) madvise(b->map, b->map_bytes, MADV_RANDOM);   /* our own read-ahead only */
+    b->cells             = (uint64_t *)(b->map + CKPT_HEADER_BYTES);
+    b->win.cells         = b->stage.ptr;
+    b->win.shape         = (SoupShape){ wtapes, p->tape_len };
+    b->win.max_steps     = p->max_steps;
+    b->win.stack_depth   = p->stack_depth;
+    soup_lib_start(0);
+    return b;
+}
+
+BigSoup *bigsoup_create(const char *path, const BigSoupParams *params) {
+    BigSoup *b = calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    b->fd = -1;
+    b->p  = *params;
+    if (params_fill(&b->p) < 0) { free(b); return NULL; }
+
+    /* Seeded as soup_core_init; p.seed then holds the warmed-up state */
+    uint64_t rng = b->p.seed ? b->p.seed : (uint64_t)(uintptr_t)&b->rng ^ 0xdeadbeefcafe1234ULL;
+    for (int i = 0; i < 32; i++) xorshift64(&rng);
+    b->p.seed = b->rng = rng;
+
+    size_t bytes = CKPT_HEADER_BYTES + (size_t)b->p.ntapes * b->p.tape_len * sizeof(uint64_t);
+    b->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (b->fd < 0 || ftruncate(b->fd, (off_t)bytes) < 0) {
+        int err = errno;
+        if (b->fd >= 0) close(b->fd);
+        free(b);
+        errno = err;
+        return NULL;
+    }
+    if (!bigsoup_setup(b)) return NULL;
+
+    pool_run(init_job, b);
+    b->next_id = (uint32_t)((size_t)b->p.ntapes * b->p.tape_len);   /* < BIG_MAX_CELLS */
+    b->dirty   = 1;
+    if (bigsoup_sync(b) < 0) {
+        int err = errno;
+        bigsoup_free(b);
+        errno = err;
+        return NULL;
+    }
+    return b;
+}
+
+BigSoup *bigsoup_open(const char *path, double mutation_rate, size_t mem_budget) {
+    CheckpointHeader h;
+    if (ckpt_read_header(path, &h) < 0) return NULL;
+    struct stat st;
+    if (h.epoch < 0 || h.header_bytes != CKPT_HEADER_BYTES || h.grid_width ||
+        h.soup_bytes != (uint64_t)h.soup_size * h.half_len * sizeof(uint64_t) ||
+        stat(path, &st) < 0 || (uint64_t)st.st_size < CKPT_HEADER_BYTES + h.soup_bytes) {
+        errno = EINVAL;
+        return NULL;
+    }
+    BigSoup *b = calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    b->p = (BigSoupParams){
+        .seed          = h.seed,
+        .mutation_rate = mutation_rate < 0.0 ? h.mutation_rate : mutation_rate,
+        .ntapes        = h.soup_size,
+        .tape_len      = h.half_len,
+        .block_tapes   = h.block_tapes,
+        .window_blocks = h.window_blocks,
+        .max_steps     = h.max_steps,
+        .stack_depth   = h.stack_depth,
+        .mem_budget    = mem_budget,
+    };
+    if (params_fill(&b->p) < 0 || (b->fd = open(path, O_RDWR)) < 0) {
+        int err = errno;
+        free(b);
+        errno = err;
+        return NULL;
+    }
+    if (!bigsoup_setup(b)) return NULL;
+    b->rng     = h.global_rng;
+    b->next_id = h.next_token_id;
+    b->epoch   = h.epoch;
+    return b;
+}
+
+/* The header's epoch is -1 while the cells are between two syncs */
+static int write_header(BigSoup *b, int epoch) {
+    CheckpointHeader *h = (CheckpointHeader *)b->map;
+    ckpt_header_init(h, b->p.ntapes, b->p.tape_len);
+    h->epoch         = epoch;
+    h->next_token_id = b->next_id;
+    h->global_rng    = b->rng;
+    h->seed          = b->p.seed;
+    h->mutation_rate = b->p.mutation_rate;
+    h->max_steps     = b->p.max_steps;
+    h->stack_depth   = b->p.stack_depth;
+    h->block_tapes   = b->p.block_tapes;
+    h->window_blocks = b->p.window_blocks;
+    return msync(b->map, CKPT_HEADER_BYTES, MS_SYNC);
+}
+
+int bigsoup_sync(BigSoup *b) {
+    if (!b->dirty) return 0;
+    if (msync(b->map, b->map_bytes, MS_SYNC) < 0 || write_header(b, b->epoch) < 0) return -1;
+    b->dirty = 0;
+    return 0;
+}
+
+int bigsoup_close(BigSoup *b) {
+    int rc = bigsoup_sync(b);
+    int err = errno;
+    bigsoup_free(b);
+    errno = err;
+    return rc;
+}
+
+int bigsoup_current_epoch(const BigSoup *b) {
+    return b->epoch;
+}
+
+const BigSoupParams *bigsoup_params(const BigSoup *b) {
+    return &b->p;
+}
+
+/* -------------------------------------------------------------------------
+ * Epoch
+ * -------------------------------------------------------------------------*/
+void bigsoup_epoch(BigSoup *b, SoupStats *st, int full) {
+    int e = b->epoch + 1;
+    if (!b->dirty) {
+        write_header(b, -1);
+        b->dirty = 1;
+    }
+    if (b->next_epoch == e) {
+        uint32_t *t = b->order; b->order = b->next_order; b->next_order = t;
+    } else {
+        block_order(b, e, b->order);
+        window_io(b, b->order, 0, WINDOW_READ_AHEAD);
+    }
+
+    uint32_t freq[BFFO_MAX_HALF_LEN + 1], wfreq[BFFO_MAX_HALF_LEN + 1];
+    uint64_t total_steps = 0;
+    uint32_t max_steps = 0;
+    ComplexitySum cx;
+    if (st) {
+        memset(st, 0, sizeof(*st));
+        memset(freq, 0, sizeof(freq));
+        memset(&cx, 0, sizeof(cx));
+    }
+
+    uint64_t base = xorshift64(&b->rng);
+    for (uint32_t k = 0; k < b->nwindows; k++) {
+        /* The kernel reads the next window (or epoch) while this one runs */
+        if (k + 1 < b->nwindows) {
+            window_io(b, b->order, k + 1, WINDOW_READ_AHEAD);
+        } else {
+            block_order(b, e + 1, b->next_order);
+            b->next_epoch = e + 1;
+            window_io(b, b->next_order, 0, WINDOW_READ_AHEAD);
+        }
+
+        CopyJob cj = { b, k, 0 };
+        pool_run(copy_job, &cj);
+
+        SoupCore *w = &b->win;
+        w->rng     = splitmix64(base + k) | 1;
+        w->next_id = b->next_id;
+        soup_core_pair_up(w);
+        soup_core_run_pairs(w);
+        soup_core_mutate(w, b->p.mutation_rate, e);
+        b->next_id = w->next_id;
+
+        if (st) {
+            for (uint32_t i = 0; i < w->shape.ntapes / 2; i++) {
+                total_steps += w->steps[i];
+                if (w->steps[i] > max_steps) max_steps = w->steps[i];
+            }
+            soup_ops_hist(w->cells, w->shape, wfreq);
+            for (uint32_t v = 0; v <= b->p.tape_len; v++) freq[v] += wfreq[v];
+            if (full) soup_complexity_add(&cx, w->cells, w->shape);
+            if (full && k + 1 == b->nwindows) {
+                uint32_t modal;
+                soup_lineage(w->cells, w->shape, &st->unique_ids, &modal, &st->modal_count, st->rep_tape);
+                st->modal_id = modal;
+            }
+        }
+
+        cj.out = 1;
+        pool_run(copy_job, &cj);
+        if (b->evict) {
+            window_io(b, b->order, k, WINDOW_WRITE_BACK);
+            if (k > 0) window_io(b, b->order, k - 1, WINDOW_DROP);
+        }
+    }
+    if (b->evict) window_io(b, b->order, b->nwindows - 1, WINDOW_DROP);
+    b->epoch = e;
+
+    if (st) {
+        SoupShape sh = { b->p.ntapes, b->p.tape_len };
+        st->epoch = e;
+        soup_ops_mean_median(freq, sh, &st->mean_ops, &st->median_ops);
+        st->mean_steps = (double)total_steps / (b->p.ntapes / 2);
+        st->max_steps  = max_steps;
+        if (full) {
+            soup_complexity_finish(&cx, &st->entropy, &st->lz_bpb);
+            st->hoe = st->entropy - st->lz_bpb;
+        } else {
+            st->entropy = st->lz_bpb = st->hoe = NAN;
+        }
+    }
+}
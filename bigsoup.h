@@ -0,0 +1,88 @@
+#pragma once
+
+#include "soup_api.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Out-of-core soup (soup_big): a soup larger than RAM, e.g. 2^24-2^25 tapes
+ * (8-16 GB of tokens), kept in a file mapped MAP_SHARED.
+ *
+ * The file has the checkpoint layout (checkpoint.h): a header page, then the
+ * cells.  The cells are cut into blocks of block_tapes tapes.  Each epoch
+ * deals the blocks into windows of window_blocks blocks, in a fresh random
+ * order.  The windows then run one after another:
+ *
+ *   - the window's blocks are copied into an in-memory stage (huge pages);
+ *     every read of the file is a whole block, so it streams;
+ *   - the stage runs as one soup (soup_core.h): a uniform random pairing of
+ *     all its tapes, every pair on the worker pool, then Poisson mutation
+ *     at the same per-cell rate;
+ *   - the tapes are dealt back into the window's blocks in the order of
+ *     that pairing, so a block holds different tapes each epoch.
+ *
+ * Within an epoch a tape can only meet tapes of its own window.  Because both
+ * the windows and each block's contents are re-drawn every epoch, any two
+ * tapes are equally likely to meet over a few epochs.  With a single window
+ * (window_blocks = all blocks) the pairing is the in-memory soup's.
+ *
+ * While a window runs, the kernel reads the next one ahead
+ * (MADV_WILLNEED).  When the file is larger than mem_budget, each window's
+ * blocks are written back and dropped from the page cache once the next
+ * window is done.  Resident memory is then about three windows plus the
+ * stage, whatever the soup size.  Below the budget the page cache keeps the
+ * whole soup.
+ *
+ * Results depend only on the file and the parameters, never on the thread
+ * count or the memory budget.  Token ids are 32-bit and the initial tokens
+ * take one each, so a soup has fewer than 2^32 cells (at most 2^25 tapes of
+ * 64 tokens), leaving 2^32 - cells ids for mutations before they wrap.
+ */
+typedef struct BigSoup BigSoup;
+
+typedef struct {
+    uint64_t seed;                /* 0 = from an address */
+    double   mutation_rate;       /* per cell per epoch */
+    uint32_t ntapes;              /* power of two, ntapes * tape_len < 2^32 */
+    uint32_t tape_len;            /* tokens per tape, power of two <= 128; 0 = BFFO_HALF_LEN */
+    uint32_t block_tapes;         /* power of two, >= 4 KB of cells; 0 = 2^16 (32 MB) */
+    uint32_t window_blocks;       /* power of two; 0 = 8 */
+    uint32_t max_steps;           /* 0 = BFFO_MAX_STEPS */
+    uint32_t stack_depth;         /* 0 = BFFO_STACK_DEPTH */
+    size_t   mem_budget;          /* bytes of soup to leave cached; 0 = half of RAM */
+} BigSoupParams;
+
+/* Create path (replacing it) and fill it with a fresh soup at epoch 0.
+ * NULL with errno set (EINVAL: bad parameters). */
+BigSoup *bigsoup_create(const char *path, const BigSoupParams *p);
+
+/*
+ * Continue the soup in path (from bigsoup_create, or any checkpoint, which is
+ * then run in place with the default blocks).  mutation_rate < 0 keeps the
+ * file's rate; mem_budget 0 = half of RAM.  NULL with errno set (EINVAL: not a
+ * checkpoint, a spatial soup_orig --grid one, or a file from a run that
+ * stopped mid-epoch).
+ */
+BigSoup *bigsoup_open(const char *path, double mutation_rate, size_t mem_budget);
+
+/*
+ * Run one epoch.  With st, fill the whole soup's ops and step columns.  With
+ * full, also fill the whole soup's complexity (each window's chars as it is
+ * staged) and lineage, which covers the epoch's last window only (a sample of
+ * window_blocks * block_tapes tapes; soup_big's header marks those columns).
+ * Otherwise they are 0 / NaN.
+ */
+void bigsoup_epoch(BigSoup *b, SoupStats *st, int full);
+
+/* Flush the cells and write the header, so the file is a consistent
+ * checkpoint of the current epoch.  0, or -1 with errno set. */
+int  bigsoup_sync(BigSoup *b);
+
+/* bigsoup_sync(), then unmap and close.  0, or -1 with errno set. */
+int  bigsoup_close(BigSoup *b);
+
+int  bigsoup_current_epoch(const BigSoup *b);
+
+/* The parameters in effect (defaults filled in, seed = RNG state after init). */
+const BigSoupParams *bigsoup_params(const BigSoup *b);
@@ -0,0 +1,133 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "checkpoint.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void ckpt_header_init(CheckpointHeader *h, uint32_t soup_size, uint32_t half_len) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, "BFFCKPT", 8);
+    h->version      = CKPT_VERSION;
+    h->header_bytes = CKPT_HEADER_BYTES;
+    h->soup_size    = soup_size;
+    h->half_len     = half_len;
+    h->soup_bytes   = (uint64_t)soup_size * half_len * sizeof(uint64_t);
+}
+
+/* Write all of buf, or -1 with errno set */
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p   += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int ckpt_write_tail(const char *path, const void *buf, size_t len, const void *tail, size_t tail_len) {
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+
+    if (write_all(fd, buf, len) < 0 || write_all(fd, tail, tail_len) < 0) goto fail;
+    if (fsync(fd) < 0) goto fail;
+    if (close(fd) < 0) { unlink(tmp); return -1; }
+    if (rename(tmp, path) < 0) { unlink(tmp); return -1; }
+    return 0;
+
+fail: {
+        int err = errno;
+        close(fd);
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+}
+
+int ckpt_write(const char *path, const void *buf, size_t len) {
+    return ckpt_write_tail(path, buf, len, NULL, 0);
+}
+
+int ckpt_read_header(const char *path, CheckpointHeader *h) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    ssize_t n = pread(fd, h, sizeof(*h), 0);
+    close(fd);
+    if (n != (ssize_t)sizeof(*h) || memcmp(h->magic, "BFFCKPT", 8) || h->version != CKPT_VERSION) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int ckpt_map(const char *path, CheckpointHeader *h, void *cells, size_t bytes) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (pread(fd, h, sizeof(*h), 0) != (ssize_t)sizeof(*h) || fstat(fd, &st) < 0 ||
+        memcmp(h->magic, "BFFCKPT", 8) || h->version != CKPT_VERSION ||
+        h->header_bytes != CKPT_HEADER_BYTES || h->soup_bytes != bytes ||
+        (uint64_t)st.st_size < CKPT_HEADER_BYTES + h->soup_bytes) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *m = mmap(cells, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, CKPT_HEADER_BYTES);
+    int err = errno;
+    close(fd);   /* the mapping keeps the file open */
+    if (m == MAP_FAILED) { errno = err; return -1; }
+    return 0;
+}
+
+/* Read bytes at off of path into buf; a short file is EINVAL */
+static int read_at(const char *path, void *buf, size_t bytes, off_t off) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    char *p = buf;
+    while (bytes > 0) {
+        ssize_t n = pread(fd, p, bytes, off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            int err = n < 0 ? errno : EINVAL;   /* short file */
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        p += n; off += n; bytes -= (size_t)n;
+    }
+    close(fd);
+    return 0;
+}
+
+int ckpt_read(const char *path, CheckpointHeader *h, void *cells, size_t bytes) {
+    if (ckpt_read_header(path, h) < 0) return -1;
+    if (h->header_bytes != CKPT_HEADER_BYTES || h->soup_bytes != bytes) {
+        errno = EINVAL;
+        return -1;
+    }
+    return read_at(path, cells, bytes, CKPT_HEADER_BYTES);
+}
+
+int ckpt_read_tail(const char *path, const CheckpointHeader *h, void *buf, size_t bytes) {
+    struct stat st;
+    if (stat(path, &st) < 0) return -1;
+    if ((uint64_t)st.st_size != CKPT_HEADER_BYTES + h->soup_bytes + bytes) {
+        errno = EINVAL;
+        return -1;
+    }
+    return read_at(path, buf, bytes, (off_t)(CKPT_HEADER_BYTES + h->soup_bytes));
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Soup checkpoint file (soup_orig --checkpoint-every / --resume), also the
+ * live file of an out-of-core soup (bigsoup.h).
+ *
+ *   CheckpointHeader, zero padded to CKPT_HEADER_BYTES
+ *   the soup array, soup_bytes raw native-endian uint64 tokens (uint32 for
+ *   a compact soup, token_bytes = 4)
+ *   compact soups only: the handle table (handles_save(), handles.h)
+ *
+ * The soup starts on a page boundary so ckpt_map() can map it copy-on-write
+ * straight over the in-memory soup array: resuming reads no data up front,
+ * pages fault in from the page cache as the first epoch touches them, and
+ * the file itself is never modified.  Files are replaced atomically
+ * (written to PATH.tmp, fsync'd, then renamed), so a crash mid-write leaves
+ * the previous checkpoint intact.
+ */
+#define CKPT_VERSION       1
+#define CKPT_HEADER_BYTES  4096
+
+typedef struct {
+    char     magic[8];            /* "BFFCKPT" */
+    uint32_t version;
+    uint32_t header_bytes;        /* offset of the soup: CKPT_HEADER_BYTES */
+    uint32_t soup_size;           /* tapes */
+    uint32_t half_len;            /* tokens per tape */
+    int32_t  epoch;               /* last completed epoch */
+    uint32_t next_token_id;
+    uint64_t global_rng;
+    uint64_t seed;                /* RNG state after soup_init, as reported at start */
+    double   mutation_rate;
+    uint64_t soup_bytes;
+    uint32_t max_steps;           /* per-pair step limit; 0 (older files) = BFFO_MAX_STEPS */
+    uint32_t stack_depth;         /* bracket depth; 0 (older files) = BFFO_STACK_DEPTH */
+    uint32_t block_tapes;         /* out-of-core blocking (bigsoup.h); 0 = an in-memory soup */
+    uint32_t window_blocks;
+    uint32_t token_bytes;         /* 4: compact soup; 0 (older files) or 8: bff_orig.h tokens */
+    uint32_t handles_used;        /* compact: handle table high-water mark, free list length */
+    uint32_t handles_free;
+    uint32_t handles_limit;       /* and next collection point (handles.h) */
+    uint64_t next_lineage_id;     /* compact: id of the next lineage */
+    uint32_t grid_width;          /* spatial soup (soup_core.h SoupGrid); 0 = well mixed */
+    uint32_t grid_height;
+    uint32_t grid_radius;
+} CheckpointHeader;
+
+/* Fill the magic, version and sizes of h; the caller sets the run state. */
+void ckpt_header_init(CheckpointHeader *h, uint32_t soup_size, uint32_t half_len);
+
+/* Atomically replace path with len bytes of buf (a header page, then the soup).
+ * Returns 0, or -1 with errno set. */
+int  ckpt_write(const char *path, const void *buf, size_t len);
+
+/* ckpt_write() of buf followed by tail_len bytes of tail. */
+int  ckpt_write_tail(const char *path, const void *buf, size_t len, const void *tail, size_t tail_len);
+
+/* Read path's header into h, to size the soup before ckpt_map().  Returns 0,
+ * or -1 with errno set (EINVAL if it is not a checkpoint). */
+int  ckpt_read_header(const char *path, CheckpointHeader *h);
+
+/*
+ * Read path's header into h and map its soup over cells (bytes long, page
+ * aligned) with MAP_PRIVATE | MAP_FIXED.  Returns 0, or -1 with errno set
+ * (EINVAL for a bad header or a size mismatch).
+ */
+int  ckpt_map(const char *path, CheckpointHeader *h, void *cells, size_t bytes);
+
+/* As ckpt_map(), but read the soup into cells: for memory that must keep its
+ * own pages (huge pages, see hugemem.h), which a file mapping would replace. */
+int  ckpt_read(const char *path, CheckpointHeader *h, void *cells, size_t bytes);
+
+/* Read bytes from just after path's soup (h from ckpt_read_header()) into
+ * buf: a compact soup's handle table.  0, or -1 with errno set (EINVAL if
+ * the file does not end right after them). */
+int  ckpt_read_tail(const char *path, const CheckpointHeader *h, void *buf, size_t bytes);
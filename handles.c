@@ -0,0 +1,97 @@
+#include "handles.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int handles_init(HandleTable *t, size_t ncells) {
+    memset(t, 0, sizeof(*t));
+    if (ncells > HANDLE_LIMIT / 2) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t n = HANDLE_LIMIT - ncells;
+    t->base    = (uint32_t)ncells;
+    t->limit   = n < HANDLE_SLACK ? (uint32_t)n : HANDLE_SLACK;
+    t->next_id = (uint32_t)ncells;
+    /* Large enough that malloc maps them: pages appear as entries are first written */
+    t->id    = malloc(n * sizeof(uint32_t));
+    t->epoch = malloc(n * sizeof(uint16_t));
+    t->free  = malloc(n * sizeof(uint32_t));
+    t->mark  = malloc(HANDLE_LIMIT / 8);
+    if (!t->id || !t->epoch || !t->free || !t->mark) {
+        int err = errno;
+        handles_free(t);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+void handles_free(HandleTable *t) {
+    free(t->id);
+    free(t->epoch);
+    free(t->free);
+    free(t->mark);
+    memset(t, 0, sizeof(*t));
+}
+
+uint32_t handles_new(HandleTable *t, int epoch) {
+    if (!t->nfree && t->used >= HANDLE_LIMIT - t->base) {
+        fprintf(stderr, "handles_new: all %u lineage handles are live\n", HANDLE_LIMIT - t->base);
+        exit(1);
+    }
+    uint32_t h = t->nfree ? t->free[--t->nfree] : t->base + t->used++;
+    t->id[h - t->base]    = t->next_id++;
+    t->epoch[h - t->base] = (uint16_t)epoch;
+    return h;
+}
+
+void handles_collect(HandleTable *t, const uint32_t *cells, size_t ncells) {
+    memset(t->mark, 0, (((size_t)t->base + t->used + 63) / 64) * sizeof(uint64_t));
+    for (size_t n = 0; n < ncells; n++) {
+        uint32_t h = cells[n] >> 8;
+        t->mark[h / 64] |= 1ULL << (h % 64);
+    }
+    t->nfree = 0;
+    for (uint32_t k = t->used; k-- > 0; ) {
+        uint32_t h = t->base + k;
+        if (!(t->mark[h / 64] >> (h % 64) & 1)) t->free[t->nfree++] = h;
+    }
+    uint64_t limit = (uint64_t)t->used + (t->used - t->nfree) + HANDLE_SLACK;
+    uint32_t cap   = HANDLE_LIMIT - t->base;
+    t->limit = limit < cap ? (uint32_t)limit : cap;
+}
+
+size_t handles_tail_bytes(uint32_t used, uint32_t nfree) {
+    return (size_t)used * (sizeof(uint32_t) + sizeof(uint16_t)) + (size_t)nfree * sizeof(uint32_t);
+}
+
+size_t handles_bytes(const HandleTable *t) {
+    return handles_tail_bytes(t->used, t->nfree);
+}
+
+void handles_save(const HandleTable *t, void *buf) {
+    uint8_t *p = buf;
+    memcpy(p, t->id, t->used * sizeof(uint32_t));     p += t->used * sizeof(uint32_t);
+    memcpy(p, t->epoch, t->used * sizeof(uint16_t));  p += t->used * sizeof(uint16_t);
+    memcpy(p, t->free, t->nfree * sizeof(uint32_t));
+}
+
+int handles_restore(HandleTable *t, const void *buf, uint32_t used, uint32_t nfree, uint32_t limit,
+                    uint32_t next_id) {
+    if (used > HANDLE_LIMIT - t->base || nfree > used || limit > HANDLE_LIMIT - t->base) {
+        errno = EINVAL;
+        return -1;
+    }
+    const uint8_t *p = buf;
+    memcpy(t->id, p, used * sizeof(uint32_t));     p += used * sizeof(uint32_t);
+    memcpy(t->epoch, p, used * sizeof(uint16_t));  p += used * sizeof(uint16_t);
+    memcpy(t->free, p, nfree * sizeof(uint32_t));
+    t->used    = used;
+    t->nfree   = nfree;
+    t->limit   = limit;
+    t->next_id = next_id;
+    return 0;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Lineage handles of a compact soup (soup_core.h, BFFO_MAKE_CTOKEN).
+ *
+ * A compact token carries a 24-bit handle instead of a 32-bit id and 16-bit
+ * epoch.  Handles below base (the soup's cell count) are the initial tokens:
+ * handle h is id h, born at epoch 0, and needs no table entry.  Handles from
+ * base up index a table of the ids and creation epochs, one entry per
+ * lineage a mutation started.  They keep the 64-bit token's widths (32-bit
+ * id, 16-bit epoch) and wrap as it does, so a compact soup reports exactly
+ * what the 64-bit soup of the same seed does; the handle saves the memory,
+ * not the overflow.
+ *
+ * Handles are not reference counted while the soup runs, which would put an
+ * atomic update on every copy the interpreter makes.  Instead
+ * handles_collect() marks the handles still present in the cells and puts
+ * every unmarked table handle on the free list: those are exactly the
+ * handles whose count has dropped to zero.  soup_core_mutate() collects
+ * when the free list is empty and the table has grown to limit, which each
+ * collection sets to the handles in use plus the live ones plus
+ * HANDLE_SLACK.  The table then stays within about twice the live mutation
+ * lineages, and each collection (a pass over the cells) is paid for by at
+ * least HANDLE_SLACK mutations.  Up to HANDLE_LIMIT - base lineages can be
+ * alive at once, and as base is at most HANDLE_LIMIT / 2 that is no fewer
+ * than the cells: a collection that runs with the cell being replaced
+ * cleared (as soup_core_mutate() does) always frees a handle.  Collection pushes the free handles in descending order, so
+ * the lowest are reused first; the arrays are reserved at full size but only
+ * the pages reached are ever touched.  Which handle a lineage gets depends
+ * only on the soup's history, never on the thread count.
+ */
+#define HANDLE_BITS   24
+#define HANDLE_LIMIT  (1u << HANDLE_BITS)
+#define HANDLE_SLACK  (1u << 16)
+
+typedef struct {
+    uint32_t  base;               /* first table handle: the soup's cell count */
+    uint32_t  used;               /* table handles handed out so far (high-water mark) */
+    uint32_t  nfree;              /* recycled handles on the free list */
+    uint32_t  limit;              /* collect at this many used with none free */
+    uint32_t  next_id;            /* id of the next lineage */
+    uint32_t *id;                 /* HANDLE_LIMIT - base entries */
+    uint16_t *epoch;
+    uint32_t *free;               /* free list, next handle last */
+    uint64_t *mark;               /* HANDLE_LIMIT bits, for handles_collect() */
+} HandleTable;
+
+/* Empty table for a soup of ncells initial tokens (next_id = ncells).  0, or
+ * -1 with errno set (EINVAL if ncells leaves fewer than half the handles). */
+int  handles_init(HandleTable *t, size_t ncells);
+void handles_free(HandleTable *t);
+
+/* 1 if handles_collect() is due before the next handles_new(). */
+static inline int handles_due(const HandleTable *t) {
+    return !t->nfree && t->used >= t->limit;
+}
+
+/* A handle for a new lineage born at epoch; collect first if due.  A table
+ * still full after collecting is a caller bug (see above) and exits. */
+uint32_t handles_new(HandleTable *t, int epoch);
+
+/* Free every table handle that no token of cells (ncells compact tokens) holds. */
+void handles_collect(HandleTable *t, const uint32_t *cells, size_t ncells);
+
+static inline uint32_t handles_id(const HandleTable *t, uint32_t h) {
+    return h < t->base ? h : t->id[h - t->base];
+}
+
+static inline uint16_t handles_epoch(const HandleTable *t, uint32_t h) {
+    return h < t->base ? 0 : t->epoch[h - t->base];
+}
+
+/*
+ * Checkpoint form (checkpoint.h): used ids, used epochs, then nfree free-list
+ * entries, back to back; used, nfree, limit and next_id go in the header.
+ * handles_restore() fills a table from handles_init() with base equal to the
+ * saved one.  0, or -1 with errno EINVAL.  handles_tail_bytes() is the size
+ * of a table saved with used and nfree.
+ */
+size_t handles_tail_bytes(uint32_t used, uint32_t nfree);
+size_t handles_bytes(const HandleTable *t);
+void   handles_save(const HandleTable *t, void *buf);
+int    handles_restore(HandleTable *t, const void *buf, uint32_t used, uint32_t nfree, uint32_t limit,
+                       uint32_t next_id);
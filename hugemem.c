@@ -0,0 +1,124 @@
+#define _GNU_SOURCE
+
+#include "hugemem.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#define HUGE_2M_BYTES  ((size_t)2 << 20)
+#define HUGE_1G_BYTES  ((size_t)1 << 30)
+
+int huge_mode_parse(const char *s) {
+    if (!strcmp(s, "off"))  return HUGE_OFF;
+    if (!strcmp(s, "thp"))  return HUGE_THP;
+    if (!strcmp(s, "2m"))   return HUGE_2M;
+    if (!strcmp(s, "1g"))   return HUGE_1G;
+    if (!strcmp(s, "auto")) return HUGE_AUTO;
+    return -1;
+}
+
+static size_t round_up(size_t n, size_t to) {
+    return (n + to - 1) / to * to;
+}
+
+/* hugetlb mapping of page-sized pages, or NULL */
+static void *map_hugetlb(size_t bytes, size_t page) {
+    int log2_page = __builtin_ctzll(page);
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (log2_page << MAP_HUGE_SHIFT), -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+/* Ordinary mapping trimmed to a 2 MB boundary, so THP can back all of it */
+static void *map_aligned(size_t bytes) {
+    size_t span = bytes + HUGE_2M_BYTES;
+    uint8_t *p = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    uint8_t *a = (uint8_t *)round_up((uintptr_t)p, HUGE_2M_BYTES);
+    if (a > p) munmap(p, (size_t)(a - p));
+    if (p + span > a + bytes) munmap(a + bytes, (size_t)(p + span - (a + bytes)));
+    return a;
+}
+
+int huge_alloc(HugeMem *m, size_t bytes, HugeMode mode) {
+    memset(m, 0, sizeof(*m));
+    if (mode == HUGE_AUTO) mode = bytes >= HUGE_1G_BYTES ? HUGE_1G : HUGE_2M;
+
+    static const size_t pages[] = { HUGE_1G_BYTES, HUGE_2M_BYTES };
+    for (int k = mode == HUGE_1G ? 0 : 1; mode >= HUGE_2M && k < 2; k++) {
+        size_t len = round_up(bytes, pages[k]);
+        if ((m->ptr = map_hugetlb(len, pages[k]))) {
+            m->bytes = len;
+            m->page  = pages[k];
+            return 0;
+        }
+    }
+
+    m->bytes = round_up(bytes, HUGE_2M_BYTES);
+    if (!(m->ptr = map_aligned(m->bytes))) return -1;
+    if (mode != HUGE_OFF) m->thp = madvise(m->ptr, m->bytes, MADV_HUGEPAGE) == 0;
+    return 0;
+}
+
+void huge_free(HugeMem *m) {
+    if (m->ptr) munmap(m->ptr, m->bytes);
+    memset(m, 0, sizeof(*m));
+}
+
+size_t huge_backed(const HugeMem *m) {
+    if (m->page) return m->bytes;
+    if (!m->thp) return 0;
+
+    /* Sum AnonHugePages over the VMAs inside the mapping (a checkpoint
+     * mapped over part of it splits it into several). */
+    FILE *f = fopen("/proc/self/smaps", "r");
+    if (!f) return 0;
+    uintptr_t lo = (uintptr_t)m->ptr, hi = lo + m->bytes;
+    int inside = 0;
+    size_t total = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long start, end, kb;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2)
+            inside = start >= lo && end <= hi;
+        else if (inside && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+            total += (size_t)kb << 10;
+    }
+    fclose(f);
+    return total;
+}
+
+const char *huge_describe(const HugeMem *m) {
+    if (m->page == HUGE_1G_BYTES) return "1 GB hugetlb";
+    if (m->page == HUGE_2M_BYTES) return "2 MB hugetlb";
+    if (m->thp)                   return "THP (madvise)";
+    return "4 KB";
+}
+
+int huge_tlb_open(void) {
+    struct perf_event_attr a;
+    memset(&a, 0, sizeof(a));
+    a.type           = PERF_TYPE_HW_CACHE;
+    a.size           = sizeof(a);
+    a.config         = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    a.inherit        = 1;      /* and the worker threads started after this */
+    a.exclude_kernel = 1;
+    a.exclude_hv     = 1;
+    return (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
+}
+
+uint64_t huge_tlb_read(int fd) {
+    uint64_t v = 0;
+    if (fd < 0 || read(fd, &v, sizeof(v)) != (ssize_t)sizeof(v)) return 0;
+    return v;
+}
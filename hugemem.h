@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Large anonymous allocations on huge pages (soup_orig --hugepages).
+ *
+ * The soup is gathered in random pair order every epoch, so with 4 KB pages
+ * nearly every tape touched costs a dTLB miss and a page walk; 2 MB pages
+ * cover the 64 MB soup with 32 TLB entries, 1 GB pages with one.
+ *
+ * huge_alloc() tries explicit hugetlb pages first (MAP_HUGETLB, which needs
+ * pages reserved in /proc/sys/vm/nr_hugepages or the 1 GB pool), then falls
+ * back to an ordinary mapping aligned to 2 MB with madvise(MADV_HUGEPAGE), so
+ * transparent huge pages back it when THP is "always" or "madvise".  The
+ * result is zero filled, like BSS.
+ *
+ * hugetlb mappings are not split on fork(): a child's first write to a page
+ * copies the whole huge page from the same reserve, and kills the child with
+ * SIGBUS when the reserve is empty.  Callers that fork should ask for HUGE_THP.
+ */
+typedef enum {
+    HUGE_OFF,       /* 4 KB pages, no madvise */
+    HUGE_THP,       /* transparent huge pages only */
+    HUGE_2M,        /* hugetlb 2 MB, else THP */
+    HUGE_1G,        /* hugetlb 1 GB, else 2 MB, else THP */
+    HUGE_AUTO,      /* HUGE_1G for regions of 1 GB or more, else HUGE_2M */
+} HugeMode;
+
+typedef struct {
+    void    *ptr;
+    size_t   bytes;         /* mapped length (rounded up to the page size) */
+    size_t   page;          /* hugetlb page size, or 0 for an ordinary mapping */
+    int      thp;           /* 1 if MADV_HUGEPAGE was applied */
+} HugeMem;
+
+/* Parse "off", "thp", "2m", "1g" or "auto"; -1 if unknown. */
+int  huge_mode_parse(const char *s);
+
+/* Map bytes with mode into m; 0, or -1 with errno set if no mapping at all could be made. */
+int  huge_alloc(HugeMem *m, size_t bytes, HugeMode mode);
+void huge_free(HugeMem *m);
+
+/*
+ * Bytes of m currently backed by huge pages: the whole mapping for hugetlb,
+ * AnonHugePages from /proc/self/smaps for THP (call after the memory has
+ * been touched), 0 otherwise.
+ */
+size_t huge_backed(const HugeMem *m);
+
+/* "1 GB hugetlb", "2 MB hugetlb", "THP (madvise)" or "4 KB" */
+const char *huge_describe(const HugeMem *m);
+
+/*
+ * User-space dTLB load misses of this thread and the threads it starts
+ * afterwards (perf_event_open), to measure what the page size buys.  -1 if
+ * the kernel or CPU has no such counter, as in most VMs.
+ */
+int      huge_tlb_open(void);
+uint64_t huge_tlb_read(int fd);
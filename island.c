@@ -0,0 +1,118 @@
+#define _GNU_SOURCE
+
+#include "island.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Header page of the mapping; the outboxes, reports and snapshot follow */
+struct IslandNet {
+    pthread_barrier_t migrate;
+    atomic_ullong     published[ISLAND_MAX];   /* rows published by each island */
+    atomic_ullong     consumed;                /* rows the orchestrator has read */
+    pid_t             orchestrator;
+    int               n;
+    size_t            box_bytes, report_bytes, snap_bytes;
+    size_t            map_bytes;
+    uint8_t          *boxes;                   /* [2][n] outboxes */
+    uint8_t          *reports;                 /* [n] */
+    uint8_t          *snap;                    /* [n] slices */
+};
+
+/* Cache-line multiples, so neighbouring islands' writes never share a line */
+static size_t line_up(size_t n) {
+    return (n + 63) & ~(size_t)63;
+}
+
+IslandNet *island_net_create(int n, size_t box_bytes, size_t report_bytes, size_t snap_bytes) {
+    if (n < 1 || n > ISLAND_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+    box_bytes    = line_up(box_bytes);
+    report_bytes = line_up(report_bytes);
+    size_t head  = line_up(sizeof(IslandNet));
+    size_t bytes = head + 2 * (size_t)n * box_bytes + (size_t)n * report_bytes + (size_t)n * snap_bytes;
+    IslandNet *net = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (net == MAP_FAILED) return NULL;
+
+    pthread_barrierattr_t attr;
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    int err = pthread_barrier_init(&net->migrate, &attr, (unsigned)n);
+    pthread_barrierattr_destroy(&attr);
+    if (err) {
+        munmap(net, bytes);
+        errno = err;
+        return NULL;
+    }
+    for (int k = 0; k < ISLAND_MAX; k++) atomic_init(&net->published[k], 0);
+    atomic_init(&net->consumed, 0);
+    net->orchestrator = getpid();
+    net->n            = n;
+    net->box_bytes    = box_bytes;
+    net->report_bytes = report_bytes;
+    net->snap_bytes   = snap_bytes;
+    net->map_bytes    = bytes;
+    net->boxes        = (uint8_t *)net + head;
+    net->reports      = net->boxes + 2 * (size_t)n * box_bytes;
+    net->snap         = net->reports + (size_t)n * report_bytes;
+    return net;
+}
+
+void island_net_destroy(IslandNet *net) {
+    pthread_barrier_destroy(&net->migrate);
+    munmap(net, net->map_bytes);
+}
+
+void *island_outbox(IslandNet *net, int k, uint64_t m) {
+    return net->boxes + ((m % 2) * (size_t)net->n + (size_t)k) * net->box_bytes;
+}
+
+const void *island_inbox(IslandNet *net, int k, uint64_t m) {
+    return island_outbox(net, (k + net->n - 1) % net->n, m);
+}
+
+void island_migrate_wait(IslandNet *net) {
+    pthread_barrier_wait(&net->migrate);
+}
+
+static void nap(void) {
+    struct timespec ts = { 0, 1000000 };      /* 1 ms: rows are seconds apart */
+    nanosleep(&ts, NULL);
+}
+
+int island_report_wait(IslandNet *net, uint64_t row) {
+    while (atomic_load(&net->consumed) < row) {
+        if (getppid() != net->orchestrator) return -1;
+        nap();
+    }
+    return 0;
+}
+
+void *island_report(IslandNet *net, int k) {
+    return net->reports + (size_t)k * net->report_bytes;
+}
+
+void *island_snapshot(IslandNet *net, int k) {
+    return net->snap + (size_t)k * net->snap_bytes;
+}
+
+void island_publish(IslandNet *net, int k, uint64_t row) {
+    atomic_store(&net->published[k], row + 1);
+}
+
+int island_ready(IslandNet *net, uint64_t row) {
+    for (int k = 0; k < net->n; k++)
+        if (atomic_load(&net->published[k]) <= row) return 0;
+    return 1;
+}
+
+void island_consume(IslandNet *net, uint64_t row) {
+    atomic_store(&net->consumed, row + 1);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Island transport (soup_orig --islands): n soup processes on one box, each
+ * evolving its own sub-soup, exchange migrant tapes through one shared
+ * anonymous mapping that the orchestrator creates before it forks them.
+ *
+ * Migration m uses outbox set m % 2.  Every island writes its migrants into
+ * its own outbox, waits on a process-shared barrier, then reads the outbox
+ * of its ring predecessor (island k reads island k - 1).  Double buffering
+ * makes one barrier per migration enough: no island can write set m % 2
+ * again (migration m + 2) before all have passed migration m + 1's barrier,
+ * which each reaches only after reading migration m.  What an island
+ * receives depends only on what the others sent, never on timing.
+ *
+ * Reports go to the orchestrator.  For each stats row an island waits until
+ * the previous row has been consumed, writes its report and its soup into
+ * its slice of a shared snapshot, and publishes the row.  The orchestrator
+ * waits for all n, reads the whole snapshot as one soup, and marks the row
+ * consumed.  Those waits poll rather than block, so the orchestrator can
+ * notice a dead island (waitpid) and stop the others.
+ */
+#define ISLAND_MAX  64
+
+typedef struct IslandNet IslandNet;
+
+/* Shared mapping for n islands: outboxes of box_bytes, reports of
+ * report_bytes and snapshot slices of snap_bytes each.  NULL with errno set. */
+IslandNet *island_net_create(int n, size_t box_bytes, size_t report_bytes, size_t snap_bytes);
+void       island_net_destroy(IslandNet *net);
+
+/* Migration m: island k's outbox, the predecessor's outbox it reads, and the
+ * barrier between writing the one and reading the other. */
+void       *island_outbox(IslandNet *net, int k, uint64_t m);
+const void *island_inbox(IslandNet *net, int k, uint64_t m);
+void        island_migrate_wait(IslandNet *net);
+
+/* Island side of stats row `row`: wait until the orchestrator has consumed
+ * row - 1 (0, or -1 if the orchestrator is gone), fill the report and the
+ * snapshot slice, then publish. */
+int   island_report_wait(IslandNet *net, uint64_t row);
+void *island_report(IslandNet *net, int k);
+void *island_snapshot(IslandNet *net, int k);
+void  island_publish(IslandNet *net, int k, uint64_t row);
+
+/* Orchestrator side: 1 once every island has published row, then read the
+ * reports and the whole snapshot (n slices back to back) before consuming. */
+int   island_ready(IslandNet *net, uint64_t row);
+void  island_consume(IslandNet *net, uint64_t row);
@@ -0,0 +1,401 @@
+#define _POSIX_C_SOURCE 200809L
+
+/*
+ * Exhaustive single-mutant fitness landscape of one tape.
+ *
+ * Every single-byte mutant (BFFO_HALF_LEN positions x 256 values), plus
+ * optionally a sample of double mutants, is run against a fixed partner panel
+ * and scored like assay: copy rate (partner half becomes an exact copy of the
+ * mutant), survival (mutant half unchanged) and offspring = copy + survival.
+ *
+ * Mutants share execution with the wildtype.  A mutant at cell c behaves
+ * exactly like the wildtype until the first step that reads or writes c, so
+ * for each partner the wildtype is run once with bffo_run_touch to find each
+ * cell's first touch, replayed once more to checkpoint the interpreter state
+ * at those steps, and every mutant of c resumes from c's checkpoint.  Cells
+ * the wildtype never touches need no execution at all.
+ *
+ * Usage:
+ *   ./landscape [--partners N] [--soup FILE] [--doubles N] [--tolerance F]
+ *               [--seed S] [--threads T] (--tape STR | TAPEFILE)
+ *
+ * The tape is given as in assay (|tape|, 128 hex digits or an instruction
+ * string); with TAPEFILE the first tape in the file is used.  Output is TSV:
+ * '#' summary lines (wildtype fitness, mutational robustness, work saved by
+ * prefix sharing) followed by one row per mutant.
+ */
+
+#include "bff_orig.h"
+#include "pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define NVALS   256
+#define NSINGLE (BFFO_HALF_LEN * NVALS)
+
+typedef struct {
+    uint64_t copies;
+    uint64_t survivals;
+    uint64_t steps;
+} Score;
+
+typedef struct {
+    uint8_t pos[2];
+    uint8_t val[2];
+} Double;
+
+/* Per-worker accumulators, merged after the run */
+typedef struct {
+    Score    single[NSINGLE];    /* index pos * NVALS + val */
+    Score   *dbl;                /* ndoubles entries */
+    uint64_t steps_run;          /* interpreter steps actually executed */
+    uint64_t steps_total;        /* steps a from-scratch evaluation would execute */
+} Accum;
+
+static uint8_t     wt[BFFO_HALF_LEN];
+static uint8_t   (*partners)[BFFO_HALF_LEN] = NULL;
+static uint32_t    npartners = 256;
+static Double     *doubles   = NULL;
+static uint32_t    ndoubles  = 0;
+static uint64_t    g_seed    = 1;
+static Accum      *accum[POOL_MAX_THREADS];
+static atomic_uint next_partner;
+
+#define MAX_COUNT (1u << 24)          /* cap on --partners and --doubles */
+
+static inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* -------------------------------------------------------------------------
+ * Partner panel: uniform random bytes or tapes sampled from a soup snapshot
+ * -------------------------------------------------------------------------*/
+static void make_partners(const char *soup_path) {
+    partners = malloc((size_t)npartners * BFFO_HALF_LEN);
+    if (!partners) { perror("partners"); exit(1); }
+    uint64_t rng = splitmix64(g_seed ^ 0x5041524eULL);
+
+    if (!soup_path) {
+        for (uint32_t p = 0; p < npartners; p++)
+            for (int j = 0; j < BFFO_HALF_LEN; j++)
+                partners[p][j] = (uint8_t)(rng = splitmix64(rng));
+        return;
+    }
+
+    FILE *f = fopen(soup_path, "rb");
+    if (!f) { perror(soup_path); exit(1); }
+    fseek(f, 0, SEEK_END);
+    uint32_t ntapes = (uint32_t)(ftell(f) / (long)(BFFO_HALF_LEN * sizeof(uint64_t)));
+    if (ntapes == 0) { fprintf(stderr, "%s: no tapes\n", soup_path); exit(1); }
+
+    uint64_t tape[BFFO_HALF_LEN];
+    for (uint32_t p = 0; p < npartners; p++) {
+        rng = splitmix64(rng);
+        fseek(f, (long)(rng % ntapes) * (long)sizeof(tape), SEEK_SET);
+        if (fread(tape, sizeof(tape), 1, f) != 1) { perror(soup_path); exit(1); }
+        for (int j = 0; j < BFFO_HALF_LEN; j++)
+            partners[p][j] = BFFO_TOKEN_CHAR(tape[j]);
+    }
+    fclose(f);
+}
+
+/* -------------------------------------------------------------------------
+ * Scoring a finished interaction against the (mutant) tape it started from
+ * -------------------------------------------------------------------------*/
+static inline void score(Score *s, const uint64_t *tape, int cbase, int pbase,
+                         const uint8_t *mut, uint32_t steps) {
+    int copied = 1, survived = 1;
+    for (int j = 0; j < BFFO_HALF_LEN; j++) {
+        copied   &= BFFO_TOKEN_CHAR(tape[pbase + j]) == mut[j];
+        survived &= BFFO_TOKEN_CHAR(tape[cbase + j]) == mut[j];
+    }
+    s->copies    += (uint64_t)copied;
+    s->survivals += (uint64_t)survived;
+    s->steps     += steps;
+}
+
+static inline uint64_t set_char(uint64_t tok, uint8_t ch) {
+    return (tok & ~0xFFULL) | ch;
+}
+
+/* -------------------------------------------------------------------------
+ * One partner: wildtype touch pass, checkpoint replay, then all mutants
+ * -------------------------------------------------------------------------*/
+static void scan_partner(uint32_t p, Accum *acc) {
+    int cand_first = !(p & 1);
+    int cbase = cand_first ? 0 : BFFO_HALF_LEN;
+    int pbase = cand_first ? BFFO_HALF_LEN : 0;
+
+    uint64_t orig[BFFO_TAPE_LEN];
+    for (int j = 0; j < BFFO_HALF_LEN; j++) {
+        orig[cbase + j] = BFFO_MAKE_TOKEN(j + 1, 0, wt[j]);
+        orig[pbase + j] = BFFO_MAKE_TOKEN(0, 0, partners[p][j]);
+    }
+    uint64_t h  = splitmix64(g_seed ^ p);
+    uint8_t  h0 = (uint8_t)(h & (BFFO_TAPE_LEN - 1));
+    uint8_t  h1 = (uint8_t)((h >> 8) & (BFFO_TAPE_LEN - 1));
+
+    /* Wildtype run with first-touch tracking */
+    uint64_t  final[BFFO_TAPE_LEN];
+    uint32_t  touch[BFFO_TAPE_LEN];
+    BffoState st;
+    memcpy(final, orig, sizeof(orig));
+    memset(touch, 0xFF, sizeof(touch));
+    bffo_init(&st, h0, h1);
+    uint32_t wt_steps = bffo_run_touch(final, &st, touch);
+
+    /* Replay the wildtype, checkpointing at each candidate cell's first touch */
+    static _Thread_local uint64_t  snap_tape[BFFO_HALF_LEN][BFFO_TAPE_LEN];
+    static _Thread_local BffoState snap_st[BFFO_HALF_LEN];
+    int order[BFFO_HALF_LEN], n = 0;
+    for (int j = 0; j < BFFO_HALF_LEN; j++)
+        if (touch[cbase + j] != UINT32_MAX) order[n++] = j;
+    for (int a = 1; a < n; a++)                  /* insertion sort by touch step */
+        for (int b = a; b > 0 && touch[cbase + order[b]] < touch[cbase + order[b - 1]]; b--) {
+            int t = order[b]; order[b] = order[b - 1]; order[b - 1] = t;
+        }
+    uint64_t work[BFFO_TAPE_LEN];
+    memcpy(work, orig, sizeof(orig));
+    bffo_init(&st, h0, h1);
+    for (int k = 0; k < n; k++) {
+        int j = order[k];
+        bffo_resume(work, &st, touch[cbase + j]);
+        memcpy(snap_tape[j], work, sizeof(work));
+        snap_st[j] = st;
+    }
+    acc->steps_run += 2ull * wt_steps;
+
+    /* Single mutants */
+    uint8_t  mut[BFFO_HALF_LEN];
+    uint64_t tape[BFFO_TAPE_LEN];
+    memcpy(mut, wt, sizeof(mut));
+    for (int j = 0; j < BFFO_HALF_LEN; j++) {
+        uint32_t t0 = touch[cbase + j];
+        for (int v = 0; v < NVALS; v++) {
+            Score *s = &acc->single[j * NVALS + v];
+            mut[j] = (uint8_t)v;
+            if (v == wt[j]) {
+                acc->steps_total += wt_steps;
+                score(s, final, cbase, pbase, mut, wt_steps);
+            } else if (t0 == UINT32_MAX) {
+                acc->steps_total += wt_steps;
+                memcpy(tape, final, sizeof(tape));
+                tape[cbase + j] = set_char(tape[cbase + j], (uint8_t)v);
+                score(s, tape, cbase, pbase, mut, wt_steps);
+            } else {
+                BffoState ms = snap_st[j];
+                memcpy(tape, snap_tape[j], sizeof(tape));
+                tape[cbase + j] = set_char(tape[cbase + j], (uint8_t)v);
+                uint32_t steps = bffo_resume(tape, &ms, BFFO_MAX_STEPS);
+                acc->steps_run   += steps - t0;
+                acc->steps_total += steps;
+                score(s, tape, cbase, pbase, mut, steps);
+            }
+        }
+        mut[j] = wt[j];
+    }
+
+    /* Double mutants resume from whichever mutated cell is touched first */
+    for (uint32_t d = 0; d < ndoubles; d++) {
+        const Double *dm = &doubles[d];
+        int a = dm->pos[0], b = dm->pos[1];
+        int first = touch[cbase + a] <= touch[cbase + b] ? a : b;
+        mut[a] = dm->val[0];
+        mut[b] = dm->val[1];
+
+        uint32_t steps;
+        if (touch[cbase + first] == UINT32_MAX) {
+            /* neither cell is ever touched: the wildtype result with both cells replaced */
+            memcpy(tape, final, sizeof(tape));
+            tape[cbase + a] = set_char(tape[cbase + a], dm->val[0]);
+            tape[cbase + b] = set_char(tape[cbase + b], dm->val[1]);
+            steps = wt_steps;
+        } else {
+            BffoState ms = snap_st[first];
+            memcpy(tape, snap_tape[first], sizeof(tape));
+            tape[cbase + a] = set_char(tape[cbase + a], dm->val[0]);
+            tape[cbase + b] = set_char(tape[cbase + b], dm->val[1]);
+            steps = bffo_resume(tape, &ms, BFFO_MAX_STEPS);
+            acc->steps_run += steps - touch[cbase + first];
+        }
+        acc->steps_total += steps;
+        score(&acc->dbl[d], tape, cbase, pbase, mut, steps);
+        mut[a] = wt[a];
+        mut[b] = wt[b];
+    }
+}
+
+static void scan_job(void *ctx, int tid, int nthreads) {
+    (void)ctx; (void)nthreads;
+    Accum *acc = accum[tid];
+    for (;;) {
+        uint32_t p = atomic_fetch_add(&next_partner, 1);
+        if (p >= npartners) break;
+        scan_partner(p, acc);
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * -------------------------------------------------------------------------*/
+/* Parse a decimal count in [lo, MAX_COUNT]; returns 0 on anything else */
+static int parse_count(const char *v, uint32_t lo, uint32_t *out) {
+    char         *end;
+    unsigned long n = strtoul(v, &end, 10);
+    if (*v < '0' || *v > '9' || *end || n < lo || n > MAX_COUNT) return 0;
+    *out = (uint32_t)n;
+    return 1;
+}
+
+static int usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--partners N] [--soup FILE] [--doubles N] [--tolerance F] "
+                    "[--seed S] [--threads T] (--tape STR | TAPEFILE)\n"
+                    "  --partners is 1 to %u, --doubles 0 to %u\n", prog, MAX_COUNT, MAX_COUNT);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    int         nthreads  = 0;
+    double      tolerance = 0.1;
+    const char *soup_path = NULL;
+    const char *tape_str  = NULL;
+    const char *tape_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--partners") && i + 1 < argc) {
+            if (!parse_count(argv[++i], 1, &npartners)) return usage(argv[0]);
+        }
+        else if (!strcmp(argv[i], "--doubles") && i + 1 < argc) {
+            if (!parse_count(argv[++i], 0, &ndoubles)) return usage(argv[0]);
+        }
+        else if (!strcmp(argv[i], "--soup")      && i + 1 < argc) soup_path = argv[++i];
+        else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) tolerance = strtod(argv[++i], NULL);
+        else if (!strcmp(argv[i], "--seed")      && i + 1 < argc) g_seed    = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--threads")   && i + 1 < argc) nthreads  = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--tape")      && i + 1 < argc) tape_str  = argv[++i];
+        else if (argv[i][0] != '-' && !tape_path) tape_path = argv[i];
+        else { fprintf(stderr, "Unknown argument: %s\n", argv[i]); return 1; }
+    }
+
+    int have_tape = 0;
+    if (tape_str) {
+        have_tape = bffo_parse_tape(tape_str, wt);
+    } else if (tape_path) {
+        FILE *f = fopen(tape_path, "r");
+        if (!f) { perror(tape_path); return 1; }
+        char line[4096];
+        while (!have_tape && fgets(line, sizeof(line), f))
+            have_tape = bffo_parse_tape(line, wt);
+        fclose(f);
+    }
+    if (!have_tape) return usage(argv[0]);
+
+    make_partners(soup_path);
+
+    /* Sample double mutants: two distinct positions, values differing from the wildtype */
+    doubles = malloc((ndoubles ? ndoubles : 1) * sizeof(Double));
+    if (!doubles) { perror("doubles"); return 1; }
+    uint64_t rng = splitmix64(g_seed ^ 0x444f55424cULL);
+    for (uint32_t d = 0; d < ndoubles; d++) {
+        Double *dm = &doubles[d];
+        rng = splitmix64(rng);
+        dm->pos[0] = (uint8_t)(rng % BFFO_HALF_LEN);
+        dm->pos[1] = (uint8_t)((dm->pos[0] + 1 + (rng >> 8) % (BFFO_HALF_LEN - 1)) % BFFO_HALF_LEN);
+        dm->val[0] = (uint8_t)(wt[dm->pos[0]] + 1 + (rng >> 16) % 255);
+        dm->val[1] = (uint8_t)(wt[dm->pos[1]] + 1 + (rng >> 24) % 255);
+    }
+
+    nthreads = pool_start(nthreads);
+    for (int t = 0; t < nthreads; t++) {
+        accum[t] = calloc(1, sizeof(Accum));
+        if (!accum[t]) { perror("accumulators"); return 1; }
+        accum[t]->dbl = calloc(ndoubles ? ndoubles : 1, sizeof(Score));
+        if (!accum[t]->dbl) { perror("accumulators"); return 1; }
+    }
+    fprintf(stderr, "Landscape: %d single + %u double mutants x %u partners, %d threads\n",
+            NSINGLE, ndoubles, npartners, nthreads);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    atomic_store(&next_partner, 0);
+    pool_run(scan_job, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    pool_stop();
+
+    /* Merge per-worker accumulators into accum[0] */
+    Accum *tot = accum[0];
+    for (int t = 1; t < nthreads; t++) {
+        for (int k = 0; k < NSINGLE; k++) {
+            tot->single[k].copies    += accum[t]->single[k].copies;
+            tot->single[k].survivals += accum[t]->single[k].survivals;
+            tot->single[k].steps     += accum[t]->single[k].steps;
+        }
+        for (uint32_t d = 0; d < ndoubles; d++) {
+            tot->dbl[d].copies    += accum[t]->dbl[d].copies;
+            tot->dbl[d].survivals += accum[t]->dbl[d].survivals;
+            tot->dbl[d].steps     += accum[t]->dbl[d].steps;
+        }
+        tot->steps_run   += accum[t]->steps_run;
+        tot->steps_total += accum[t]->steps_total;
+    }
+
+    /* Wildtype fitness and robustness over the 64 x 255 true single mutants */
+    double np = (double)npartners;
+    const Score *ws = &tot->single[0 * NVALS + wt[0]];
+    double wt_off = (ws->copies + ws->survivals) / np;
+    uint32_t neutral = 0, nmut = 0;
+    double rel_sum = 0.0;
+    for (int j = 0; j < BFFO_HALF_LEN; j++)
+        for (int v = 0; v < NVALS; v++) {
+            if (v == wt[j]) continue;
+            const Score *s = &tot->single[j * NVALS + v];
+            double off = (s->copies + s->survivals) / np;
+            neutral += off >= (1.0 - tolerance) * wt_off;
+            rel_sum += wt_off > 0.0 ? off / wt_off : 0.0;
+            nmut++;
+        }
+
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    double saved = tot->steps_total ? 1.0 - (double)tot->steps_run / (double)tot->steps_total : 0.0;
+    char s[BFFO_HALF_LEN + 1];
+    bffo_tape_str(wt, s);
+
+    printf("# wildtype |%s|  copy_rate %.4f  survival %.4f  offspring %.4f\n",
+           s, ws->copies / np, ws->survivals / np, wt_off);
+    printf("# robustness %.4f  (fraction of %u single mutants with offspring >= %.2f x wildtype)\n",
+           (double)neutral / nmut, nmut, 1.0 - tolerance);
+    printf("# mean_relative_fitness %.4f\n", rel_sum / nmut);
+    printf("# prefix sharing executed %.3g of %.3g steps (%.1f%% saved), %.2f s\n",
+           (double)tot->steps_run, (double)tot->steps_total, 100.0 * saved, secs);
+    fprintf(stderr, "robustness %.4f, %.1f%% of steps saved by prefix sharing, %.2f s\n",
+            (double)neutral / nmut, 100.0 * saved, secs);
+
+    printf("%s\t%s\t%s\t%s\t%s\t%-10s\t%-10s\t%-10s\t%s\n",
+           "kind", "pos", "val", "pos2", "val2", "copy_rate", "survival", "offspring", "mean_steps");
+    for (int j = 0; j < BFFO_HALF_LEN; j++)
+        for (int v = 0; v < NVALS; v++) {
+            const Score *sc = &tot->single[j * NVALS + v];
+            printf("%s\t%d\t%d\t-\t-\t%-10.4f\t%-10.4f\t%-10.4f\t%.1f\n",
+                   v == wt[j] ? "wt" : "single", j, v,
+                   sc->copies / np, sc->survivals / np, (sc->copies + sc->survivals) / np, sc->steps / np);
+        }
+    for (uint32_t d = 0; d < ndoubles; d++) {
+        const Score *sc = &tot->dbl[d];
+        printf("double\t%d\t%d\t%d\t%d\t%-10.4f\t%-10.4f\t%-10.4f\t%.1f\n",
+               doubles[d].pos[0], doubles[d].val[0], doubles[d].pos[1], doubles[d].val[1],
+               sc->copies / np, sc->survivals / np, (sc->copies + sc->survivals) / np, sc->steps / np);
+    }
+
+    for (int t = 0; t < nthreads; t++) { free(accum[t]->dbl); free(accum[t]); }
+    free(partners);
+    free(doubles);
+    return 0;
+}
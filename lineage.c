@@ -0,0 +1,277 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "lineage.h"
+#include "pool.h"
+#include "soup_core.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static inline uint32_t threshold(int level) {
+    return 1u << (2 * level + 2);    /* 16, 64, 256, ... */
+}
+
+static int push(void **buf, size_t *n, size_t *cap, size_t elem) {
+    if (*n == *cap) {
+        size_t ncap = *cap ? *cap * 2 : 256;
+        void  *p    = realloc(*buf, ncap * elem);
+        if (!p) return -1;
+        *buf = p;
+        *cap = ncap;
+    }
+    return 0;
+}
+
+static void push_grown(LineageThread *t, uint32_t id) {
+    if (push((void **)&t->grown, &t->ngrown, &t->gcap, sizeof(uint32_t)) == 0)
+        t->grown[t->ngrown++] = id;
+}
+
+/* Make room for ids below n.  Only called while no pair is running. */
+static int ensure_ids(Lineage *lg, size_t n) {
+    if (n <= lg->cap) return 0;
+    size_t ncap = lg->cap ? lg->cap : lg->base_id;
+    while (ncap < n) ncap *= 2;
+    atomic_uint *c = realloc(lg->count, ncap * sizeof(*c));
+    if (!c) return -1;
+    lg->count = c;
+    uint8_t *l = realloc(lg->level, ncap);
+    if (!l) return -1;
+    lg->level = l;
+    memset(c + lg->cap, 0, (ncap - lg->cap) * sizeof(*c));
+    memset(l + lg->cap, 0, ncap - lg->cap);
+    lg->cap = ncap;
+    return 0;
+}
+
+/* One id leaves a cell and another takes it; note the latter if it hit its next threshold */
+static inline void replace_id(Lineage *lg, LineageThread *t, uint32_t old_id, uint32_t new_id) {
+    atomic_fetch_sub_explicit(&lg->count[old_id], 1, memory_order_relaxed);
+    uint32_t c = atomic_fetch_add_explicit(&lg->count[new_id], 1, memory_order_relaxed) + 1;
+    int lv = lg->level[new_id];
+    if (lv + 1 < LINEAGE_LEVELS && c == threshold(lv + 1)) push_grown(t, new_id);
+}
+
+/* -------------------------------------------------------------------------
+ * Soup observer
+ *
+ * Levels only change in lineage_epoch(), so whether an id is tracked is
+ * fixed for the whole epoch and the COPY records do not depend on the
+ * order the workers run their pairs in.
+ * -------------------------------------------------------------------------*/
+static void on_pair(void *ctx, int tid, uint32_t i, uint32_t a, uint32_t b, const uint64_t *old_a,
+                    const uint64_t *old_b, const uint64_t *after) {
+    Lineage       *lg   = ctx;
+    LineageThread *t    = &lg->thr[tid];
+    const uint64_t *before[2] = { old_a, old_b };
+    const uint32_t  tape[2]   = { a, b };
+    const uint32_t  half      = lg->half_len;
+
+    for (int h = 0; h < 2; h++) {
+        const uint64_t *old     = before[h];
+        const uint64_t *now     = after + h * half;
+        const uint64_t *partner = before[h ^ 1];
+        uint32_t ids[BFFO_MAX_HALF_LEN], cells[BFFO_MAX_HALF_LEN];
+        int      nids = 0;
+
+        for (uint32_t j = 0; j < half; j++) {
+            uint32_t oid = BFFO_TOKEN_ID(old[j]), nid = BFFO_TOKEN_ID(now[j]);
+            if (oid == nid) continue;
+            replace_id(lg, t, oid, nid);
+
+            int lv = lg->level[nid];
+            if (lv < lg->track_lo || lv >= lg->track_hi) continue;
+            int k = 0;
+            while (k < nids && ids[k] != nid) k++;
+            if (k == nids) {
+                int seen = 0;
+                for (uint32_t m = 0; m < half && !seen; m++)
+                    seen = BFFO_TOKEN_ID(partner[m]) == nid;
+                if (!seen) continue;     /* copied within the tape */
+                ids[nids]     = nid;
+                cells[nids++] = 0;
+            }
+            cells[k]++;
+        }
+
+        for (int k = 0; k < nids; k++) {
+            if (push((void **)&t->recs, &t->nrecs, &t->cap, sizeof(LineageRecord)) < 0) break;
+            LineageRecord r = { 0, LINEAGE_COPY, (uint16_t)cells[k], ids[k], i, tape[h ^ 1], tape[h] };
+            t->recs[t->nrecs++] = r;
+        }
+    }
+}
+
+static void on_mutation(void *ctx, uint32_t cell, uint64_t old_token, uint64_t new_token, int epoch) {
+    Lineage *lg  = ctx;
+    uint32_t nid = BFFO_TOKEN_ID(new_token);
+    if (ensure_ids(lg, (size_t)nid + 1) < 0) {
+        perror("lineage");
+        exit(1);
+    }
+    replace_id(lg, &lg->thr[0], BFFO_TOKEN_ID(old_token), nid);
+    LineageRecord r = { (uint32_t)epoch, LINEAGE_BIRTH, 0, nid, cell, 0, 0 };
+    fwrite(&r, sizeof(r), 1, lg->f);
+    lg->nrecords[LINEAGE_BIRTH]++;
+}
+
+static SoupObserver observer = { on_pair, on_mutation, NULL };
+
+/* -------------------------------------------------------------------------
+ * Open / reopen
+ * -------------------------------------------------------------------------*/
+static int lineage_init(Lineage *lg) {
+    memset(lg, 0, sizeof(*lg));
+    lg->base_id  = (uint32_t)soup_cells(soup_shape);
+    lg->half_len = soup_shape.half_len;
+    lg->track_lo = 1;
+    while (threshold(lg->track_lo) < LINEAGE_TRACK_MIN) lg->track_lo++;
+    lg->track_hi = lg->track_lo;
+    while (threshold(lg->track_hi) < LINEAGE_TRACK_MAX) lg->track_hi++;
+    lg->thr = calloc(POOL_MAX_THREADS, sizeof(LineageThread));
+    if (!lg->thr || ensure_ids(lg, (size_t)next_token_id + 1) < 0) return -1;
+
+    for (uint32_t c = 0; c < lg->base_id; c++) {
+        uint32_t id = soup ? BFFO_TOKEN_ID(soup[c]) : handles_id(&soup_handles, BFFO_CTOKEN_HANDLE(soup32[c]));
+        atomic_fetch_add_explicit(&lg->count[id], 1, memory_order_relaxed);
+    }
+    return 0;
+}
+
+static void lineage_attach(Lineage *lg) {
+    observer.ctx  = lg;
+    soup_observer = &observer;
+}
+
+int lineage_open(Lineage *lg, const char *path) {
+    if (lineage_init(lg) < 0) return -1;
+    lg->f = fopen(path, "wb");
+    if (!lg->f) {
+        int err = errno;
+        lineage_close(lg);
+        errno = err;
+        return -1;
+    }
+
+    LineageHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "BFFLINE", 8);
+    h.version      = LINEAGE_VERSION;
+    h.record_bytes = sizeof(LineageRecord);
+    h.base_id      = lg->base_id;
+    h.track_min    = LINEAGE_TRACK_MIN;
+    h.track_max    = LINEAGE_TRACK_MAX;
+    h.half_len     = lg->half_len;
+    fwrite(&h, sizeof(h), 1, lg->f);
+    lineage_attach(lg);
+    return 0;
+}
+
+int lineage_reopen(Lineage *lg, const char *path, int epoch) {
+    if (lineage_init(lg) < 0) return -1;
+    lg->f = fopen(path, "r+b");
+    if (!lg->f) {
+        int err = errno;
+        lineage_close(lg);
+        errno = err;
+        return -1;
+    }
+
+    LineageHeader h;
+    struct stat   st;
+    if (fread(&h, sizeof(h), 1, lg->f) != 1 || memcmp(h.magic, "BFFLINE", 8) ||
+        h.version != LINEAGE_VERSION || h.record_bytes != sizeof(LineageRecord) ||
+        h.base_id != lg->base_id || (h.half_len ? h.half_len : BFFO_HALF_LEN) != lg->half_len ||
+        h.track_min != LINEAGE_TRACK_MIN || h.track_max != LINEAGE_TRACK_MAX || fstat(fileno(lg->f), &st) < 0) {
+        lineage_close(lg);
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Keep records up to epoch, taking each id's level from its LEVEL records */
+    uint64_t total = ((uint64_t)st.st_size - sizeof(h)) / sizeof(LineageRecord);
+    uint64_t keep  = 0;
+    LineageRecord buf[4096];
+    size_t n;
+    while (keep < total && (n = fread(buf, sizeof(LineageRecord), 4096, lg->f)) > 0) {
+        size_t k = 0;
+        while (k < n && buf[k].epoch <= (uint32_t)epoch) {
+            const LineageRecord *r = &buf[k++];
+            if (r->kind <= LINEAGE_COPY) lg->nrecords[r->kind]++;
+            if (r->kind == LINEAGE_LEVEL && r->id < lg->cap && r->n > lg->level[r->id])
+                lg->level[r->id] = (uint8_t)r->n;
+        }
+        keep += k;
+        if (k < n) break;
+    }
+
+    off_t end = (off_t)(sizeof(h) + keep * sizeof(LineageRecord));
+    if (ftruncate(fileno(lg->f), end) < 0 || fseeko(lg->f, end, SEEK_SET) < 0) {
+        lineage_close(lg);
+        return -1;
+    }
+    lineage_attach(lg);
+    return 0;
+}
+
+/* -------------------------------------------------------------------------
+ * Per-epoch records
+ * -------------------------------------------------------------------------*/
+static int cmp_level(const void *pa, const void *pb) {
+    const LineageRecord *a = pa, *b = pb;
+    if (a->id != b->id) return a->id < b->id ? -1 : 1;
+    return (a->n > b->n) - (a->n < b->n);
+}
+
+void lineage_epoch(Lineage *lg, int epoch) {
+    /* Ids that hit a threshold during the epoch and are still at or above it */
+    lg->nlevels = 0;
+    for (int t = 0; t < POOL_MAX_THREADS; t++) {
+        LineageThread *th = &lg->thr[t];
+        for (size_t g = 0; g < th->ngrown; g++) {
+            uint32_t id = th->grown[g];
+            uint32_t c  = atomic_load_explicit(&lg->count[id], memory_order_relaxed);
+            while (lg->level[id] + 1 < LINEAGE_LEVELS && c >= threshold(lg->level[id] + 1)) {
+                int lv = ++lg->level[id];
+                if (push((void **)&lg->levels, &lg->nlevels, &lg->lcap, sizeof(LineageRecord)) < 0) break;
+                LineageRecord r = { (uint32_t)epoch, LINEAGE_LEVEL, (uint16_t)lv, id, threshold(lv), c, 0 };
+                lg->levels[lg->nlevels++] = r;
+            }
+        }
+        th->ngrown = 0;
+    }
+    qsort(lg->levels, lg->nlevels, sizeof(LineageRecord), cmp_level);
+    fwrite(lg->levels, sizeof(LineageRecord), lg->nlevels, lg->f);
+    lg->nrecords[LINEAGE_LEVEL] += lg->nlevels;
+
+    /* Workers own contiguous pair ranges (pool_slice), so this is pair order */
+    for (int t = 0; t < POOL_MAX_THREADS; t++) {
+        LineageThread *th = &lg->thr[t];
+        for (size_t k = 0; k < th->nrecs; k++) th->recs[k].epoch = (uint32_t)epoch;
+        fwrite(th->recs, sizeof(LineageRecord), th->nrecs, lg->f);
+        lg->nrecords[LINEAGE_COPY] += th->nrecs;
+        th->nrecs = 0;
+    }
+}
+
+void lineage_flush(Lineage *lg) {
+    fflush(lg->f);
+}
+
+void lineage_close(Lineage *lg) {
+    if (soup_observer == &observer) soup_observer = NULL;
+    if (lg->f) fclose(lg->f);
+    if (lg->thr)
+        for (int t = 0; t < POOL_MAX_THREADS; t++) {
+            free(lg->thr[t].recs);
+            free(lg->thr[t].grown);
+        }
+    free(lg->thr);
+    free(lg->count);
+    free(lg->level);
+    free(lg->levels);
+    memset(lg, 0, sizeof(*lg));
+}
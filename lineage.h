@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Append-only lineage index (soup_orig --lineage FILE).
+ *
+ *   LineageHeader
+ *   LineageRecord[]   in the order written, so epoch never decreases
+ *
+ * Token ids below base_id are the initial soup: id i was born at epoch 0 in
+ * cell i (tape i / half_len) and has no record.  Every later id is born by
+ * mutation and gets a BIRTH record.  LEVEL records mark the epoch an id's copy count (cells
+ * holding it, after the epoch) first reached 4^(level + 1), and COPY
+ * records the pairs that copied cells of an id across tapes while it is
+ * tracked, i.e. its highest count so far is in [track_min, track_max) --
+ * the spread of a lineage from a few copies to a visible fraction of the
+ * soup, without the millions of copies that follow once it has won.
+ *
+ * Records are fixed-size, so the whole file is one structured array:
+ *   np.memmap(path, dtype=<fields below>, offset=sizeof(LineageHeader))
+ * and any id's history is a single vectorised filter on `id`.
+ */
+#define LINEAGE_VERSION    1
+#define LINEAGE_LEVELS     11         /* level 1..10: 16 .. 4^11 (4,194,304) copies */
+#define LINEAGE_TRACK_MIN  16
+#define LINEAGE_TRACK_MAX  4096
+
+enum { LINEAGE_BIRTH, LINEAGE_LEVEL, LINEAGE_COPY };
+
+typedef struct {
+    char     magic[8];            /* "BFFLINE" */
+    uint32_t version;
+    uint32_t record_bytes;
+    uint32_t base_id;             /* first mutation id (= cells in the soup) */
+    uint32_t track_min;
+    uint32_t track_max;
+    uint32_t half_len;            /* tokens per tape (0 in older files: 64) */
+} LineageHeader;
+
+typedef struct {
+    uint32_t epoch;
+    uint16_t kind;                /* LINEAGE_BIRTH, LINEAGE_LEVEL or LINEAGE_COPY */
+    uint16_t n;                   /* LEVEL: level; COPY: cells copied */
+    uint32_t id;
+    uint32_t a;                   /* BIRTH: cell; LEVEL: threshold; COPY: pair */
+    uint32_t b;                   /* LEVEL: count;  COPY: source tape */
+    uint32_t c;                   /*                COPY: destination tape */
+} LineageRecord;
+
+typedef struct {
+    LineageRecord *recs;          /* COPY records of this worker's pairs */
+    size_t         nrecs, cap;
+    uint32_t      *grown;         /* ids whose count hit their next threshold */
+    size_t         ngrown, gcap;
+} LineageThread;
+
+typedef struct {
+    FILE          *f;
+    uint32_t       base_id;
+    uint32_t       half_len;
+    int            track_lo;      /* tracked levels: [track_lo, track_hi) */
+    int            track_hi;
+    atomic_uint   *count;         /* cells holding each id */
+    uint8_t       *level;         /* thresholds reached so far, per id */
+    size_t         cap;           /* ids allocated */
+    LineageThread *thr;           /* POOL_MAX_THREADS */
+    LineageRecord *levels;        /* LEVEL records of the current epoch */
+    size_t         nlevels, lcap;
+    uint64_t       nrecords[3];   /* written, by kind */
+} Lineage;
+
+/*
+ * Create path and start observing the soup (soup_core.h's soup_observer),
+ * counting the ids in the current soup.  Returns 0, or -1 with errno set.
+ */
+int  lineage_open(Lineage *lg, const char *path);
+
+/*
+ * Reopen an index for a run resumed after epoch: records past it are
+ * dropped, counts come from the current soup and levels from the LEVEL
+ * records kept.  Returns 0, or -1 (errno set; EINVAL for a different format).
+ */
+int  lineage_reopen(Lineage *lg, const char *path, int epoch);
+
+/* After each epoch (mutation included): write its LEVEL and COPY records. */
+void lineage_epoch(Lineage *lg, int epoch);
+
+void lineage_flush(Lineage *lg);
+
+/* Stop observing, flush and free. */
+void lineage_close(Lineage *lg);
@@ -0,0 +1,146 @@
+#include "lz.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LZ_HASH_SIZE  (1u << LZ_HASH_BITS)
+#define LZ_PREV_MASK  0xFFFFu   /* prev[] is a ring over the last 64 KiB of positions */
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+size_t lz_bound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+/* Length continuation bytes: 255, 255, ..., remainder */
+static uint8_t *put_len(uint8_t *op, size_t len) {
+    while (len >= 255) { *op++ = 255; len -= 255; }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/* Emit one sequence; mlen == 0 marks the final, literal-only sequence. */
+static uint8_t *emit(uint8_t *op, const uint8_t *lit, size_t nlit, size_t off, size_t mlen) {
+    uint8_t *tok = op++;
+    uint8_t  t   = (uint8_t)((nlit >= 15 ? 15 : nlit) << 4);
+    if (nlit >= 15) op = put_len(op, nlit - 15);
+    memcpy(op, lit, nlit);
+    op += nlit;
+    if (mlen) {
+        size_t m = mlen - LZ_MIN_MATCH;
+        *op++ = (uint8_t)(off & 0xFF);
+        *op++ = (uint8_t)(off >> 8);
+        t |= (uint8_t)(m >= 15 ? 15 : m);
+        if (m >= 15) op = put_len(op, m - 15);
+    }
+    *tok = t;
+    return op;
+}
+
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst) {
+    LzTables *t = malloc(sizeof(*t));
+    if (!t) return (size_t)-1;
+    size_t comp = lz_compress_depth(src, n, dst, LZ_CHAIN_DEPTH, t);
+    free(t);
+    return comp;
+}
+
+size_t lz_compress_depth(const uint8_t *src, size_t n, uint8_t *dst, int depth, LzTables *t) {
+    int32_t *head = t->head;
+    int32_t *prev = t->prev;
+    memset(head, 0xFF, LZ_HASH_SIZE * sizeof(int32_t));   /* -1 = empty */
+
+    uint8_t *op     = dst;
+    size_t   ip     = 0;
+    size_t   anchor = 0;
+
+    if (n >= LZ_MIN_MATCH) {
+        size_t limit = n - LZ_MIN_MATCH;   /* last position with a full 4-byte read */
+        while (ip <= limit) {
+            uint32_t v = read32(src + ip);
+            uint32_t h = hash4(v);
+
+            /* Walk the hash chain for the longest match inside the window */
+            size_t  best_len = 0, best_off = 0;
+            int32_t cand     = head[h];
+            for (int d = 0; cand >= 0 && d < depth; d++) {
+                size_t off = ip - (size_t)cand;
+                if (off > LZ_WINDOW) break;
+                if (read32(src + cand) == v) {
+                    size_t l = LZ_MIN_MATCH;
+                    while (ip + l < n && src[cand + l] == src[ip + l]) l++;
+                    if (l > best_len) { best_len = l; best_off = off; }
+                }
+                cand = prev[cand & LZ_PREV_MASK];
+            }
+            prev[ip & LZ_PREV_MASK] = head[h];
+            head[h] = (int32_t)ip;
+
+            if (best_len < LZ_MIN_MATCH) { ip++; continue; }
+
+            op = emit(op, src + anchor, ip - anchor, best_off, best_len);
+
+            /* Index the positions covered by the match so later data can refer to them */
+            size_t end = ip + best_len;
+            for (size_t p = ip + 1; p < end && p <= limit; p++) {
+                h = hash4(read32(src + p));
+                prev[p & LZ_PREV_MASK] = head[h];
+                head[h] = (int32_t)p;
+            }
+            ip = anchor = end;
+        }
+    }
+    op = emit(op, src + anchor, n - anchor, 0, 0);
+    return (size_t)(op - dst);
+}
+
+/* Read a length continuation; returns 0 if it runs past the input. */
+static int get_len(const uint8_t **ip, const uint8_t *end, size_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= end) return 0;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 1;
+}
+
+size_t lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    const uint8_t *ip  = src;
+    const uint8_t *end = src + n;
+    size_t         o   = 0;
+
+    while (ip < end) {
+        uint8_t t    = *ip++;
+        size_t  nlit = t >> 4;
+        if (nlit == 15 && !get_len(&ip, end, &nlit)) return (size_t)-1;
+        if (nlit > (size_t)(end - ip) || nlit > cap - o) return (size_t)-1;
+        memcpy(dst + o, ip, nlit);
+        ip += nlit;
+        o  += nlit;
+        if (ip == end) break;   /* final, literal-only sequence */
+
+        if (end - ip < 2) return (size_t)-1;
+        size_t off  = (size_t)ip[0] | (size_t)ip[1] << 8;
+        size_t mlen = t & 15;
+        ip += 2;
+        if (mlen == 15 && !get_len(&ip, end, &mlen)) return (size_t)-1;
+        mlen += LZ_MIN_MATCH;
+        if (off == 0 || off > o || mlen > cap - o) return (size_t)-1;
+
+        /* Overlapping copies (off < mlen) replicate the last off bytes */
+        const uint8_t *m = dst + o - off;
+        if (off >= mlen) memcpy(dst + o, m, mlen);
+        else for (size_t i = 0; i < mlen; i++) dst[o + i] = m[i];
+        o += mlen;
+    }
+    return o;
+}
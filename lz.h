@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Small self-contained LZ77 byte codec (LZ4-style sequence layout).
+ *
+ * A compressed block is a series of sequences:
+ *   token      high nibble = literal count, low nibble = match length - LZ_MIN_MATCH
+ *              (15 in either nibble means "more length bytes follow")
+ *   [lit ext]  extra literal count bytes: 255, 255, ..., <255
+ *   literals
+ *   offset     2 bytes little-endian, 1..LZ_WINDOW   (absent in the final sequence)
+ *   [mlen ext] extra match length bytes, same scheme as literals
+ *
+ * The final sequence carries only literals.  Matches are found with hash
+ * chains of depth LZ_CHAIN_DEPTH, which trades a little speed for a ratio
+ * that tracks structure in the soup well enough to serve as a complexity
+ * estimate.
+ */
+#define LZ_MIN_MATCH      4
+#define LZ_WINDOW     65535
+#define LZ_HASH_BITS     16
+#define LZ_CHAIN_DEPTH    8
+
+/* Worst-case compressed size for n input bytes. */
+size_t lz_bound(size_t n);
+
+/* Match tables (512 KiB).  Callers that compress every epoch keep one per
+ * thread and pass it to lz_compress_depth instead of allocating each time. */
+typedef struct LzTables {
+    int32_t head[1u << LZ_HASH_BITS];
+    int32_t prev[LZ_WINDOW + 1];
+} LzTables;
+
+/*
+ * Compress n bytes of src into dst (which must hold lz_bound(n) bytes).
+ * Returns the compressed size, or (size_t)-1 if the match tables cannot be
+ * allocated.  Thread-safe.
+ */
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst);
+
+/* As lz_compress with the caller's tables, following at most depth
+ * hash-chain links per position (1 = fastest; LZ_CHAIN_DEPTH is what
+ * lz_compress uses).  Cannot fail. */
+size_t lz_compress_depth(const uint8_t *src, size_t n, uint8_t *dst, int depth, LzTables *t);
+
+/*
+ * Decompress n bytes of src into dst (capacity cap).  Returns the
+ * decompressed size, or (size_t)-1 if the input is malformed or would
+ * overrun dst.
+ */
+size_t lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap);
@@ -0,0 +1,72 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "metrics.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *const DTYPE[] = {
+    [METRICS_U8]  = "<u1",
+    [METRICS_U32] = "<u4",
+    [METRICS_U64] = "<u8",
+    [METRICS_F64] = "<f8",
+};
+
+int metrics_open(Metrics *m, const char *path, const MetricsCol *cols, int ncols, size_t row_bytes) {
+    char hdr[METRICS_HEADER_BYTES];
+    int  n = snprintf(hdr, sizeof(hdr), "BFFMETRICS %d\nrow_bytes %zu\ncolumns %d\n",
+                      METRICS_VERSION, row_bytes, ncols);
+    for (int c = 0; c < ncols && n < (int)sizeof(hdr); c++)
+        n += snprintf(hdr + n, sizeof(hdr) - (size_t)n, "%s %s %u %zu\n",
+                      cols[c].name, DTYPE[cols[c].type], cols[c].count, cols[c].offset);
+    if (n >= (int)sizeof(hdr)) return -1;
+    memset(hdr + n, '\n', sizeof(hdr) - (size_t)n);
+
+    m->f = fopen(path, "wb");
+    if (!m->f) return -1;
+    m->row_bytes = row_bytes;
+    fwrite(hdr, 1, sizeof(hdr), m->f);
+    return 0;
+}
+
+int metrics_reopen(Metrics *m, const char *path, size_t row_bytes, uint64_t *nrows) {
+    m->f = fopen(path, "r+b");
+    if (!m->f) return -1;
+
+    char   line[128];
+    size_t file_row_bytes = 0;
+    struct stat st;
+    if (!fgets(line, sizeof(line), m->f) || strncmp(line, "BFFMETRICS ", 11) ||
+        !fgets(line, sizeof(line), m->f) || sscanf(line, "row_bytes %zu", &file_row_bytes) != 1 ||
+        file_row_bytes != row_bytes || fstat(fileno(m->f), &st) < 0) {
+        metrics_close(m);
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint64_t have = st.st_size > METRICS_HEADER_BYTES
+                  ? ((uint64_t)st.st_size - METRICS_HEADER_BYTES) / row_bytes : 0;
+    if (have < *nrows) *nrows = have;
+    off_t end = (off_t)(METRICS_HEADER_BYTES + *nrows * row_bytes);
+    if (ftruncate(fileno(m->f), end) < 0 || fseeko(m->f, end, SEEK_SET) < 0) {
+        metrics_close(m);
+        return -1;
+    }
+    m->row_bytes = row_bytes;
+    return 0;
+}
+
+void metrics_append(Metrics *m, const void *row) {
+    fwrite(row, 1, m->row_bytes, m->f);
+}
+
+void metrics_flush(Metrics *m) {
+    fflush(m->f);
+}
+
+void metrics_close(Metrics *m) {
+    if (m->f) fclose(m->f);
+    m->f = NULL;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Append-only columnar metrics file: a self-describing text header padded to
+ * METRICS_HEADER_BYTES, followed by fixed-width binary rows.
+ *
+ * Header (ASCII, one item per line, then '\n' padding):
+ *   BFFMETRICS <version>
+ *   row_bytes <R>
+ *   columns <N>
+ *   <name> <numpy dtype> <count> <offset>     (N lines)
+ *
+ * A row is the raw bytes of a caller-defined struct, so column offsets are
+ * simply offsetof() into it and rows can be mapped in place with
+ *   np.memmap(path, dtype=<structured dtype from header>, offset=METRICS_HEADER_BYTES)
+ * Vector columns (count > 1) hold histograms and tapes.  Rows are written
+ * with one fwrite each; partial trailing rows from a crash are ignored by
+ * readers because they map floor((size - header) / row_bytes) rows.
+ */
+#define METRICS_VERSION       1
+#define METRICS_HEADER_BYTES  4096
+
+typedef enum {
+    METRICS_U8,
+    METRICS_U32,
+    METRICS_U64,
+    METRICS_F64,
+} MetricsType;
+
+typedef struct {
+    const char *name;
+    MetricsType type;
+    uint32_t    count;     /* elements; 1 for scalars */
+    size_t      offset;    /* byte offset within the row */
+} MetricsCol;
+
+/* Describe a field of row struct T as a column. */
+#define METRICS_COL(T, field, type, count) \
+    { #field, (type), (count), offsetof(T, field) }
+
+typedef struct {
+    FILE  *f;
+    size_t row_bytes;
+} Metrics;
+
+/* Create path and write the header.  Returns 0 on success, -1 (errno set) on failure. */
+int  metrics_open(Metrics *m, const char *path, const MetricsCol *cols, int ncols, size_t row_bytes);
+
+/*
+ * Reopen an existing file written with the same row_bytes for appending,
+ * dropping rows past the first *nrows (a run resumed from a checkpoint).
+ * On return *nrows is the number of rows kept, which is smaller if the file
+ * was shorter.  Returns 0, or -1 (errno set; EINVAL for a different layout).
+ */
+int  metrics_reopen(Metrics *m, const char *path, size_t row_bytes, uint64_t *nrows);
+
+/* Append one row of row_bytes bytes. */
+void metrics_append(Metrics *m, const void *row);
+
+void metrics_flush(Metrics *m);
+void metrics_close(Metrics *m);
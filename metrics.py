@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""
+Reader for the columnar binary metrics stream (./soup_orig --metrics FILE).
+
+The file is a text header padded to 4096 bytes followed by fixed-width rows
+(see metrics.h).  load_metrics() maps the rows in place with np.memmap; no
+parsing beyond the header is done.
+
+Usage:
+    python3 metrics.py <metrics.bin>            # header summary
+    python3 metrics.py <metrics.bin> --tsv      # stats TSV for rows with full == 1
+    python3 metrics.py <metrics.bin> --tsv-all  # scalar columns for every epoch
+
+From Python:
+    from metrics import load_metrics
+    m = load_metrics('run.bin')
+    m['mean_steps'], m['ops_hist'][:, 10], m[m['full'] == 1]['hoe']
+"""
+
+import sys
+import numpy as np
+
+HEADER_BYTES = 4096
+OPS = set(b'<>{}+-.,[]')
+
+
+def read_header(path):
+    with open(path, 'rb') as f:
+        hdr = f.read(HEADER_BYTES).decode('ascii').split('\n')
+    magic, version = hdr[0].split()
+    if magic != 'BFFMETRICS':
+        raise ValueError(f'{path}: not a metrics file')
+    row_bytes = int(hdr[1].split()[1])
+    ncols = int(hdr[2].split()[1])
+    cols = []
+    for line in hdr[3:3 + ncols]:
+        name, dtype, count, offset = line.split()
+        cols.append((name, dtype, int(count), int(offset)))
+    return int(version), row_bytes, cols
+
+
+def load_metrics(path):
+    """Return a read-only structured memmap with one record per epoch."""
+    _, row_bytes, cols = read_header(path)
+    dtype = np.dtype({
+        'names':   [c[0] for c in cols],
+        'formats': [c[1] if c[2] == 1 else (c[1], (c[2],)) for c in cols],
+        'offsets': [c[3] for c in cols],
+        'itemsize': row_bytes,
+    })
+    with open(path, 'rb') as f:
+        f.seek(0, 2)
+        nrows = (f.tell() - HEADER_BYTES) // row_bytes
+    if nrows <= 0:
+        return np.zeros(0, dtype=dtype)
+    return np.memmap(path, dtype=dtype, mode='r', offset=HEADER_BYTES, shape=(nrows,))
+
+
+def tape_str(chars):
+    return ''.join(chr(c) if c in OPS else ' ' for c in chars)
+
+
+def print_tsv(m):
+    """Same layout as the soup_orig stdout table."""
+    print('\t'.join(['epoch', 'mean_ops', 'median_ops', 'mean_steps', 'max_steps',
+                     'unique_ids', 'modal_id', 'representative_tape (modal_count)',
+                     'entropy', 'lz_bpb', 'hoe']))
+    for r in m[m['full'] == 1]:
+        print(f"{r['epoch']:<10d}\t{r['mean_ops']:<12.4f}\t{r['median_ops']:<12.1f}\t"
+              f"{r['mean_steps']:<12.1f}\t{r['max_steps']:<12d}\t{r['unique_ids']:<12d}\t"
+              f"{r['modal_id']:<10d}\t|{tape_str(r['rep_tape'])}| ({r['modal_count']})\t"
+              f"{r['entropy']:<8.4f}\t{r['lz_bpb']:<8.4f}\t{r['hoe']:.4f}")
+
+
+def print_scalars(m):
+    names = [n for n in m.dtype.names if m.dtype[n].shape == ()]
+    print('\t'.join(names))
+    for r in m:
+        print('\t'.join(str(r[n]) for n in names))
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+    path = sys.argv[1]
+    mode = sys.argv[2] if len(sys.argv) > 2 else ''
+    m = load_metrics(path)
+    if mode == '--tsv':
+        print_tsv(m)
+    elif mode == '--tsv-all':
+        print_scalars(m)
+    else:
+        version, row_bytes, cols = read_header(path)
+        print(f'{path}: version {version}, {len(m)} rows of {row_bytes} bytes, '
+              f'{int((m["full"] == 1).sum()) if len(m) else 0} full')
+        for name, dtype, count, offset in cols:
+            print(f'  {name:<12} {dtype} x{count:<3} @ {offset}')
+
+
+if __name__ == '__main__':
+    main()
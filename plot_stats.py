@@ -4,9 +4,11 @@ Plot soup stats TSV (output of ./soup_orig --stats N).
 
 Usage:
     python3 plot_stats.py <stats.tsv> [output.png]
+    python3 plot_stats.py <metrics.bin> [output.png]   (./soup_orig --metrics FILE)
 
 Columns (old): epoch  mean_ops  median_ops  unique_ids  modal_id  repr_tape (modal_count)
 Columns (new): epoch  mean_ops  median_ops  mean_steps  max_steps  unique_ids  modal_id  repr_tape (modal_count)
+               [entropy  lz_bpb  hoe]   (complexity columns, when present)
 """
 
 import sys
@@ -15,9 +17,24 @@ import numpy as np
 import matplotlib.pyplot as plt
 import matplotlib.ticker as ticker
 
+def parse_metrics(path):
+    """Same arrays as parse(), from the binary metrics stream.  Ops and step
+    columns are taken from every epoch; lineage/complexity from full rows."""
+    from metrics import load_metrics
+    m = load_metrics(path)
+    full = m['full'] == 1
+    nan = np.full(len(m), np.nan)
+    unique = np.where(full, m['unique_ids'], nan)
+    modal  = np.where(full, m['modal_count'], nan)
+    return (m['epoch'], m['mean_ops'], m['median_ops'],
+            np.where(m['epoch'] > 0, m['mean_steps'], np.nan), m['max_steps'],
+            unique, modal, m['hoe'])
+
 def parse(path):
-    epochs, mean_ops, median_ops, mean_steps, max_steps, unique_ids, modal_counts = \
-        [], [], [], [], [], [], []
+    if path.endswith('.bin'):
+        return parse_metrics(path)
+    epochs, mean_ops, median_ops, mean_steps, max_steps, unique_ids, modal_counts, hoe = \
+        [], [], [], [], [], [], [], []
     with open(path) as f:
         for line in f:
             line = line.strip()
@@ -41,21 +58,23 @@ def parse(path):
                 last = parts[5]
             m = re.search(r'\((\d+)\)\s*$', last)
             modal_counts.append(int(m.group(1)) if m else 0)
+            hoe.append(float(parts[10]) if len(parts) >= 11 else float('nan'))
     return (np.array(epochs), np.array(mean_ops), np.array(median_ops),
             np.array(mean_steps), np.array(max_steps),
-            np.array(unique_ids), np.array(modal_counts))
+            np.array(unique_ids, dtype=float), np.array(modal_counts, dtype=float), np.array(hoe))
 
 def main():
     if len(sys.argv) < 2:
         print(__doc__)
         sys.exit(1)
     path = sys.argv[1]
-    out  = sys.argv[2] if len(sys.argv) > 2 else re.sub(r'\.tsv$', '', path) + '_plot.png'
+    out  = sys.argv[2] if len(sys.argv) > 2 else re.sub(r'\.(tsv|bin)$', '', path) + '_plot.png'
 
-    ep, mean, med, msteps, xsteps, uniq, modal = parse(path)
+    ep, mean, med, msteps, xsteps, uniq, modal, hoe = parse(path)
     has_steps = not np.all(np.isnan(msteps))
+    has_hoe   = not np.all(np.isnan(hoe))
 
-    nrows = 4 if has_steps else 3
+    nrows = (4 if has_steps else 3) + (1 if has_hoe else 0)
     fig, axes = plt.subplots(nrows, 1, figsize=(10, 3.5 * nrows), sharex=True)
     fig.suptitle('BFF-orig primordial soup — stats over epochs', fontsize=13)
 
@@ -81,7 +100,8 @@ def main():
 
     # --- unique IDs ---
     ax = axes[2 if has_steps else 1]
-    ax.plot(ep, uniq, color='forestgreen')
+    ok = ~np.isnan(uniq)
+    ax.plot(ep[ok], uniq[ok], color='forestgreen')
     ax.set_ylabel('unique token IDs')
     ax.yaxis.set_major_formatter(ticker.FuncFormatter(
         lambda x, _: f'{x/1e6:.1f}M' if x >= 1e5 else f'{int(x):,}'))
@@ -89,12 +109,22 @@ def main():
 
     # --- modal lineage count ---
     ax = axes[3 if has_steps else 2]
-    ax.plot(ep, modal, color='crimson')
+    ok = ~np.isnan(modal)
+    ax.plot(ep[ok], modal[ok], color='crimson')
     ax.set_ylabel('modal lineage count')
-    ax.set_xlabel('epoch')
     ax.yaxis.set_major_formatter(ticker.FuncFormatter(lambda x, _: f'{int(x):,}'))
     ax.grid(True, alpha=0.3)
 
+    # --- high-order entropy (H0 - LZ bits/byte) ---
+    if has_hoe:
+        ax = axes[-1]
+        ok = ~np.isnan(hoe)
+        ax.plot(ep[ok], hoe[ok], color='purple')
+        ax.set_ylabel('high-order entropy (bits/byte)')
+        ax.grid(True, alpha=0.3)
+
+    axes[-1].set_xlabel('epoch')
+
     fig.tight_layout()
     fig.savefig(out, dpi=150)
     print(f'Saved to {out}')
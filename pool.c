@@ -0,0 +1,70 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "pool.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+static pthread_t         tids[POOL_MAX_THREADS];
+static int               tid_index[POOL_MAX_THREADS];
+static pthread_barrier_t barrier_start;
+static pthread_barrier_t barrier_end;
+static volatile int      pool_shutdown = 0;
+static int               g_nthreads    = 0;
+
+/* Current job, published by pool_run before the start barrier */
+static pool_fn job_fn  = NULL;
+static void   *job_ctx = NULL;
+
+static void *worker_thread(void *arg) {
+    int tid = *(int *)arg;
+
+    for (;;) {
+        pthread_barrier_wait(&barrier_start);
+        if (pool_shutdown) break;
+        job_fn(job_ctx, tid, g_nthreads);
+        pthread_barrier_wait(&barrier_end);
+    }
+    return NULL;
+}
+
+int pool_start(int nthreads) {
+    if (nthreads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (cpus > 1) ? (int)cpus : 1;
+    }
+    if (nthreads > POOL_MAX_THREADS) nthreads = POOL_MAX_THREADS;
+
+    g_nthreads    = nthreads;
+    pool_shutdown = 0;
+    pthread_barrier_init(&barrier_start, NULL, (unsigned)(nthreads + 1));
+    pthread_barrier_init(&barrier_end,   NULL, (unsigned)(nthreads + 1));
+
+    for (int t = 0; t < nthreads; t++) {
+        tid_index[t] = t;
+        pthread_create(&tids[t], NULL, worker_thread, &tid_index[t]);
+    }
+    return nthreads;
+}
+
+void pool_run(pool_fn fn, void *ctx) {
+    job_fn  = fn;
+    job_ctx = ctx;
+    pthread_barrier_wait(&barrier_start);  /* release workers */
+    pthread_barrier_wait(&barrier_end);    /* wait for completion */
+}
+
+int pool_threads(void) {
+    return g_nthreads;
+}
+
+void pool_stop(void) {
+    if (g_nthreads == 0) return;
+    pool_shutdown = 1;
+    pthread_barrier_wait(&barrier_start);
+    for (int t = 0; t < g_nthreads; t++)
+        pthread_join(tids[t], NULL);
+    pthread_barrier_destroy(&barrier_start);
+    pthread_barrier_destroy(&barrier_end);
+    g_nthreads = 0;
+}
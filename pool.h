@@ -0,0 +1,38 @@
+#pragma once
+
+/*
+ * Persistent worker pool driven by a pair of pthread barriers.
+ *
+ * pool_start() creates nthreads workers that park on a start barrier.
+ * pool_run() publishes a job, releases the workers and waits on the end
+ * barrier until every worker has returned from fn.  The calling thread does
+ * not execute the job itself; it only coordinates.
+ *
+ * There is one pool per process.  Jobs split work themselves using the
+ * (tid, nthreads) arguments, so a job's result must not depend on which
+ * thread runs which slice if it is to be thread-count independent.
+ */
+
+#define POOL_MAX_THREADS 256
+
+typedef void (*pool_fn)(void *ctx, int tid, int nthreads);
+
+/* Start nthreads workers (clamped to [1, POOL_MAX_THREADS]); <= 0 = all CPUs.
+ * Returns the number of workers actually started. */
+int  pool_start(int nthreads);
+
+/* Run fn(ctx, tid, nthreads) on every worker and wait for all to finish. */
+void pool_run(pool_fn fn, void *ctx);
+
+/* Number of running workers (0 before pool_start). */
+int  pool_threads(void);
+
+/* Release and join all workers. */
+void pool_stop(void);
+
+/* Half-open slice [*lo, *hi) of n items owned by worker tid (last one takes the remainder). */
+static inline void pool_slice(unsigned n, int tid, int nthreads, unsigned *lo, unsigned *hi) {
+    unsigned chunk = n / (unsigned)nthreads;
+    *lo = (unsigned)tid * chunk;
+    *hi = (tid == nthreads - 1) ? n : *lo + chunk;
+}
@@ -1,7 +1,10 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "bff.h"
+#include "bgwrite.h"
+#include "trace.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -73,16 +76,22 @@ static void shuffle_perm(void) {
 static void mutate_soup(double rate, int epoch) {
     if (rate <= 0.0) return;
 
-    /* Sample k ~ Poisson(lambda) via Knuth's algorithm */
-    double lambda = SOUP_TOTAL_BYTES * rate;
-    double L = exp(-lambda);
+    /* Sample k ~ Poisson(lambda) via Knuth's algorithm.  exp(-lambda)
+     * underflows past lambda ~ 745, so p is instead scaled up by exp(lambda)
+     * in steps of at most 500 and compared against 1. */
+    double left = SOUP_TOTAL_BYTES * rate;
     double p = 1.0;
     uint32_t k = 0;
     do {
         k++;
         /* uniform in (0,1]: top 53 bits of RNG output */
         p *= (double)(xorshift64(&global_rng) >> 11) * (1.0 / (double)(1ULL << 53));
-    } while (p > L);
+        while (p < 1.0 && left > 0.0) {
+            double d = left > 500.0 ? 500.0 : left;
+            p *= exp(d);
+            left -= d;
+        }
+    } while (p > 1.0);
     k--;
 
     /* Apply k mutations at uniformly random positions */
@@ -137,37 +146,43 @@ static void *worker_thread(void *arg) {
 }
 
 /* -------------------------------------------------------------------------
- * Trace: save epoch snapshots to disk for post-hoc analysis.
+ * Trace: per-epoch soup history for post-hoc analysis (soup_analyze.py).
  *
- * Each epoch E writes:
- *   epochE_soup.bin  — SOUP_SIZE × BFF_HALF_LEN uint64 (row-major, 64 MB)
- *   epochE_perm.bin  — SOUP_SIZE uint32 (pair i = perm[i] paired with perm[i+NPAIRS])
- *   epochE_steps.bin — NPAIRS uint32 (bff_run step count per pair)
- * Epoch 0 only has epochE_soup.bin (initial state, no pairs yet).
+ * Written through trace.c as keyframes plus XOR/run-length deltas, LZ
+ * compressed, with a chunk index (see trace.h).  Instead of perm, each chunk
+ * records global_rng as it was before shuffle_perm(), from which the reader
+ * regenerates the pairing.  Epoch 0 is the initial soup (no pairs yet).
  * -------------------------------------------------------------------------*/
-static void save_trace_epoch(const char *dir, int epoch, int with_pairs) {
-    char path[512];
-    FILE *f;
-
-    snprintf(path, sizeof(path), "%s/epoch%d_soup.bin", dir, epoch);
-    f = fopen(path, "wb");
-    if (!f) { perror(path); return; }
-    fwrite(soup, sizeof(uint64_t), (size_t)SOUP_SIZE * BFF_HALF_LEN, f);
-    fclose(f);
-
-    if (!with_pairs) return;
-
-    snprintf(path, sizeof(path), "%s/epoch%d_perm.bin", dir, epoch);
-    f = fopen(path, "wb");
-    if (!f) { perror(path); return; }
-    fwrite(perm, sizeof(uint32_t), SOUP_SIZE, f);
-    fclose(f);
-
-    snprintf(path, sizeof(path), "%s/epoch%d_steps.bin", dir, epoch);
-    f = fopen(path, "wb");
-    if (!f) { perror(path); return; }
-    fwrite(pair_steps, sizeof(uint32_t), NPAIRS, f);
-    fclose(f);
+static TraceWriter trace;
+
+/*
+ * Trace chunks are encoded and written on a background thread (bgwrite.c)
+ * from a copy of the soup, so the workers only wait for the snapshot memcpy.
+ */
+typedef struct {
+    TraceEpoch ep;
+    uint32_t   steps[NPAIRS];
+    uint64_t   cells[SOUP_SIZE][BFF_HALF_LEN];
+} TraceSnapshot;
+
+static BgWriter trace_bg;
+
+static void trace_job(void *ctx, void *buf, size_t len, int epoch) {
+    (void)ctx; (void)len;
+    const TraceSnapshot *snap = buf;
+    size_t bytes = trace_write(&trace, &snap->ep, &snap->cells[0][0]);
+    if (bytes) fprintf(stderr, "Trace: saved epoch %d (%zu bytes)\n", epoch, bytes);
+    else       fprintf(stderr, "Trace: epoch %d not saved: %s\n", epoch, strerror(errno));
+}
+
+static void trace_epoch(int epoch, uint64_t rng_state) {
+    TraceSnapshot *snap = bgw_acquire(&trace_bg);
+    TraceEpoch ep = { epoch, rng_state, global_rng, next_token_id,
+                      epoch ? NPAIRS : 0, epoch ? snap->steps : NULL, NULL };
+    snap->ep = ep;
+    memcpy(snap->steps, pair_steps, sizeof(pair_steps));
+    memcpy(snap->cells, soup, sizeof(soup));
+    bgw_submit(&trace_bg, sizeof(*snap), epoch);
 }
 
 /* -------------------------------------------------------------------------
@@ -282,6 +297,8 @@ int main(int argc, char *argv[]) {
     double   mutation_rate  = 0.0;
     const char *runlog_path = NULL;
     const char *trace_dir   = NULL;
+    int      keyframe_every = 100;
+    int      trace_buffers  = 2;
 
     for (int i = 1; i < argc - 1; i++) {
         if      (!strcmp(argv[i], "--epochs"))    epochs         = atoi(argv[++i]);
@@ -291,6 +308,8 @@ int main(int argc, char *argv[]) {
         else if (!strcmp(argv[i], "--mutation"))  mutation_rate  = strtod(argv[++i], NULL);
         else if (!strcmp(argv[i], "--runlog"))    runlog_path    = argv[++i];
         else if (!strcmp(argv[i], "--trace-dir")) trace_dir      = argv[++i];
+        else if (!strcmp(argv[i], "--keyframe"))  keyframe_every = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--trace-buffers")) trace_buffers = atoi(argv[++i]);
         else { fprintf(stderr, "Unknown argument: %s\n", argv[i]); return 1; }
     }
 
@@ -321,13 +340,23 @@ int main(int argc, char *argv[]) {
         FILE *mf = fopen(path, "w");
         if (mf) {
             fprintf(mf, "soup_size=%d\nhalf_len=%d\nnpairs=%d\n"
-                        "seed=%llu\nepochs=%d\nmutation_rate=%g\n",
+                        "seed=%llu\nepochs=%d\nmutation_rate=%g\n"
+                        "trace_format=delta%d\nkeyframe_interval=%d\n",
                     SOUP_SIZE, BFF_HALF_LEN, NPAIRS,
-                    (unsigned long long)global_rng, epochs, mutation_rate);
+                    (unsigned long long)global_rng, epochs, mutation_rate,
+                    TRACE_VERSION, keyframe_every);
             fclose(mf);
         }
-        save_trace_epoch(trace_dir, 0, 0);
-        fprintf(stderr, "Trace: saved epoch 0 soup → %s\n", trace_dir);
+        if (trace_open(&trace, trace_dir, (size_t)SOUP_SIZE * BFF_HALF_LEN, NPAIRS, keyframe_every) < 0) {
+            perror(trace_dir);
+            return 1;
+        }
+        if (bgw_start(&trace_bg, trace_buffers, sizeof(TraceSnapshot), trace_job, NULL) < 0) {
+            perror("trace writer");
+            return 1;
+        }
+        fprintf(stderr, "Trace: %s, %d snapshot buffers\n", trace_dir, trace_bg.nslots);
+        trace_epoch(0, 0);
     }
 
     /* Set up thread pool */
@@ -366,14 +395,13 @@ int main(int argc, char *argv[]) {
     fflush(stdout);
 
     for (int epoch = 1; epoch <= epochs; epoch++) {
+        uint64_t shuffle_rng = global_rng;
         soup_epoch();
         mutate_soup(mutation_rate, epoch);
         if (runlog)
             fwrite(pair_steps, sizeof(uint32_t), NPAIRS, runlog);
-        if (trace_dir) {
-            save_trace_epoch(trace_dir, epoch, 1);
-            fprintf(stderr, "Trace: saved epoch %d\n", epoch);
-        }
+        if (trace_dir)
+            trace_epoch(epoch, shuffle_rng);
         if (epoch % stats_interval == 0) {
             soup_stats(&mean, &median, &unique, &modal_id, &modal_count, rep_str);
             printf("%-10d\t%-12.4f\t%-12.1f\t%-12u\t%-10u\t|%s| (%u)\n",
@@ -383,6 +411,14 @@ int main(int argc, char *argv[]) {
     }
 
     if (runlog) fclose(runlog);
+    if (trace_dir) {
+        uint64_t stalls = trace_bg.stalls;
+        bgw_stop(&trace_bg);
+        fprintf(stderr, "Trace: writer stalled the simulation %llu times\n", (unsigned long long)stalls);
+        fprintf(stderr, "Trace: %d epochs in %.1f MB (%.0fx smaller than raw snapshots)\n",
+                trace.nchunks, trace.offset / 1e6, (double)trace.raw_total / (double)trace.offset);
+        trace_close(&trace);
+    }
 
     /* Shut down thread pool */
     pool_shutdown = 1;
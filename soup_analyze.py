@@ -1,7 +1,8 @@
 #!/usr/bin/env python3
 """Interactive analysis of BFF soup trace data.
 
-Loads binary snapshots written by soup --trace-dir and lets you explore
+Loads the trace written by soup --trace-dir (trace.idx/trace.bin, or the
+older per-epoch epochE_*.bin snapshots) and lets you explore
 the soup evolution epoch by epoch: inspect tapes, find dominant lineages,
 trace ancestry through pair interactions, and step through BFF execution.
 
@@ -12,13 +13,14 @@ Usage:
 Commands (in REPL):
   help                  Show this help
   epochs                List available epochs in trace
-  stats [E]             Per-epoch stats for epoch E (or all)
+  stats [E]             Stats for epoch E, or a table over all epochs
   tape N [E]            Show tape N at epoch E (default: last)
   top E [K]             Top K pairs by step count in epoch E (default 10)
   pair N E              Show pair containing tape N in epoch E + before/after
   lineage [E]           Dominant token ID analysis at epoch E
-  trace                 Trace dominant lineage back to origin epoch
+  trace [ID]            Trace dominant lineage (or token ID) back to origin epoch
   bff N E               Step-by-step BFF run of tape N's epoch-E interaction
+  rerun E [K]           Re-execute all of epoch E's pairs (libbff.so) and check the trace
   search PAT [E]        Find tapes matching instruction pattern at epoch E
   quit / exit           Exit
 """
@@ -26,7 +28,10 @@ Commands (in REPL):
 import sys
 import os
 import struct
+import subprocess
 import argparse
+import time
+import ctypes
 import readline
 from collections import Counter
 
@@ -44,6 +49,13 @@ BFF_IP_START   = 2
 BFF_MAX_STEPS  = 16384
 BFF_STACK_DEPTH = 64
 BFF_OPS        = set(b'<>+-,[]')
+DATA_CH        = '.'            # tape_str placeholder for non-instruction bytes
+
+# soup_orig's 10-instruction interpreter (bff_orig.c); selected by
+# interpreter=bff_orig in metadata.txt.  Heads are random per pair and are
+# recorded in the trace instead of living in tape[0..1].
+BFFO_MAX_STEPS = 8192
+BFFO_OPS       = set(b'<>{}+-.,[]')
 
 # ── Global config (overridden by metadata.txt) ─────────────────────────────────
 CFG = dict(soup_size=131072, half_len=64, npairs=65536)
@@ -52,8 +64,10 @@ CFG = dict(soup_size=131072, half_len=64, npairs=65536)
 _soup_cache  = {}   # epoch -> np.ndarray (SOUP_SIZE, HALF_LEN) uint64
 _perm_cache  = {}   # epoch -> np.ndarray SOUP_SIZE uint32
 _steps_cache = {}   # epoch -> np.ndarray NPAIRS uint32
+_heads_cache = {}   # epoch -> np.ndarray (2, NPAIRS) uint8: head0, head1 per pair
 
 TRACE_DIR = None
+LINEAGE_PATH = None     # soup_orig --lineage index (default <trace-dir>/lineage.bin)
 
 
 # ── Loading ────────────────────────────────────────────────────────────────────
@@ -74,13 +88,311 @@ def load_metadata(trace_dir):
                         CFG[k] = float(v)
                     except ValueError:
                         CFG[k] = v
+    # The soup's shape comes from the trace header, as soup_replay takes it
+    _, hdr = _read_trace_index(trace_dir)
+    if hdr is not None and hdr[4]:
+        CFG['npairs'] = hdr[4]
+        CFG['soup_size'] = 2 * hdr[4]
+        CFG['half_len'] = hdr[3] // CFG['soup_size']
+    if CFG.get('interpreter') == 'bff_orig':
+        global BFF_OPS, DATA_CH
+        BFF_OPS = BFFO_OPS
+        DATA_CH = ' '
 
 
 def _bin_path(epoch, kind):
     return os.path.join(TRACE_DIR, f"epoch{epoch}_{kind}.bin")
 
 
+# ── Delta-compressed trace (trace.idx + trace.bin, see trace.h) ─────────────────
+#
+# Each chunk is an LZ block holding the shuffle RNG state, the pair step counts
+# and the soup, either as a keyframe or as XOR/run-length changes against the
+# previous chunk.  load_soup(E) decodes the nearest keyframe <= E (or starts
+# from a cached epoch in between) and applies deltas forward.
+#
+# A sparse trace (soup_orig --trace-sparse) holds keyframes only.  The first
+# time an epoch between two keyframes is needed, soup_replay recomputes that
+# whole block into <trace-dir>/replay/K as a dense trace, whose chunks are
+# then merged into the index; delta chains never cross directories.
+# A triggered trace (soup_orig --trigger) is read the same way: it holds
+# dense windows plus the keyframe each window's history is replayed from.
+
+TRACE_KEYFRAME = 0
+TRACE_DELTA    = 1
+SOUP_CACHE_MAX = 8      # decoded soups kept in memory (64 MB each)
+
+REPLAY_BIN = os.path.join(os.path.dirname(os.path.abspath(__file__)), "soup_replay")
+QUERY_BIN  = os.path.join(os.path.dirname(os.path.abspath(__file__)), "soup_query")
+
+_trace_index = None     # epoch -> (dir, kind, offset, comp_bytes, raw_bytes)
+_chunk_cache = {}       # epoch -> (kind, rng_state, steps, heads, payload, soup offset)
+
+
+def _read_trace_index(d):
+    """{epoch: (d, kind, offset, comp_bytes, raw_bytes)} of d/trace.idx, and its header."""
+    entries = {}
+    path = os.path.join(d, "trace.idx")
+    if not os.path.exists(path):
+        return entries, None
+    with open(path, 'rb') as f:
+        hdr = struct.unpack('<8sIIQII', f.read(32))
+        if hdr[0] != b'BFFTRACE':
+            print(f"  {path}: not a trace index", file=sys.stderr)
+            return entries, None
+        while True:
+            e = f.read(32)
+            if len(e) < 32:
+                break
+            epoch, kind, off, comp, raw = struct.unpack('<IIQQQ', e)
+            entries[epoch] = (d, kind, off, comp, raw)
+    return entries, hdr
+
+
+def _load_trace_index():
+    global _trace_index
+    if _trace_index is not None:
+        return _trace_index
+    _trace_index, hdr = _read_trace_index(TRACE_DIR)
+    if hdr is None:
+        return _trace_index
+    CFG['trace_version'] = hdr[1]
+    CFG['keyframe_interval'] = hdr[2]
+    # Blocks replayed by earlier sessions
+    replay_root = os.path.join(TRACE_DIR, "replay")
+    if os.path.isdir(replay_root):
+        for name in sorted(os.listdir(replay_root)):
+            entries, _ = _read_trace_index(os.path.join(replay_root, name))
+            for e, v in entries.items():
+                _trace_index.setdefault(e, v)
+    return _trace_index
+
+
+def _ensure_epoch(epoch):
+    """Make epoch available, replaying its keyframe block of a sparse trace if needed."""
+    index = _load_trace_index()
+    if epoch in index or CFG.get('trace_mode') not in ('sparse', 'triggered'):
+        return epoch in index
+    if not index or not 0 < epoch <= CFG.get('epochs', 0):
+        return False
+    key = max((e for e in index if e < epoch), default=None)
+    if key is None:
+        return False
+    later = [e for e in index if e > epoch]
+    end = min(key + CFG['keyframe_interval'] - 1, CFG['epochs'], min(later, default=epoch) - 1)
+    end = max(end, epoch)
+    out = os.path.join(TRACE_DIR, "replay", str(key))
+    if not os.path.exists(REPLAY_BIN):
+        print(f"  Epoch {epoch} is not stored and {REPLAY_BIN} is not built (make soup_replay)")
+        return False
+    os.makedirs(os.path.dirname(out), exist_ok=True)
+    print(f"  Replaying epochs {key + 1}..{end} from keyframe {key} ...", flush=True)
+    res = subprocess.run([REPLAY_BIN, TRACE_DIR, '--from', str(key + 1), '--to', str(end),
+                          '--out', out], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    if res.returncode != 0:
+        print(f"  soup_replay failed: {res.stderr.strip()}")
+        return False
+    entries, _ = _read_trace_index(out)
+    for e, v in entries.items():
+        index.setdefault(e, v)
+    return epoch in index
+
+
+# ── Native queries (soup_query) ───────────────────────────────────────────────
+#
+# Whole-soup scans (stats, search, top pairs, id histories) over many epochs
+# run in soup_query, which decodes each chunk once and spreads the epochs
+# over threads.  It reads the trace directory's own chunks only, so epochs
+# replayed from a sparse trace, or a missing binary, fall back to numpy.
+
+QUERY_STR_COLS = {'str', 'a_before', 'a_after', 'b_before', 'b_after', 'modal_epochs'}
+
+
+def run_query(args, epochs):
+    """soup_query rows (dicts) for epochs, or None if it cannot answer for all of them."""
+    if not epochs or not os.path.exists(QUERY_BIN):
+        return None
+    own = {e for e, v in _load_trace_index().items() if v[0] == TRACE_DIR}
+    wanted = set(epochs)
+    if not wanted <= own:
+        return None
+    res = subprocess.run([QUERY_BIN, TRACE_DIR, '--from', str(min(wanted)), '--to', str(max(wanted)),
+                          *map(str, args)], stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    if res.returncode != 0:
+        print(f"  soup_query failed: {res.stderr.strip()}")
+        return None
+    lines = res.stdout.split('\n')
+    cols  = lines[0].split('\t')
+    rows  = []
+    for line in lines[1:]:
+        if not line:
+            continue
+        r = dict(zip(cols, line.split('\t')))
+        for k, v in r.items():
+            if k not in QUERY_STR_COLS:
+                r[k] = None if v == '' else float(v) if '.' in v else int(v)
+        if r['epoch'] in wanted:
+            rows.append(r)
+    return rows
+
+
+def _load_liblz():
+    """lz.c built as a shared library (make liblz.so), or None."""
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "liblz.so")
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+    lib.lz_decompress.restype  = ctypes.c_size_t
+    lib.lz_decompress.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_char_p, ctypes.c_size_t]
+    return lib
+
+_liblz = _load_liblz()
+
+
+def lz_decompress(src, raw_size):
+    """Decoder for lz.c blocks (LZ4-style sequences); native when liblz.so is built."""
+    if _liblz is not None:
+        out = bytearray(raw_size)
+        buf = (ctypes.c_char * raw_size).from_buffer(out)
+        n = _liblz.lz_decompress(src, len(src), buf, raw_size)
+        if n != raw_size:
+            raise ValueError("corrupt trace chunk")
+        return out
+    out = bytearray(raw_size)
+    ip, o, n = 0, 0, len(src)
+    while ip < n:
+        t = src[ip]; ip += 1
+        nlit = t >> 4
+        if nlit == 15:
+            while True:
+                b = src[ip]; ip += 1
+                nlit += b
+                if b != 255:
+                    break
+        out[o:o + nlit] = src[ip:ip + nlit]
+        ip += nlit; o += nlit
+        if ip >= n:
+            break
+        off = src[ip] | (src[ip + 1] << 8); ip += 2
+        mlen = t & 15
+        if mlen == 15:
+            while True:
+                b = src[ip]; ip += 1
+                mlen += b
+                if b != 255:
+                    break
+        mlen += 4
+        if off >= mlen:
+            out[o:o + mlen] = out[o - off:o - off + mlen]
+        else:
+            pat = bytes(out[o - off:o])
+            out[o:o + mlen] = (pat * (mlen // off + 1))[:mlen]
+        o += mlen
+    return out
+
+
+def _planes(buf, pos, count, width):
+    """Read count little-endian values stored as width byte planes."""
+    a = np.frombuffer(buf, dtype=np.uint8, count=count * width, offset=pos)
+    vals = np.ascontiguousarray(a.reshape(width, count).T).view(f'<u{width}').reshape(count)
+    return vals, pos + count * width
+
+
+def _read_chunk(epoch):
+    """(kind, rng_state, steps, heads, payload, soup section offset) of a chunk."""
+    if epoch not in _chunk_cache:
+        d, kind, off, comp, raw = _load_trace_index()[epoch]
+        with open(os.path.join(d, "trace.bin"), 'rb') as f:
+            f.seek(off)
+            buf = lz_decompress(f.read(comp), raw)
+        # v3 adds rng_after and next_id after rng_state
+        hdr = 28 if CFG.get('trace_version', 1) >= 3 else 12
+        (rng_state,) = struct.unpack_from('<Q', buf, 0)
+        (nsteps,) = struct.unpack_from('<I', buf, hdr - 4)
+        steps, pos = _planes(buf, hdr, nsteps, 4)
+        heads = None
+        if CFG.get('trace_version', 1) >= 2:
+            (nheads,) = struct.unpack_from('<I', buf, pos)
+            if nheads:
+                heads = np.frombuffer(buf, dtype=np.uint8, count=2 * nheads, offset=pos + 4)
+                heads = heads.reshape(2, nheads)
+            pos += 4 + 2 * nheads
+        if len(_chunk_cache) >= SOUP_CACHE_MAX:
+            _chunk_cache.pop(next(iter(_chunk_cache)))
+        _chunk_cache[epoch] = (kind, rng_state, steps if nsteps else None, heads, buf, pos)
+    return _chunk_cache[epoch]
+
+
+def _apply_chunk(soup, epoch):
+    """Return the soup after epoch, given the soup after the previous chunk."""
+    kind, _, _, _, buf, pos = _read_chunk(epoch)
+    ncells = CFG['soup_size'] * CFG['half_len']
+    if kind == TRACE_KEYFRAME:
+        cells, _ = _planes(buf, pos, ncells, 8)
+        return cells.reshape(CFG['soup_size'], CFG['half_len'])
+    (nruns,) = struct.unpack_from('<I', buf, pos)
+    skip, pos = _planes(buf, pos + 4, nruns, 4)
+    lens, pos = _planes(buf, pos, nruns, 4)
+    nchanged = int(lens.sum(dtype=np.int64))
+    xor, _    = _planes(buf, pos, nchanged, 8)
+    # Run r starts skip[r] cells after the end of run r-1
+    ends   = np.cumsum(skip.astype(np.int64) + lens)
+    starts = ends - lens
+    first  = np.cumsum(lens, dtype=np.int64) - lens       # index of each run's first value
+    idx    = np.arange(nchanged, dtype=np.int64) + np.repeat(starts - first, lens)
+    flat   = soup.reshape(-1).copy()
+    flat[idx] ^= xor
+    return flat.reshape(CFG['soup_size'], CFG['half_len'])
+
+
+def _rebuild_soup(epoch):
+    if not _ensure_epoch(epoch):
+        return None
+    index = _load_trace_index()
+    d = index[epoch][0]
+    written = sorted(e for e in index if e <= epoch and index[e][0] == d)
+    # Start from the latest keyframe, or a later cached epoch on the same path
+    start = max(e for e in written if index[e][1] == TRACE_KEYFRAME)
+    cached = [e for e in written if e >= start and e in _soup_cache]
+    soup = None
+    if cached:
+        start = max(cached)
+        soup = _soup_cache[start]
+    else:
+        soup = _apply_chunk(None, start)
+    for e in written:
+        if e > start:
+            soup = _apply_chunk(soup, e)
+    return soup
+
+
+def _trace_perm(rng_state):
+    """Regenerate soup.c's shuffle_perm() from the recorded RNG state."""
+    ss = CFG['soup_size']
+    perm = list(range(ss))
+    s = rng_state
+    M = 0xFFFFFFFFFFFFFFFF
+    for i in range(ss - 1, 0, -1):
+        s ^= (s << 13) & M
+        s ^= s >> 7
+        s ^= (s << 17) & M
+        j = s % (i + 1)
+        perm[i], perm[j] = perm[j], perm[i]
+    return np.array(perm, dtype=np.uint32) if HAS_NUMPY else perm
+
+
 def available_epochs():
+    if _load_trace_index():
+        if CFG.get('trace_mode') == 'sparse':
+            return list(range(CFG['epochs'] + 1))
+        epochs = set(_trace_index)
+        if CFG.get('trace_mode') == 'triggered':
+            # Each event's window, from its replay base
+            for ev in load_triggers():
+                start = ev['base_epoch'] if ev['base_epoch'] >= 0 else ev['epoch']
+                epochs.update(range(start, min(ev['dense_until'], CFG['epochs']) + 1))
+        return sorted(epochs)
     epochs = []
     for fn in os.listdir(TRACE_DIR):
         if fn.startswith("epoch") and fn.endswith("_soup.bin"):
@@ -91,8 +403,36 @@ def available_epochs():
     return sorted(epochs)
 
 
+def load_triggers():
+    """Events of a triggered trace (triggers.tsv) as dicts, in epoch order."""
+    path = os.path.join(TRACE_DIR, "triggers.tsv")
+    if not os.path.exists(path):
+        return []
+    with open(path) as f:
+        cols = f.readline().split()
+        rows = [dict(zip(cols, line.split())) for line in f if line.strip()]
+    for r in rows:
+        for k in ('epoch', 'base_epoch', 'dense_until'):
+            r[k] = int(r[k])
+        for k in ('value', 'baseline'):
+            r[k] = float(r[k])
+    return rows
+
+
 def load_soup(epoch):
     if epoch not in _soup_cache:
+        if _load_trace_index():
+            if not HAS_NUMPY:
+                print("  numpy is required to read trace.bin")
+                return None
+            soup = _rebuild_soup(epoch)
+            if soup is None:
+                print(f"  No soup snapshot for epoch {epoch}")
+                return None
+            if len(_soup_cache) >= SOUP_CACHE_MAX:
+                _soup_cache.pop(next(iter(_soup_cache)))
+            _soup_cache[epoch] = soup
+            return soup
         path = _bin_path(epoch, "soup")
         if not os.path.exists(path):
             print(f"  No soup snapshot for epoch {epoch}")
@@ -111,6 +451,12 @@ def load_soup(epoch):
 
 def load_perm(epoch):
     if epoch not in _perm_cache:
+        index = _load_trace_index()
+        if index:
+            if not HAS_NUMPY or not _ensure_epoch(epoch) or _read_chunk(epoch)[2] is None:
+                return None
+            _perm_cache[epoch] = _trace_perm(_read_chunk(epoch)[1])
+            return _perm_cache[epoch]
         path = _bin_path(epoch, "perm")
         if not os.path.exists(path):
             return None
@@ -125,6 +471,12 @@ def load_perm(epoch):
 
 def load_steps(epoch):
     if epoch not in _steps_cache:
+        index = _load_trace_index()
+        if index:
+            if not HAS_NUMPY or not _ensure_epoch(epoch):
+                return None
+            _steps_cache[epoch] = _read_chunk(epoch)[2]
+            return _steps_cache[epoch]
         path = _bin_path(epoch, "steps")
         if not os.path.exists(path):
             return None
@@ -137,6 +489,16 @@ def load_steps(epoch):
     return _steps_cache[epoch]
 
 
+def load_heads(epoch):
+    """Start heads per pair, shape (2, NPAIRS), or None if not recorded."""
+    if epoch not in _heads_cache:
+        index = _load_trace_index()
+        if not index or not HAS_NUMPY or not _ensure_epoch(epoch):
+            return None
+        _heads_cache[epoch] = _read_chunk(epoch)[3]
+    return _heads_cache[epoch]
+
+
 # ── Token field extraction ─────────────────────────────────────────────────────
 
 def tok_char(t):
@@ -152,14 +514,14 @@ def is_op(ch):
     return ch in BFF_OPS
 
 def tape_str(half_tape, mark_ops=True):
-    """Format a HALF_LEN token array as a string (op char or '.' for data)."""
+    """Format a HALF_LEN token array as a string (op char, DATA_CH for data)."""
     chars = []
     for t in half_tape:
         ch = tok_char(t)
         if mark_ops and ch in BFF_OPS:
             chars.append(chr(ch))
         else:
-            chars.append('.')
+            chars.append(DATA_CH)
     return ''.join(chars)
 
 def tape_str_full(half_tape):
@@ -179,18 +541,33 @@ def count_ops(half_tape):
 
 # ── Stats ──────────────────────────────────────────────────────────────────────
 
+def _query_stats(row):
+    dist = {}
+    if row['modal_epochs']:
+        dist = {int(k): int(v) for k, v in (x.split(':') for x in row['modal_epochs'].split(','))}
+    return dict(epoch=row['epoch'], mean_ops=row['mean_ops'], median_ops=row['median_ops'],
+                unique=row['unique_ids'], modal_id=row['modal_id'],
+                modal_count=row['modal_count'], epoch_dist=dist)
+
+
 def compute_stats(epoch):
+    rows = run_query(['stats'], [epoch])
+    if rows:
+        return _query_stats(rows[0])
     soup = load_soup(epoch)
     if soup is None:
         return None
     ss = CFG['soup_size']
     hl = CFG['half_len']
     if HAS_NUMPY:
-        chars = (soup & 0xFF).astype(np.uint8)
-        op_mask = np.zeros(256, dtype=bool)
-        for b in BFF_OPS:
-            op_mask[b] = True
-        ops_per_tape = op_mask[chars].sum(axis=1)
+        if _libbff is not None and BFF_OPS is BFFO_OPS:
+            ops_per_tape = bffo_count_ops_all(soup)
+        else:
+            chars = (soup & 0xFF).astype(np.uint8)
+            op_mask = np.zeros(256, dtype=bool)
+            for b in BFF_OPS:
+                op_mask[b] = True
+            ops_per_tape = op_mask[chars].sum(axis=1)
         mean_ops   = float(ops_per_tape.mean())
         median_ops = float(np.median(ops_per_tape))
 
@@ -219,6 +596,16 @@ def compute_stats(epoch):
                 epoch_dist=epoch_dist)
 
 
+def show_stats_table(epochs):
+    rows = run_query(['stats'], epochs)
+    stats = [_query_stats(r) for r in rows] if rows is not None else map(compute_stats, epochs)
+    print(f"  {'epoch':>5}  {'mean_ops':>9}  {'median':>7}  {'unique_ids':>11}  {'modal_count':>12}")
+    for st in stats:
+        if st:
+            print(f"  {st['epoch']:>5}  {st['mean_ops']:>9.3f}  {st['median_ops']:>7.1f}"
+                  f"  {st['unique']:>11,}  {st['modal_count']:>12,}")
+
+
 # ── Display helpers ────────────────────────────────────────────────────────────
 
 def show_tape(tape_idx, epoch):
@@ -300,7 +687,39 @@ def show_pair(tape_idx, epoch):
             print(f"     after:  |{tape_str(soup_after[tidx])}|")
 
 
-def show_top_pairs(epoch, k=10):
+def _pair_flow(epoch, pairs):
+    """Copy flow of the given pairs of epoch, re-run natively: {pair: (A→B, B→A)}, or {}."""
+    if _libbff is None or CFG.get('interpreter') != 'bff_orig' or not pairs:
+        return {}
+    perm, heads, before = load_perm(epoch), load_heads(epoch), load_soup(epoch - 1)
+    if perm is None or heads is None or before is None:
+        return {}
+    idx = np.array(pairs)
+    npairs = CFG['npairs']
+    _, _, flow = bffo_run_pairs(before[perm[idx]], before[perm[idx + npairs]],
+                                heads[0][idx], heads[1][idx])
+    return {p: (int(f[0, 1]), int(f[1, 0])) for p, f in zip(pairs, flow)}
+
+
+def _flow_str(flow, pair):
+    return f"  A→B {flow[pair][0]:3d} B→A {flow[pair][1]:3d}" if pair in flow else ""
+
+
+def show_top_pairs(epoch, k=10, rows=None):
+    """rows: this epoch's soup_query top rows, if already queried."""
+    if rows is None:
+        rows = run_query(['top', k], [epoch])
+    if rows:
+        print(f"\n  Top {k} pairs by step count in epoch {epoch}:")
+        print(f"  {'pair':>6}  {'A':>7}  {'B':>7}  {'steps':>7}  A-before / A-after  B-before / B-after")
+        flow = _pair_flow(epoch, [r['pair'] for r in rows[:k]])
+        for r in rows[:k]:
+            before_a = r['a_before'] or '?'*64
+            before_b = r['b_before'] or '?'*64
+            print(f"  {r['pair']:>6}  {r['tape_a']:>7}  {r['tape_b']:>7}  {r['steps']:>7}"
+                  f"  |{before_a[:20]}…|→|{r['a_after'][:20]}…|"
+                  f"  |{before_b[:20]}…|→|{r['b_after'][:20]}…|{_flow_str(flow, r['pair'])}")
+        return
     steps = load_steps(epoch)
     perm  = load_perm(epoch)
     if steps is None or perm is None:
@@ -317,6 +736,7 @@ def show_top_pairs(epoch, k=10):
 
     print(f"\n  Top {k} pairs by step count in epoch {epoch}:")
     print(f"  {'pair':>6}  {'A':>7}  {'B':>7}  {'steps':>7}  A-before / A-after  B-before / B-after")
+    flow = _pair_flow(epoch, top_idx)
     for pi in top_idx:
         ai  = int(perm[pi])
         bi  = int(perm[pi + npairs])
@@ -325,7 +745,7 @@ def show_top_pairs(epoch, k=10):
             return tape_str(soup[idx]) if soup is not None else '?'*64
         print(f"  {pi:>6}  {ai:>7}  {bi:>7}  {st:>7}"
               f"  |{s(soup_before,ai)[:20]}…|→|{s(soup_after,ai)[:20]}…|"
-              f"  |{s(soup_before,bi)[:20]}…|→|{s(soup_after,bi)[:20]}…|")
+              f"  |{s(soup_before,bi)[:20]}…|→|{s(soup_after,bi)[:20]}…|{_flow_str(flow, pi)}")
 
 
 def show_lineage(epoch):
@@ -352,8 +772,79 @@ def show_lineage(epoch):
         print(f"      Instr: |{tape_str(soup[best_tape])}|")
 
 
-def trace_lineage():
+# ── Lineage index (soup_orig --lineage, see lineage.h) ──────────────────────────
+
+LINEAGE_BIRTH, LINEAGE_LEVEL, LINEAGE_COPY = 0, 1, 2
+
+_lineage = None         # (header dict, record memmap)
+
+
+def load_lineage():
+    """The lineage index as (header, records), or None; records are mapped, not read."""
+    global _lineage
+    if _lineage is None and LINEAGE_PATH and os.path.exists(LINEAGE_PATH) and HAS_NUMPY:
+        with open(LINEAGE_PATH, 'rb') as f:
+            magic, ver, rec_bytes, base, tmin, tmax, half = struct.unpack('<8sIIIIII', f.read(32))
+        if magic != b'BFFLINE\0' or rec_bytes != 24:
+            print(f"  {LINEAGE_PATH}: not a lineage index", file=sys.stderr)
+            return None
+        dt = np.dtype([('epoch', '<u4'), ('kind', '<u2'), ('n', '<u2'), ('id', '<u4'),
+                       ('a', '<u4'), ('b', '<u4'), ('c', '<u4')])
+        nrec = (os.path.getsize(LINEAGE_PATH) - 32) // rec_bytes
+        recs = np.memmap(LINEAGE_PATH, dtype=dt, mode='r', offset=32, shape=(nrec,))
+        _lineage = (dict(base_id=base, track_min=tmin, track_max=tmax, half_len=half or 64), recs)
+    return _lineage
+
+
+def lineage_history(tid):
+    """Birth (epoch, cell), LEVEL records and COPY records of token id tid."""
+    hdr, recs = load_lineage()
+    mine = recs[recs['id'] == tid]
+    if tid < hdr['base_id']:
+        birth = (0, tid)
+    else:
+        b = mine[mine['kind'] == LINEAGE_BIRTH]
+        birth = (int(b['epoch'][0]), int(b['a'][0])) if len(b) else None
+    return birth, mine[mine['kind'] == LINEAGE_LEVEL], mine[mine['kind'] == LINEAGE_COPY]
+
+
+def show_id_history(tid, max_copies=20):
+    hdr = load_lineage()[0]
+    birth, levels, copies = lineage_history(tid)
+    hl = hdr['half_len']
+    if birth is None:
+        print(f"  ID {tid}: no birth record (born after the index ends?)")
+        return
+    how = "initial soup" if birth[0] == 0 else "mutation"
+    print(f"  ID {tid}: born epoch {birth[0]} in tape {birth[1] // hl} cell {birth[1] % hl} ({how})")
+    for r in levels:
+        print(f"    epoch {int(r['epoch']):6d}: reached {int(r['a']):>9,} copies ({int(r['b']):,})")
+    print(f"  {len(copies):,} cross-tape copies while tracked "
+          f"({hdr['track_min']}..{hdr['track_max']} copies)")
+    for r in copies[:max_copies]:
+        print(f"    epoch {int(r['epoch']):6d}  pair {int(r['a']):6d}  tape {int(r['b']):6d} → "
+              f"{int(r['c']):6d}  {int(r['n'])} cells")
+    if len(copies) > max_copies:
+        print(f"    ... {len(copies) - max_copies:,} more, last at epoch {int(copies['epoch'][-1])}")
+
+
+def trace_lineage(tid=None):
     """Trace dominant token from final epoch back to its first appearance."""
+    if load_lineage() is not None:
+        if tid is None:
+            final = available_epochs()[-1]
+            st = compute_stats(final)
+            if st is None:
+                return
+            tid = st['modal_id']
+            print(f"\n  Modal ID {tid} (×{st['modal_count']:,} cells at epoch {final}), "
+                  f"from {LINEAGE_PATH}:\n")
+        show_id_history(tid)
+        return
+    if tid is not None:
+        print("  trace ID needs a lineage index (soup_orig --lineage)")
+        return
+
     epochs = available_epochs()
     if not epochs:
         print("  No epochs available"); return
@@ -365,6 +856,19 @@ def trace_lineage():
     mid = st['modal_id']
     print(f"\n  Tracing modal ID {mid} (×{st['modal_count']:,} cells at epoch {final}) backwards...\n")
 
+    rows = run_query(['history', mid], epochs)
+    if rows is not None:
+        found = {r['epoch']: r for r in rows}
+        for ep in epochs:
+            r = found.get(ep)
+            if r is None:
+                print(f"  epoch {ep:3d}: ID {mid} not present")
+                continue
+            step_info = "" if r['steps'] is None else f"  paired with {r['partner']}, {r['steps']} steps"
+            print(f"  epoch {ep:3d}: {r['cells']:>8,} cells  best tape={r['best_tape']:6d} "
+                  f"({r['best_cells']:2d} cells)  |{r['str']}|{step_info}")
+        return
+
     soup_final = load_soup(final)
     if soup_final is None:
         return
@@ -406,6 +910,80 @@ def trace_lineage():
         print(f"  epoch {ep:3d}: {total:>8,} cells  best tape={best:6d} ({n:2d} cells)  |{instr}|{step_info}")
 
 
+# ── Native interpreter (libbff.so, see bff_orig.h) ──────────────────────────────
+#
+# bff_orig.c built as a shared library runs pairs with exactly the simulator's
+# semantics.  Tapes are passed as C-contiguous uint64 numpy arrays and run in
+# place, so a batch costs one copy to pair the halves up and no conversion.
+
+class BffoState(ctypes.Structure):
+    _fields_ = [('steps', ctypes.c_uint32), ('ip', ctypes.c_uint8), ('head0', ctypes.c_uint8),
+                ('head1', ctypes.c_uint8), ('sp', ctypes.c_uint8), ('halted', ctypes.c_uint8),
+                ('stack', ctypes.c_uint8 * BFF_STACK_DEPTH)]
+
+
+def _load_libbff():
+    """bff_orig.c built as a shared library (make libbff.so), or None."""
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "libbff.so")
+    if not HAS_NUMPY:
+        return None
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+    p = ctypes.c_void_p
+    lib.bffo_init.restype        = None
+    lib.bffo_init.argtypes       = [ctypes.POINTER(BffoState), ctypes.c_uint8, ctypes.c_uint8]
+    lib.bffo_resume_log.restype  = ctypes.c_uint32
+    lib.bffo_resume_log.argtypes = [p, ctypes.POINTER(BffoState), ctypes.c_uint32, p]
+    lib.bffo_run_batch.restype   = None
+    lib.bffo_run_batch.argtypes  = [p, ctypes.c_size_t, p, p, p, p]
+    lib.bffo_count_ops_batch.restype  = None
+    lib.bffo_count_ops_batch.argtypes = [p, ctypes.c_size_t, p]
+    return lib
+
+_libbff = _load_libbff()
+
+# BffoStep: the state each step's instruction ran in
+BFFO_STEP_DT = np.dtype([('token', '<u8'), ('ip', 'u1'), ('op', 'u1'), ('head0', 'u1'),
+                         ('head1', 'u1'), ('sp', 'u1'), ('top', 'u1'), ('reserved', 'u1', 2)]) \
+               if HAS_NUMPY else None
+
+
+def bffo_run_pairs(tapes_a, tapes_b, head0, head1):
+    """Run n pairs (arrays (n, HALF_LEN) uint64, heads (n,) uint8) natively.
+    Returns (tapes after, (n, TAPE_LEN); steps; copy flow (n, 2, 2) [from half][to half])."""
+    tapes = np.ascontiguousarray(np.concatenate([tapes_a, tapes_b], axis=1), dtype=np.uint64)
+    n     = len(tapes)
+    h0    = np.ascontiguousarray(head0, dtype=np.uint8)
+    h1    = np.ascontiguousarray(head1, dtype=np.uint8)
+    steps = np.zeros(n, dtype=np.uint32)
+    flow  = np.zeros((n, 2, 2), dtype=np.uint16)
+    _libbff.bffo_run_batch(tapes.ctypes.data, n, h0.ctypes.data, h1.ctypes.data,
+                           steps.ctypes.data, flow.ctypes.data)
+    return tapes, steps, flow
+
+
+def bffo_count_ops_all(soup):
+    """Ops per tape of a (SOUP_SIZE, HALF_LEN) soup, natively."""
+    soup = np.ascontiguousarray(soup, dtype=np.uint64)
+    ops  = np.zeros(len(soup), dtype=np.uint8)
+    _libbff.bffo_count_ops_batch(soup.ctypes.data, len(soup), ops.ctypes.data)
+    return ops
+
+
+def bffo_log(tape_a, tape_b, head0, head1, max_steps):
+    """Run A||B natively, recording each step: (BFFO_STEP_DT log, tape after, BffoState)."""
+    tape = np.ascontiguousarray(np.concatenate([np.asarray(tape_a, dtype=np.uint64),
+                                                np.asarray(tape_b, dtype=np.uint64)]))
+    stop = min(max_steps, BFFO_MAX_STEPS)
+    log  = np.zeros(stop, dtype=BFFO_STEP_DT)
+    st   = BffoState()
+    _libbff.bffo_init(ctypes.byref(st), head0, head1)
+    n = _libbff.bffo_resume_log(tape.ctypes.data, ctypes.byref(st), stop, log.ctypes.data)
+    return log[:n], tape, st
+
+
 # ── BFF step-by-step tracer ────────────────────────────────────────────────────
 
 def bff_trace(tape_a, tape_b, max_steps=200, verbose=True):
@@ -489,6 +1067,172 @@ def bff_trace(tape_a, tape_b, max_steps=200, verbose=True):
     return tape[:hl], tape[hl:], steps
 
 
+def bffo_trace(tape_a, tape_b, head0, head1, max_steps=200, verbose=True):
+    """
+    Run soup_orig's 10-instruction BFF (bff_orig.c) on A||B from the given
+    start heads, printing each instruction.  IP starts at 0; '.' copies
+    tape[head0] -> tape[head1], ',' copies tape[head1] -> tape[head0], and
+    '{' / '}' move head1.  Returns (final_tape_a, final_tape_b, steps_taken).
+    Runs in libbff.so when it is built, so the trace is the simulator's own run.
+    """
+    if _libbff is not None:
+        return _bffo_trace_native(tape_a, tape_b, head0, head1, max_steps, verbose)
+    hl = CFG['half_len']
+    tape = list(tape_a) + list(tape_b)
+    n = len(tape)
+
+    ip    = 0
+    stack = []
+    steps = 0
+
+    if verbose:
+        print(f"\n  BFF-orig trace: head0={head0}, head1={head1}, ip={ip}")
+        print(f"  {'step':>5}  {'ip':>3}  {'op':>4}  {'head0':>5}  {'head1':>5}  effect")
+
+    def note(msg):
+        if verbose:
+            print(f"  {steps:>5}  {ip:>3}  {op_ch:>4}  {head0:>5}  {head1:>5}  {msg}")
+
+    while steps < min(max_steps, BFFO_MAX_STEPS):
+        steps += 1
+        ch = tok_char(tape[ip])
+        op_ch = chr(ch) if ch in BFFO_OPS else f"0x{ch:02x}"
+
+        if ch == ord('<'):
+            head0 = (head0 - 1) % n
+            note(f"head0 → {head0}")
+        elif ch == ord('>'):
+            head0 = (head0 + 1) % n
+            note(f"head0 → {head0}")
+        elif ch == ord('{'):
+            head1 = (head1 - 1) % n
+            note(f"head1 → {head1}")
+        elif ch == ord('}'):
+            head1 = (head1 + 1) % n
+            note(f"head1 → {head1}")
+        elif ch in (ord('+'), ord('-')):
+            old = tok_char(tape[head0])
+            new = (old + (1 if ch == ord('+') else -1)) & 0xFF
+            tape[head0] = (tape[head0] & ~0xFF) | new
+            note(f"tape[{head0}] char {old}→{new}")
+        elif ch == ord('.'):
+            tape[head1] = tape[head0]
+            note(f"tape[{head1}] ← tape[{head0}] (id={tok_id(tape[head0])}, ch={tok_char(tape[head0])})")
+        elif ch == ord(','):
+            tape[head0] = tape[head1]
+            note(f"tape[{head0}] ← tape[{head1}] (id={tok_id(tape[head1])}, ch={tok_char(tape[head1])})")
+        elif ch == ord('['):
+            if len(stack) >= BFF_STACK_DEPTH:
+                note("stack overflow → HALT")
+                break
+            stack.append(ip)
+            note(f"push ip={ip}  (depth={len(stack)})")
+        elif ch == ord(']'):
+            if not stack:
+                note("empty stack → HALT")
+                break
+            val = tok_char(tape[head0])
+            if val != 0:
+                ip = stack[-1]
+                note(f"loop (tape[{head0}]={val} ≠ 0) → ip={ip}")
+            else:
+                stack.pop()
+                note(f"exit loop (tape[{head0}]=0)  (depth={len(stack)})")
+        else:
+            note(f"nop (0x{ch:02x})")
+
+        if ip + 1 >= n:
+            if verbose:
+                print(f"  ... IP ran off the tape → HALT")
+            break
+        ip += 1
+
+    if steps >= max_steps and verbose:
+        print(f"  ... stopped at step limit {max_steps}")
+
+    if verbose:
+        print(f"\n  Final tape A: |{tape_str(tape[:hl])}|")
+        print(f"  Final tape B: |{tape_str(tape[hl:])}|")
+
+    return tape[:hl], tape[hl:], steps
+
+
+def _bffo_trace_native(tape_a, tape_b, head0, head1, max_steps, verbose):
+    """bffo_trace from a libbff step log; same output."""
+    hl = CFG['half_len']
+    n  = 2 * hl
+    log, tape, st = bffo_log(tape_a, tape_b, head0, head1, max_steps)
+    steps = len(log)
+    if verbose:
+        print(f"\n  BFF-orig trace: head0={head0}, head1={head1}, ip=0")
+        print(f"  {'step':>5}  {'ip':>3}  {'op':>4}  {'head0':>5}  {'head1':>5}  effect")
+        halt_op = False
+        for k, e in enumerate(log, 1):
+            ch, ip, h0, h1, sp, tok = int(e['op']), int(e['ip']), int(e['head0']), int(e['head1']), \
+                                      int(e['sp']), int(e['token'])
+            val = tok_char(tok)
+            if ch == ord('<'):   h0 = (h0 - 1) % n; msg = f"head0 → {h0}"
+            elif ch == ord('>'): h0 = (h0 + 1) % n; msg = f"head0 → {h0}"
+            elif ch == ord('{'): h1 = (h1 - 1) % n; msg = f"head1 → {h1}"
+            elif ch == ord('}'): h1 = (h1 + 1) % n; msg = f"head1 → {h1}"
+            elif ch in (ord('+'), ord('-')):
+                msg = f"tape[{h0}] char {val}→{(val + (1 if ch == ord('+') else -1)) & 0xFF}"
+            elif ch == ord('.'):
+                msg = f"tape[{h1}] ← tape[{h0}] (id={tok_id(tok)}, ch={val})"
+            elif ch == ord(','):
+                msg = f"tape[{h0}] ← tape[{h1}] (id={tok_id(tok)}, ch={val})"
+            elif ch == ord('['):
+                halt_op = sp >= BFF_STACK_DEPTH
+                msg = "stack overflow → HALT" if halt_op else f"push ip={ip}  (depth={sp + 1})"
+            elif ch == ord(']'):
+                halt_op = sp == 0
+                if halt_op:
+                    msg = "empty stack → HALT"
+                elif val != 0:
+                    ip = int(e['top'])
+                    msg = f"loop (tape[{h0}]={val} ≠ 0) → ip={ip}"
+                else:
+                    msg = f"exit loop (tape[{h0}]=0)  (depth={sp - 1})"
+            else:
+                msg = f"nop (0x{ch:02x})"
+            op_ch = chr(ch) if ch in BFFO_OPS else f"0x{ch:02x}"
+            print(f"  {k:>5}  {ip:>3}  {op_ch:>4}  {h0:>5}  {h1:>5}  {msg}")
+        if st.halted and not halt_op and steps < BFFO_MAX_STEPS:
+            print(f"  ... IP ran off the tape → HALT")
+        if steps >= max_steps:
+            print(f"  ... stopped at step limit {max_steps}")
+        print(f"\n  Final tape A: |{tape_str(tape[:hl])}|")
+        print(f"  Final tape B: |{tape_str(tape[hl:])}|")
+    return tape[:hl].tolist(), tape[hl:].tolist(), steps
+
+
+def rerun_epoch(epoch, k=5):
+    """Re-execute every pair of epoch natively from the soup before it and check the trace."""
+    if _libbff is None or CFG.get('interpreter') != 'bff_orig':
+        print("  rerun needs libbff.so (make libbff.so) and a soup_orig trace"); return
+    perm, steps, heads = load_perm(epoch), load_steps(epoch), load_heads(epoch)
+    before, after = load_soup(epoch - 1), load_soup(epoch)
+    if perm is None or steps is None or heads is None or before is None or after is None:
+        print(f"  Need pairing, heads and soups for epochs {epoch - 1} and {epoch}"); return
+    npairs, hl = CFG['npairs'], CFG['half_len']
+    a, b = perm[:npairs], perm[npairs:]
+    t0 = time.time()
+    tapes, got, flow = bffo_run_pairs(before[a], before[b], heads[0], heads[1])
+    dt = time.time() - t0
+    same = (tapes[:, :hl] == after[a]).all(axis=1) & (tapes[:, hl:] == after[b]).all(axis=1)
+    print(f"\n  Epoch {epoch}: re-ran {npairs:,} pairs in {dt:.2f} s")
+    print(f"    steps match the trace:  {int((got == steps).sum()):,} / {npairs:,}")
+    print(f"    both tapes match:       {int(same.sum()):,} / {npairs:,}"
+          + ("  (the rest hold this epoch's mutations)" if not same.all() else ""))
+    cross = flow[:, 0, 1].astype(np.int64) + flow[:, 1, 0]
+    print(f"    copies A→B {int(flow[:, 0, 1].sum()):,}, B→A {int(flow[:, 1, 0].sum()):,}, "
+          f"within a tape {int(flow[:, 0, 0].sum() + flow[:, 1, 1].sum()):,}")
+    print(f"  Top {k} pairs by cross-tape copies:")
+    for pi in np.argsort(cross, kind='stable')[::-1][:k].tolist():
+        print(f"    pair {pi:6d}  A={int(a[pi]):6d}  B={int(b[pi]):6d}  steps={int(got[pi]):5d}"
+              f"  A→B {int(flow[pi, 0, 1]):3d}  B→A {int(flow[pi, 1, 0]):3d}  |{tape_str(tapes[pi, :hl])}|")
+
+
 def show_bff_trace(tape_idx, epoch, max_steps=200):
     """Run step-by-step BFF trace for the pair containing tape_idx at epoch."""
     perm  = load_perm(epoch)
@@ -525,28 +1269,40 @@ def show_bff_trace(tape_idx, epoch, max_steps=200):
     tape_b = soup_before[bi].tolist() if HAS_NUMPY else soup_before[bi]
     print(f"  A before: |{tape_str(tape_a)}|")
     print(f"  B before: |{tape_str(tape_b)}|")
-    bff_trace(tape_a, tape_b, max_steps=max_steps)
+    if CFG.get('interpreter') == 'bff_orig':
+        heads = load_heads(epoch)
+        if heads is None:
+            print(f"  No head positions recorded for epoch {epoch}"); return
+        bffo_trace(tape_a, tape_b, int(heads[0][pair_i]), int(heads[1][pair_i]), max_steps=max_steps)
+    else:
+        bff_trace(tape_a, tape_b, max_steps=max_steps)
 
 
 def search_tapes(pattern, epoch):
     """Find tapes whose instruction string contains pattern at given epoch."""
-    soup = load_soup(epoch)
-    if soup is None:
-        return
-    matches = []
-    ss = CFG['soup_size']
-    for i in range(ss):
-        s = tape_str(soup[i])
-        if pattern in s:
-            matches.append((i, s))
+    rows = run_query(['--limit', 20, 'search', pattern], [epoch])
+    if rows is not None:
+        matches = [(r['tape'], r['str']) for r in rows]
+        total   = rows[0]['matches'] if rows else 0
+    else:
+        soup = load_soup(epoch)
+        if soup is None:
+            return
+        matches = []
+        ss = CFG['soup_size']
+        for i in range(ss):
+            s = tape_str(soup[i])
+            if pattern in s:
+                matches.append((i, s))
+        total = len(matches)
     if not matches:
         print(f"  No tapes matching '{pattern}' at epoch {epoch}")
         return
-    print(f"  {len(matches)} tapes matching '{pattern}' at epoch {epoch}:")
+    print(f"  {total} tapes matching '{pattern}' at epoch {epoch}:")
     for idx, s in matches[:20]:
         print(f"    tape {idx:6d}: |{s}|")
-    if len(matches) > 20:
-        print(f"    ... ({len(matches)-20} more)")
+    if total > 20:
+        print(f"    ... ({total-20} more)")
 
 
 # ── Auto analysis ─────────────────────────────────────────────────────────────
@@ -560,17 +1316,13 @@ def auto_analyze():
 
     # Per-epoch stats
     print("─── Per-epoch stats ───────────────────────────────────────")
-    print(f"  {'epoch':>5}  {'mean_ops':>9}  {'median':>7}  {'unique_ids':>11}  {'modal_count':>12}")
-    for ep in epochs:
-        st = compute_stats(ep)
-        if st:
-            print(f"  {ep:>5}  {st['mean_ops']:>9.3f}  {st['median_ops']:>7.1f}"
-                  f"  {st['unique']:>11,}  {st['modal_count']:>12,}")
+    show_stats_table(epochs)
 
     # Top pairs per epoch
+    top = run_query(['top', 5], epochs[1:])
     for ep in epochs[1:]:
         print(f"\n─── Top 5 pairs by step count: epoch {ep} ──────────────────")
-        show_top_pairs(ep, k=5)
+        show_top_pairs(ep, k=5, rows=None if top is None else [r for r in top if r['epoch'] == ep])
 
     # Lineage trace
     print(f"\n─── Lineage trace ──────────────────────────────────────────")
@@ -617,9 +1369,10 @@ def repl():
             elif cmd == 'epochs':
                 print(f"  Available: {available_epochs()}")
             elif cmd == 'stats':
-                eps = [int(parts[1])] if len(parts) > 1 else available_epochs()
-                for ep in eps:
-                    show_lineage(ep)
+                if len(parts) > 1:
+                    show_lineage(int(parts[1]))
+                else:
+                    show_stats_table(available_epochs())
             elif cmd == 'tape':
                 n  = int(parts[1])
                 ep = int(parts[2]) if len(parts) > 2 else available_epochs()[-1]
@@ -636,12 +1389,14 @@ def repl():
                 ep = int(parts[1]) if len(parts) > 1 else available_epochs()[-1]
                 show_lineage(ep)
             elif cmd == 'trace':
-                trace_lineage()
+                trace_lineage(int(parts[1]) if len(parts) > 1 else None)
             elif cmd == 'bff':
                 n  = int(parts[1])
                 ep = int(parts[2])
                 ms = int(parts[3]) if len(parts) > 3 else 200
                 show_bff_trace(n, ep, max_steps=ms)
+            elif cmd == 'rerun':
+                rerun_epoch(int(parts[1]), int(parts[2]) if len(parts) > 2 else 5)
             elif cmd == 'search':
                 pat = parts[1]
                 ep  = int(parts[2]) if len(parts) > 2 else available_epochs()[-1]
@@ -655,13 +1410,15 @@ def repl():
 # ── Entry point ────────────────────────────────────────────────────────────────
 
 def main():
-    global TRACE_DIR
+    global TRACE_DIR, LINEAGE_PATH
     parser = argparse.ArgumentParser(description="Soup trace analyzer")
     parser.add_argument("trace_dir", help="Directory written by soup --trace-dir")
     parser.add_argument("--auto", action="store_true", help="Run automatic analysis and exit")
+    parser.add_argument("--lineage", help="soup_orig --lineage index (default <trace-dir>/lineage.bin)")
     args = parser.parse_args()
 
     TRACE_DIR = args.trace_dir
+    LINEAGE_PATH = args.lineage or os.path.join(TRACE_DIR, "lineage.bin")
     load_metadata(TRACE_DIR)
 
     if args.auto:
@@ -0,0 +1,316 @@
+#define _DEFAULT_SOURCE
+
+#include "soup_api.h"
+#include "checkpoint.h"
+#include "handles.h"
+#include "hugemem.h"
+#include "pool.h"
+#include "soup_core.h"
+#include "soup_stats.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(sizeof(((SoupStats *)0)->rep_tape) == BFFO_MAX_HALF_LEN, "rep_tape holds the longest tape");
+
+/*
+ * The cells live in one anonymous mapping right after a header page, laid
+ * out exactly like a checkpoint file, so soup_checkpoint() writes the
+ * mapping as is and soup_restore() maps a file's soup over the cells.  The
+ * mapping asks for transparent huge pages (hugemem.h); hugetlb pages could
+ * not take the checkpoint mapping.  The per-pair arrays are sized from the
+ * soup's shape.  A compact soup's cells are 32-bit tokens, and a checkpoint
+ * appends its handle table.
+ */
+struct Soup {
+    SoupCore  core;
+    HugeMem   mem;                /* header page, then the cells */
+    HandleTable handles;          /* compact soups */
+    SoupGrid  grid;               /* spatial soups (core.grid) */
+    size_t    map_bytes;
+    double    mutation_rate;
+    uint64_t  seed;               /* rng after init, as soup_orig reports it */
+    int       epoch;
+};
+
+int soup_lib_start(int nthreads) {
+    return pool_threads() ? pool_threads() : pool_start(nthreads);
+}
+
+void soup_lib_stop(void) {
+    if (pool_threads()) pool_stop();
+}
+
+void soup_destroy(Soup *s) {
+    if (!s) return;
+    huge_free(&s->mem);
+    handles_free(&s->handles);
+    soup_grid_free(&s->grid);
+    free(s->core.perm);
+    free(s->core.steps);
+    free(s->core.heads);
+    free(s->core.flow);
+    free(s);
+}
+
+static Soup *soup_alloc(SoupShape sh, uint32_t max_steps, uint32_t stack_depth, int compact) {
+    BffoShape bs = { sh.half_len * 2, max_steps, stack_depth };
+    if (!soup_shape_valid(sh) || !bffo_shape_valid(&bs)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    Soup *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    if (compact && handles_init(&s->handles, soup_cells(sh)) < 0) {   /* EINVAL: too many cells */
+        free(s);
+        return NULL;
+    }
+    uint32_t npairs = sh.ntapes / 2;
+    s->map_bytes = CKPT_HEADER_BYTES + soup_cells(sh) * (compact ? sizeof(uint32_t) : sizeof(uint64_t));
+    huge_alloc(&s->mem, s->map_bytes, HUGE_THP);
+    s->core.perm  = malloc(sh.ntapes * sizeof(uint32_t));
+    s->core.steps = calloc(npairs, sizeof(uint32_t));
+    s->core.heads = malloc(2 * (size_t)npairs);
+    s->core.flow  = malloc(npairs * sizeof(BffoFlow));
+    if (!s->mem.ptr || !s->core.perm || !s->core.steps || !s->core.heads || !s->core.flow) {
+        int err = errno;
+        soup_destroy(s);
+        errno = err;
+        return NULL;
+    }
+    if (compact) {
+        s->core.cells32 = (uint32_t *)((uint8_t *)s->mem.ptr + CKPT_HEADER_BYTES);
+        s->core.handles = &s->handles;
+    } else {
+        s->core.cells   = (uint64_t *)((uint8_t *)s->mem.ptr + CKPT_HEADER_BYTES);
+    }
+    s->core.shape       = sh;
+    s->core.max_steps   = max_steps ? max_steps : BFFO_MAX_STEPS;
+    s->core.stack_depth = stack_depth ? stack_depth : BFFO_STACK_DEPTH;
+    soup_lib_start(0);
+    return s;
+}
+
+Soup *soup_create(const SoupParams *p) {
+    if (p->mutation_rate < 0.0 || (p->compact && p->first_id)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    SoupShape sh = { p->ntapes ? p->ntapes : SOUP_SIZE, p->tape_len ? p->tape_len : BFFO_HALF_LEN };
+    Soup *s = soup_alloc(sh, p->max_steps, p->stack_depth, p->compact);
+    if (!s) return NULL;
+    s->core.flow_on  = p->flow;
+    s->mutation_rate = p->mutation_rate;
+    s->core.next_id  = p->first_id;
+    soup_core_init(&s->core, p->seed);
+    s->seed = s->core.rng;
+    return s;
+}
+
+/* A compact checkpoint's handle table, after its cells */
+static int restore_handles(Soup *s, const char *path, const CheckpointHeader *h) {
+    size_t bytes = handles_tail_bytes(h->handles_used, h->handles_free);
+    void *buf = malloc(bytes ? bytes : 1);
+    if (!buf) return -1;
+    int rc = ckpt_read_tail(path, h, buf, bytes);
+    if (rc == 0) rc = handles_restore(&s->handles, buf, h->handles_used, h->handles_free, h->handles_limit,
+                                      h->next_lineage_id);
+    int err = errno;
+    free(buf);
+    errno = err;
+    return rc;
+}
+
+Soup *soup_restore(const char *path, double mutation_rate) {
+    CheckpointHeader h;
+    if (ckpt_read_header(path, &h) < 0) return NULL;
+    int compact = h.token_bytes == sizeof(uint32_t);
+    Soup *s = soup_alloc((SoupShape){ h.soup_size, h.half_len }, h.max_steps, h.stack_depth, compact);
+    if (!s) return NULL;
+    if (ckpt_map(path, &h, (uint8_t *)s->mem.ptr + CKPT_HEADER_BYTES, s->map_bytes - CKPT_HEADER_BYTES) < 0 ||
+        (compact && restore_handles(s, path, &h) < 0) ||
+        (h.grid_width && soup_grid_init(&s->grid, s->core.shape, h.grid_width, h.grid_height, h.grid_radius) < 0)) {
+        int err = errno;
+        soup_destroy(s);
+        errno = err;
+        return NULL;
+    }
+    if (h.grid_width) s->core.grid = &s->grid;
+    s->core.rng      = h.global_rng;
+    s->core.next_id  = h.next_token_id;
+    s->epoch         = h.epoch;
+    s->seed          = h.seed;
+    s->mutation_rate = mutation_rate < 0.0 ? h.mutation_rate : mutation_rate;
+    return s;
+}
+
+void soup_run_epochs(Soup *s, int n) {
+    for (int i = 0; i < n; i++) {
+        soup_core_pair_up(&s->core);
+        soup_core_run_pairs(&s->core);
+        soup_core_mutate(&s->core, s->mutation_rate, ++s->epoch);
+    }
+}
+
+/* Shuffles and mutations of an ensemble, one soup per worker at a time */
+typedef struct {
+    Soup *const *s;
+    int          n;
+    int          mutate;
+} EnsembleStep;
+
+static void ensemble_step_job(void *ctx, int tid, int nthreads) {
+    const EnsembleStep *e = ctx;
+    for (int k = tid; k < e->n; k += nthreads) {
+        Soup *s = e->s[k];
+        if (e->mutate) soup_core_mutate(&s->core, s->mutation_rate, ++s->epoch);
+        else           soup_core_pair_up(&s->core);
+    }
+}
+
+int soup_run_epochs_many(Soup *const *s, int n, int epochs) {
+    SoupCore **cores = malloc((size_t)n * sizeof(*cores));
+    if (!cores) return -1;
+    for (int k = 0; k < n; k++) cores[k] = &s[k]->core;
+    for (int i = 0; i < epochs; i++) {
+        EnsembleStep e = { s, n, 0 };
+        pool_run(ensemble_step_job, &e);
+        soup_core_run_pairs_many(cores, n);
+        e.mutate = 1;
+        pool_run(ensemble_step_job, &e);
+    }
+    free(cores);
+    return 0;
+}
+
+int soup_current_epoch(const Soup *s) {
+    return s->epoch;
+}
+
+void soup_get_shape(const Soup *s, uint32_t *ntapes, uint32_t *tape_len) {
+    *ntapes   = s->core.shape.ntapes;
+    *tape_len = s->core.shape.half_len;
+}
+
+void soup_get_stats(Soup *s, SoupStats *st, int full) {
+    const uint64_t *cells   = s->core.cells;
+    const uint32_t *cells32 = s->core.cells32;
+    SoupShape sh = s->core.shape;
+    uint32_t freq[BFFO_MAX_HALF_LEN + 1];
+    memset(st, 0, sizeof(*st));
+    st->epoch = s->epoch;
+
+    if (cells32) soup_ops_hist32(cells32, sh, freq);
+    else         soup_ops_hist(cells, sh, freq);
+    soup_ops_mean_median(freq, sh, &st->mean_ops, &st->median_ops);
+
+    if (s->epoch > 0) {
+        StepSummary ss;
+        soup_step_summary(s->core.steps, sh.ntapes / 2, &ss);
+        st->mean_steps = (double)ss.total / (sh.ntapes / 2);
+        st->max_steps  = ss.max;
+    }
+
+    if (full && cells32) {
+        uint32_t modal;
+        soup_lineage32(cells32, sh, &st->unique_ids, &modal, &st->modal_count, st->rep_tape);
+        st->modal_id = handles_id(&s->handles, modal);
+        soup_complexity32(cells32, sh, &st->entropy, &st->lz_bpb);
+        st->hoe = st->entropy - st->lz_bpb;
+    } else if (full) {
+        uint32_t modal;
+        soup_lineage(cells, sh, &st->unique_ids, &modal, &st->modal_count, st->rep_tape);
+        st->modal_id = modal;
+        soup_complexity(cells, sh, &st->entropy, &st->lz_bpb);
+        st->hoe = st->entropy - st->lz_bpb;
+    } else {
+        st->entropy = st->lz_bpb = st->hoe = NAN;
+    }
+}
+
+const uint64_t *soup_view_tapes(const Soup *s) { return s->core.cells; }
+const uint32_t *soup_view_tokens32(const Soup *s) { return s->core.cells32; }
+const uint32_t *soup_view_steps(const Soup *s) { return s->core.steps; }
+const uint32_t *soup_view_perm(const Soup *s)  { return s->core.perm; }
+const void     *soup_view_flow(const Soup *s)  { return s->core.flow_on ? s->core.flow : NULL; }
+
+/* Tapes [first, first + n) mod ntapes as two runs: *head tapes from tape
+ * first, then n - *head from tape 0.  Returns the first run's offset in
+ * cells, or -1 with errno EINVAL. */
+static ptrdiff_t tape_runs(const Soup *s, uint32_t first, uint32_t n, uint32_t *head) {
+    uint32_t ntapes = s->core.shape.ntapes;
+    if (!s->core.cells || n > ntapes) {
+        errno = EINVAL;
+        return -1;
+    }
+    first &= ntapes - 1;
+    *head = n < ntapes - first ? n : ntapes - first;
+    return (ptrdiff_t)first * s->core.shape.half_len;
+}
+
+int soup_get_tapes(const Soup *s, uint32_t first, uint32_t n, uint64_t *out) {
+    uint32_t  head;
+    ptrdiff_t at = tape_runs(s, first, n, &head);
+    if (at < 0) return -1;
+    size_t len = s->core.shape.half_len;
+    memcpy(out, s->core.cells + at, head * len * sizeof(uint64_t));
+    memcpy(out + head * len, s->core.cells, (n - head) * len * sizeof(uint64_t));
+    return 0;
+}
+
+int soup_set_tapes(Soup *s, uint32_t first, uint32_t n, const uint64_t *in) {
+    uint32_t  head;
+    ptrdiff_t at = tape_runs(s, first, n, &head);
+    if (at < 0) return -1;
+    size_t len = s->core.shape.half_len;
+    memcpy(s->core.cells + at, in, head * len * sizeof(uint64_t));
+    memcpy(s->core.cells, in + head * len, (n - head) * len * sizeof(uint64_t));
+    return 0;
+}
+
+void soup_cell_lineage(const Soup *s, size_t cell, uint32_t *id, int *epoch) {
+    if (s->core.cells32) {
+        uint32_t h = BFFO_CTOKEN_HANDLE(s->core.cells32[cell]);
+        *id    = handles_id(&s->handles, h);
+        *epoch = handles_epoch(&s->handles, h);
+    } else {
+        *id    = BFFO_TOKEN_ID(s->core.cells[cell]);
+        *epoch = BFFO_TOKEN_EPOCH(s->core.cells[cell]);
+    }
+}
+
+int soup_checkpoint(Soup *s, const char *path) {
+    CheckpointHeader *h = s->mem.ptr;
+    ckpt_header_init(h, s->core.shape.ntapes, s->core.shape.half_len);
+    h->epoch         = s->epoch;
+    h->next_token_id = s->core.next_id;
+    h->global_rng    = s->core.rng;
+    h->seed          = s->seed;
+    h->mutation_rate = s->mutation_rate;
+    h->max_steps     = s->core.max_steps;
+    h->stack_depth   = s->core.stack_depth;
+    if (s->core.grid) {
+        h->grid_width  = s->grid.width;
+        h->grid_height = s->grid.height;
+        h->grid_radius = s->grid.radius;
+    }
+    if (!s->core.cells32) return ckpt_write(path, s->mem.ptr, s->map_bytes);
+
+    h->token_bytes     = sizeof(uint32_t);
+    h->soup_bytes      = soup_cells(s->core.shape) * sizeof(uint32_t);
+    h->handles_used    = s->handles.used;
+    h->handles_free    = s->handles.nfree;
+    h->handles_limit   = s->handles.limit;
+    h->next_lineage_id = s->handles.next_id;
+    size_t bytes = handles_bytes(&s->handles);
+    void  *tail  = malloc(bytes ? bytes : 1);
+    if (!tail) return -1;
+    handles_save(&s->handles, tail);
+    int rc  = ckpt_write_tail(path, s->mem.ptr, s->map_bytes, tail, bytes);
+    int err = errno;
+    free(tail);
+    errno = err;
+    return rc;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Embeddable soup library (libsoup.so).
+ *
+ * Each Soup is an independent soup_orig run: SOUP_SIZE tapes of BFFO_HALF_LEN
+ * tokens, paired, run and mutated one epoch at a time exactly as soup_orig
+ * does, so a Soup created with seed S reproduces `soup_orig --seed S`
+ * column for column.  SoupParams can also give a soup its own shape (tape
+ * count and length) and interpreter limits; soups of different shapes mix
+ * freely in one process and one soup_run_epochs_many() call.  Many soups can live in one process; they all share one
+ * worker pool (pool.h), which runs one job at a time, so calls on different
+ * soups must come from one thread (or be serialised by the caller).
+ *
+ *     soup_lib_start(0);                       optional: defaults to all CPUs
+ *     Soup *s = soup_create(&(SoupParams){ .seed = 1, .mutation_rate = 0.00024 });
+ *     soup_run_epochs(s, 1000);
+ *     SoupStats st;
+ *     soup_get_stats(s, &st, 1);
+ *     const uint64_t *cells = soup_view_tapes(s);   zero-copy, read-only
+ *     soup_checkpoint(s, "run.ckpt");
+ *     soup_destroy(s);
+ *     soup_lib_stop();
+ *
+ * Functions returning int return 0, or -1 with errno set.
+ */
+
+typedef struct Soup Soup;
+
+typedef struct {
+    uint64_t seed;                /* 0 = from an address, as soup_orig */
+    double   mutation_rate;       /* per byte per epoch */
+    uint32_t max_steps;           /* per-pair step limit; 0 = BFFO_MAX_STEPS (the most) */
+    uint32_t stack_depth;         /* bracket nesting limit; 0 = BFFO_STACK_DEPTH (the most) */
+    uint32_t ntapes;              /* power of two >= 2; 0 = SOUP_SIZE */
+    uint32_t tape_len;            /* tokens per tape, power of two <= 128; 0 = BFFO_HALF_LEN */
+    int      flow;                /* 1 = count copies per pair (soup_view_flow) */
+    int      compact;             /* 1 = 32-bit tokens with a lineage table (soup_core.h); <= 2^23 cells */
+    uint32_t first_id;            /* id of the first initial token, so soups that swap tapes
+                                     (soup_orig --islands) keep apart; 64-bit tokens only */
+} SoupParams;
+
+typedef struct {
+    int      epoch;               /* epochs run */
+    double   mean_ops;
+    double   median_ops;
+    double   mean_steps;          /* last epoch's pairs; 0 at epoch 0 */
+    uint32_t max_steps;
+    uint32_t unique_ids;          /* lineage and complexity: full only */
+    uint32_t modal_id;
+    uint32_t modal_count;
+    double   entropy;
+    double   lz_bpb;
+    double   hoe;                 /* entropy - lz_bpb */
+    uint8_t  rep_tape[128];       /* chars of the tape carrying the modal id (tape_len used) */
+} SoupStats;
+
+/* Start the shared pool with nthreads workers (<= 0 = all CPUs); returns the
+ * number started.  soup_create() starts it on first use if not called. */
+int  soup_lib_start(int nthreads);
+void soup_lib_stop(void);
+
+/* New soup at epoch 0, or NULL with errno set (EINVAL: bad shape or limits). */
+Soup *soup_create(const SoupParams *p);
+
+/* New soup from a soup_orig or soup_checkpoint() file, mapped copy-on-write
+ * (pages are read as the first epoch touches them), with the file's shape,
+ * limits and --grid torus.  mutation_rate < 0 keeps the checkpoint's rate.
+ * NULL with errno set (EINVAL: not a checkpoint). */
+Soup *soup_restore(const char *path, double mutation_rate);
+
+void soup_destroy(Soup *s);
+
+/* Run n epochs: pair up, run every pair, mutate. */
+void soup_run_epochs(Soup *s, int n);
+
+/*
+ * soup_run_epochs() for an ensemble of n soups in lockstep: each epoch's
+ * pairs of every soup go to the workers as one interleaved job, so soups
+ * with long-running pairs are balanced against quiet ones and a small soup
+ * count still fills a large pool.  Each soup ends exactly as if run alone.
+ */
+int  soup_run_epochs_many(Soup *const *s, int n, int epochs);
+
+int  soup_current_epoch(const Soup *s);
+
+/* Tape count and tokens per tape. */
+void soup_get_shape(const Soup *s, uint32_t *ntapes, uint32_t *tape_len);
+
+/* Stats of the current soup, as in the soup_orig TSV; full = 0 skips the
+ * lineage and complexity columns (0 / NaN), which cost most of the time. */
+void soup_get_stats(Soup *s, SoupStats *st, int full);
+
+/*
+ * Zero-copy views, valid until the next call that runs an epoch or restores:
+ * the ntapes x tape_len tokens (bff_orig.h layout), and the last epoch's
+ * npairs = ntapes / 2 step counts, perm (pair i is perm[i], perm[i + npairs])
+ * and copy counts (NULL without SoupParams.flow).
+ */
+const uint64_t *soup_view_tapes(const Soup *s);     /* NULL for a compact soup */
+const uint32_t *soup_view_tokens32(const Soup *s);  /* a compact soup's tokens, else NULL */
+const uint32_t *soup_view_steps(const Soup *s);
+const uint32_t *soup_view_perm(const Soup *s);
+const void     *soup_view_flow(const Soup *s);     /* BffoFlow[npairs] */
+
+/*
+ * Copy n tapes, from tape first on and wrapping past the last, out of or
+ * into the soup (soup_orig --islands migrants).  64-bit soups only; EINVAL
+ * for a compact soup or n > ntapes.
+ */
+int  soup_get_tapes(const Soup *s, uint32_t first, uint32_t n, uint64_t *out);
+int  soup_set_tapes(Soup *s, uint32_t first, uint32_t n, const uint64_t *in);
+
+/* Lineage id and creation epoch of the token in cell (tape * tape_len + j),
+ * in either token format. */
+void soup_cell_lineage(const Soup *s, size_t cell, uint32_t *id, int *epoch);
+
+/* Atomically write a checkpoint (checkpoint.h format) readable by
+ * soup_restore() and soup_orig --resume. */
+int  soup_checkpoint(Soup *s, const char *path);
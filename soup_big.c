@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+
+/*
+ * Out-of-core soup: a population larger than RAM, run from a file
+ * (bigsoup.h).
+ *
+ * Usage:
+ *   ./soup_big --file PATH [--tapes N] [--tape-len L] [--seed S]
+ *              [--mutation R] [--block B] [--window W] [--max-steps S]
+ *              [--stack-depth D] [--epochs E] [--stats I] [--sync-every I]
+ *              [--mem-budget MB] [--threads T]
+ *
+ * With --tapes, PATH is created (replacing it) with a fresh soup of N tapes;
+ * otherwise the soup in PATH continues, from a soup_big file or any
+ * soup_orig checkpoint.  Either way it runs until epoch --epochs.  Blocks of
+ * --block tapes are the unit of I/O and --window blocks run together
+ * (defaults 65536 and 8).
+ *
+ * Stats go to stdout in soup_orig's columns every --stats epochs.  The ops,
+ * step and complexity columns cover the whole soup.  The lineage columns,
+ * named win_* in the header, cover the epoch's last window: a sample of
+ * block * window tapes, as counting every id of a soup this size would not
+ * fit the memory budget.
+ *
+ * The file is a checkpoint after every --sync-every epochs, at the end, and
+ * after SIGINT / SIGTERM, which stop the run once the current epoch is done.
+ * A file left mid-epoch (killed harder) cannot be continued.
+ */
+
+#include "bigsoup.h"
+#include "soup_core.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Instruction lookup for tape display */
+static const uint8_t SOUP_IS_OP[256] = {
+    ['<']=1, ['>']=1, ['{']=1, ['}']=1,
+    ['+']=1, ['-']=1, ['.']=1, [',']=1,
+    ['[']=1, [']']=1,
+};
+
+static volatile sig_atomic_t stop_requested;
+
+static void on_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void print_stats_header(void) {
+    printf("%-10s\t%-12s\t%-12s\t%-12s\t%-12s\t%-12s\t%-10s\t%s\t%-8s\t%-8s\t%s\n",
+           "epoch", "mean_ops", "median_ops", "mean_steps", "max_steps",
+           "win_unique_ids", "win_modal_id", "win_representative_tape (modal_count)",
+           "entropy", "lz_bpb", "hoe");
+}
+
+static void print_stats(const SoupStats *st, uint32_t tape_len) {
+    char rep_str[BFFO_MAX_HALF_LEN + 1];
+    for (uint32_t j = 0; j < tape_len; j++)
+        rep_str[j] = SOUP_IS_OP[st->rep_tape[j]] ? (char)st->rep_tape[j] : ' ';
+    rep_str[tape_len] = '\0';
+    printf("%-10d\t%-12.4f\t%-12.1f\t%-12.1f\t%-12u\t%-12u\t%-10u\t|%s| (%u)\t%-8.4f\t%-8.4f\t%.4f\n",
+           st->epoch, st->mean_ops, st->median_ops, st->mean_steps, st->max_steps,
+           st->unique_ids, st->modal_id, rep_str, st->modal_count,
+           st->entropy, st->lz_bpb, st->hoe);
+    fflush(stdout);
+}
+
+static int usage(const char *prog) {
+    fprintf(stderr, "Usage: %s --file PATH [--tapes N] [--tape-len L] [--seed S] [--mutation R] "
+                    "[--block B] [--window W] [--max-steps S] [--stack-depth D] [--epochs E] "
+                    "[--stats I] [--sync-every I] [--mem-budget MB] [--threads T]\n", prog);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    BigSoupParams p = { 0 };
+    double mutation = -1.0;
+    int epochs = 100, stats_interval = 10, sync_every = 0, nthreads = 0;
+    size_t budget_mb = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) return usage(argv[0]);
+        if      (!strcmp(argv[i], "--file"))        path            = argv[++i];
+        else if (!strcmp(argv[i], "--tapes"))       p.ntapes        = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--tape-len"))    p.tape_len      = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--seed"))        p.seed          = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--mutation"))    mutation        = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--block"))       p.block_tapes   = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--window"))      p.window_blocks = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--max-steps"))   p.max_steps     = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--stack-depth")) p.stack_depth   = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--epochs"))      epochs          = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--stats"))       stats_interval  = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--sync-every"))  sync_every      = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--mem-budget"))  budget_mb       = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--threads"))     nthreads        = atoi(argv[++i]);
+        else return usage(argv[0]);
+    }
+    if (!path || stats_interval < 1 || sync_every < 0) return usage(argv[0]);
+    if ((uint64_t)p.ntapes * (p.tape_len ? p.tape_len : BFFO_HALF_LEN) >= 1ULL << 32) {
+        fprintf(stderr, "--tapes x --tape-len must be under 2^32 cells: token ids are 32-bit\n");
+        return 1;
+    }
+
+    nthreads = soup_lib_start(nthreads);
+    p.mem_budget = budget_mb << 20;
+    BigSoup *b;
+    if (p.ntapes) {
+        p.mutation_rate = mutation < 0.0 ? 0.0 : mutation;
+        b = bigsoup_create(path, &p);
+    } else {
+        b = bigsoup_open(path, mutation, p.mem_budget);
+    }
+    if (!b) {
+        perror(path);
+        return 1;
+    }
+
+    const BigSoupParams *bp = bigsoup_params(b);
+    double gb = (double)bp->ntapes * bp->tape_len * sizeof(uint64_t) / (1 << 30);
+    fprintf(stderr, "Soup: %s, %u tapes x %u (%.2f GB), blocks of %u tapes, windows of %u blocks, "
+                    "seed %llu, mutation %g, %d threads, %s\n",
+            path, bp->ntapes, bp->tape_len, gb, bp->block_tapes, bp->window_blocks,
+            (unsigned long long)bp->seed, bp->mutation_rate, nthreads,
+            (double)bp->ntapes * bp->tape_len * sizeof(uint64_t) > (double)bp->mem_budget
+                ? "out of core" : "cached");
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    print_stats_header();
+    int    from = bigsoup_current_epoch(b);
+    double t0   = now_sec();
+    while (bigsoup_current_epoch(b) < epochs && !stop_requested) {
+        int e = bigsoup_current_epoch(b) + 1;
+        int stats_epoch = e % stats_interval == 0 || e == epochs;
+        SoupStats st;
+        bigsoup_epoch(b, stats_epoch ? &st : NULL, 1);
+        if (stats_epoch) print_stats(&st, bp->tape_len);
+        if (sync_every && e % sync_every == 0 && bigsoup_sync(b) < 0) {
+            perror(path);
+            return 1;
+        }
+    }
+    int    ran  = bigsoup_current_epoch(b) - from;
+    double secs = now_sec() - t0;
+    if (stop_requested)
+        fprintf(stderr, "Stopped at epoch %d; continue with: %s --file %s --epochs %d\n",
+                bigsoup_current_epoch(b), argv[0], path, epochs);
+    fprintf(stderr, "Run: %d epochs in %.1f s, %.2f epochs/s\n", ran, secs, secs > 0 ? ran / secs : 0.0);
+
+    if (bigsoup_close(b) < 0) {
+        perror(path);
+        return 1;
+    }
+    soup_lib_stop();
+    return 0;
+}
@@ -0,0 +1,528 @@
+#include "soup_core.h"
+#include "pool.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------
+ * Global soup state
+ * -------------------------------------------------------------------------*/
+SoupShape soup_shape = { SOUP_SIZE, BFFO_HALF_LEN };
+uint64_t *soup;
+uint32_t *soup32;
+HandleTable soup_handles;
+uint32_t *perm;
+HugeMem  soup_mem;
+uint32_t *pair_steps;
+uint8_t  *pair_heads;
+uint64_t global_rng;
+uint32_t next_token_id = 0;
+uint32_t soup_max_steps = BFFO_MAX_STEPS;
+uint32_t soup_stack_depth = BFFO_STACK_DEPTH;
+int      soup_flow;
+int      soup_cow_shared;
+BffoFlow *pair_flow;
+const SoupObserver *soup_observer;
+SoupGrid *soup_grid;
+uint32_t soup_npairs = SOUP_SIZE / 2;
+
+/* The global soup as a SoupCore; its scalars are copied from and back to
+ * the globals around each call, so callers may keep using those directly. */
+static SoupCore main_core;
+
+/* The soup first, so it starts on a huge page boundary and a checkpoint can
+ * be mapped over it (checkpoint.h); perm after it. */
+int soup_global_alloc(SoupShape sh, HugeMode mode, int compact) {
+    if (!soup_shape_valid(sh) || (compact && soup_cells(sh) > HANDLE_LIMIT / 2)) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t ncells = soup_cells(sh), npairs = sh.ntapes / 2;
+    size_t bytes  = ncells * (compact ? sizeof(uint32_t) : sizeof(uint64_t));
+    if (compact && handles_init(&soup_handles, ncells) < 0) return -1;
+    if (!(pair_steps = calloc(npairs, sizeof(uint32_t))) ||
+        !(pair_heads = calloc(npairs, 2)) ||
+        !(pair_flow  = calloc(npairs, sizeof(BffoFlow))))
+        return -1;
+    if (huge_alloc(&soup_mem, bytes + sh.ntapes * sizeof(uint32_t), mode) < 0) return -1;
+    soup_shape = sh;
+    if (compact) {
+        soup32            = soup_mem.ptr;
+        main_core.cells32 = soup32;
+        main_core.handles = &soup_handles;
+    } else {
+        soup              = soup_mem.ptr;
+        main_core.cells   = soup;
+    }
+    perm            = (uint32_t *)((uint8_t *)soup_mem.ptr + bytes);
+    main_core.perm  = perm;
+    main_core.steps = pair_steps;
+    main_core.heads = pair_heads;
+    main_core.flow  = pair_flow;
+    main_core.shape = sh;
+    soup_npairs     = (uint32_t)npairs;
+    return 0;
+}
+
+static SoupCore *main_enter(void) {
+    main_core.rng         = global_rng;
+    main_core.next_id     = next_token_id;
+    main_core.max_steps   = soup_max_steps;
+    main_core.stack_depth = soup_stack_depth;
+    main_core.flow_on     = soup_flow;
+    main_core.cow_shared  = soup_cow_shared;
+    main_core.observer    = soup_observer;
+    main_core.grid        = soup_grid;
+    return &main_core;
+}
+
+static void main_leave(void) {
+    global_rng    = main_core.rng;
+    next_token_id = main_core.next_id;
+    soup_npairs   = main_core.npairs;
+}
+
+int soup_shape_valid(SoupShape sh) {
+    uint64_t cells = (uint64_t)sh.ntapes * sh.half_len;
+    return sh.ntapes >= 2 && !(sh.ntapes & (sh.ntapes - 1)) && sh.half_len >= 1 &&
+           sh.half_len <= BFFO_MAX_HALF_LEN && !(sh.half_len & (sh.half_len - 1)) &&
+           cells <= (1ULL << 32);
+}
+
+void soup_core_init(SoupCore *c, uint64_t seed) {
+    c->rng = seed ? seed : (uint64_t)(uintptr_t)&c->rng ^ 0xdeadbeefcafe1234ULL;
+    for (int i = 0; i < 32; i++) xorshift64(&c->rng);
+
+    /* Each element is a fresh token with a unique ID, from the caller's
+     * next_id (0 but for soup_orig --islands; compact: handle = ID) */
+    size_t ncells = soup_cells(c->shape);
+    for (size_t n = 0; n < ncells; n++) {
+        uint8_t ch = (uint8_t)(xorshift64(&c->rng) & 0xFF);
+        if (c->cells32) c->cells32[n] = BFFO_MAKE_CTOKEN(c->next_id++, ch);
+        else            c->cells[n]   = BFFO_MAKE_TOKEN(c->next_id++, 0, ch);
+    }
+}
+
+typedef struct {
+    const SoupCore *c;
+    uint64_t       *out;
+} TokensJob;
+
+/* A compact token as the 64-bit token of the same lineage */
+static inline uint64_t wide_token(const HandleTable *t, uint32_t tok) {
+    uint32_t h = BFFO_CTOKEN_HANDLE(tok);
+    return BFFO_MAKE_TOKEN(handles_id(t, h), handles_epoch(t, h), BFFO_CTOKEN_CHAR(tok));
+}
+
+static void tokens_job(void *ctx, int tid, int nthreads) {
+    const TokensJob   *j = ctx;
+    uint32_t half = j->c->shape.half_len;
+    unsigned lo, hi;
+    pool_slice(j->c->shape.ntapes, tid, nthreads, &lo, &hi);
+    for (size_t n = (size_t)lo * half; n < (size_t)hi * half; n++)
+        j->out[n] = wide_token(j->c->handles, j->c->cells32[n]);
+}
+
+void soup_core_tokens(const SoupCore *c, uint64_t *out) {
+    if (!c->cells32) {
+        memcpy(out, c->cells, soup_cells(c->shape) * sizeof(uint64_t));
+        return;
+    }
+    TokensJob j = { c, out };
+    pool_run(tokens_job, &j);
+}
+
+void soup_tokens(uint64_t *out) {
+    soup_core_tokens(&main_core, out);
+}
+
+void soup_init(uint64_t seed) {
+    soup_core_init(main_enter(), seed);
+    main_leave();
+}
+
+/* -------------------------------------------------------------------------
+ * Fisher-Yates shuffle of perm[0..ntapes-1]
+ * -------------------------------------------------------------------------*/
+static void shuffle_perm(SoupCore *c) {
+    uint32_t *perm = c->perm;
+    uint32_t  n    = c->shape.ntapes;
+    uint64_t  rng  = c->rng;
+    for (uint32_t i = 0; i < n; i++) perm[i] = i;
+    for (uint32_t i = n - 1; i > 0; i--) {
+        uint32_t j = (uint32_t)(xorshift64(&rng) % (i + 1));
+        uint32_t tmp = perm[i]; perm[i] = perm[j]; perm[j] = tmp;
+    }
+    c->rng = rng;
+}
+
+/* -------------------------------------------------------------------------
+ * Spatial pairing on a torus (SoupGrid)
+ *
+ * mate[a] is GRID_FREE, the partner of a tape that picked it, or the tape
+ * that picked it | GRID_PICKED.  It is all GRID_FREE between epochs: listing
+ * a tile's pairs clears its cells again.
+ * -------------------------------------------------------------------------*/
+#define GRID_FREE    UINT32_MAX
+#define GRID_PICKED  (1u << 31)
+
+int soup_grid_valid(SoupShape sh, uint32_t width, uint32_t height, uint32_t radius) {
+    return soup_shape_valid(sh) && (uint64_t)width * height == sh.ntapes &&
+           !(width & (width - 1)) && !(height & (height - 1)) &&
+           width >= 2 * GRID_TILE && height >= 2 * GRID_TILE &&
+           radius >= 1 && radius <= GRID_MAX_RADIUS;
+}
+
+int soup_grid_init(SoupGrid *g, SoupShape sh, uint32_t width, uint32_t height, uint32_t radius) {
+    memset(g, 0, sizeof(*g));
+    if (!soup_grid_valid(sh, width, height, radius)) {
+        errno = EINVAL;
+        return -1;
+    }
+    g->width      = width;
+    g->height     = height;
+    g->radius     = radius;
+    g->mate       = malloc(sh.ntapes * sizeof(uint32_t));
+    g->tile_pairs = malloc((sh.ntapes / (GRID_TILE * GRID_TILE) + 1) * sizeof(uint32_t));
+    if (!g->mate || !g->tile_pairs) {
+        soup_grid_free(g);
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(g->mate, 0xFF, sh.ntapes * sizeof(uint32_t));
+    return 0;
+}
+
+void soup_grid_free(SoupGrid *g) {
+    free(g->mate);
+    free(g->tile_pairs);
+    memset(g, 0, sizeof(*g));
+}
+
+/* Uniform in [0, n): the high bits of one draw scaled, without a division */
+static inline uint32_t grid_below(uint64_t *rng, uint32_t n) {
+    return (uint32_t)(((xorshift64(rng) >> 32) * n) >> 32);
+}
+
+/* Greedy matching of tile t's tapes, in an order drawn from its own stream.
+ * The neighbour scan is branch-free: whether a neighbour is free is a coin
+ * flip the predictor cannot learn. */
+static void grid_match_tile(const SoupGrid *g, uint64_t seed, uint32_t t) {
+    uint32_t  w = g->width, h = g->height, r = g->radius;
+    uint32_t  x0 = t % (w / GRID_TILE) * GRID_TILE, y0 = t / (w / GRID_TILE) * GRID_TILE;
+    uint32_t *mate = g->mate;
+    uint64_t  rng  = splitmix64(seed + t) | 1;
+
+    uint16_t order[GRID_TILE * GRID_TILE];
+    for (uint32_t k = 0; k < GRID_TILE * GRID_TILE; k++) order[k] = (uint16_t)k;
+    for (uint32_t k = GRID_TILE * GRID_TILE - 1; k > 0; k--) {
+        uint32_t j = grid_below(&rng, k + 1);
+        uint16_t tmp = order[k]; order[k] = order[j]; order[j] = tmp;
+    }
+
+    uint32_t free_nb[(2 * GRID_MAX_RADIUS + 1) * (2 * GRID_MAX_RADIUS + 1)];
+    uint32_t formed = 0;
+    for (uint32_t k = 0; k < GRID_TILE * GRID_TILE; k++) {
+        uint32_t x = x0 + order[k] % GRID_TILE, y = y0 + order[k] / GRID_TILE;
+        uint32_t a = y * w + x;
+        if (mate[a] != GRID_FREE) continue;
+        mate[a] = a;                              /* not a candidate for itself */
+        uint32_t n = 0;
+        for (uint32_t dy = 0; dy <= 2 * r; dy++) {
+            uint32_t row = ((y + h - r + dy) & (h - 1)) * w;
+            for (uint32_t dx = 0; dx <= 2 * r; dx++) {
+                uint32_t b = row + ((x + w - r + dx) & (w - 1));
+                free_nb[n] = b;
+                n += mate[b] == GRID_FREE;
+            }
+        }
+        if (!n) {
+            mate[a] = GRID_FREE;
+            continue;
+        }
+        uint32_t b = free_nb[grid_below(&rng, n)];
+        mate[a] = b;
+        mate[b] = a | GRID_PICKED;
+        formed++;
+    }
+    g->tile_pairs[t] = formed;
+}
+
+typedef struct {
+    SoupCore *c;
+    uint64_t  seed;
+    uint32_t  colour;                             /* 0..3: (tile x, tile y) parity */
+} GridJob;
+
+static void grid_match_job(void *ctx, int tid, int nthreads) {
+    const GridJob  *j = ctx;
+    const SoupGrid *g = j->c->grid;
+    uint32_t half_x = g->width / GRID_TILE / 2, half_y = g->height / GRID_TILE / 2;
+    unsigned start, end;
+    pool_slice(half_x * half_y, tid, nthreads, &start, &end);
+    for (uint32_t k = start; k < end; k++) {
+        uint32_t tx = k % half_x * 2 + (j->colour & 1);
+        uint32_t ty = k / half_x * 2 + (j->colour >> 1);
+        grid_match_tile(g, j->seed, ty * half_x * 2 + tx);
+    }
+}
+
+/* Write each tile's pairs from its offset in tile_pairs, picker first */
+static void grid_list_job(void *ctx, int tid, int nthreads) {
+    const GridJob  *j = ctx;
+    const SoupCore *c = j->c;
+    const SoupGrid *g = c->grid;
+    uint32_t  tiles_x = g->width / GRID_TILE, half = c->shape.ntapes / 2;
+    uint32_t *mate    = g->mate;
+    unsigned start, end;
+    pool_slice(c->shape.ntapes / (GRID_TILE * GRID_TILE), tid, nthreads, &start, &end);
+    for (uint32_t t = start; t < end; t++) {
+        uint32_t i   = g->tile_pairs[t];
+        uint32_t row = t / tiles_x * GRID_TILE * g->width + t % tiles_x * GRID_TILE;
+        for (uint32_t y = 0; y < GRID_TILE; y++, row += g->width)
+            for (uint32_t a = row; a < row + GRID_TILE; a++) {
+                if (mate[a] < GRID_PICKED) {
+                    c->perm[i]        = a;
+                    c->perm[half + i] = mate[a];
+                    i++;
+                }
+                mate[a] = GRID_FREE;
+            }
+    }
+}
+
+static void grid_pair_up(SoupCore *c) {
+    GridJob j = { c, xorshift64(&c->rng), 0 };
+    for (j.colour = 0; j.colour < 4; j.colour++) pool_run(grid_match_job, &j);
+
+    /* Pair counts to offsets, so the pairs come out in tile order */
+    uint32_t *tp     = c->grid->tile_pairs;
+    uint32_t  ntiles = c->shape.ntapes / (GRID_TILE * GRID_TILE);
+    uint32_t  total  = 0;
+    for (uint32_t t = 0; t < ntiles; t++) {
+        uint32_t n = tp[t];
+        tp[t]  = total;
+        total += n;
+    }
+    pool_run(grid_list_job, &j);
+
+    uint32_t half = c->shape.ntapes / 2;
+    c->npairs = total;
+    memset(c->steps + total, 0, (half - total) * sizeof(uint32_t));
+    if (c->flow_on) memset(c->flow + total, 0, (half - total) * sizeof(BffoFlow));
+}
+
+/* -------------------------------------------------------------------------
+ * Mutation
+ * -------------------------------------------------------------------------*/
+void soup_core_mutate(SoupCore *c, double rate, int epoch) {
+    if (rate <= 0.0) return;
+
+    /* k ~ Poisson(lambda), Knuth's method with exp(lambda) applied in steps
+     * so it does not underflow (exp(-lambda) is 0 past lambda ~ 745) */
+    size_t ncells = soup_cells(c->shape);
+    double left = (double)ncells * rate;
+    double p = 1.0;
+    uint32_t k = 0;
+    do {
+        k++;
+        p *= (double)(xorshift64(&c->rng) >> 11) * (1.0 / (double)(1ULL << 53));
+        while (p < 1.0 && left > 0.0) {
+            double d = left > 500.0 ? 500.0 : left;
+            p *= exp(d);
+            left -= d;
+        }
+    } while (p > 1.0);
+    k--;
+
+    /* The cell is the top log2(ncells) bits of r (bits 41..63 for the
+     * paper's 2^23 cells), the new char the low byte */
+    int pos_shift = 64 - __builtin_ctzll(ncells);
+    const SoupObserver *obs = c->observer;
+    for (uint32_t m = 0; m < k; m++) {
+        uint64_t r   = xorshift64(&c->rng);
+        uint32_t pos = pos_shift < 64 ? (uint32_t)(r >> pos_shift) : 0;
+        uint8_t  val = (uint8_t)(r & 0xFF);
+        if (c->cells32) {
+            uint32_t old = c->cells32[pos];
+            uint64_t old_tok = obs ? wide_token(c->handles, old) : 0;
+            /* Recycle the handles no cell holds any more.  The cell about to
+             * be replaced is cleared first, so at least its handle comes
+             * free even if every other one is live (handles.h). */
+            if (handles_due(c->handles)) {
+                c->cells32[pos] = 0;
+                handles_collect(c->handles, c->cells32, ncells);
+            }
+            c->cells32[pos] = BFFO_MAKE_CTOKEN(handles_new(c->handles, epoch), val);
+            c->next_id++;
+            if (obs) obs->mutation(obs->ctx, pos, old_tok, wide_token(c->handles, c->cells32[pos]), epoch);
+            continue;
+        }
+        uint64_t *cell = &c->cells[pos];
+        uint64_t  tok  = BFFO_MAKE_TOKEN(c->next_id++, (uint16_t)epoch, val);
+        if (obs) obs->mutation(obs->ctx, pos, *cell, tok, epoch);
+        *cell = tok;
+    }
+}
+
+void mutate_soup(double rate, int epoch) {
+    soup_core_mutate(main_enter(), rate, epoch);
+    main_leave();
+}
+
+/* -------------------------------------------------------------------------
+ * Pair execution on the worker pool
+ *
+ * run_pair is inlined with half constant for the paper's 64-token tapes, so
+ * that case copies tapes with fixed-size moves and runs bffo_run directly;
+ * other shapes go through bffo_run_shape's kernels.  With compact set (a
+ * constant too) the cells are 32-bit tokens and run through
+ * bffo_run_shape32.
+ * -------------------------------------------------------------------------*/
+/* Pass pair i to c's observer, a compact soup's tapes widened */
+static void observe_pair(const SoupCore *c, int tid, uint32_t i, uint32_t ai, uint32_t bi,
+                         const void *a, const void *b, const void *after, uint32_t half) {
+    const SoupObserver *obs = c->observer;
+    if (!c->cells32) {
+        obs->pair(obs->ctx, tid, i, ai, bi, a, b, after);
+        return;
+    }
+    uint64_t wa[BFFO_MAX_HALF_LEN], wb[BFFO_MAX_HALF_LEN], wafter[BFFO_MAX_TAPE_LEN];
+    const uint32_t *ca = a, *cb = b, *cafter = after;
+    for (uint32_t j = 0; j < half; j++) {
+        wa[j] = wide_token(c->handles, ca[j]);
+        wb[j] = wide_token(c->handles, cb[j]);
+    }
+    for (uint32_t j = 0; j < 2 * half; j++) wafter[j] = wide_token(c->handles, cafter[j]);
+    obs->pair(obs->ctx, tid, i, ai, bi, wa, wb, wafter);
+}
+
+static inline __attribute__((always_inline))
+void run_pair(const SoupCore *c, uint32_t i, int tid, uint32_t half, int compact) {
+    uint32_t npairs = c->shape.ntapes / 2;
+    union {
+        uint64_t w[BFFO_MAX_TAPE_LEN];
+        uint32_t c[BFFO_MAX_TAPE_LEN];
+    } combined;
+    size_t   tb    = compact ? sizeof(uint32_t) : sizeof(uint64_t);
+    uint8_t *cells = compact ? (uint8_t *)c->cells32 : (uint8_t *)c->cells;
+    uint8_t *comb  = compact ? (uint8_t *)combined.c : (uint8_t *)combined.w;
+    uint32_t ai = c->perm[i];
+    uint32_t bi = c->perm[i + npairs];
+    uint8_t *a = cells + (size_t)ai * half * tb;
+    uint8_t *b = cells + (size_t)bi * half * tb;
+
+    memcpy(comb,             a, half * tb);
+    memcpy(comb + half * tb, b, half * tb);
+
+    /* head0 and head1 are random per pair, keyed by pair index */
+    uint64_t h  = splitmix64(c->epoch_seed + i);
+    uint8_t  h0 = (uint8_t)(h & (2 * half - 1));
+    uint8_t  h1 = (uint8_t)((h >> 8) & (2 * half - 1));
+
+    c->heads[i]          = h0;
+    c->heads[npairs + i] = h1;
+    BffoFlow *flow = c->flow_on ? &c->flow[i] : NULL;
+    if (flow) memset(flow, 0, sizeof(*flow));
+    if (compact) {
+        BffoShape sh = { 2 * half, c->max_steps, c->stack_depth };
+        c->steps[i] = bffo_run_shape32(combined.c, &sh, h0, h1, flow);
+    } else if (half != BFFO_HALF_LEN || c->stack_depth < BFFO_STACK_DEPTH) {
+        BffoShape sh = { 2 * half, c->max_steps, c->stack_depth };
+        c->steps[i] = bffo_run_shape(combined.w, &sh, h0, h1, flow);
+    } else if (c->max_steps >= BFFO_MAX_STEPS) {
+        c->steps[i] = flow ? bffo_run_flow(combined.w, h0, h1, flow) : bffo_run(combined.w, h0, h1);
+    } else {
+        BffoState st;
+        bffo_init(&st, h0, h1);
+        c->steps[i] = flow ? bffo_resume_flow(combined.w, &st, c->max_steps, flow)
+                           : bffo_resume(combined.w, &st, c->max_steps);
+    }
+    if (c->observer) observe_pair(c, tid, i, ai, bi, a, b, comb, half);
+
+    /* In a forked branch, store only tapes that changed, so pages shared
+     * with the parent (soup_orig --fork-at) stay shared until they diverge */
+    if (!c->cow_shared || memcmp(a, comb, half * tb))
+        memcpy(a, comb,             half * tb);
+    if (!c->cow_shared || memcmp(b, comb + half * tb, half * tb))
+        memcpy(b, comb + half * tb, half * tb);
+}
+
+static void pairs_job(void *ctx, int tid, int nthreads) {
+    const SoupCore *c = ctx;
+    unsigned start, end;
+    pool_slice(c->npairs, tid, nthreads, &start, &end);
+    if (c->cells32)
+        for (uint32_t i = start; i < end; i++) run_pair(c, i, tid, c->shape.half_len, 1);
+    else if (c->shape.half_len == BFFO_HALF_LEN)
+        for (uint32_t i = start; i < end; i++) run_pair(c, i, tid, BFFO_HALF_LEN, 0);
+    else
+        for (uint32_t i = start; i < end; i++) run_pair(c, i, tid, c->shape.half_len, 0);
+}
+
+/*
+ * Pairs of several soups in one job.  Work item j is pair j / n of soup
+ * j % n (cycling over the soups that still have a pair j / n), so every
+ * worker's slice holds the same share of each soup and a soup whose pairs
+ * run long does not leave the others' workers idle.
+ */
+typedef struct {
+    SoupCore *const *cores;
+    int              n;
+    uint32_t         max_pairs;
+} ManyPairs;
+
+static void many_pairs_job(void *ctx, int tid, int nthreads) {
+    const ManyPairs *m = ctx;
+    unsigned start, end;
+    pool_slice((unsigned)m->n * m->max_pairs, tid, nthreads, &start, &end);
+    for (uint32_t j = start; j < end; j++) {
+        const SoupCore *c = m->cores[j % (unsigned)m->n];
+        uint32_t i = j / (unsigned)m->n;
+        if (i >= c->npairs) continue;
+        if (c->cells32)                              run_pair(c, i, tid, c->shape.half_len, 1);
+        else if (c->shape.half_len == BFFO_HALF_LEN) run_pair(c, i, tid, BFFO_HALF_LEN, 0);
+        else                                         run_pair(c, i, tid, c->shape.half_len, 0);
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * Run one epoch: shuffle, draw the head seed, run all pairs
+ * -------------------------------------------------------------------------*/
+void soup_core_pair_up(SoupCore *c) {
+    if (c->grid) {
+        grid_pair_up(c);
+    } else {
+        shuffle_perm(c);
+        c->npairs = c->shape.ntapes / 2;
+    }
+    c->epoch_seed = xorshift64(&c->rng);
+}
+
+void soup_core_run_pairs(SoupCore *c) {
+    pool_run(pairs_job, c);
+}
+
+void soup_core_run_pairs_many(SoupCore *const *c, int n) {
+    ManyPairs m = { c, n, 0 };
+    for (int k = 0; k < n; k++)
+        if (c[k]->npairs > m.max_pairs) m.max_pairs = c[k]->npairs;
+    pool_run(many_pairs_job, &m);
+}
+
+void soup_pair_up(void) {
+    soup_core_pair_up(main_enter());
+    main_leave();
+}
+
+void soup_run_pairs(void) {
+    soup_core_run_pairs(main_enter());
+    main_leave();
+}
+
+void soup_epoch(void) {
+    soup_pair_up();
+    soup_run_pairs();
+}
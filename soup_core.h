@@ -0,0 +1,216 @@
+#pragma once
+
+#include "bff_orig.h"
+#include "handles.h"
+#include "hugemem.h"
+
+#include <stdint.h>
+
+/*
+ * Soup simulation core shared by soup_orig, soup_replay and the soup
+ * library (soup_api.h).
+ *
+ * One epoch is: Fisher-Yates shuffle of perm from global_rng (or a spatial
+ * matching, see SoupGrid), one epoch seed drawn from global_rng, every pair
+ * (perm[i], perm[i + ntapes / 2]) run through bffo_run on the worker pool
+ * (pool.h, started by the caller), then Poisson mutation from global_rng.  Pair i's start heads come from
+ * splitmix64(epoch_seed + i), so the state after each epoch depends only on
+ * the state before it -- never on the thread count or scheduling -- and any
+ * epoch can be recomputed from a snapshot of (soup, global_rng, next_token_id).
+ */
+
+/* -------------------------------------------------------------------------
+ * Soup parameters
+ * -------------------------------------------------------------------------*/
+#define SOUP_SIZE   (1 << 17)   /* 131072 tapes: the paper's soup, the default */
+
+/*
+ * Soup dimensions chosen at runtime (soup_orig --tapes/--tape-len,
+ * soup_api.h): both powers of two, with half_len <= BFFO_MAX_HALF_LEN.
+ */
+typedef struct {
+    uint32_t ntapes;
+    uint32_t half_len;                            /* tokens per tape; pairs run 2 * half_len */
+} SoupShape;
+
+#define SOUP_DEFAULT_SHAPE ((SoupShape){ SOUP_SIZE, BFFO_HALF_LEN })
+
+static inline size_t soup_cells(SoupShape sh) { return (size_t)sh.ntapes * sh.half_len; }
+
+/* 1 if sh is a shape soup_core can run. */
+int soup_shape_valid(SoupShape sh);
+
+/* -------------------------------------------------------------------------
+ * Global soup state
+ * -------------------------------------------------------------------------*/
+extern SoupShape soup_shape;                      /* set by soup_global_alloc() */
+extern uint64_t *soup;                            /* ntapes * half_len tokens, in soup_mem */
+extern uint32_t *soup32;                          /* compact instead (see SoupCore), or NULL */
+extern HandleTable soup_handles;                  /* soup32's lineages */
+extern uint32_t *perm;                            /* pairing of the last epoch, in soup_mem */
+extern uint32_t *pair_steps;                      /* bffo_run steps per pair (ntapes / 2) */
+extern uint8_t  *pair_heads;                      /* start head0 per pair, then head1 per pair */
+extern uint64_t global_rng;                       /* shuffle, epoch seed and mutation */
+extern uint32_t next_token_id;                    /* assigned at init and mutation */
+extern uint32_t soup_max_steps;                   /* per-pair step limit, <= BFFO_MAX_STEPS */
+extern uint32_t soup_stack_depth;                 /* bracket depth, <= BFFO_STACK_DEPTH */
+extern int      soup_flow;                        /* 1 = fill pair_flow (bffo_resume_flow) */
+extern int      soup_cow_shared;                  /* 1 = soup pages shared copy-on-write after fork() */
+extern BffoFlow *pair_flow;                       /* copies per pair by direction (ntapes / 2) */
+
+/* Tape t of the global soup */
+static inline uint64_t *soup_tape(uint32_t t) { return soup + (size_t)t * soup_shape.half_len; }
+
+/* Pairs of a full pairing of the global soup */
+static inline uint32_t soup_pairs(void) { return soup_shape.ntapes / 2; }
+
+/*
+ * Allocate the global soup at shape sh.  soup and perm share one huge-page
+ * mapping (hugemem.h), so the random gathers of an epoch stay within a few
+ * TLB entries; the per-pair arrays are allocated beside it.  With compact
+ * set the global soup is soup32 instead (soup stays NULL), 32-bit tokens
+ * whose lineages are in soup_handles.  Call once before anything touches
+ * them; 0, or -1 with errno set (EINVAL for a shape soup_core cannot run).
+ */
+extern HugeMem soup_mem;
+int soup_global_alloc(SoupShape sh, HugeMode mode, int compact);
+
+static inline uint64_t xorshift64(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/*
+ * Optional observer of every change the epoch makes (soup_orig --lineage).
+ * pair() runs on the worker pool right after pair i's interaction, before
+ * the tapes are written back: old_a and old_b are the old contents of tapes
+ * a and b, and after the new combined tape; tid is the pool worker.
+ * mutation() runs on the calling thread for each mutated cell.  A compact
+ * soup's tokens are passed widened, as soup_core_tokens() gives them.
+ */
+typedef struct {
+    void (*pair)(void *ctx, int tid, uint32_t i, uint32_t a, uint32_t b, const uint64_t *old_a,
+                 const uint64_t *old_b, const uint64_t *after);
+    void (*mutation)(void *ctx, uint32_t cell, uint64_t old_token, uint64_t new_token, int epoch);
+    void *ctx;
+} SoupObserver;
+
+extern const SoupObserver *soup_observer;         /* NULL = none */
+
+/*
+ * Spatial soup (soup_orig --grid): tape y * width + x sits at (x, y) of a
+ * width x height torus and only pairs with tapes within Chebyshev distance
+ * radius.  Each epoch's pairing is a greedy random matching: every tape, in
+ * random order, picks a partner uniformly among its unpaired neighbours, and
+ * sits the epoch out if there are none.
+ *
+ * The matching runs on the worker pool in GRID_TILE x GRID_TILE tiles.  A
+ * tile only reads and writes mate[] within radius of itself, so the tiles of
+ * one colour of a 2 x 2 colouring never touch the same tape and run
+ * concurrently; the four colours run one after another, each reading the
+ * pairs its neighbours made in earlier colours in place (the halo).  Tile t
+ * draws from splitmix64(match seed + t), so the pairing does not depend on
+ * the thread count.  Pairs are then listed tile by tile, so each worker runs
+ * a contiguous patch of the torus whose tapes stay in cache, instead of
+ * gathering random tapes from the whole soup.
+ */
+#define GRID_TILE        16
+#define GRID_MAX_RADIUS  (GRID_TILE / 2)
+
+typedef struct {
+    uint32_t  width, height;                      /* powers of two, >= 2 * GRID_TILE */
+    uint32_t  radius;                             /* 1 .. GRID_MAX_RADIUS */
+    uint32_t *mate;                               /* ntapes, scratch for the matching */
+    uint32_t *tile_pairs;                         /* pairs per tile, then their offsets */
+} SoupGrid;
+
+/* 1 if a width x height torus with this radius can hold a soup of shape sh. */
+int  soup_grid_valid(SoupShape sh, uint32_t width, uint32_t height, uint32_t radius);
+
+/* Allocate g's scratch for soup_grid_valid() dimensions.  0, or -1 with errno
+ * set (EINVAL for invalid ones). */
+int  soup_grid_init(SoupGrid *g, SoupShape sh, uint32_t width, uint32_t height, uint32_t radius);
+void soup_grid_free(SoupGrid *g);
+
+/* The global soup's grid (set before its first epoch) and its pair count */
+extern SoupGrid *soup_grid;                       /* NULL = well mixed, as the paper */
+extern uint32_t soup_npairs;                      /* pairs run in the last epoch (soup_pairs() unless on a grid) */
+
+/*
+ * One soup's state.  The functions below work on the global soup above;
+ * soup_core_*() take any SoupCore, so one process can host several soups
+ * (soup_api.h).  Arrays are caller-owned; cells must be page aligned for
+ * checkpoint mapping.  A SoupCore runs on the shared worker pool, so two
+ * soups' epochs never run at the same time.
+ *
+ * A compact soup sets cells32 and handles instead of cells: its tokens are
+ * [handle:24][char:8] (bff_orig.h), half the memory and bandwidth, with each
+ * lineage's id and epoch in the handle table (handles.h, initialised by the
+ * caller).  Its chars, and so every pair's run, match the 64-bit soup of the
+ * same seed epoch for epoch; lineage ids and epochs match too.  Compact
+ * soups hold at most HANDLE_LIMIT / 2 cells.
+ */
+typedef struct {
+    uint64_t  *cells;                             /* ntapes * half_len tokens, or NULL */
+    uint32_t  *cells32;                           /* compact tokens instead, or NULL */
+    HandleTable *handles;                         /* compact: lineage of each handle */
+    uint32_t  *perm;                              /* ntapes: pair i is perm[i], perm[ntapes / 2 + i] */
+    uint32_t  *steps;                             /* ntapes / 2 */
+    uint8_t   *heads;                             /* ntapes / 2 head0, then ntapes / 2 head1 */
+    BffoFlow  *flow;                              /* ntapes / 2, filled if flow_on */
+    SoupShape  shape;
+    SoupGrid  *grid;                              /* spatial pairing, or NULL: well mixed */
+    uint32_t   npairs;                            /* pairs of the last pair-up: ntapes / 2
+                                                     unless on a grid, whose steps and flow
+                                                     past npairs are 0 */
+    uint64_t   rng;
+    uint64_t   epoch_seed;
+    uint32_t   next_id;
+    uint32_t   max_steps;                         /* <= BFFO_MAX_STEPS */
+    uint32_t   stack_depth;                       /* <= BFFO_STACK_DEPTH */
+    int        flow_on;
+    int        cow_shared;                        /* cells shared copy-on-write with another
+                                                     process: write back changed tapes only */
+    const SoupObserver *observer;
+} SoupCore;
+
+void soup_core_init(SoupCore *c, uint64_t seed);
+void soup_core_pair_up(SoupCore *c);
+void soup_core_run_pairs(SoupCore *c);
+void soup_core_mutate(SoupCore *c, double rate, int epoch);
+
+/* soup_core_run_pairs() for n soups at once (of any shapes), their pairs
+ * interleaved across the workers; each soup ends up exactly as if run alone. */
+void soup_core_run_pairs_many(SoupCore *const *c, int n);
+
+/*
+ * c's cells as 64-bit tokens (bff_orig.h) into out, on the worker pool.  For
+ * a compact soup these are exactly the cells of the 64-bit soup of the same
+ * seed.
+ */
+void soup_core_tokens(const SoupCore *c, uint64_t *out);
+
+/* soup_core_tokens() of the global soup: a copy of soup, or soup32 widened. */
+void soup_tokens(uint64_t *out);
+
+/* Seed global_rng (0 = from an address) and fill the soup with fresh random tokens. */
+void soup_init(uint64_t seed);
+
+/* Shuffle and run every pair once on the worker pool. */
+void soup_epoch(void);
+
+/* soup_epoch() in two halves, for callers that inspect the pairing before the run. */
+void soup_pair_up(void);      /* shuffle perm and draw the epoch seed */
+void soup_run_pairs(void);
+
+/* Poisson-sampled random byte flips across the whole soup (rate per byte). */
+void mutate_soup(double rate, int epoch);
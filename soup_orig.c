@@ -1,31 +1,32 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "bff_orig.h"
+#include "bgwrite.h"
+#include "checkpoint.h"
+#include "hugemem.h"
+#include "island.h"
+#include "lineage.h"
+#include "metrics.h"
+#include "pool.h"
+#include "soup_api.h"
+#include "soup_core.h"
+#include "soup_stats.h"
+#include "trace.h"
 
+#include <errno.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <math.h>
-#include <pthread.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
-/* -------------------------------------------------------------------------
- * Soup parameters
- * -------------------------------------------------------------------------*/
-#define SOUP_SIZE   (1 << 17)   /* 131072 tapes */
-#define NPAIRS      (SOUP_SIZE / 2)
-#define MAX_THREADS 256
-
-/* -------------------------------------------------------------------------
- * Global soup state
- * -------------------------------------------------------------------------*/
-static uint64_t soup[SOUP_SIZE][BFFO_HALF_LEN];  /* 64 MB in BSS */
-static uint32_t perm[SOUP_SIZE];                  /* shuffle buffer for pairing */
-
-/* Monotonically increasing token ID assigned at init and mutation */
-static uint32_t next_token_id = 0;
-
 /* Instruction lookup for tape display */
 static const uint8_t SOUP_IS_OP[256] = {
     ['<']=1, ['>']=1, ['{']=1, ['}']=1,
@@ -33,193 +34,1247 @@ static const uint8_t SOUP_IS_OP[256] = {
     ['[']=1, [']']=1,
 };
 
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 /* -------------------------------------------------------------------------
- * XorShift64 RNG
+ * Step histogram TSV (--stepstats), one soup_step_summary() row per epoch
  * -------------------------------------------------------------------------*/
-static uint64_t global_rng;
+static void step_summary_header(FILE *f) {
+    fprintf(f, "epoch\ttotal_steps\tzero\tat_max\tp50\tp90\tp99");
+    fprintf(f, "\ts0");
+    for (int k = 1; k < STEP_LOG_BUCKETS - 1; k++) fprintf(f, "\ts%u", 1u << (k - 1));
+    fprintf(f, "\tmax%d\n", BFFO_MAX_STEPS);
+}
 
-static inline uint64_t xorshift64(uint64_t *s) {
-    *s ^= *s << 13;
-    *s ^= *s >> 7;
-    *s ^= *s << 17;
-    return *s;
+static void step_summary_row(FILE *f, int epoch, const StepSummary *ss) {
+    fprintf(f, "%d\t%llu\t%u\t%u\t%u\t%u\t%u", epoch, (unsigned long long)ss->total,
+            ss->zero, ss->at_max, ss->p50, ss->p90, ss->p99);
+    for (int k = 0; k < STEP_LOG_BUCKETS; k++) fprintf(f, "\t%u", ss->hist[k]);
+    fputc('\n', f);
 }
 
 /* -------------------------------------------------------------------------
- * Fisher-Yates shuffle of perm[0..SOUP_SIZE-1]
+ * Copy flow of the last epoch's pairs (--flow): total copies by direction
+ * and a 2-D histogram of pairs by (A->B, B->A) cross-tape copies, in the
+ * log buckets of the step histogram (0, [1,2), [2,4), ..., 8192).  A pair
+ * where one side writes into the other and nothing comes back sits on an
+ * axis; an exchange between two replicators sits near the diagonal.
  * -------------------------------------------------------------------------*/
-static void shuffle_perm(void) {
-    for (uint32_t i = 0; i < SOUP_SIZE; i++) perm[i] = i;
-    for (uint32_t i = SOUP_SIZE - 1; i > 0; i--) {
-        uint32_t j = (uint32_t)(xorshift64(&global_rng) % (i + 1));
-        uint32_t tmp = perm[i]; perm[i] = perm[j]; perm[j] = tmp;
+#define FLOW_BUCKETS  STEP_LOG_BUCKETS
+
+typedef struct {
+    uint64_t copies[2][2];
+    uint32_t hist[FLOW_BUCKETS][FLOW_BUCKETS];   /* [A->B bucket][B->A bucket] */
+} FlowSummary;
+
+static FlowSummary flow_part[POOL_MAX_THREADS];
+
+static inline int flow_bucket(uint32_t v) {
+    return v == 0 ? 0 : 32 - __builtin_clz(v);
+}
+
+static void flow_job(void *ctx, int tid, int nthreads) {
+    (void)ctx;
+    FlowSummary *fs = &flow_part[tid];
+    memset(fs, 0, sizeof(*fs));
+    unsigned lo, hi;
+    pool_slice(soup_npairs, tid, nthreads, &lo, &hi);
+    for (uint32_t i = lo; i < hi; i++) {
+        const BffoFlow *f = &pair_flow[i];
+        for (int s = 0; s < 2; s++)
+            for (int d = 0; d < 2; d++) fs->copies[s][d] += f->copies[s][d];
+        fs->hist[flow_bucket(f->copies[0][1])][flow_bucket(f->copies[1][0])]++;
+    }
+}
+
+static void flow_summary(FlowSummary *out) {
+    pool_run(flow_job, NULL);
+    memset(out, 0, sizeof(*out));
+    for (int t = 0; t < pool_threads(); t++) {
+        for (int s = 0; s < 2; s++)
+            for (int d = 0; d < 2; d++) out->copies[s][d] += flow_part[t].copies[s][d];
+        for (int a = 0; a < FLOW_BUCKETS; a++)
+            for (int b = 0; b < FLOW_BUCKETS; b++) out->hist[a][b] += flow_part[t].hist[a][b];
     }
 }
 
 /* -------------------------------------------------------------------------
- * Mutation
+ * Comparator for qsort
  * -------------------------------------------------------------------------*/
-#define SOUP_TOTAL_BYTES  ((uint32_t)(SOUP_SIZE) * BFFO_HALF_LEN)  /* 2^23 */
-#define SOUP_BYTE_MASK    (SOUP_TOTAL_BYTES - 1)                    /* 0x7FFFFF */
+static int cmp_uint32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
 
-static void mutate_soup(double rate, int epoch) {
-    if (rate <= 0.0) return;
+/* -------------------------------------------------------------------------
+ * Per-epoch metrics row.
+ *
+ * One struct feeds both outputs: the binary --metrics stream stores it
+ * verbatim (one row per epoch, see metrics.h), and the stdout TSV is printed
+ * from it on stats epochs.  Cheap columns (op, step and flow histograms) are
+ * filled every epoch; the lineage and complexity columns only on stats
+ * epochs, flagged by full = 1 (NaN / 0 otherwise).  The flow columns are 0
+ * without --flow.  The ops_hist and rep_tape columns are sized for the
+ * largest tape; the file's header gives the soup's half_len + 1 and half_len
+ * elements of them (metrics_cols()).
+ * -------------------------------------------------------------------------*/
+typedef struct {
+    uint32_t epoch;
+    uint32_t full;
+    double   mean_ops;
+    double   median_ops;
+    double   mean_steps;
+    uint32_t max_steps;
+    uint32_t unique_ids;
+    uint32_t modal_id;
+    uint32_t modal_count;
+    double   entropy;
+    double   lz_bpb;
+    double   hoe;
+    uint64_t total_steps;
+    uint32_t zero_steps;
+    uint32_t at_max;
+    uint32_t p50;
+    uint32_t p90;
+    uint32_t p99;
+    uint32_t step_hist[STEP_LOG_BUCKETS];
+    uint32_t ops_hist[BFFO_MAX_HALF_LEN + 1];       /* half_len + 1 used */
+    uint8_t  rep_tape[BFFO_MAX_HALF_LEN];           /* half_len used */
+    uint64_t flow[2][2];                            /* copies [from half][to half] */
+    uint32_t flow_hist[FLOW_BUCKETS][FLOW_BUCKETS];
+} MetricsRow;
 
-    double lambda = SOUP_TOTAL_BYTES * rate;
-    double L = exp(-lambda);
-    double p = 1.0;
-    uint32_t k = 0;
-    do {
-        k++;
-        p *= (double)(xorshift64(&global_rng) >> 11) * (1.0 / (double)(1ULL << 53));
-    } while (p > L);
-    k--;
+static const MetricsCol METRICS_COLS[] = {
+    METRICS_COL(MetricsRow, epoch,       METRICS_U32, 1),
+    METRICS_COL(MetricsRow, full,        METRICS_U32, 1),
+    METRICS_COL(MetricsRow, mean_ops,    METRICS_F64, 1),
+    METRICS_COL(MetricsRow, median_ops,  METRICS_F64, 1),
+    METRICS_COL(MetricsRow, mean_steps,  METRICS_F64, 1),
+    METRICS_COL(MetricsRow, max_steps,   METRICS_U32, 1),
+    METRICS_COL(MetricsRow, unique_ids,  METRICS_U32, 1),
+    METRICS_COL(MetricsRow, modal_id,    METRICS_U32, 1),
+    METRICS_COL(MetricsRow, modal_count, METRICS_U32, 1),
+    METRICS_COL(MetricsRow, entropy,     METRICS_F64, 1),
+    METRICS_COL(MetricsRow, lz_bpb,      METRICS_F64, 1),
+    METRICS_COL(MetricsRow, hoe,         METRICS_F64, 1),
+    METRICS_COL(MetricsRow, total_steps, METRICS_U64, 1),
+    METRICS_COL(MetricsRow, zero_steps,  METRICS_U32, 1),
+    METRICS_COL(MetricsRow, at_max,      METRICS_U32, 1),
+    METRICS_COL(MetricsRow, p50,         METRICS_U32, 1),
+    METRICS_COL(MetricsRow, p90,         METRICS_U32, 1),
+    METRICS_COL(MetricsRow, p99,         METRICS_U32, 1),
+    METRICS_COL(MetricsRow, step_hist,   METRICS_U32, STEP_LOG_BUCKETS),
+    METRICS_COL(MetricsRow, ops_hist,    METRICS_U32, BFFO_MAX_HALF_LEN + 1),
+    METRICS_COL(MetricsRow, rep_tape,    METRICS_U8,  BFFO_MAX_HALF_LEN),
+    METRICS_COL(MetricsRow, flow,        METRICS_U64, 4),
+    METRICS_COL(MetricsRow, flow_hist,   METRICS_U32, FLOW_BUCKETS * FLOW_BUCKETS),
+};
+#define METRICS_NCOLS ((int)(sizeof(METRICS_COLS) / sizeof(METRICS_COLS[0])))
+
+/* METRICS_COLS for a soup of shape sh into cols */
+static const MetricsCol *metrics_cols(MetricsCol cols[METRICS_NCOLS], SoupShape sh) {
+    memcpy(cols, METRICS_COLS, sizeof(METRICS_COLS));
+    for (int c = 0; c < METRICS_NCOLS; c++) {
+        if (!strcmp(cols[c].name, "ops_hist")) cols[c].count = sh.half_len + 1;
+        if (!strcmp(cols[c].name, "rep_tape")) cols[c].count = sh.half_len;
+    }
+    return cols;
+}
+
+/* Fill r for a soup of shape sh (cells; the global soup but for --ensemble
+ * members, NULL for the compact global soup32); ss is the last epoch's step summary (NULL
+ * at epoch 0).  ops, if not NULL, gets each tape's instruction count
+ * (--density).  A compact soup's modal_id is its modal handle's lineage id,
+ * as the 64-bit soup of the same seed reports it. */
+static void metrics_fill(MetricsRow *r, const uint64_t *cells, SoupShape sh, int epoch, int full,
+                         const StepSummary *ss, uint8_t *ops) {
+    memset(r, 0, sizeof(*r));
+    r->epoch = (uint32_t)epoch;
+    r->full  = (uint32_t)full;
+
+    if (cells) {
+        soup_ops_hist_map(cells, sh, r->ops_hist, ops);
+    } else {
+        soup_ops_hist_map32(soup32, sh, r->ops_hist, ops);
+    }
+    soup_ops_mean_median(r->ops_hist, sh, &r->mean_ops, &r->median_ops);
+
+    if (ss) {
+        r->mean_steps  = ss->pairs ? (double)ss->total / ss->pairs : 0.0;
+        r->max_steps   = ss->max;
+        r->total_steps = ss->total;
+        r->zero_steps  = ss->zero;
+        r->at_max      = ss->at_max;
+        r->p50         = ss->p50;
+        r->p90         = ss->p90;
+        r->p99         = ss->p99;
+        memcpy(r->step_hist, ss->hist, sizeof(r->step_hist));
+    }
+    if (ss && soup_flow) {
+        static FlowSummary fs;
+        flow_summary(&fs);
+        memcpy(r->flow, fs.copies, sizeof(r->flow));
+        memcpy(r->flow_hist, fs.hist, sizeof(r->flow_hist));
+    }
 
-    for (uint32_t m = 0; m < k; m++) {
-        uint64_t r   = xorshift64(&global_rng);
-        uint32_t pos = (uint32_t)(r >> 41) & SOUP_BYTE_MASK;
-        uint8_t  val = (uint8_t)(r & 0xFF);
-        soup[pos >> 6][pos & (BFFO_HALF_LEN - 1)] =
-            BFFO_MAKE_TOKEN(next_token_id++, (uint16_t)epoch, val);
+    if (full && cells) {
+        soup_lineage(cells, sh, &r->unique_ids, &r->modal_id, &r->modal_count, r->rep_tape);
+        soup_complexity(cells, sh, &r->entropy, &r->lz_bpb);
+        r->hoe = r->entropy - r->lz_bpb;
+    } else if (full) {
+        uint32_t modal;
+        soup_lineage32(soup32, sh, &r->unique_ids, &modal, &r->modal_count, r->rep_tape);
+        r->modal_id = handles_id(&soup_handles, modal);
+        soup_complexity32(soup32, sh, &r->entropy, &r->lz_bpb);
+        r->hoe = r->entropy - r->lz_bpb;
+    } else {
+        r->entropy = r->lz_bpb = r->hoe = NAN;
     }
 }
 
+static void print_stats_header(FILE *f) {
+    fprintf(f, "%-10s\t%-12s\t%-12s\t%-12s\t%-12s\t%-12s\t%-10s\t%s\t%-8s\t%-8s\t%s\n",
+           "epoch", "mean_ops", "median_ops", "mean_steps", "max_steps",
+           "unique_ids", "modal_id", "representative_tape (modal_count)",
+           "entropy", "lz_bpb", "hoe");
+}
+
+/* One stats row; the representative tape is tape_len chars */
+static void print_soup_stats(FILE *f, const SoupStats *st, uint32_t tape_len) {
+    char rep_str[BFFO_MAX_HALF_LEN + 1];
+    for (uint32_t j = 0; j < tape_len; j++)
+        rep_str[j] = SOUP_IS_OP[st->rep_tape[j]] ? (char)st->rep_tape[j] : ' ';
+    rep_str[tape_len] = '\0';
+    fprintf(f, "%-10d\t%-12.4f\t%-12.1f\t%-12.1f\t%-12u\t%-12u\t%-10u\t|%s| (%u)\t%-8.4f\t%-8.4f\t%.4f\n",
+           st->epoch, st->mean_ops, st->median_ops, st->mean_steps, st->max_steps,
+           st->unique_ids, st->modal_id, rep_str, st->modal_count,
+           st->entropy, st->lz_bpb, st->hoe);
+    fflush(f);
+}
+
+static void print_stats_row(FILE *f, const MetricsRow *r, uint32_t half_len) {
+    SoupStats st = {
+        .epoch = (int)r->epoch, .mean_ops = r->mean_ops, .median_ops = r->median_ops,
+        .mean_steps = r->mean_steps, .max_steps = r->max_steps, .unique_ids = r->unique_ids,
+        .modal_id = r->modal_id, .modal_count = r->modal_count,
+        .entropy = r->entropy, .lz_bpb = r->lz_bpb, .hoe = r->hoe,
+    };
+    memcpy(st.rep_tape, r->rep_tape, half_len);
+    print_soup_stats(f, &st, half_len);
+}
+
 /* -------------------------------------------------------------------------
- * Thread pool
+ * Run-length log: raw pair_steps per epoch, written on a background thread
+ * so the workers do not wait on the disk (bgwrite.c).
  * -------------------------------------------------------------------------*/
+#define RUNLOG_BUFFERS 4
+
+static BgWriter runlog_bg;
+
+static void runlog_job(void *ctx, void *buf, size_t len, int epoch) {
+    (void)epoch;
+    fwrite(buf, 1, len, (FILE *)ctx);
+}
+
+/* Per-pair flow log (--flowlog): pair_flow per epoch, soup_pairs() BffoFlow records */
+static BgWriter flowlog_bg;
+
+/* -------------------------------------------------------------------------
+ * Trace (--trace-dir): the soup after every epoch plus each pair's start
+ * heads and step count, in the delta-compressed format of trace.h.  The
+ * pairing is stored as the global_rng state before shuffle_perm().  Chunks
+ * are encoded on the background writer from a snapshot copy.
+ *
+ * With --trace-sparse only the keyframe epochs are written; soup_replay
+ * recomputes everything in between from them (see soup_core.h).  With
+ * --trigger only the windows around detected events are (see below).
+ *
+ * A --compact soup is traced as 64-bit tokens (soup_tokens()): the trace is
+ * the one the 64-bit soup of the same seed writes, so soup_replay,
+ * soup_query and soup_analyze.py read and replay it unchanged.
+ * -------------------------------------------------------------------------*/
+#define TRACE_BUFFERS 2
+
+enum { TRACE_MODE_DENSE, TRACE_MODE_SPARSE, TRACE_MODE_TRIGGERED };
+static const char *const TRACE_MODE_NAMES[] = { "dense", "sparse", "triggered" };
+
+/* Followed by the epoch's soup_pairs() steps and 2 * soup_pairs() heads */
 typedef struct {
-    uint32_t start;
-    uint32_t end;
-    uint64_t rng;
-} WorkerArgs;
+    TraceEpoch ep;
+    int        keyframe;          /* force a keyframe (a window's base soup) */
+    uint64_t   cells[];           /* soup_cells(soup_shape) */
+} TraceSnapshot;
 
-static WorkerArgs        worker_args[MAX_THREADS];
-static pthread_barrier_t barrier_start;
-static pthread_barrier_t barrier_end;
-static volatile int      pool_shutdown = 0;
-static int               g_nthreads    = 0;
-static uint32_t          pair_steps[NPAIRS];
+static size_t trace_snapshot_bytes(void) {
+    return sizeof(TraceSnapshot) + soup_cells(soup_shape) * sizeof(uint64_t) +
+           (size_t)soup_pairs() * (sizeof(uint32_t) + 2);
+}
 
-static void *worker_thread(void *arg) {
-    WorkerArgs *a = (WorkerArgs *)arg;
-    uint64_t combined[BFFO_TAPE_LEN];
+static uint32_t *snap_steps(TraceSnapshot *snap) {
+    return (uint32_t *)(snap->cells + soup_cells(soup_shape));
+}
 
-    for (;;) {
-        pthread_barrier_wait(&barrier_start);
-        if (pool_shutdown) break;
+static uint8_t *snap_heads(TraceSnapshot *snap) {
+    return (uint8_t *)(snap_steps(snap) + soup_pairs());
+}
 
-        uint64_t rng = a->rng;
-        for (uint32_t i = a->start; i < a->end; i++) {
-            uint32_t ai = perm[i];
-            uint32_t bi = perm[i + NPAIRS];
+static TraceWriter trace;
+static BgWriter    trace_bg;
 
-            memcpy(combined,                  soup[ai], BFFO_HALF_LEN * sizeof(uint64_t));
-            memcpy(combined + BFFO_HALF_LEN,  soup[bi], BFFO_HALF_LEN * sizeof(uint64_t));
+static void trace_job(void *ctx, void *buf, size_t len, int epoch) {
+    (void)ctx; (void)len;
+    const TraceSnapshot *snap = buf;
+    if (snap->keyframe) trace.need_keyframe = 1;
+    if (!trace_write(&trace, &snap->ep, snap->cells))
+        fprintf(stderr, "Trace: epoch %d not saved: %s\n", epoch, strerror(errno));
+}
 
-            /* head0 and head1 are random per pair */
-            uint8_t h0 = (uint8_t)(xorshift64(&rng) & (BFFO_TAPE_LEN - 1));
-            uint8_t h1 = (uint8_t)(xorshift64(&rng) & (BFFO_TAPE_LEN - 1));
+/* Record the epoch just run into snap */
+static void trace_fill(TraceSnapshot *snap, int epoch, uint64_t rng_state) {
+    TraceEpoch ep = { epoch, rng_state, global_rng, next_token_id, epoch ? soup_pairs() : 0,
+                      epoch ? snap_steps(snap) : NULL, epoch ? snap_heads(snap) : NULL };
+    snap->ep       = ep;
+    snap->keyframe = 0;
+    memcpy(snap_steps(snap), pair_steps, soup_pairs() * sizeof(uint32_t));
+    memcpy(snap_heads(snap), pair_heads, soup_pairs() * 2);
+    soup_tokens(snap->cells);
+}
 
-            pair_steps[i] = bffo_run(combined, h0, h1);
+static void trace_epoch(int epoch, uint64_t rng_state) {
+    TraceSnapshot *snap = bgw_acquire(&trace_bg);
+    trace_fill(snap, epoch, rng_state);
+    bgw_submit(&trace_bg, trace_snapshot_bytes(), epoch);
+}
 
-            memcpy(soup[ai], combined,                  BFFO_HALF_LEN * sizeof(uint64_t));
-            memcpy(soup[bi], combined + BFFO_HALF_LEN,  BFFO_HALF_LEN * sizeof(uint64_t));
-        }
+/* Queue an earlier epoch kept by trace_fill as a keyframe */
+static void trace_keyframe_copy(const TraceSnapshot *src) {
+    TraceSnapshot *snap = bgw_acquire(&trace_bg);
+    memcpy(snap, src, trace_snapshot_bytes());
+    if (snap->ep.steps) {
+        snap->ep.steps = snap_steps(snap);
+        snap->ep.heads = snap_heads(snap);
+    }
+    snap->keyframe = 1;
+    bgw_submit(&trace_bg, trace_snapshot_bytes(), snap->ep.epoch);
+}
+
+static int trace_start(const char *dir, int keyframe_every, int mode, int epochs, double mutation_rate,
+                       uint64_t seed, int resume_epoch) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/metadata.txt", dir);
+    FILE *mf = fopen(path, "w");
+    if (!mf) { perror(path); return -1; }
+    fprintf(mf, "soup_size=%u\nhalf_len=%u\nnpairs=%u\n"
+                "seed=%llu\nepochs=%d\nmutation_rate=%g\n"
+                "interpreter=bff_orig\nmax_steps=%u\nstack_depth=%u\n"
+                "trace_format=delta%d\nkeyframe_interval=%d\ntrace_mode=%s\n",
+            soup_shape.ntapes, soup_shape.half_len, soup_pairs(), (unsigned long long)seed,
+            epochs, mutation_rate, soup_max_steps, soup_stack_depth, TRACE_VERSION, keyframe_every,
+            TRACE_MODE_NAMES[mode]);
+    if (soup32) fprintf(mf, "compact=1\n");
+    fclose(mf);
+
+    /* A resumed run appends to the trace it was writing, from a fresh keyframe */
+    size_t ncells = soup_cells(soup_shape);
+    int opened = resume_epoch > 0 ? trace_reopen(&trace, dir, ncells, soup_pairs(), resume_epoch)
+                                  : trace_open(&trace, dir, ncells, soup_pairs(), keyframe_every);
+    if (opened < 0 || bgw_start(&trace_bg, TRACE_BUFFERS, trace_snapshot_bytes(), trace_job, NULL) < 0) {
+        perror(dir);
+        return -1;
+    }
+    fprintf(stderr, "Trace: %s, keyframe every %d epochs%s\n", dir, trace.keyframe_interval,
+            mode == TRACE_MODE_SPARSE ? " (sparse: keyframes only)" :
+            mode == TRACE_MODE_TRIGGERED ? " (triggered windows only)" : "");
+    if (resume_epoch == 0) trace_epoch(0, 0);
+    return 0;
+}
+
+static void trace_finish(void) {
+    uint64_t stalls = trace_bg.stalls;
+    bgw_stop(&trace_bg);
+    fprintf(stderr, "Trace: %d epochs in %.1f MB (%.0fx smaller than raw snapshots), %llu writer stalls\n",
+            trace.nchunks, trace.offset / 1e6, (double)trace.raw_total / (double)trace.offset,
+            (unsigned long long)stalls);
+    trace_close(&trace);
+}
+
+/* -------------------------------------------------------------------------
+ * Triggered tracing (--trace-dir DIR --trigger SPEC): the trace holds only
+ * dense windows around events.  Every --trigger-ring K epochs the epoch's
+ * soup, pairing, heads and steps are copied into one of two in-memory
+ * snapshots, so the older one is always K..2K epochs old.  When a trigger
+ * fires at epoch T that snapshot is written as a keyframe (the epochs
+ * between it and T follow from it deterministically and are recomputed on
+ * demand by soup_replay) and every epoch from T to T + --trigger-dense M
+ * is traced in full; a trigger inside a window extends it.  Events are
+ * logged to DIR/triggers.tsv.
+ *
+ * Triggers compare estimates from a fixed sample of the soup (1 cell in
+ * 128, 1 tape in 8; ~2 ms per epoch for the paper's soup) against their value `window` epochs
+ * earlier:
+ *   unique_drop=F    distinct token ids among the sampled cells fell by
+ *                    more than fraction F
+ *   ops_jump=D       mean instructions per sampled tape rose by more than D
+ *   modal_growth=X   the modal lineage grew more than X-fold (needs >= 8
+ *                    sampled cells)
+ *   window=W         comparison distance in epochs (default 10)
+ * -------------------------------------------------------------------------*/
+#define CELL_STRIDE       128
+#define TAPE_STRIDE       8
+#define TRIGGER_MAX_WIN   256
+
+typedef struct {
+    double unique_drop;       /* 0 = off */
+    double ops_jump;
+    double modal_growth;
+    int    window;
+} TriggerSpec;
 
-        pthread_barrier_wait(&barrier_end);
+typedef struct {
+    double unique;            /* distinct ids among the sampled cells */
+    double mean_ops;
+    double modal;             /* estimated cells of the modal lineage */
+} CheapMetrics;
+
+typedef struct {
+    TriggerSpec  spec;
+    int          ring;                      /* snapshot interval K */
+    int          dense;                     /* window length M */
+    int          dense_until;               /* last epoch of the current window, or -1 */
+    int          last_written;              /* last epoch in the trace */
+    CheapMetrics hist[TRIGGER_MAX_WIN];     /* by epoch % window */
+    TraceSnapshot *snap[2];                 /* ring snapshots */
+    int          snap_epoch[2];             /* -1 = empty */
+    uint32_t    *ids;                       /* cell samples, scratch */
+    uint32_t     nids;
+    FILE        *log;
+    int          fired;
+} Trigger;
+
+static Trigger trig;
+
+static void cheap_metrics(CheapMetrics *m) {
+    uint32_t half = soup_shape.half_len, ntapes = soup_shape.ntapes;
+    uint32_t tapes = 0;
+    uint64_t ops = 0;
+    for (uint32_t i = 0; i < ntapes; i += TAPE_STRIDE, tapes++)
+        ops += (uint64_t)(soup32 ? bffo_count_ops_n32(&soup32[(size_t)i * half], half)
+                                 : bffo_count_ops_n(soup_tape(i), half));
+    m->mean_ops = (double)ops / tapes;
+
+    /* One cell per CELL_STRIDE, at a position that varies along the soup */
+    uint32_t *ids = trig.ids;
+    const uint64_t *cells = soup;
+    for (uint32_t k = 0; k < trig.nids; k++) {
+        size_t n = (size_t)k * CELL_STRIDE + ((k * 37) & (CELL_STRIDE - 1));
+        ids[k] = cells ? BFFO_TOKEN_ID(cells[n])
+                       : handles_id(&soup_handles, BFFO_CTOKEN_HANDLE(soup32[n]));
+    }
+    qsort(ids, trig.nids, sizeof(uint32_t), cmp_uint32);
+    uint32_t distinct = 1, best = 1, run = 1;
+    for (uint32_t k = 1; k < trig.nids; k++) {
+        run = ids[k] == ids[k - 1] ? run + 1 : 1;
+        distinct += run == 1;
+        if (run > best) best = run;
+    }
+    m->unique = distinct;
+    m->modal  = best >= 8 ? (double)best * CELL_STRIDE : 0.0;
+}
+
+static int parse_trigger(const char *spec, TriggerSpec *t) {
+    memset(t, 0, sizeof(*t));
+    t->window = 10;
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *save = NULL, *kv = strtok_r(buf, ",", &save); kv; kv = strtok_r(NULL, ",", &save)) {
+        char *v = strchr(kv, '=');
+        if (!v) return -1;
+        *v++ = '\0';
+        if      (!strcmp(kv, "unique_drop"))  t->unique_drop  = strtod(v, NULL);
+        else if (!strcmp(kv, "ops_jump"))     t->ops_jump     = strtod(v, NULL);
+        else if (!strcmp(kv, "modal_growth")) t->modal_growth = strtod(v, NULL);
+        else if (!strcmp(kv, "window"))       t->window       = atoi(v);
+        else return -1;
+    }
+    return t->window >= 1 && t->window <= TRIGGER_MAX_WIN ? 0 : -1;
+}
+
+static int trigger_start(const char *dir, const TriggerSpec *spec, int ring, int dense) {
+    memset(&trig, 0, sizeof(trig));
+    trig.spec         = *spec;
+    trig.ring         = ring > 0 ? ring : 1;
+    trig.dense        = dense > 0 ? dense : 1;
+    trig.dense_until  = -1;
+    trig.last_written = 0;    /* trace_start wrote epoch 0 */
+    for (int b = 0; b < 2; b++) {
+        trig.snap[b]       = malloc(trace_snapshot_bytes());
+        trig.snap_epoch[b] = -1;
+        if (!trig.snap[b]) { perror("trigger ring"); return -1; }
+    }
+    trig.nids = (uint32_t)(soup_cells(soup_shape) / CELL_STRIDE);
+    if (trig.nids == 0) trig.nids = 1;
+    if (!(trig.ids = malloc(trig.nids * sizeof(uint32_t)))) { perror("trigger samples"); return -1; }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/triggers.tsv", dir);
+    trig.log = fopen(path, "w");
+    if (!trig.log) { perror(path); return -1; }
+    fprintf(trig.log, "epoch\ttrigger\tvalue\tbaseline\tbase_epoch\tdense_until\n");
+    fprintf(stderr, "Trigger: ring every %d epochs, dense window %d epochs, window %d "
+                    "(unique_drop %g, ops_jump %g, modal_growth %g)\n",
+            trig.ring, trig.dense, spec->window, spec->unique_drop, spec->ops_jump, spec->modal_growth);
+    return 0;
+}
+
+/* Name of the first trigger that fires for cur against prev, with its value and baseline */
+static const char *trigger_check(const CheapMetrics *cur, const CheapMetrics *prev,
+                                 double *value, double *baseline) {
+    const TriggerSpec *t = &trig.spec;
+    if (t->unique_drop > 0 && cur->unique < (1.0 - t->unique_drop) * prev->unique) {
+        *value = cur->unique; *baseline = prev->unique;
+        return "unique_drop";
+    }
+    if (t->ops_jump > 0 && cur->mean_ops - prev->mean_ops > t->ops_jump) {
+        *value = cur->mean_ops; *baseline = prev->mean_ops;
+        return "ops_jump";
+    }
+    if (t->modal_growth > 0 && cur->modal > 0 &&
+        cur->modal > t->modal_growth * (prev->modal > 0 ? prev->modal : 8.0 * CELL_STRIDE)) {
+        *value = cur->modal; *baseline = prev->modal;
+        return "modal_growth";
     }
     return NULL;
 }
 
+/* After each epoch: update the estimates, fire, trace inside windows, refresh the ring. */
+static void trigger_epoch(int epoch, uint64_t shuffle_rng) {
+    CheapMetrics cur;
+    cheap_metrics(&cur);
+    int w = trig.spec.window;
+    CheapMetrics *slot = &trig.hist[epoch % w];
+
+    double value, baseline;
+    const char *name = epoch > w ? trigger_check(&cur, slot, &value, &baseline) : NULL;
+    *slot = cur;
+
+    if (name) {
+        int base = -1;
+        if (epoch > trig.dense_until) {
+            /* New window: write the older ring snapshot unless the trace already reaches it */
+            int b = trig.snap_epoch[0] < trig.snap_epoch[1] ? 0 : 1;
+            if (trig.snap_epoch[b] < 0) b ^= 1;
+            if (trig.snap_epoch[b] > trig.last_written) {
+                base = trig.snap_epoch[b];
+                trace_keyframe_copy(trig.snap[b]);
+            }
+        }
+        trig.dense_until = epoch + trig.dense;
+        trig.fired++;
+        fprintf(trig.log, "%d\t%s\t%.4f\t%.4f\t%d\t%d\n", epoch, name, value, baseline, base,
+                trig.dense_until);
+        fflush(trig.log);
+        fprintf(stderr, "Trigger: %s at epoch %d (%.4g vs %.4g), tracing to epoch %d\n",
+                name, epoch, value, baseline, trig.dense_until);
+    }
+
+    if (epoch <= trig.dense_until) {
+        trace_epoch(epoch, shuffle_rng);
+        trig.last_written = epoch;
+    }
+
+    if (epoch % trig.ring == 0) {
+        int b = trig.snap_epoch[0] <= trig.snap_epoch[1] ? 0 : 1;   /* replace the older one */
+        trace_fill(trig.snap[b], epoch, shuffle_rng);
+        trig.snap_epoch[b] = epoch;
+    }
+}
+
+static void trigger_finish(void) {
+    fprintf(stderr, "Trigger: %d events\n", trig.fired);
+    fclose(trig.log);
+    free(trig.snap[0]);
+    free(trig.snap[1]);
+    free(trig.ids);
+}
+
 /* -------------------------------------------------------------------------
- * Run one epoch: shuffle, seed workers, sync
+ * Checkpoints (--checkpoint-every / --resume): the whole simulation state --
+ * soup, global_rng and next_token_id (see soup_core.h) -- in the mmap-able
+ * format of checkpoint.h.  The soup is copied into the slot of a one-buffer
+ * background writer, which writes and renames the file while the next
+ * epochs run.  A compact soup (--compact) stores its 32-bit cells in the
+ * first half of the slot and its handle table in ckpt_tail, which the one
+ * slot also guards.  SIGTERM or SIGINT ends the run after the current epoch
+ * with a final checkpoint.
  * -------------------------------------------------------------------------*/
-static void soup_epoch(void) {
-    shuffle_perm();
-    for (int t = 0; t < g_nthreads; t++)
-        worker_args[t].rng = xorshift64(&global_rng);
-    pthread_barrier_wait(&barrier_start);
-    pthread_barrier_wait(&barrier_end);
+typedef struct {
+    union {
+        CheckpointHeader h;
+        uint8_t          page[CKPT_HEADER_BYTES];
+    } hdr;
+    uint64_t cells[];                  /* soup_cells(soup_shape) */
+} CheckpointImage;
+
+/* The global soup's cells in bytes */
+static size_t soup_bytes(void) {
+    return soup_cells(soup_shape) * (soup32 ? sizeof(uint32_t) : sizeof(uint64_t));
+}
+
+static BgWriter    ckpt_bg;
+static const char *ckpt_path;
+static uint8_t    *ckpt_tail;          /* compact: handles_save() of the slot's epoch */
+static size_t      ckpt_tail_bytes;
+static volatile sig_atomic_t stop_requested;
+
+static void on_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void ckpt_job(void *ctx, void *buf, size_t len, int epoch) {
+    (void)ctx;
+    if (ckpt_write_tail(ckpt_path, buf, len, ckpt_tail, ckpt_tail_bytes) < 0)
+        fprintf(stderr, "Checkpoint at epoch %d: %s: %s\n", epoch, ckpt_path, strerror(errno));
+}
+
+static void checkpoint(int epoch, uint64_t seed, double mutation_rate) {
+    CheckpointImage *img = bgw_acquire(&ckpt_bg);
+    memset(&img->hdr, 0, sizeof(img->hdr));
+    CheckpointHeader *h = &img->hdr.h;
+    ckpt_header_init(h, soup_shape.ntapes, soup_shape.half_len);
+    h->epoch         = epoch;
+    h->next_token_id = next_token_id;
+    h->global_rng    = global_rng;
+    h->seed          = seed;
+    h->mutation_rate = mutation_rate;
+    h->max_steps     = soup_max_steps;
+    h->stack_depth   = soup_stack_depth;
+    if (soup_grid) {
+        h->grid_width  = soup_grid->width;
+        h->grid_height = soup_grid->height;
+        h->grid_radius = soup_grid->radius;
+    }
+    if (!soup32) {
+        memcpy(img->cells, soup, soup_bytes());
+        bgw_submit(&ckpt_bg, sizeof(*img) + soup_bytes(), epoch);
+        return;
+    }
+    h->token_bytes     = sizeof(uint32_t);
+    h->soup_bytes      = soup_bytes();
+    h->handles_used    = soup_handles.used;
+    h->handles_free    = soup_handles.nfree;
+    h->handles_limit   = soup_handles.limit;
+    h->next_lineage_id = soup_handles.next_id;
+    memcpy(img->cells, soup32, soup_bytes());
+    ckpt_tail_bytes = handles_bytes(&soup_handles);
+    handles_save(&soup_handles, ckpt_tail);
+    bgw_submit(&ckpt_bg, CKPT_HEADER_BYTES + soup_bytes(), epoch);
+}
+
+/* Restore a compact checkpoint's handle table into soup_handles (h from its cells' read) */
+static int restore_handles(const char *path, const CheckpointHeader *h) {
+    size_t bytes = handles_tail_bytes(h->handles_used, h->handles_free);
+    void *buf = malloc(bytes ? bytes : 1);
+    if (!buf) return -1;
+    int rc = ckpt_read_tail(path, h, buf, bytes);
+    if (rc == 0) rc = handles_restore(&soup_handles, buf, h->handles_used, h->handles_free, h->handles_limit,
+                                      h->next_lineage_id);
+    int err = errno;
+    free(buf);
+    errno = err;
+    return rc;
+}
+
+/* Reopen a per-epoch TSV for appending, dropping rows after epoch (header kept). */
+static FILE *reopen_tsv(const char *path, int epoch) {
+    FILE *f = fopen(path, "r+");
+    if (!f) return NULL;
+    char  line[4096];
+    off_t keep = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] >= '0' && line[0] <= '9' && atoi(line) > epoch) break;
+        keep = ftello(f);
+    }
+    if (ftruncate(fileno(f), keep) < 0 || fseeko(f, keep, SEEK_SET) < 0) { fclose(f); return NULL; }
+    return f;
+}
+
+/* Reopen a fixed-record file for appending after nrecords records of rec_bytes. */
+static FILE *reopen_records(const char *path, size_t rec_bytes, uint64_t nrecords) {
+    FILE *f = fopen(path, "r+b");
+    if (!f) return NULL;
+    off_t keep = (off_t)(rec_bytes * nrecords);
+    fseeko(f, 0, SEEK_END);
+    if (ftello(f) < keep) keep = ftello(f) / (off_t)rec_bytes * (off_t)rec_bytes;
+    if (ftruncate(fileno(f), keep) < 0 || fseeko(f, keep, SEEK_SET) < 0) { fclose(f); return NULL; }
+    return f;
 }
 
 /* -------------------------------------------------------------------------
- * Comparator for qsort
+ * Density snapshots (--density DIR): DIR/density_EPOCH.pgm on stats epochs,
+ * a binary PGM with one pixel per tape of the --grid torus whose grey level
+ * is the tape's instruction count (maxval the tape length half_len).  The counts come
+ * out of the stats epoch's ops histogram, so a snapshot costs one small write.
  * -------------------------------------------------------------------------*/
-static int cmp_uint32(const void *a, const void *b) {
-    uint32_t x = *(const uint32_t *)a;
-    uint32_t y = *(const uint32_t *)b;
-    return (x > y) - (x < y);
+static void write_density(const char *dir, int epoch, const uint8_t *ops) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/density_%06d.pgm", dir, epoch);
+    FILE *f = fopen(path, "wb");
+    if (!f) { perror(path); return; }
+    fprintf(f, "P5\n%u %u\n%u\n", soup_grid->width, soup_grid->height, soup_shape.half_len);
+    size_t n = fwrite(ops, 1, soup_shape.ntapes, f);
+    if (fclose(f) != 0 || n != soup_shape.ntapes) perror(path);
 }
 
 /* -------------------------------------------------------------------------
- * Statistics
+ * What-if branches (--fork-at E --branch SPEC ...): the run stops after
+ * epoch E, closes its outputs, and fork(2)s one child per branch.  Each child
+ * applies its overrides and runs on to --epochs with its own worker pool,
+ * writing stats.tsv, metrics.bin and spec.txt to BRANCH_DIR/NAME.  The soup
+ * is shared copy-on-write with the parent, and a branch (soup_cow_shared)
+ * only stores tapes that changed, so its memory grows with the pages it has
+ * diverged on.
+ *
+ * SPEC is a comma-separated list of
+ *   name=NAME        output subdirectory (default bK)
+ *   mutation=R       mutation rate
+ *   max_steps=S      per-pair step limit (at most BFFO_MAX_STEPS)
+ *   knockout=ID      replace every token of lineage ID (or "modal") with a
+ *                    fresh random token at the fork
+ *   reseed=S         mix S into global_rng, for replicate branches
  * -------------------------------------------------------------------------*/
-static void soup_stats(double *mean_out, double *median_out, uint32_t *unique_out,
-                       uint32_t *modal_id_out, uint32_t *modal_count_out,
-                       char rep_str[BFFO_HALF_LEN + 1]) {
-    uint32_t freq[BFFO_HALF_LEN + 1];
-    memset(freq, 0, sizeof(freq));
-
-    uint64_t total = 0;
-    for (uint32_t i = 0; i < SOUP_SIZE; i++) {
-        int ops = bffo_count_ops(soup[i]);
-        freq[ops]++;
-        total += (uint64_t)ops;
-    }
-
-    *mean_out = (double)total / SOUP_SIZE;
-
-    uint32_t pos_lo = SOUP_SIZE / 2 - 1;
-    uint32_t pos_hi = SOUP_SIZE / 2;
-    uint32_t cumul  = 0;
-    int lo_val = -1, hi_val = -1;
-    for (int v = 0; v <= BFFO_HALF_LEN; v++) {
-        cumul += freq[v];
-        if (lo_val < 0 && cumul > pos_lo) lo_val = v;
-        if (hi_val < 0 && cumul > pos_hi) hi_val = v;
-        if (lo_val >= 0 && hi_val >= 0) break;
-    }
-    *median_out = (lo_val + hi_val) / 2.0;
-
-    static uint32_t ids[SOUP_SIZE * BFFO_HALF_LEN];
+#define MAX_BRANCHES 64
+
+typedef struct {
+    char     name[64];
+    double   mutation_rate;   /* < 0: inherit */
+    uint32_t max_steps;       /* 0: inherit */
+    int      knockout;        /* 0 none, 1 id, 2 modal */
+    uint32_t knockout_id;
+    uint64_t reseed;          /* 0: none */
+} BranchSpec;
+
+static int parse_branch(const char *spec, BranchSpec *b, int index) {
+    memset(b, 0, sizeof(*b));
+    snprintf(b->name, sizeof(b->name), "b%d", index);
+    b->mutation_rate = -1.0;
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *save = NULL, *kv = strtok_r(buf, ",", &save); kv; kv = strtok_r(NULL, ",", &save)) {
+        char *v = strchr(kv, '=');
+        if (!v) return -1;
+        *v++ = '\0';
+        if      (!strcmp(kv, "name"))      snprintf(b->name, sizeof(b->name), "%s", v);
+        else if (!strcmp(kv, "mutation"))  b->mutation_rate = strtod(v, NULL);
+        else if (!strcmp(kv, "max_steps")) b->max_steps     = (uint32_t)strtoul(v, NULL, 10);
+        else if (!strcmp(kv, "reseed"))    b->reseed        = strtoull(v, NULL, 10);
+        else if (!strcmp(kv, "knockout")) {
+            b->knockout    = strcmp(v, "modal") ? 1 : 2;
+            b->knockout_id = (uint32_t)strtoul(v, NULL, 10);
+        }
+        else return -1;
+    }
+    if (b->max_steps > BFFO_MAX_STEPS || strchr(b->name, '/')) return -1;
+    return 0;
+}
+
+/* Replace every token of lineage id with a fresh random token; returns the
+ * count.  A compact soup's new tokens get new handles, collecting as
+ * soup_core_mutate() does. */
+static uint32_t knockout_lineage(uint32_t id, int epoch) {
     uint32_t n = 0;
-    for (uint32_t i = 0; i < SOUP_SIZE; i++)
-        for (int j = 0; j < BFFO_HALF_LEN; j++)
-            ids[n++] = BFFO_TOKEN_ID(soup[i][j]);
-    qsort(ids, n, sizeof(uint32_t), cmp_uint32);
-    uint32_t unique = 0;
-    for (uint32_t i = 0; i < n; i++)
-        if (i == 0 || ids[i] != ids[i - 1]) unique++;
-    *unique_out = unique;
-
-    uint32_t modal_id = ids[0], modal_count = 0;
-    uint32_t cur_id = ids[0], cur_count = 1;
-    for (uint32_t i = 1; i < n; i++) {
-        if (ids[i] == cur_id) {
-            cur_count++;
+    size_t ncells = soup_cells(soup_shape);
+    if (soup32) {
+        for (size_t c = 0; c < ncells; c++)
+            if (handles_id(&soup_handles, BFFO_CTOKEN_HANDLE(soup32[c])) == id) {
+                uint8_t ch = (uint8_t)(xorshift64(&global_rng) & 0xFF);
+                if (handles_due(&soup_handles)) {
+                    soup32[c] = 0;
+                    handles_collect(&soup_handles, soup32, ncells);
+                }
+                soup32[c] = BFFO_MAKE_CTOKEN(handles_new(&soup_handles, epoch), ch);
+                next_token_id++;
+                n++;
+            }
+        return n;
+    }
+    for (size_t c = 0; c < ncells; c++)
+        if (BFFO_TOKEN_ID(soup[c]) == id) {
+            uint8_t ch = (uint8_t)(xorshift64(&global_rng) & 0xFF);
+            soup[c] = BFFO_MAKE_TOKEN(next_token_id++, (uint16_t)epoch, ch);
+            n++;
+        }
+    return n;
+}
+
+/* Private (diverged) memory of this process in kB, from /proc; 0 if unavailable. */
+static long private_dirty_kb(void) {
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) return 0;
+    char line[256];
+    long kb = 0, v;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "Private_Dirty: %ld kB", &v) == 1) kb += v;
+    fclose(f);
+    return kb;
+}
+
+/* Body of one forked branch: epochs from+1..to.  Returns the exit status. */
+static int run_branch(const BranchSpec *b, const char *dir, int from, int to, int nthreads,
+                      int stats_interval, double mutation_rate, uint64_t seed) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, b->name);
+    mkdir(path, 0777);
+
+    long base_kb = private_dirty_kb();
+    soup_cow_shared = 1;                         /* the soup's pages are still the parent's */
+    if (b->mutation_rate >= 0.0) mutation_rate = b->mutation_rate;
+    if (b->max_steps)            soup_max_steps = b->max_steps;
+    if (b->reseed) {
+        global_rng ^= splitmix64(b->reseed);
+        if (!global_rng) global_rng = 1;
+    }
+    uint32_t knocked = 0, knock_id = b->knockout_id;
+    if (b->knockout == 2) {
+        uint32_t unique, count;
+        uint8_t  rep[BFFO_MAX_HALF_LEN];
+        if (soup32) {
+            soup_lineage32(soup32, soup_shape, &unique, &knock_id, &count, rep);
+            knock_id = handles_id(&soup_handles, knock_id);
         } else {
-            if (cur_count > modal_count) { modal_count = cur_count; modal_id = cur_id; }
-            cur_id = ids[i];
-            cur_count = 1;
+            soup_lineage(soup, soup_shape, &unique, &knock_id, &count, rep);
         }
     }
-    if (cur_count > modal_count) { modal_count = cur_count; modal_id = cur_id; }
-    *modal_id_out    = modal_id;
-    *modal_count_out = modal_count;
+    if (b->knockout) knocked = knockout_lineage(knock_id, from);
 
-    uint32_t best_tape = 0, best_count = 0;
-    for (uint32_t i = 0; i < SOUP_SIZE; i++) {
-        uint32_t cnt = 0;
-        for (int j = 0; j < BFFO_HALF_LEN; j++)
-            cnt += (BFFO_TOKEN_ID(soup[i][j]) == modal_id);
-        if (cnt > best_count) { best_count = cnt; best_tape = i; }
+    snprintf(path, sizeof(path), "%s/%s/spec.txt", dir, b->name);
+    FILE *sf = fopen(path, "w");
+    if (!sf) { perror(path); return 1; }
+    fprintf(sf, "name=%s\nfork_epoch=%d\nepochs=%d\nseed=%llu\nmutation_rate=%g\nmax_steps=%u\n"
+                "reseed=%llu\n", b->name, from, to, (unsigned long long)seed, mutation_rate,
+            soup_max_steps, (unsigned long long)b->reseed);
+    if (b->knockout) fprintf(sf, "knockout_id=%u\nknockout_tokens=%u\n", knock_id, knocked);
+    fclose(sf);
+
+    snprintf(path, sizeof(path), "%s/%s/stats.tsv", dir, b->name);
+    if (!freopen(path, "w", stdout)) { perror(path); return 1; }
+    Metrics    metrics;
+    MetricsCol cols[METRICS_NCOLS];
+    snprintf(path, sizeof(path), "%s/%s/metrics.bin", dir, b->name);
+    if (metrics_open(&metrics, path, metrics_cols(cols, soup_shape), METRICS_NCOLS, sizeof(MetricsRow)) < 0) {
+        perror(path);
+        return 1;
+    }
+
+    pool_start(nthreads);
+    MetricsRow  row;
+    StepSummary ss;
+    print_stats_header(stdout);
+    metrics_fill(&row, soup, soup_shape, from, 1, NULL, NULL);
+    print_stats_row(stdout, &row, soup_shape.half_len);
+    metrics_append(&metrics, &row);
+    for (int epoch = from + 1; epoch <= to && !stop_requested; epoch++) {
+        soup_epoch();
+        mutate_soup(mutation_rate, epoch);
+        int stats_epoch = epoch % stats_interval == 0 || epoch == to;
+        soup_step_summary(pair_steps, soup_npairs, &ss);
+        metrics_fill(&row, soup, soup_shape, epoch, stats_epoch, &ss, NULL);
+        metrics_append(&metrics, &row);
+        if (stats_epoch) {
+            print_stats_row(stdout, &row, soup_shape.half_len);
+            metrics_flush(&metrics);
+        }
+    }
+    pool_stop();
+    metrics_close(&metrics);
+
+    fprintf(stderr, "Branch %s: epochs %d..%d done, %ld MB of private copy-on-write memory\n",
+            b->name, from + 1, to, (private_dirty_kb() - base_kb) / 1024);
+    return 0;
+}
+
+/* Fork every branch from the current state and wait for them.  Returns the exit status. */
+static int run_branches(const BranchSpec *branches, int nbranches, const char *dir, int from, int to,
+                        int nthreads, int stats_interval, double mutation_rate, uint64_t seed) {
+    mkdir(dir, 0777);
+    int per_branch = nthreads / nbranches > 0 ? nthreads / nbranches : 1;
+    fprintf(stderr, "Forking %d branches at epoch %d into %s, %d threads each\n",
+            nbranches, from, dir, per_branch);
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pids[MAX_BRANCHES];
+    for (int k = 0; k < nbranches; k++) {
+        pids[k] = fork();
+        if (pids[k] < 0) { perror("fork"); return 1; }
+        if (pids[k] == 0)
+            _exit(run_branch(&branches[k], dir, from, to, per_branch, stats_interval, mutation_rate, seed));
+    }
+
+    int failed = 0;
+    for (int k = 0; k < nbranches; k++) {
+        int status;
+        while (waitpid(pids[k], &status, 0) < 0 && errno == EINTR) {
+            /* a stop signal is handled by each branch itself */
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Branch %s failed\n", branches[k].name);
+            failed = 1;
+        }
+    }
+    return failed;
+}
+
+/* -------------------------------------------------------------------------
+ * Ensemble (--ensemble K / --member SPEC): K independent soups in this one
+ * process, in lockstep through soup_run_epochs_many(), which hands every
+ * soup's pairs to the pool as one interleaved job instead of K processes
+ * competing for cores and cache.  Each member writes stats.tsv, metrics.bin
+ * and spec.txt to ENSEMBLE_DIR/NAME, as a branch does; with --tapes or
+ * --tape-len every member has that shape.  With --compact (32-bit tokens,
+ * soup_core.h) members write stats.tsv (from soup_get_stats) and spec.txt
+ * only, as metrics_fill() reads 64-bit cells or the global compact soup.
+ *
+ * SPEC is a comma-separated list of
+ *   name=NAME        output subdirectory (default sK)
+ *   seed=S           seed (default --seed + K, or from an address)
+ *   mutation=R       mutation rate (default --mutation)
+ *   max_steps=S      per-pair step limit (at most BFFO_MAX_STEPS)
+ * Members without a --member spec take the defaults.
+ * -------------------------------------------------------------------------*/
+#define MAX_MEMBERS 256
+
+typedef struct {
+    char     name[64];
+    uint64_t seed;
+    int      seed_set;
+    double   mutation_rate;   /* < 0: --mutation */
+    uint32_t max_steps;       /* 0: --max-steps */
+} MemberSpec;
+
+static void member_defaults(MemberSpec *m, int index) {
+    memset(m, 0, sizeof(*m));
+    snprintf(m->name, sizeof(m->name), "s%d", index);
+    m->mutation_rate = -1.0;
+}
+
+static int parse_member(const char *spec, MemberSpec *m, int index) {
+    member_defaults(m, index);
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *save = NULL, *kv = strtok_r(buf, ",", &save); kv; kv = strtok_r(NULL, ",", &save)) {
+        char *v = strchr(kv, '=');
+        if (!v) return -1;
+        *v++ = '\0';
+        if      (!strcmp(kv, "name"))      snprintf(m->name, sizeof(m->name), "%s", v);
+        else if (!strcmp(kv, "seed"))      m->seed = strtoull(v, NULL, 10), m->seed_set = 1;
+        else if (!strcmp(kv, "mutation"))  m->mutation_rate = strtod(v, NULL);
+        else if (!strcmp(kv, "max_steps")) m->max_steps     = (uint32_t)strtoul(v, NULL, 10);
+        else return -1;
+    }
+    if (m->max_steps > BFFO_MAX_STEPS || strchr(m->name, '/')) return -1;
+    return 0;
+}
+
+typedef struct {
+    Soup   *soup;
+    FILE   *stats;
+    Metrics metrics;
+} Member;
+
+/* Run the members of the given shape to epoch `epochs`.  Returns the exit status. */
+static int run_ensemble(const MemberSpec *specs, int nmembers, const char *dir, int epochs,
+                        int nthreads, int stats_interval, double mutation_rate, uint64_t seed,
+                        SoupShape shape, int compact) {
+    int metrics_on = !compact;
+    mkdir(dir, 0777);
+    nthreads = soup_lib_start(nthreads);
+    fprintf(stderr, "Ensemble: %d soups of %u tapes x %u bytes%s, %d epochs, %d threads, stats every %d, "
+                    "into %s\n", nmembers, shape.ntapes, shape.half_len, compact ? " (compact tokens)" : "",
+            epochs, nthreads, stats_interval, dir);
+
+    Member *mem  = calloc((size_t)nmembers, sizeof(*mem));
+    Soup  **soups = calloc((size_t)nmembers, sizeof(*soups));
+    if (!mem || !soups) { perror("ensemble"); return 1; }
+    char       path[1024];
+    MetricsCol cols[METRICS_NCOLS];
+    metrics_cols(cols, shape);
+    for (int k = 0; k < nmembers; k++) {
+        const MemberSpec *m = &specs[k];
+        SoupParams p = {
+            .seed          = m->seed_set ? m->seed : seed ? seed + (uint64_t)k : 0,
+            .mutation_rate = m->mutation_rate >= 0.0 ? m->mutation_rate : mutation_rate,
+            .max_steps     = m->max_steps ? m->max_steps : soup_max_steps,
+            .stack_depth   = soup_stack_depth,
+            .ntapes        = shape.ntapes,
+            .tape_len      = shape.half_len,
+            .compact       = compact,
+        };
+        snprintf(path, sizeof(path), "%s/%.63s", dir, m->name);
+        mkdir(path, 0777);
+        if (!(soups[k] = mem[k].soup = soup_create(&p))) { perror("soup_create"); return 1; }
+
+        snprintf(path, sizeof(path), "%s/%.63s/spec.txt", dir, m->name);
+        FILE *sf = fopen(path, "w");
+        if (!sf) { perror(path); return 1; }
+        fprintf(sf, "name=%s\nepochs=%d\nseed=%llu\nmutation_rate=%g\nmax_steps=%u\nstack_depth=%u\n"
+                    "soup_size=%u\nhalf_len=%u\n", m->name, epochs, (unsigned long long)p.seed,
+                p.mutation_rate, p.max_steps, p.stack_depth, p.ntapes, p.tape_len);
+        if (compact) fprintf(sf, "compact=1\n");
+        fclose(sf);
+
+        snprintf(path, sizeof(path), "%s/%.63s/stats.tsv", dir, m->name);
+        if (!(mem[k].stats = fopen(path, "w"))) { perror(path); return 1; }
+        if (!metrics_on) continue;
+        snprintf(path, sizeof(path), "%s/%.63s/metrics.bin", dir, m->name);
+        if (metrics_open(&mem[k].metrics, path, cols, METRICS_NCOLS, sizeof(MetricsRow)) < 0) {
+            perror(path);
+            return 1;
+        }
+    }
+
+    MetricsRow  row;
+    SoupStats   st;
+    StepSummary ss;
+    for (int epoch = 0; epoch <= epochs; epoch++) {
+        if (epoch > 0 && soup_run_epochs_many(soups, nmembers, 1) < 0) { perror("ensemble"); return 1; }
+        int stats_epoch = epoch % stats_interval == 0 || epoch == epochs;
+        for (int k = 0; k < nmembers; k++) {
+            if (epoch == 0) print_stats_header(mem[k].stats);
+            if (!metrics_on) {
+                if (stats_epoch) {
+                    soup_get_stats(soups[k], &st, 1);
+                    print_soup_stats(mem[k].stats, &st, shape.half_len);
+                }
+                continue;
+            }
+            if (epoch > 0) soup_step_summary(soup_view_steps(soups[k]), shape.ntapes / 2, &ss);
+            metrics_fill(&row, soup_view_tapes(soups[k]), shape, epoch, stats_epoch, epoch > 0 ? &ss : NULL,
+                         NULL);
+            metrics_append(&mem[k].metrics, &row);
+            if (stats_epoch) {
+                print_stats_row(mem[k].stats, &row, shape.half_len);
+                metrics_flush(&mem[k].metrics);
+            }
+        }
+        if (stats_epoch && epoch > 0)
+            fprintf(stderr, "Ensemble: epoch %d\n", epoch);
+    }
+
+    for (int k = 0; k < nmembers; k++) {
+        fclose(mem[k].stats);
+        if (metrics_on) metrics_close(&mem[k].metrics);
+        soup_destroy(mem[k].soup);
+    }
+    free(soups);
+    free(mem);
+    soup_lib_stop();
+    return 0;
+}
+
+/* -------------------------------------------------------------------------
+ * Islands (--islands N): N sub-soups in N forked processes, standing in for
+ * nodes, each with its share of --threads.  Every --migrate-every epochs each
+ * island sends --migrate-frac of its tapes to the next island around a ring
+ * and takes as many from the previous one into the tapes it sent, through
+ * the shared-memory transport of island.h.  The migrants are a block of
+ * tapes from a start drawn from the seed, the migration and the island: a
+ * well-mixed soup's tape order means nothing, so a block is as good a sample
+ * as any.  Island k is seeded with splitmix64(seed + k) and numbers its
+ * tokens from k * 2^32 / N, so lineages stay apart until they migrate.  Its
+ * initial tokens must fit that slice; the ids left over are its mutation
+ * headroom, after which its ids run into island k + 1's.
+ *
+ * This process is the orchestrator.  At every stats epoch it gathers each
+ * island's soup and step counts and prints the stats of the merged soup to
+ * stdout, like a single run's.  Each island writes its own stats.tsv and
+ * spec.txt to ISLAND_DIR/iK.  The output depends only on the seed, never on
+ * the thread count or on how the processes are scheduled.
+ * -------------------------------------------------------------------------*/
+typedef struct {
+    uint64_t total_steps;                        /* last epoch's pairs */
+    uint32_t pairs;
+    uint32_t max_steps;
+} IslandReport;
+
+typedef struct {
+    int         n;
+    int         epochs, stats_interval;
+    int         migrate_every;
+    uint32_t    migrants;                        /* tapes per island per migration */
+    double      mutation_rate;
+    uint64_t    seed;
+    SoupShape   shape;                           /* of each island */
+    int         threads;                         /* per island */
+    const char *dir;
+} IslandRun;
+
+static int run_island(const IslandRun *r, IslandNet *net, int k) {
+    prctl(PR_SET_PDEATHSIG, SIGKILL);            /* never outlive the orchestrator */
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/i%d", r->dir, k);
+    mkdir(path, 0777);
+
+    soup_lib_start(r->threads);
+    uint32_t first_id = (uint32_t)((1ULL << 32) / (uint64_t)r->n * (uint64_t)k);
+    Soup *s = soup_create(&(SoupParams){
+        .seed = splitmix64(r->seed + (uint64_t)k) | 1, .mutation_rate = r->mutation_rate,
+        .max_steps = soup_max_steps, .stack_depth = soup_stack_depth,
+        .ntapes = r->shape.ntapes, .tape_len = r->shape.half_len, .first_id = first_id,
+    });
+    if (!s) { perror("island soup"); return 1; }
+
+    snprintf(path, sizeof(path), "%s/i%d/spec.txt", r->dir, k);
+    FILE *sf = fopen(path, "w");
+    if (!sf) { perror(path); return 1; }
+    fprintf(sf, "island=%d\nislands=%d\nseed=%llu\ntapes=%u\ntape_len=%u\nmutation_rate=%g\nmax_steps=%u\n"
+                "migrate_every=%d\nmigrate_tapes=%u\nfirst_id=%u\n",
+            k, r->n, (unsigned long long)r->seed, r->shape.ntapes, r->shape.half_len, r->mutation_rate,
+            soup_max_steps, r->migrate_every, r->migrants, first_id);
+    fclose(sf);
+    snprintf(path, sizeof(path), "%s/i%d/stats.tsv", r->dir, k);
+    FILE *f = fopen(path, "w");
+    if (!f) { perror(path); return 1; }
+    print_stats_header(f);
+
+    SoupStats   st;
+    StepSummary ss;
+    uint64_t    row = 0;
+    for (int epoch = 0; epoch <= r->epochs; epoch++) {
+        if (epoch > 0) soup_run_epochs(s, 1);
+        if (epoch > 0 && r->migrants && epoch % r->migrate_every == 0) {
+            uint64_t m     = (uint64_t)(epoch / r->migrate_every);
+            uint32_t first = (uint32_t)splitmix64(r->seed ^ splitmix64(m * ISLAND_MAX + (uint64_t)k));
+            soup_get_tapes(s, first, r->migrants, island_outbox(net, k, m));
+            island_migrate_wait(net);
+            soup_set_tapes(s, first, r->migrants, island_inbox(net, k, m));
+        }
+        if (epoch % r->stats_interval != 0 && epoch != r->epochs) continue;
+
+        soup_get_stats(s, &st, 1);
+        print_soup_stats(f, &st, r->shape.half_len);
+        if (island_report_wait(net, row) < 0) return 1;
+        IslandReport *rep = island_report(net, k);
+        memset(rep, 0, sizeof(*rep));
+        if (epoch > 0) {
+            soup_step_summary(soup_view_steps(s), r->shape.ntapes / 2, &ss);
+            rep->total_steps = ss.total;
+            rep->pairs       = ss.pairs;
+            rep->max_steps   = ss.max;
+        }
+        soup_get_tapes(s, 0, r->shape.ntapes, island_snapshot(net, k));
+        island_publish(net, k, row++);
+    }
+    fclose(f);
+    soup_destroy(s);
+    soup_lib_stop();
+    return 0;
+}
+
+/* Reap the islands that have exited; 1 if any of them failed. */
+static int islands_failed(pid_t *pids, int n) {
+    int failed = 0;
+    for (int k = 0; k < n; k++) {
+        int status;
+        if (pids[k] > 0 && waitpid(pids[k], &status, WNOHANG) == pids[k]) {
+            pids[k] = 0;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = 1;
+        }
+    }
+    return failed;
+}
+
+/* Stats of the whole archipelago from the islands' snapshots and reports */
+static void island_merged_stats(IslandNet *net, const IslandRun *r, int epoch, SoupStats *st) {
+    SoupShape       all   = { (uint32_t)r->n * r->shape.ntapes, r->shape.half_len };
+    const uint64_t *cells = island_snapshot(net, 0);
+    uint32_t freq[BFFO_MAX_HALF_LEN + 1];
+    memset(st, 0, sizeof(*st));
+    st->epoch = epoch;
+    soup_ops_hist(cells, all, freq);
+    soup_ops_mean_median(freq, all, &st->mean_ops, &st->median_ops);
+
+    uint64_t total = 0, pairs = 0;
+    for (int k = 0; k < r->n; k++) {
+        const IslandReport *rep = island_report(net, k);
+        total += rep->total_steps;
+        pairs += rep->pairs;
+        if (rep->max_steps > st->max_steps) st->max_steps = rep->max_steps;
+    }
+    st->mean_steps = pairs ? (double)total / pairs : 0.0;
+
+    uint32_t modal;
+    soup_lineage(cells, all, &st->unique_ids, &modal, &st->modal_count, st->rep_tape);
+    st->modal_id = modal;
+    soup_complexity(cells, all, &st->entropy, &st->lz_bpb);
+    st->hoe = st->entropy - st->lz_bpb;
+}
+
+/* Fork the islands and print the merged stats.  Returns the exit status. */
+static int run_islands(const IslandRun *r, int nthreads) {
+    mkdir(r->dir, 0777);
+    size_t     tape_bytes = (size_t)r->shape.half_len * sizeof(uint64_t);
+    IslandNet *net = island_net_create(r->n, r->migrants * tape_bytes, sizeof(IslandReport),
+                                       r->shape.ntapes * tape_bytes);
+    if (!net) { perror("islands"); return 1; }
+    fprintf(stderr, "Islands: %d processes of %u tapes x %u, %d threads each, into %s\n",
+            r->n, r->shape.ntapes, r->shape.half_len, r->threads, r->dir);
+    fprintf(stderr, "Migration: %u tapes every %d epochs around the ring; seed %llu, mutation rate %.2g\n",
+            r->migrants, r->migrate_every, (unsigned long long)r->seed, r->mutation_rate);
+    uint64_t slice = (1ULL << 32) / (uint64_t)r->n, cells = soup_cells(r->shape);
+    fprintf(stderr, "Ids: %llu per island, %llu left for mutations", (unsigned long long)slice,
+            (unsigned long long)(slice - cells));
+    if (r->mutation_rate > 0.0)
+        fprintf(stderr, " (about %.3g epochs at this rate)", (double)(slice - cells) / ((double)cells * r->mutation_rate));
+    fprintf(stderr, "\n");
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pids[ISLAND_MAX];
+    for (int k = 0; k < r->n; k++) {
+        pids[k] = fork();
+        if (pids[k] < 0) { perror("fork"); return 1; }
+        if (pids[k] == 0) _exit(run_island(r, net, k));
     }
 
-    for (int j = 0; j < BFFO_HALF_LEN; j++) {
-        uint8_t ch = BFFO_TOKEN_CHAR(soup[best_tape][j]);
-        rep_str[j] = SOUP_IS_OP[ch] ? (char)ch : ' ';
+    pool_start(nthreads);                        /* after fork: the merged stats */
+    print_stats_header(stdout);
+    int      failed = 0;
+    uint64_t row    = 0;
+    double   t0     = now_sec();
+    SoupStats st;
+    for (int epoch = 0; epoch <= r->epochs && !failed; epoch++) {
+        if (epoch % r->stats_interval != 0 && epoch != r->epochs) continue;
+        while (!island_ready(net, row) && !(failed = islands_failed(pids, r->n)))
+            nanosleep(&(struct timespec){ 0, 1000000 }, NULL);
+        if (failed) break;
+        island_merged_stats(net, r, epoch, &st);
+        print_soup_stats(stdout, &st, r->shape.half_len);
+        island_consume(net, row++);
     }
-    rep_str[BFFO_HALF_LEN] = '\0';
+
+    for (int k = 0; k < r->n; k++) {
+        if (pids[k] <= 0) continue;
+        if (failed) kill(pids[k], SIGKILL);
+        int status;
+        while (waitpid(pids[k], &status, 0) < 0 && errno == EINTR) {
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = 1;
+    }
+    double secs = now_sec() - t0;
+    if (failed)
+        fprintf(stderr, "Islands: an island failed; the others were stopped\n");
+    else
+        fprintf(stderr, "Run: %d epochs in %.1f s, %.2f epochs/s\n", r->epochs, secs, r->epochs / secs);
+    pool_stop();
+    island_net_destroy(net);
+    return failed;
 }
 
 /* -------------------------------------------------------------------------
@@ -232,100 +1287,503 @@ int main(int argc, char *argv[]) {
     int      stats_interval = 100;
     double   mutation_rate  = 0.0;
     const char *runlog_path = NULL;
+    const char *flowlog_path = NULL;
+    const char *stepstats_path = NULL;
+    const char *metrics_path   = NULL;
+    const char *trace_dir      = NULL;
+    const char *lineage_path   = NULL;
+    int      keyframe_every = 100;
+    int      trace_mode     = TRACE_MODE_DENSE;
+    TriggerSpec trigger;
+    int      trigger_ring   = 100;
+    int      trigger_dense  = 200;
+    int      ckpt_every     = 0;
+    int      mutation_set   = 0;
+    const char *resume_path = NULL;
+    int      fork_at        = -1;
+    const char *branch_dir  = "branches";
+    BranchSpec  branches[MAX_BRANCHES];
+    int         nbranches   = 0;
+    int         nmembers    = 0;
+    const char *ensemble_dir = "ensemble";
+    MemberSpec  members[MAX_MEMBERS];
+    uint32_t    max_steps   = 0;           /* 0: BFFO_MAX_STEPS, or the checkpoint's */
+    uint32_t    stack_depth = 0;           /* 0: BFFO_STACK_DEPTH, or the checkpoint's */
+    SoupShape   shape       = SOUP_DEFAULT_SHAPE;
+    int         compact     = 0;
+    int         huge_mode   = HUGE_AUTO;
+    uint32_t    grid_w      = 0, grid_h = 0; /* 0: well mixed, or the checkpoint's grid */
+    uint32_t    grid_r      = 0;
+    const char *density_dir = NULL;
+    int         nislands    = 0;
+    int         migrate_every = 100;
+    double      migrate_frac  = 0.01;
+    const char *island_dir  = "islands";
+    int         tapes_set   = 0;
+    int         tape_len_set = 0;
 
-    for (int i = 1; i < argc - 1; i++) {
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--trace-sparse")) { trace_mode = TRACE_MODE_SPARSE; continue; }
+        if (!strcmp(argv[i], "--flow"))         { soup_flow = 1; continue; }
+        if (!strcmp(argv[i], "--compact"))      { compact = 1; continue; }
+        if (i + 1 >= argc) { fprintf(stderr, "Missing value for %s\n", argv[i]); return 1; }
         if      (!strcmp(argv[i], "--epochs"))   epochs         = atoi(argv[++i]);
         else if (!strcmp(argv[i], "--threads"))  nthreads       = atoi(argv[++i]);
         else if (!strcmp(argv[i], "--seed"))     seed           = (uint64_t)strtoull(argv[++i], NULL, 10);
         else if (!strcmp(argv[i], "--stats"))    stats_interval = atoi(argv[++i]);
-        else if (!strcmp(argv[i], "--mutation")) mutation_rate  = strtod(argv[++i], NULL);
+        else if (!strcmp(argv[i], "--mutation")) mutation_rate  = strtod(argv[++i], NULL), mutation_set = 1;
         else if (!strcmp(argv[i], "--runlog"))   runlog_path    = argv[++i];
+        else if (!strcmp(argv[i], "--flowlog"))  flowlog_path   = argv[++i], soup_flow = 1;
+        else if (!strcmp(argv[i], "--stepstats")) stepstats_path = argv[++i];
+        else if (!strcmp(argv[i], "--metrics"))   metrics_path   = argv[++i];
+        else if (!strcmp(argv[i], "--trace-dir")) trace_dir      = argv[++i];
+        else if (!strcmp(argv[i], "--keyframe"))  keyframe_every = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--lineage"))   lineage_path   = argv[++i];
+        else if (!strcmp(argv[i], "--trigger-ring"))  trigger_ring  = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--trigger-dense")) trigger_dense = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--trigger")) {
+            if (parse_trigger(argv[++i], &trigger) < 0) {
+                fprintf(stderr, "Bad --trigger spec: %s\n", argv[i]);
+                return 1;
+            }
+            trace_mode = TRACE_MODE_TRIGGERED;
+        }
+        else if (!strcmp(argv[i], "--checkpoint"))       ckpt_path   = argv[++i];
+        else if (!strcmp(argv[i], "--checkpoint-every")) ckpt_every  = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--resume"))           resume_path = argv[++i];
+        else if (!strcmp(argv[i], "--fork-at"))          fork_at     = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--branch-dir"))       branch_dir  = argv[++i];
+        else if (!strcmp(argv[i], "--branch")) {
+            if (nbranches == MAX_BRANCHES || parse_branch(argv[++i], &branches[nbranches], nbranches) < 0) {
+                fprintf(stderr, "Bad or too many --branch specs: %s\n", argv[i]);
+                return 1;
+            }
+            nbranches++;
+        }
+        else if (!strcmp(argv[i], "--max-steps"))   max_steps       = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--stack-depth")) stack_depth     = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--tapes"))       shape.ntapes    = (uint32_t)strtoul(argv[++i], NULL, 10), tapes_set = 1;
+        else if (!strcmp(argv[i], "--tape-len"))    shape.half_len  = (uint32_t)strtoul(argv[++i], NULL, 10), tape_len_set = 1;
+        else if (!strcmp(argv[i], "--radius"))      grid_r          = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--density"))     density_dir     = argv[++i];
+        else if (!strcmp(argv[i], "--islands"))       nislands      = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--migrate-every")) migrate_every = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--migrate-frac"))  migrate_frac  = strtod(argv[++i], NULL);
+        else if (!strcmp(argv[i], "--island-dir"))    island_dir    = argv[++i];
+        else if (!strcmp(argv[i], "--grid")) {
+            if (sscanf(argv[++i], "%ux%u", &grid_w, &grid_h) != 2) {
+                fprintf(stderr, "--grid takes WIDTHxHEIGHT, e.g. 512x256\n");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--hugepages")) {
+            if ((huge_mode = huge_mode_parse(argv[++i])) < 0) {
+                fprintf(stderr, "--hugepages takes auto, 1g, 2m, thp or off\n");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--ensemble-dir"))     ensemble_dir = argv[++i];
+        else if (!strcmp(argv[i], "--ensemble")) {
+            int k = atoi(argv[++i]);
+            if (k < 1 || k > MAX_MEMBERS) {
+                fprintf(stderr, "--ensemble takes 1 to %d soups\n", MAX_MEMBERS);
+                return 1;
+            }
+            for (; nmembers < k; nmembers++) member_defaults(&members[nmembers], nmembers);
+        }
+        else if (!strcmp(argv[i], "--member")) {
+            if (nmembers == MAX_MEMBERS || parse_member(argv[++i], &members[nmembers], nmembers) < 0) {
+                fprintf(stderr, "Bad or too many --member specs: %s\n", argv[i]);
+                return 1;
+            }
+            nmembers++;
+        }
         else { fprintf(stderr, "Unknown argument: %s\n", argv[i]); return 1; }
     }
 
-    if (nthreads <= 0) {
-        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
-        nthreads = (cpus > 1) ? (int)cpus : 1;
+    if (max_steps > BFFO_MAX_STEPS || stack_depth > BFFO_STACK_DEPTH || !soup_shape_valid(shape)) {
+        fprintf(stderr, "--max-steps is at most %d, --stack-depth at most %d; --tapes must be a power of "
+                        "two and --tape-len a power of two up to %d\n",
+                BFFO_MAX_STEPS, BFFO_STACK_DEPTH, BFFO_MAX_HALF_LEN);
+        return 1;
+    }
+    if (max_steps)   soup_max_steps   = max_steps;
+    if (stack_depth) soup_stack_depth = stack_depth;
+    if (compact && soup_cells(shape) > HANDLE_LIMIT / 2) {
+        fprintf(stderr, "--compact holds at most %u cells (tapes x tape length)\n", HANDLE_LIMIT / 2);
+        return 1;
     }
-    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
 
-    global_rng = seed ? seed : (uint64_t)(uintptr_t)&global_rng ^ 0xdeadbeefcafe1234ULL;
-    for (int i = 0; i < 32; i++) xorshift64(&global_rng);
+    if ((grid_w || grid_r) && (nmembers || trace_dir)) {
+        fprintf(stderr, "--grid and --radius run the single soup, without --trace-dir\n");
+        return 1;
+    }
 
-    /* Initialise soup: each element is a fresh token with a unique ID */
-    for (uint32_t i = 0; i < SOUP_SIZE; i++)
-        for (int j = 0; j < BFFO_HALF_LEN; j++) {
-            uint8_t ch = (uint8_t)(xorshift64(&global_rng) & 0xFF);
-            soup[i][j] = BFFO_MAKE_TOKEN(next_token_id++, 0, ch);
+    if (nislands) {
+        if (nislands < 2 || nislands > ISLAND_MAX || migrate_every < 1 || migrate_frac < 0.0 || migrate_frac > 1.0) {
+            fprintf(stderr, "--islands takes 2 to %d processes, --migrate-every at least 1 epoch and "
+                            "--migrate-frac a fraction of each island's tapes\n", ISLAND_MAX);
+            return 1;
+        }
+        if (nmembers || grid_w || grid_r || resume_path || ckpt_path || ckpt_every || trace_dir || lineage_path ||
+            runlog_path || flowlog_path || stepstats_path || metrics_path || soup_flow || nbranches || density_dir ||
+            compact) {
+            fprintf(stderr, "--islands prints merged stats and writes per-island stats.tsv only; it does not "
+                            "combine with --ensemble, --grid, checkpoints, traces, logs, --flow, --density, "
+                            "--compact or branches\n");
+            return 1;
         }
+        /* By default the islands share the built-in soup's tapes between them */
+        if (!tapes_set)
+            while (shape.ntapes > 2 && (uint64_t)shape.ntapes * (uint64_t)nislands > SOUP_SIZE) shape.ntapes /= 2;
+        if (soup_cells(shape) >= (1ULL << 32) / (uint64_t)nislands) {
+            fprintf(stderr, "--islands %d: each island's %zu initial token ids must fit its id range of "
+                            "2^32 / %d = %llu\n", nislands, soup_cells(shape), nislands,
+                    (unsigned long long)((1ULL << 32) / (uint64_t)nislands));
+            return 1;
+        }
+        int cpus = nthreads > 0 ? nthreads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        IslandRun r = {
+            .n = nislands, .epochs = epochs, .stats_interval = stats_interval > 0 ? stats_interval : 1,
+            .migrate_every = migrate_every, .migrants = (uint32_t)(migrate_frac * shape.ntapes + 0.5),
+            .mutation_rate = mutation_rate,
+            .seed = seed ? seed : ((uint64_t)time(NULL) << 20) ^ (uint64_t)getpid(),
+            .shape = shape, .threads = cpus / nislands > 0 ? cpus / nislands : 1, .dir = island_dir,
+        };
+        return run_islands(&r, nthreads);
+    }
 
-    fprintf(stderr, "BFF-orig soup: %d tapes x %d bytes, %d epochs, %d threads, "
-                    "stats every %d, mutation rate %.2g\n",
-            SOUP_SIZE, BFFO_HALF_LEN, epochs, nthreads, stats_interval, mutation_rate);
-    fprintf(stderr, "Seed: %llu\n", (unsigned long long)global_rng);
+    if (nmembers) {
+        if (resume_path || ckpt_path || ckpt_every || trace_dir || lineage_path || runlog_path ||
+            flowlog_path || stepstats_path || metrics_path || soup_flow || nbranches || density_dir) {
+            fprintf(stderr, "--ensemble writes per-soup stats.tsv and metrics.bin only; it does not "
+                            "combine with checkpoints, traces, logs, --flow, --density or branches\n");
+            return 1;
+        }
+        return run_ensemble(members, nmembers, ensemble_dir, epochs, nthreads,
+                            stats_interval > 0 ? stats_interval : 1,
+                            mutation_rate, seed, shape, compact);
+    }
 
-    g_nthreads = nthreads;
-    uint32_t chunk = NPAIRS / (uint32_t)nthreads;
-    for (int t = 0; t < nthreads; t++) {
-        worker_args[t].start = (uint32_t)t * chunk;
-        worker_args[t].end   = (t == nthreads - 1) ? NPAIRS : worker_args[t].start + chunk;
-        worker_args[t].rng   = 0;
+    /* A resumed run keeps its checkpoint's shape and tokens: compact ones
+     * (token_bytes 4) or 64-bit */
+    if (resume_path) {
+        CheckpointHeader h;
+        if (ckpt_read_header(resume_path, &h) < 0) {
+            fprintf(stderr, "%s: %s\n", resume_path, errno == EINVAL ? "not a checkpoint" : strerror(errno));
+            return 1;
+        }
+        if (compact && h.token_bytes != sizeof(uint32_t)) {
+            fprintf(stderr, "%s: --compact resumes compact checkpoints only\n", resume_path);
+            return 1;
+        }
+        if ((tapes_set && h.soup_size != shape.ntapes) || (tape_len_set && h.half_len != shape.half_len)) {
+            fprintf(stderr, "%s: the checkpoint's soup is %u tapes x %u bytes; resume it without a "
+                            "different --tapes or --tape-len\n", resume_path, h.soup_size, h.half_len);
+            return 1;
+        }
+        compact = h.token_bytes == sizeof(uint32_t);
+        shape   = (SoupShape){ h.soup_size, h.half_len };
     }
+    /* Branch children write to the soup after fork(), which hugetlb pages
+     * would have to copy from the reserve (hugemem.h): THP splits instead */
+    if (nbranches && huge_mode != HUGE_OFF) huge_mode = HUGE_THP;
+    if (soup_global_alloc(shape, (HugeMode)huge_mode, compact) < 0) {
+        fprintf(stderr, "soup: %s\n", errno == EINVAL ? "not a shape soup_orig can run" : strerror(errno));
+        return 1;
+    }
+    const uint64_t *cells = soup;                /* metrics_fill(): NULL reads soup32 */
+    int tlb_fd = huge_tlb_open();                /* before the workers exist */
+    nthreads = pool_start(nthreads);
 
-    pthread_barrier_init(&barrier_start, NULL, (unsigned)(nthreads + 1));
-    pthread_barrier_init(&barrier_end,   NULL, (unsigned)(nthreads + 1));
+    /* Fresh soup, or the state after the checkpoint's epoch.  A checkpoint
+     * is only mapped over 4 KB pages; it is read into huge ones. */
+    int      start_epoch = 0;
+    uint64_t run_seed;
+    if (resume_path) {
+        CheckpointHeader h;
+        if ((huge_mode == HUGE_OFF ? ckpt_map : ckpt_read)(resume_path, &h, soup_mem.ptr, soup_bytes()) < 0 ||
+            h.soup_size != soup_shape.ntapes || h.half_len != soup_shape.half_len ||
+            (compact && restore_handles(resume_path, &h) < 0)) {
+            fprintf(stderr, "%s: %s\n", resume_path,
+                    errno == EINVAL ? "not a checkpoint for this soup size" : strerror(errno));
+            return 1;
+        }
+        global_rng    = h.global_rng;
+        next_token_id = h.next_token_id;
+        start_epoch   = h.epoch;
+        run_seed      = h.seed;
+        if (!mutation_set) mutation_rate = h.mutation_rate;
+        if (!max_steps && h.max_steps)     soup_max_steps   = h.max_steps;
+        if (!stack_depth && h.stack_depth) soup_stack_depth = h.stack_depth;
+        if (!grid_w && h.grid_width) {
+            grid_w = h.grid_width;
+            grid_h = h.grid_height;
+            if (!grid_r) grid_r = h.grid_radius;
+        }
+        if (!ckpt_path) ckpt_path = resume_path;
+    } else {
+        soup_init(seed);
+        run_seed = global_rng;
+    }
+    if (ckpt_every > 0 && !ckpt_path) ckpt_path = "soup_orig.ckpt";
 
-    pthread_t tids[MAX_THREADS];
-    for (int t = 0; t < nthreads; t++)
-        pthread_create(&tids[t], NULL, worker_thread, &worker_args[t]);
+    /* Spatial soup: the torus of --grid, or of the checkpoint */
+    static SoupGrid grid;
+    if (grid_w || grid_r) {
+        if (!grid_r) grid_r = 2;
+        if (soup_grid_init(&grid, soup_shape, grid_w, grid_h, grid_r) < 0) {
+            fprintf(stderr, "--grid WxH must be %u tapes with W and H powers of two of at least %d, and "
+                            "--radius 1 to %d\n", soup_shape.ntapes, 2 * GRID_TILE, GRID_MAX_RADIUS);
+            return 1;
+        }
+        soup_grid = &grid;
+    }
+    uint8_t *density = NULL;
+    if (density_dir) {
+        if (!soup_grid) {
+            fprintf(stderr, "--density needs --grid\n");
+            return 1;
+        }
+        if (!(density = malloc(soup_shape.ntapes))) { perror("density"); return 1; }
+        mkdir(density_dir, 0777);
+    }
+    if ((fork_at >= 0) != (nbranches > 0) || (nbranches && (fork_at < start_epoch || fork_at >= epochs))) {
+        fprintf(stderr, "--fork-at E (with %d <= E < --epochs) and --branch go together\n", start_epoch);
+        return 1;
+    }
+    int run_to = nbranches ? fork_at : epochs;   /* the branches take over after fork_at */
+
+    fprintf(stderr, "BFF-orig soup: %u tapes x %u bytes, %d epochs, %d threads, "
+                    "stats every %d, mutation rate %.2g\n",
+            soup_shape.ntapes, soup_shape.half_len, epochs, nthreads, stats_interval, mutation_rate);
+    fprintf(stderr, "Seed: %llu\n", (unsigned long long)run_seed);
+    if (compact)
+        fprintf(stderr, "Tokens: compact, 32-bit with each lineage's id and epoch in a handle table\n");
+    if (resume_path)
+        fprintf(stderr, "Resumed from %s at epoch %d\n", resume_path, start_epoch);
+    fprintf(stderr, "Pages: soup and perm %zu MB on %s pages, %zu MB huge-page backed\n",
+            soup_mem.bytes >> 20, huge_describe(&soup_mem), huge_backed(&soup_mem) >> 20);
+    if (soup_grid)
+        fprintf(stderr, "Grid: %u x %u torus, pairs within radius %u, matched and run in %d x %d tiles\n",
+                grid.width, grid.height, grid.radius, GRID_TILE, GRID_TILE);
+    if (density_dir)
+        fprintf(stderr, "Density: %s/density_EPOCH.pgm at each stats epoch\n", density_dir);
 
+    if (ckpt_path) {
+        /* Room for a full handle table: only the pages a checkpoint reaches are touched */
+        uint32_t nhandles = HANDLE_LIMIT - soup_handles.base;
+        if (compact && !(ckpt_tail = malloc(handles_tail_bytes(nhandles, nhandles)))) {
+            perror("checkpoint handle table");
+            return 1;
+        }
+        if (bgw_start(&ckpt_bg, 1, sizeof(CheckpointImage) + soup_bytes(), ckpt_job, NULL) < 0) {
+            perror("checkpoint writer");
+            return 1;
+        }
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_stop_signal;
+        sa.sa_flags   = SA_RESTART;
+        sigaction(SIGTERM, &sa, NULL);
+        sigaction(SIGINT, &sa, NULL);
+        fprintf(stderr, "Checkpoint: %s", ckpt_path);
+        if (ckpt_every > 0) fprintf(stderr, " every %d epochs", ckpt_every);
+        fprintf(stderr, ", and at exit or SIGTERM\n");
+    }
+
+    /* On resume, per-epoch outputs are cut back to the checkpoint and appended to */
+    size_t steps_bytes = soup_pairs() * sizeof(uint32_t), flow_bytes = soup_pairs() * sizeof(BffoFlow);
     FILE *runlog = NULL;
     if (runlog_path) {
-        runlog = fopen(runlog_path, "wb");
+        if (start_epoch > 0) runlog = reopen_records(runlog_path, steps_bytes, (uint64_t)start_epoch);
+        if (!runlog) runlog = fopen(runlog_path, "wb");
         if (!runlog) { perror(runlog_path); return 1; }
+        if (bgw_start(&runlog_bg, RUNLOG_BUFFERS, steps_bytes, runlog_job, runlog) < 0) {
+            perror("runlog writer");
+            return 1;
+        }
         fprintf(stderr, "Run-length log: %s\n", runlog_path);
     }
 
-    double mean, median;
-    uint32_t unique, modal_id, modal_count;
-    char rep_str[BFFO_HALF_LEN + 1];
-    printf("%-10s\t%-12s\t%-12s\t%-12s\t%-12s\t%-12s\t%-10s\t%s\n",
-           "epoch", "mean_ops", "median_ops", "mean_steps", "max_steps",
-           "unique_ids", "modal_id", "representative_tape (modal_count)");
-    soup_stats(&mean, &median, &unique, &modal_id, &modal_count, rep_str);
-    printf("%-10d\t%-12.4f\t%-12.1f\t%-12.1f\t%-12u\t%-12u\t%-10u\t|%s| (%u)\n",
-           0, mean, median, 0.0, 0u, unique, modal_id, rep_str, modal_count);
-    fflush(stdout);
+    FILE *flowlog = NULL;
+    if (flowlog_path) {
+        if (start_epoch > 0) flowlog = reopen_records(flowlog_path, flow_bytes, (uint64_t)start_epoch);
+        if (!flowlog) flowlog = fopen(flowlog_path, "wb");
+        if (!flowlog) { perror(flowlog_path); return 1; }
+        if (bgw_start(&flowlog_bg, RUNLOG_BUFFERS, flow_bytes, runlog_job, flowlog) < 0) {
+            perror("flow log writer");
+            return 1;
+        }
+        fprintf(stderr, "Flow log: %s\n", flowlog_path);
+    }
+    if (soup_flow) fprintf(stderr, "Copy flow: counted per pair (metrics flow, flow_hist)\n");
 
-    for (int epoch = 1; epoch <= epochs; epoch++) {
-        soup_epoch();
-        mutate_soup(mutation_rate, epoch);
-        if (runlog)
-            fwrite(pair_steps, sizeof(uint32_t), NPAIRS, runlog);
-        if (epoch % stats_interval == 0) {
-            double step_sum = 0.0;
-            uint32_t step_max = 0;
-            for (uint32_t i = 0; i < NPAIRS; i++) {
-                step_sum += pair_steps[i];
-                if (pair_steps[i] > step_max) step_max = pair_steps[i];
+    /* Per-epoch step histogram: one TSV row per epoch, a compact alternative to --runlog */
+    FILE *stepstats = NULL;
+    if (stepstats_path) {
+        if (start_epoch > 0) stepstats = reopen_tsv(stepstats_path, start_epoch);
+        if (!stepstats) {
+            stepstats = fopen(stepstats_path, "w");
+            if (!stepstats) { perror(stepstats_path); return 1; }
+            step_summary_header(stepstats);
+        }
+        fprintf(stderr, "Step histogram: %s\n", stepstats_path);
+    }
+    StepSummary ss;
+
+    /* Columnar binary metrics: one row per epoch */
+    Metrics metrics = { NULL, 0 };
+    if (metrics_path) {
+        uint64_t rows = (uint64_t)start_epoch + 1;
+        if (start_epoch > 0 && metrics_reopen(&metrics, metrics_path, sizeof(MetricsRow), &rows) == 0) {
+            if (rows < (uint64_t)start_epoch + 1)
+                fprintf(stderr, "Metrics: %s ends at epoch %llu, not %d\n", metrics_path,
+                        (unsigned long long)rows - 1, start_epoch);
+        } else {
+            MetricsCol cols[METRICS_NCOLS];
+            if (metrics_open(&metrics, metrics_path, metrics_cols(cols, soup_shape), METRICS_NCOLS,
+                             sizeof(MetricsRow)) < 0) {
+                perror(metrics_path);
+                return 1;
             }
-            double mean_steps = step_sum / NPAIRS;
-            soup_stats(&mean, &median, &unique, &modal_id, &modal_count, rep_str);
-            printf("%-10d\t%-12.4f\t%-12.1f\t%-12.1f\t%-12u\t%-12u\t%-10u\t|%s| (%u)\n",
-                   epoch, mean, median, mean_steps, step_max,
-                   unique, modal_id, rep_str, modal_count);
-            fflush(stdout);
         }
+        fprintf(stderr, "Metrics: %s (%zu-byte rows)\n", metrics_path, sizeof(MetricsRow));
     }
 
-    if (runlog) fclose(runlog);
+    /* Lineage index: births, copy-count thresholds and copies of tracked ids */
+    Lineage lineage = { 0 };
+    if (lineage_path) {
+        if (!(start_epoch > 0 && lineage_reopen(&lineage, lineage_path, start_epoch) == 0) &&
+            lineage_open(&lineage, lineage_path) < 0) {
+            perror(lineage_path);
+            return 1;
+        }
+        fprintf(stderr, "Lineage: %s (ids tracked from %d to %d copies)\n", lineage_path,
+                LINEAGE_TRACK_MIN, LINEAGE_TRACK_MAX);
+    }
+
+    if (keyframe_every < 1) keyframe_every = 1;
+    if (trace_mode == TRACE_MODE_TRIGGERED && (!trace_dir || start_epoch > 0)) {
+        fprintf(stderr, "--trigger needs --trace-dir and a fresh run\n");
+        return 1;
+    }
+    if (trace_dir && trace_start(trace_dir, keyframe_every, trace_mode, epochs, mutation_rate,
+                                 run_seed, start_epoch) < 0)
+        return 1;
+    if (trace_mode == TRACE_MODE_TRIGGERED && trigger_start(trace_dir, &trigger, trigger_ring, trigger_dense) < 0)
+        return 1;
 
-    pool_shutdown = 1;
-    pthread_barrier_wait(&barrier_start);
-    for (int t = 0; t < nthreads; t++)
-        pthread_join(tids[t], NULL);
-    pthread_barrier_destroy(&barrier_start);
-    pthread_barrier_destroy(&barrier_end);
+    MetricsRow row;
+    print_stats_header(stdout);
+    if (start_epoch == 0) {
+        metrics_fill(&row, cells, soup_shape, 0, 1, NULL, density);
+        print_stats_row(stdout, &row, soup_shape.half_len);
+        if (density_dir) write_density(density_dir, 0, density);
+        if (metrics.f) metrics_append(&metrics, &row);
+    }
+
+    /* Last epoch run, and the epoch ckpt_path already holds */
+    int done = start_epoch;
+    int ckpt_epoch = resume_path && !strcmp(ckpt_path, resume_path) ? start_epoch : -1;
+    uint64_t tlb0  = huge_tlb_read(tlb_fd);
+    uint64_t pairs = 0;
+    double   t0    = now_sec();
+    for (int epoch = start_epoch + 1; epoch <= run_to && !stop_requested; epoch++) {
+        uint64_t shuffle_rng = global_rng;
+        soup_epoch();
+        mutate_soup(mutation_rate, epoch);
+        pairs += soup_npairs;
+        if (lineage.f) {
+            lineage_epoch(&lineage, epoch);
+            if (epoch % stats_interval == 0) lineage_flush(&lineage);
+        }
+        if (trace_mode == TRACE_MODE_TRIGGERED)
+            trigger_epoch(epoch, shuffle_rng);
+        else if (trace_dir && (trace_mode == TRACE_MODE_DENSE || epoch % keyframe_every == 0))
+            trace_epoch(epoch, shuffle_rng);
+        if (runlog) {
+            memcpy(bgw_acquire(&runlog_bg), pair_steps, steps_bytes);
+            bgw_submit(&runlog_bg, steps_bytes, epoch);
+        }
+        if (flowlog) {
+            memcpy(bgw_acquire(&flowlog_bg), pair_flow, flow_bytes);
+            bgw_submit(&flowlog_bg, flow_bytes, epoch);
+        }
+        int stats_epoch = epoch % stats_interval == 0;
+        if (stepstats || metrics.f || stats_epoch)
+            soup_step_summary(pair_steps, soup_npairs, &ss);
+        if (stepstats) {
+            step_summary_row(stepstats, epoch, &ss);
+            if (stats_epoch) fflush(stepstats);
+        }
+        if (metrics.f || stats_epoch)
+            metrics_fill(&row, cells, soup_shape, epoch, stats_epoch, &ss, stats_epoch ? density : NULL);
+        if (metrics.f) {
+            metrics_append(&metrics, &row);
+            if (stats_epoch) metrics_flush(&metrics);
+        }
+        if (stats_epoch)
+            print_stats_row(stdout, &row, soup_shape.half_len);
+        if (density_dir && stats_epoch)
+            write_density(density_dir, epoch, density);
+
+        done = epoch;
+        if (ckpt_path && ckpt_every > 0 && epoch % ckpt_every == 0 && epoch < run_to) {
+            /* Everything up to this epoch reaches its file before the checkpoint does */
+            if (trace_dir) bgw_drain(&trace_bg);
+            if (runlog) bgw_drain(&runlog_bg);
+            if (flowlog) bgw_drain(&flowlog_bg);
+            if (stepstats) fflush(stepstats);
+            if (metrics.f) metrics_flush(&metrics);
+            if (lineage.f) lineage_flush(&lineage);
+            checkpoint(epoch, run_seed, mutation_rate);
+            ckpt_epoch = epoch;
+        }
+    }
+    if (stop_requested)
+        fprintf(stderr, "Stopped by signal after epoch %d\n", done);
+    if (done > start_epoch) {
+        double secs = now_sec() - t0;
+        fprintf(stderr, "Run: %d epochs in %.1f s, %.2f epochs/s, %.2f M pairs/s", done - start_epoch, secs,
+                (done - start_epoch) / secs, pairs / secs * 1e-6);
+        if (soup_grid)
+            fprintf(stderr, " (%.1f%% of tapes paired)", 200.0 * pairs / ((double)soup_shape.ntapes * (done - start_epoch)));
+        if (tlb_fd >= 0)
+            fprintf(stderr, ", %.0f dTLB load misses per epoch",
+                    (double)(huge_tlb_read(tlb_fd) - tlb0) / (done - start_epoch));
+        fputc('\n', stderr);
+    }
+
+    if (runlog) {
+        bgw_stop(&runlog_bg);
+        fclose(runlog);
+    }
+    if (flowlog) {
+        bgw_stop(&flowlog_bg);
+        fclose(flowlog);
+    }
+    if (stepstats) fclose(stepstats);
+    metrics_close(&metrics);
+    if (lineage.f) {
+        fprintf(stderr, "Lineage: %llu births, %llu threshold crossings, %llu copies\n",
+                (unsigned long long)lineage.nrecords[LINEAGE_BIRTH],
+                (unsigned long long)lineage.nrecords[LINEAGE_LEVEL],
+                (unsigned long long)lineage.nrecords[LINEAGE_COPY]);
+        lineage_close(&lineage);
+    }
+    if (trace_mode == TRACE_MODE_TRIGGERED) trigger_finish();
+    if (trace_dir) trace_finish();
+    if (ckpt_path) {
+        if (done != ckpt_epoch)
+            checkpoint(done, run_seed, mutation_rate);
+        bgw_stop(&ckpt_bg);
+        fprintf(stderr, "Checkpoint: %s at epoch %d\n", ckpt_path, done);
+    }
 
+    pool_stop();
+    if (nbranches && !stop_requested)
+        return run_branches(branches, nbranches, branch_dir, done, epochs, nthreads, stats_interval,
+                            mutation_rate, run_seed);
     return 0;
 }
@@ -0,0 +1,445 @@
+#define _POSIX_C_SOURCE 200809L
+
+/*
+ * Queries over a --trace-dir trace (soup or soup_orig), run on the worker
+ * pool over many epochs at once.
+ *
+ * Usage:
+ *   ./soup_query TRACE_DIR [--from A] [--to B] [--every N] [--threads T]
+ *                [--limit N] [--json] QUERY [ARG]
+ *
+ * Queries (one row per epoch unless noted):
+ *   stats        mean_ops median_ops unique_ids modal_id modal_count modal_epochs
+ *   search PAT   one row per tape whose instruction string contains PAT:
+ *                matches (in the epoch) tape str
+ *   history ID   cells and tapes holding token ID, the tape with most of them,
+ *                its partner and steps that epoch, and its instructions
+ *   top K        the K (<= 1024, default 10) pairs with most steps: rank pair
+ *                tape_a tape_b steps, and both tapes before and after the epoch
+ *
+ * Every row starts with the epoch.  Output is TSV with a header line, or
+ * with --json one JSON object per line, streamed in epoch order.  --limit
+ * caps the rows per epoch (search; default all).  Instruction strings are
+ * formatted as soup_analyze.py's tape_str: ops as themselves, other bytes
+ * as ' ' (soup_orig) or '.' (soup).
+ *
+ * Only epochs stored in TRACE_DIR are read (for a sparse trace, the
+ * keyframes; soup_analyze.py replays the rest first).  trace.bin is mapped
+ * and every worker decodes a contiguous run of epochs, so each chunk is
+ * decompressed once; a worker holds one or two soups and, for stats, two
+ * id arrays (~130-200 MB for the 2^17-tape soup).
+ */
+
+#include "pool.h"
+#include "soup_core.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EPOCHS_PER_WORKER 8      /* per round, so output keeps streaming */
+#define META_MAX          4096
+
+enum { Q_STATS, Q_SEARCH, Q_HISTORY, Q_TOP };
+
+static const char *const QUERY_COLS[] = {
+    [Q_STATS]   = "epoch\tmean_ops\tmedian_ops\tunique_ids\tmodal_id\tmodal_count\tmodal_epochs",
+    [Q_SEARCH]  = "epoch\tmatches\ttape\tstr",
+    [Q_HISTORY] = "epoch\tcells\ttapes\tbest_tape\tbest_cells\tpartner\tsteps\tstr",
+    [Q_TOP]     = "epoch\trank\tpair\ttape_a\ttape_b\tsteps\ta_before\ta_after\tb_before\tb_after",
+};
+
+/* -------------------------------------------------------------------------
+ * Query parameters and trace layout, shared read-only by the workers
+ * -------------------------------------------------------------------------*/
+static int         query;
+static const char *pattern;
+static uint32_t    query_id;
+static int         top_k = 10;
+static int         limit;
+static int         json;
+static uint8_t     is_op[256];
+static char        data_ch = ' ';
+static size_t      ncells;
+static uint32_t    ntapes, npairs, half_len;       /* from the trace header */
+static const char *trace_dir;
+
+/* -------------------------------------------------------------------------
+ * Rows: TSV fields or a JSON object
+ * -------------------------------------------------------------------------*/
+typedef struct {
+    FILE *f;
+    int   n;
+} Row;
+
+static void row_key(Row *r, const char *name) {
+    if (json) fprintf(r->f, "%s\"%s\":", r->n ? "," : "{", name);
+    else if (r->n) fputc('\t', r->f);
+    r->n++;
+}
+
+static void row_u(Row *r, const char *name, uint64_t v) {
+    row_key(r, name);
+    fprintf(r->f, "%llu", (unsigned long long)v);
+}
+
+static void row_f(Row *r, const char *name, double v) {
+    row_key(r, name);
+    fprintf(r->f, "%.4f", v);
+}
+
+/* Strings here are tape_str output and "E:N,..." lists: nothing to escape */
+static void row_s(Row *r, const char *name, const char *v) {
+    row_key(r, name);
+    fprintf(r->f, json ? "\"%s\"" : "%s", v);
+}
+
+static void row_end(Row *r) {
+    fputs(json ? "}\n" : "\n", r->f);
+    r->n = 0;
+}
+
+static void tape_str(const uint64_t *tape, char out[BFFO_MAX_HALF_LEN + 1]) {
+    for (uint32_t j = 0; j < half_len; j++) {
+        uint8_t ch = BFFO_TOKEN_CHAR(tape[j]);
+        out[j] = is_op[ch] ? (char)ch : data_ch;
+    }
+    out[half_len] = '\0';
+}
+
+/* -------------------------------------------------------------------------
+ * Workers
+ * -------------------------------------------------------------------------*/
+typedef struct {
+    TraceReader tr;
+    uint64_t   *cells;
+    uint64_t   *prev;       /* top: the soup before the epoch */
+    int         held;       /* epoch in cells, or -1 */
+    uint32_t   *ids, *tmp;  /* stats: radix sort buffers */
+    uint32_t   *perm;
+} Worker;
+
+static Worker workers[POOL_MAX_THREADS];
+
+static void regen_perm(uint32_t *perm, uint64_t rng_state) {
+    for (uint32_t i = 0; i < ntapes; i++) perm[i] = i;
+    for (uint32_t i = ntapes - 1; i > 0; i--) {
+        uint32_t j = (uint32_t)(xorshift64(&rng_state) % (i + 1));
+        uint32_t t = perm[i]; perm[i] = perm[j]; perm[j] = t;
+    }
+}
+
+/* LSD radix sort of n ids in 16-bit digits; the result ends up back in a */
+static void radix_sort(uint32_t *a, uint32_t *tmp, size_t n) {
+    static _Thread_local uint32_t count[1 << 16];
+    for (int shift = 0; shift < 32; shift += 16) {
+        memset(count, 0, sizeof(count));
+        for (size_t i = 0; i < n; i++) count[(a[i] >> shift) & 0xFFFF]++;
+        uint32_t sum = 0;
+        for (int d = 0; d < 1 << 16; d++) { uint32_t c = count[d]; count[d] = sum; sum += c; }
+        for (size_t i = 0; i < n; i++) tmp[count[(a[i] >> shift) & 0xFFFF]++] = a[i];
+        uint32_t *t = a; a = tmp; tmp = t;
+    }
+}
+
+static void q_stats(Worker *w, int epoch, Row *r) {
+    static _Thread_local uint32_t ops_hist[BFFO_MAX_HALF_LEN + 1];
+    memset(ops_hist, 0, sizeof(ops_hist));
+    uint64_t total = 0;
+    for (uint32_t t = 0; t < ntapes; t++) {
+        int n = 0;
+        for (uint32_t j = 0; j < half_len; j++) n += is_op[BFFO_TOKEN_CHAR(w->cells[(size_t)t * half_len + j])];
+        ops_hist[n]++;
+        total += (uint64_t)n;
+    }
+    /* Median of an even count: mean of the two middle values, as np.median */
+    int lo = -1, hi = -1;
+    uint32_t cumul = 0;
+    for (uint32_t v = 0; v <= half_len && hi < 0; v++) {
+        cumul += ops_hist[v];
+        if (lo < 0 && cumul > ntapes / 2 - 1) lo = v;
+        if (hi < 0 && cumul > ntapes / 2) hi = v;
+    }
+
+    for (size_t c = 0; c < ncells; c++) w->ids[c] = BFFO_TOKEN_ID(w->cells[c]);
+    radix_sort(w->ids, w->tmp, ncells);
+    uint32_t unique = 0, modal = 0, best = 0, run = 0;
+    for (size_t c = 0; c < ncells; c++) {
+        run = c && w->ids[c] == w->ids[c - 1] ? run + 1 : 1;
+        unique += run == 1;
+        if (run > best) { best = run; modal = w->ids[c]; }
+    }
+
+    /* Birth epochs (token epoch field) of the modal id's cells */
+    static _Thread_local uint32_t ep_count[1 << 16];
+    memset(ep_count, 0, sizeof(ep_count));
+    for (size_t c = 0; c < ncells; c++)
+        if (BFFO_TOKEN_ID(w->cells[c]) == modal) ep_count[BFFO_TOKEN_EPOCH(w->cells[c])]++;
+    char dist[512];
+    size_t len = 0;
+    dist[0] = '\0';
+    for (int e = 0; e < 1 << 16 && len < sizeof(dist) - 24; e++)
+        if (ep_count[e])
+            len += (size_t)snprintf(dist + len, sizeof(dist) - len, "%s%d:%u", len ? "," : "", e, ep_count[e]);
+
+    row_u(r, "epoch", (uint64_t)epoch);
+    row_f(r, "mean_ops", (double)total / ntapes);
+    row_f(r, "median_ops", (lo + hi) / 2.0);
+    row_u(r, "unique_ids", unique);
+    row_u(r, "modal_id", modal);
+    row_u(r, "modal_count", best);
+    row_s(r, "modal_epochs", dist);
+    row_end(r);
+}
+
+static void q_search(Worker *w, int epoch, Row *r) {
+    static _Thread_local uint32_t *hits;
+    if (!hits) hits = malloc(ntapes * sizeof(uint32_t));
+    char s[BFFO_MAX_HALF_LEN + 1];
+    uint32_t n = 0;
+    for (uint32_t t = 0; t < ntapes; t++) {
+        tape_str(&w->cells[(size_t)t * half_len], s);
+        if (strstr(s, pattern)) hits[n++] = t;
+    }
+    for (uint32_t k = 0; k < n && (limit <= 0 || k < (uint32_t)limit); k++) {
+        tape_str(&w->cells[(size_t)hits[k] * half_len], s);
+        row_u(r, "epoch", (uint64_t)epoch);
+        row_u(r, "matches", n);
+        row_u(r, "tape", hits[k]);
+        row_s(r, "str", s);
+        row_end(r);
+    }
+}
+
+/* Slot of tape in perm: pair = slot % npairs */
+static uint32_t perm_slot(const uint32_t *perm, uint32_t tape) {
+    uint32_t s = 0;
+    while (perm[s] != tape) s++;
+    return s;
+}
+
+static void q_history(Worker *w, int epoch, const TraceEpoch *ep, Row *r) {
+    uint32_t cells = 0, tapes = 0, best = 0, best_n = 0;
+    for (uint32_t t = 0; t < ntapes; t++) {
+        uint32_t n = 0;
+        for (uint32_t j = 0; j < half_len; j++)
+            n += BFFO_TOKEN_ID(w->cells[(size_t)t * half_len + j]) == query_id;
+        cells += n;
+        tapes += n > 0;
+        if (n > best_n) { best_n = n; best = t; }
+    }
+    if (!cells) return;
+
+    char s[BFFO_MAX_HALF_LEN + 1];
+    tape_str(&w->cells[(size_t)best * half_len], s);
+    row_u(r, "epoch", (uint64_t)epoch);
+    row_u(r, "cells", cells);
+    row_u(r, "tapes", tapes);
+    row_u(r, "best_tape", best);
+    row_u(r, "best_cells", best_n);
+    if (ep->steps) {
+        regen_perm(w->perm, ep->rng_state);
+        uint32_t slot = perm_slot(w->perm, best);
+        uint32_t pair = slot % npairs;
+        row_u(r, "partner", w->perm[slot < npairs ? slot + npairs : slot - npairs]);
+        row_u(r, "steps", ep->steps[pair]);
+    } else {
+        row_s(r, "partner", "");
+        row_s(r, "steps", "");
+    }
+    row_s(r, "str", s);
+    row_end(r);
+}
+
+static void q_top(Worker *w, int epoch, const TraceEpoch *ep, int have_prev, Row *r) {
+    if (!ep->steps) return;
+    static _Thread_local uint32_t best[1024];
+    int k = top_k < 1024 ? top_k : 1024, n = 0;
+    for (uint32_t p = 0; p < ep->nsteps; p++) {
+        uint32_t st = ep->steps[p];
+        if (n == k && st <= ep->steps[best[n - 1]]) continue;
+        int i = n < k ? n++ : n - 1;
+        while (i > 0 && ep->steps[best[i - 1]] < st) { best[i] = best[i - 1]; i--; }
+        best[i] = p;
+    }
+    regen_perm(w->perm, ep->rng_state);
+
+    char s[4][BFFO_MAX_HALF_LEN + 1];
+    for (int i = 0; i < n; i++) {
+        uint32_t a = w->perm[best[i]], b = w->perm[best[i] + npairs];
+        tape_str(&w->cells[(size_t)a * half_len], s[1]);
+        tape_str(&w->cells[(size_t)b * half_len], s[3]);
+        if (have_prev) {
+            tape_str(&w->prev[(size_t)a * half_len], s[0]);
+            tape_str(&w->prev[(size_t)b * half_len], s[2]);
+        } else {
+            s[0][0] = s[2][0] = '\0';
+        }
+        row_u(r, "epoch", (uint64_t)epoch);
+        row_u(r, "rank", (uint64_t)i + 1);
+        row_u(r, "pair", best[i]);
+        row_u(r, "tape_a", a);
+        row_u(r, "tape_b", b);
+        row_u(r, "steps", ep->steps[best[i]]);
+        row_s(r, "a_before", s[0]);
+        row_s(r, "a_after", s[1]);
+        row_s(r, "b_before", s[2]);
+        row_s(r, "b_after", s[3]);
+        row_end(r);
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * Rounds: each worker decodes a contiguous slice of the round's epochs
+ * -------------------------------------------------------------------------*/
+typedef struct {
+    const int *epochs;
+    int        n;
+    char     **out;         /* per epoch, NULL if it could not be read */
+    size_t    *out_len;
+} Round;
+
+static int worker_init(Worker *w) {
+    if (w->cells) return 0;
+    if (trace_reader_open(&w->tr, trace_dir) < 0) return -1;
+    w->held  = -1;
+    w->cells = malloc(ncells * sizeof(uint64_t));
+    w->perm  = malloc(ntapes * sizeof(uint32_t));
+    if (query == Q_STATS) {
+        w->ids = malloc(ncells * sizeof(uint32_t));
+        w->tmp = malloc(ncells * sizeof(uint32_t));
+    }
+    if (query == Q_TOP) w->prev = malloc(ncells * sizeof(uint64_t));
+    return w->cells && w->perm && (query != Q_STATS || (w->ids && w->tmp)) &&
+           (query != Q_TOP || w->prev) ? 0 : -1;
+}
+
+static void round_job(void *ctx, int tid, int nthreads) {
+    Round   *rd = ctx;
+    Worker  *w  = &workers[tid];
+    unsigned lo, hi;
+    pool_slice((unsigned)rd->n, tid, nthreads, &lo, &hi);
+    if (lo < hi && worker_init(w) < 0) return;
+
+    for (unsigned k = lo; k < hi; k++) {
+        int        epoch = rd->epochs[k];
+        TraceEpoch ep;
+        int        have_prev = 0;
+
+        if (query == Q_TOP && epoch > 0 && trace_read_after(&w->tr, w->held, epoch - 1, w->cells, &ep) == 0) {
+            memcpy(w->prev, w->cells, ncells * sizeof(uint64_t));
+            w->held   = epoch - 1;
+            have_prev = 1;
+        }
+        if (trace_read_after(&w->tr, w->held, epoch, w->cells, &ep) < 0) {
+            w->held = -1;
+            continue;
+        }
+        w->held = epoch;
+
+        Row r = { open_memstream(&rd->out[k], &rd->out_len[k]), 0 };
+        if (!r.f) continue;
+        switch (query) {
+        case Q_STATS:   q_stats(w, epoch, &r);                  break;
+        case Q_SEARCH:  q_search(w, epoch, &r);                 break;
+        case Q_HISTORY: q_history(w, epoch, &ep, &r);           break;
+        case Q_TOP:     q_top(w, epoch, &ep, have_prev, &r);    break;
+        }
+        fclose(r.f);
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * -------------------------------------------------------------------------*/
+static int usage(const char *prog) {
+    fprintf(stderr, "Usage: %s TRACE_DIR [--from A] [--to B] [--every N] [--threads T] [--limit N] "
+                    "[--json] (stats | search PAT | history ID | top K)\n", prog);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    int from = 0, to = -1, every = 1, nthreads = 0;
+    const char *qname = NULL, *qarg = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        /* Options come before QUERY, so a pattern may start with '-' */
+        if      (qname && !qarg)                                qarg      = argv[i];
+        else if (qname)                                         return usage(argv[0]);
+        else if (!strcmp(argv[i], "--from")    && i + 1 < argc) from     = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--to")      && i + 1 < argc) to       = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--every")   && i + 1 < argc) every    = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) nthreads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--limit")   && i + 1 < argc) limit    = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--json"))                    json     = 1;
+        else if (argv[i][0] == '-')                             return usage(argv[0]);
+        else if (!trace_dir)                                    trace_dir = argv[i];
+        else                                                    qname     = argv[i];
+    }
+    if (!trace_dir || !qname || every < 1) return usage(argv[0]);
+    if      (!strcmp(qname, "stats"))           query = Q_STATS;
+    else if (!strcmp(qname, "search") && qarg)  query = Q_SEARCH,  pattern  = qarg;
+    else if (!strcmp(qname, "history") && qarg) query = Q_HISTORY, query_id = (uint32_t)strtoul(qarg, NULL, 10);
+    else if (!strcmp(qname, "top"))             query = Q_TOP,     top_k    = qarg ? atoi(qarg) : 10;
+    else return usage(argv[0]);
+
+    /* Op set and data placeholder of the interpreter that wrote the trace */
+    char path[1024], meta[META_MAX] = "";
+    snprintf(path, sizeof(path), "%s/metadata.txt", trace_dir);
+    FILE *mf = fopen(path, "r");
+    if (mf) {
+        meta[fread(meta, 1, sizeof(meta) - 1, mf)] = '\0';
+        fclose(mf);
+    }
+    const char *ops = strstr(meta, "interpreter=bff_orig") ? "<>{}+-.,[]" : "<>+-,[]";
+    for (const char *o = ops; *o; o++) is_op[(uint8_t)*o] = 1;
+    data_ch = strstr(meta, "interpreter=bff_orig") ? ' ' : '.';
+
+    TraceReader tr;
+    if (trace_reader_open(&tr, trace_dir) < 0) { perror(trace_dir); return 1; }
+    ncells = tr.hdr.ncells;
+    npairs = tr.hdr.npairs;
+    ntapes = 2 * npairs;
+    half_len = ntapes ? (uint32_t)(ncells / ntapes) : 0;
+    if (!half_len || half_len > BFFO_MAX_HALF_LEN || (size_t)ntapes * half_len != ncells) {
+        fprintf(stderr, "%s: unexpected soup layout\n", trace_dir);
+        return 1;
+    }
+
+    int *epochs = malloc((size_t)(tr.nentries + 1) * sizeof(int));
+    int  n = 0;
+    for (int i = 0; i < tr.nentries; i++) {
+        int e = (int)tr.entries[i].epoch;
+        if (e >= from && (to < 0 || e <= to) && (e - from) % every == 0) epochs[n++] = e;
+    }
+    trace_reader_close(&tr);
+
+    nthreads = pool_start(nthreads);
+    if (!json) printf("%s\n", QUERY_COLS[query]);
+
+    int     batch   = nthreads * EPOCHS_PER_WORKER;
+    char  **out     = calloc((size_t)batch, sizeof(char *));
+    size_t *out_len = calloc((size_t)batch, sizeof(size_t));
+    int     failed  = 0;
+    for (int start = 0; start < n; start += batch) {
+        Round rd = { epochs + start, n - start < batch ? n - start : batch, out, out_len };
+        pool_run(round_job, &rd);
+        for (int k = 0; k < rd.n; k++) {
+            if (out[k]) fwrite(out[k], 1, out_len[k], stdout);
+            else { fprintf(stderr, "%s: cannot read epoch %d\n", trace_dir, rd.epochs[k]); failed = 1; }
+            free(out[k]);
+            out[k] = NULL;
+        }
+        fflush(stdout);
+    }
+
+    pool_stop();
+    for (int t = 0; t < POOL_MAX_THREADS; t++) {
+        Worker *w = &workers[t];
+        if (w->cells) trace_reader_close(&w->tr);
+        free(w->cells); free(w->prev); free(w->ids); free(w->tmp); free(w->perm);
+    }
+    free(out); free(out_len); free(epochs);
+    return failed;
+}
@@ -0,0 +1,274 @@
+#define _POSIX_C_SOURCE 200809L
+
+/*
+ * Recompute soup_orig epochs from a --trace-dir trace.
+ *
+ * soup_orig is deterministic given (soup, global_rng, next_token_id) -- see
+ * soup_core.h -- and every trace chunk stores those, so any epoch can be
+ * rebuilt from the nearest earlier keyframe by re-running the epochs in
+ * between on the worker pool.  This is what makes --trace-sparse traces
+ * (keyframes only) usable.  A --compact run's trace holds the 64-bit tokens
+ * of the same seed's 64-bit run (soup_tokens()) and replays as one.
+ *
+ * Usage:
+ *   ./soup_replay TRACE_DIR --from A --to B --out OUT_DIR [--threads T] [--verify]
+ *   ./soup_replay TRACE_DIR --from A --to B --tape N      [--threads T] [--verify]
+ *
+ * With --out, epochs A..B are written to OUT_DIR as a dense trace (soup,
+ * pairing, heads and steps of every epoch; the first chunk is a keyframe),
+ * with a metadata.txt, so soup_analyze.py can read it like any other trace.
+ *
+ * With --tape, one TSV row per epoch follows tape N through A..B: its pair,
+ * role (A = first half), partner, start heads, steps, and the tape and its
+ * partner before the interaction, then the tape after the epoch (mutation
+ * included).
+ *
+ * The soup's shape (tapes and tape length) comes from the trace header.
+ *
+ * --verify compares every replayed epoch the source trace also stores
+ * (keyframe or delta) against the stored soup and RNG state, and fails on
+ * the first mismatch (e.g. a trace from a soup_orig build with different
+ * RNG use), or if A..B holds no stored epoch to compare.
+ */
+
+#include "soup_core.h"
+#include "pool.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define META_MAX 4096
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Value of key in a key=value metadata.txt, or NULL */
+static const char *meta_get(const char *meta, const char *key, char *out, size_t cap) {
+    size_t klen = strlen(key);
+    for (const char *p = meta; *p; ) {
+        const char *eol = strchr(p, '\n');
+        if (!eol) eol = p + strlen(p);
+        if ((size_t)(eol - p) > klen && !strncmp(p, key, klen) && p[klen] == '=') {
+            size_t n = (size_t)(eol - p) - klen - 1;
+            if (n >= cap) n = cap - 1;
+            memcpy(out, p + klen + 1, n);
+            out[n] = '\0';
+            return out;
+        }
+        p = *eol ? eol + 1 : eol;
+    }
+    return NULL;
+}
+
+static void tape_str(const uint64_t *cells, char out[BFFO_MAX_HALF_LEN + 1]) {
+    uint8_t chars[BFFO_MAX_HALF_LEN];
+    for (uint32_t j = 0; j < soup_shape.half_len; j++) chars[j] = BFFO_TOKEN_CHAR(cells[j]);
+    bffo_tape_str_n(chars, soup_shape.half_len, out);
+}
+
+/* -------------------------------------------------------------------------
+ * Single-tape history (--tape)
+ * -------------------------------------------------------------------------*/
+static void tape_header(void) {
+    printf("epoch\tpair\trole\tpartner\thead0\thead1\tsteps\ttape_before\tpartner_before\ttape_after\n");
+}
+
+static uint32_t perm_slot(uint32_t tape) {
+    uint32_t slot = 0;
+    while (perm[slot] != tape) slot++;
+    return slot;
+}
+
+static uint32_t partner_of(uint32_t tape) {
+    uint32_t slot = perm_slot(tape), npairs = soup_pairs();
+    return perm[slot < npairs ? slot + npairs : slot - npairs];
+}
+
+static void tape_row(int epoch, uint32_t tape, const uint64_t *before, const uint64_t *partner_before) {
+    uint32_t npairs  = soup_pairs();
+    uint32_t slot    = perm_slot(tape);
+    uint32_t pair    = slot % npairs;
+    int      first   = slot < npairs;
+    uint32_t partner = partner_of(tape);
+
+    char sb[BFFO_MAX_HALF_LEN + 1], sp[BFFO_MAX_HALF_LEN + 1], sa[BFFO_MAX_HALF_LEN + 1];
+    tape_str(before, sb);
+    tape_str(partner_before, sp);
+    tape_str(soup_tape(tape), sa);
+    printf("%d\t%u\t%c\t%u\t%u\t%u\t%u\t|%s|\t|%s|\t|%s|\n", epoch, pair, first ? 'A' : 'B',
+           partner, pair_heads[pair], pair_heads[npairs + pair], pair_steps[pair], sb, sp, sa);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * -------------------------------------------------------------------------*/
+int main(int argc, char *argv[]) {
+    const char *src_dir  = NULL;
+    const char *out_dir  = NULL;
+    int         from     = -1;
+    int         to       = -1;
+    long        tape     = -1;
+    int         nthreads = 0;
+    int         verify   = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if      (!strcmp(argv[i], "--from")    && i + 1 < argc) from     = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--to")      && i + 1 < argc) to       = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--out")     && i + 1 < argc) out_dir  = argv[++i];
+        else if (!strcmp(argv[i], "--tape")    && i + 1 < argc) tape     = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) nthreads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--verify"))                  verify   = 1;
+        else if (argv[i][0] != '-' && !src_dir)                 src_dir  = argv[i];
+        else { fprintf(stderr, "Unknown argument: %s\n", argv[i]); return 1; }
+    }
+    if (!src_dir || from < 0 || to < from || !out_dir == (tape < 0)) {
+        fprintf(stderr, "Usage: %s TRACE_DIR --from A --to B (--out OUT_DIR | --tape N) "
+                        "[--threads T] [--verify]\n", argv[0]);
+        return 1;
+    }
+
+    /* Run parameters */
+    char path[1024], meta[META_MAX], val[256];
+    snprintf(path, sizeof(path), "%s/metadata.txt", src_dir);
+    FILE *mf = fopen(path, "r");
+    if (!mf) { perror(path); return 1; }
+    size_t mlen = fread(meta, 1, sizeof(meta) - 1, mf);
+    meta[mlen] = '\0';
+    fclose(mf);
+
+    if (!meta_get(meta, "interpreter", val, sizeof(val)) || strcmp(val, "bff_orig")) {
+        fprintf(stderr, "%s: not a soup_orig trace\n", src_dir);
+        return 1;
+    }
+    double mutation_rate = meta_get(meta, "mutation_rate", val, sizeof(val)) ? strtod(val, NULL) : 0.0;
+
+    if (meta_get(meta, "max_steps", val, sizeof(val)))   soup_max_steps   = (uint32_t)strtoul(val, NULL, 10);
+    if (meta_get(meta, "stack_depth", val, sizeof(val))) soup_stack_depth = (uint32_t)strtoul(val, NULL, 10);
+    if (!soup_max_steps || soup_max_steps > BFFO_MAX_STEPS || !soup_stack_depth ||
+        soup_stack_depth > BFFO_STACK_DEPTH) {
+        fprintf(stderr, "%s: bad max_steps or stack_depth in metadata.txt\n", src_dir);
+        return 1;
+    }
+
+    TraceReader tr;
+    if (trace_reader_open(&tr, src_dir) < 0) { perror(src_dir); return 1; }
+    SoupShape shape = { 2 * tr.hdr.npairs, tr.hdr.npairs ? (uint32_t)(tr.hdr.ncells / (2 * tr.hdr.npairs)) : 0 };
+    if (!soup_shape_valid(shape) || soup_cells(shape) != tr.hdr.ncells) {
+        fprintf(stderr, "%s: trace header gives no soup shape soup_orig can run\n", src_dir);
+        return 1;
+    }
+    if (tape >= (long)shape.ntapes) {
+        fprintf(stderr, "%s: --tape %ld is past the soup's %u tapes\n", src_dir, tape, shape.ntapes);
+        return 1;
+    }
+    if (soup_global_alloc(shape, HUGE_AUTO, 0) < 0) { perror("soup"); return 1; }
+
+    /* Start from the last keyframe before A (at A itself only for A = 0, which has no pairing) */
+    int start = trace_keyframe_before(&tr, from > 0 ? from - 1 : 0);
+    if (start < 0) { fprintf(stderr, "%s: no keyframe at or before epoch %d\n", src_dir, from); return 1; }
+    TraceEpoch ep;
+    if (trace_read(&tr, start, soup, &ep) < 0) {
+        fprintf(stderr, "%s: cannot read epoch %d\n", src_dir, start);
+        return 1;
+    }
+    global_rng    = ep.rng_after;
+    next_token_id = (uint32_t)ep.next_id;
+
+    nthreads = pool_start(nthreads);
+    fprintf(stderr, "Replay: %s epochs %d..%d from keyframe %d, %d threads\n",
+            src_dir, from, to, start, nthreads);
+
+    TraceWriter tw;
+    if (out_dir) {
+        mkdir(out_dir, 0777);
+        snprintf(path, sizeof(path), "%s/metadata.txt", out_dir);
+        FILE *of = fopen(path, "w");
+        if (!of) { perror(path); return 1; }
+        for (const char *p = meta; *p; ) {
+            const char *eol = strchr(p, '\n');
+            size_t n = eol ? (size_t)(eol - p) + 1 : strlen(p);
+            if (strncmp(p, "trace_mode=", 11) && strncmp(p, "keyframe_interval=", 18))
+                fwrite(p, 1, n, of);
+            p += n;
+        }
+        fprintf(of, "keyframe_interval=%d\ntrace_mode=dense\nreplay_of=%s\nreplay_epochs=%d-%d\n",
+                to - from + 1, src_dir, from, to);
+        fclose(of);
+        if (trace_open(&tw, out_dir, soup_cells(shape), soup_pairs(), to - from + 1) < 0) {
+            perror(out_dir);
+            return 1;
+        }
+        if (start == from) {
+            TraceEpoch ep0 = { start, ep.rng_state, global_rng, next_token_id, 0, NULL, NULL };
+            if (!trace_write(&tw, &ep0, soup)) { perror(out_dir); return 1; }
+        }
+    } else {
+        tape_header();
+    }
+
+    uint64_t *check = verify ? malloc(soup_cells(shape) * sizeof(uint64_t)) : NULL;
+    uint64_t  before[BFFO_MAX_HALF_LEN], partner_before[BFFO_MAX_HALF_LEN];
+    size_t    tape_bytes = shape.half_len * sizeof(uint64_t);
+    if (verify && !check) { perror("verify"); return 1; }
+    double   t0 = now_sec();
+    int      checked = 0;
+    int      in_check = -1;           /* stored epoch decoded into check, for trace_read_after */
+
+    for (int epoch = start + 1; epoch <= to; epoch++) {
+        uint64_t shuffle_rng = global_rng;
+        soup_pair_up();
+        if (tape >= 0 && epoch >= from) {
+            memcpy(before, soup_tape((uint32_t)tape), tape_bytes);
+            memcpy(partner_before, soup_tape(partner_of((uint32_t)tape)), tape_bytes);
+        }
+        soup_run_pairs();
+        mutate_soup(mutation_rate, epoch);
+
+        if (epoch >= from) {
+            if (out_dir) {
+                TraceEpoch out = { epoch, shuffle_rng, global_rng, next_token_id, soup_pairs(),
+                                   pair_steps, pair_heads };
+                if (!trace_write(&tw, &out, soup)) { perror(out_dir); return 1; }
+            } else {
+                tape_row(epoch, (uint32_t)tape, before, partner_before);
+            }
+        }
+
+        if (verify && trace_has_epoch(&tr, epoch)) {
+            TraceEpoch stored;
+            int ok = trace_read_after(&tr, in_check, epoch, check, &stored) == 0;
+            in_check = ok ? epoch : -1;
+            if (!ok ||
+                stored.rng_state != shuffle_rng || stored.rng_after != global_rng ||
+                stored.next_id != next_token_id ||
+                memcmp(check, soup, soup_cells(shape) * sizeof(uint64_t))) {
+                fprintf(stderr, "Replay: epoch %d does not match the stored trace\n", epoch);
+                return 1;
+            }
+            checked++;
+        }
+    }
+
+    double dt = now_sec() - t0;
+    fprintf(stderr, "Replay: %d epochs in %.2f s (%.1f epochs/s)", to - start, dt,
+            dt > 0 ? (to - start) / dt : 0.0);
+    if (verify) fprintf(stderr, ", %d stored epochs verified", checked);
+    fprintf(stderr, "\n");
+    if (verify && !checked) {
+        fprintf(stderr, "Replay: --verify found no stored epoch in %d..%d to compare\n", start + 1, to);
+        return 1;
+    }
+
+    if (out_dir) trace_close(&tw);
+    trace_reader_close(&tr);
+    free(check);
+    pool_stop();
+    return 0;
+}
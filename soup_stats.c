@@ -0,0 +1,315 @@
+#include "soup_stats.h"
+#include "hugemem.h"
+#include "lz.h"
+#include "pool.h"
+#include "soup_core.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int cmp_uint32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* -------------------------------------------------------------------------
+ * Step counts
+ * -------------------------------------------------------------------------*/
+void soup_step_summary(const uint32_t *steps, uint32_t npairs, StepSummary *ss) {
+    static uint32_t counts[BFFO_MAX_STEPS + 1];
+    memset(counts, 0, sizeof(counts));
+    memset(ss, 0, sizeof(*ss));
+    ss->pairs = npairs;
+
+    for (uint32_t i = 0; i < npairs; i++) {
+        uint32_t st = steps[i];
+        counts[st]++;
+        ss->total += st;
+        if (st > ss->max) ss->max = st;
+    }
+    ss->zero   = counts[0];
+    ss->at_max = counts[BFFO_MAX_STEPS];
+
+    const uint32_t rank[3] = { (uint32_t)(((uint64_t)npairs * 50 + 99) / 100),
+                               (uint32_t)(((uint64_t)npairs * 90 + 99) / 100),
+                               (uint32_t)(((uint64_t)npairs * 99 + 99) / 100) };
+    uint32_t *pct[3] = { &ss->p50, &ss->p90, &ss->p99 };
+    uint32_t cumul = 0;
+    int q = 0;
+    for (uint32_t v = 0; v <= BFFO_MAX_STEPS; v++) {
+        if (!counts[v]) continue;
+        cumul += counts[v];
+        while (q < 3 && cumul >= rank[q]) *pct[q++] = v;
+        int b = v == 0 ? 0 : v == BFFO_MAX_STEPS ? STEP_LOG_BUCKETS - 1 : 32 - __builtin_clz(v);
+        ss->hist[b] += counts[v];
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * Instruction counts per tape, computed on the worker pool
+ * -------------------------------------------------------------------------*/
+static uint32_t ops_part[POOL_MAX_THREADS][BFFO_MAX_HALF_LEN + 1];
+
+typedef struct {
+    const uint64_t *cells;
+    const uint32_t *cells32;      /* compact soup instead */
+    SoupShape       sh;
+    uint8_t        *ops;          /* per-tape counts too, or NULL */
+} CellsJob;
+
+static void ops_hist_job(void *ctx, int tid, int nthreads) {
+    const CellsJob *j = ctx;
+    uint32_t half = j->sh.half_len;
+    unsigned start, end;
+    pool_slice(j->sh.ntapes, tid, nthreads, &start, &end);
+    uint32_t *freq = ops_part[tid];
+    memset(freq, 0, sizeof(ops_part[tid]));
+    if (j->ops && j->cells32)
+        for (uint32_t i = start; i < end; i++)
+            freq[j->ops[i] = (uint8_t)bffo_count_ops_n32(j->cells32 + (size_t)i * half, half)]++;
+    else if (j->ops)
+        for (uint32_t i = start; i < end; i++)
+            freq[j->ops[i] = (uint8_t)bffo_count_ops_n(j->cells + (size_t)i * half, half)]++;
+    else if (j->cells32)
+        for (uint32_t i = start; i < end; i++)
+            freq[bffo_count_ops_n32(j->cells32 + (size_t)i * half, half)]++;
+    else if (half == BFFO_HALF_LEN)
+        for (uint32_t i = start; i < end; i++)
+            freq[bffo_count_ops(j->cells + (size_t)i * BFFO_HALF_LEN)]++;
+    else
+        for (uint32_t i = start; i < end; i++)
+            freq[bffo_count_ops_n(j->cells + (size_t)i * half, half)]++;
+}
+
+static void ops_hist(CellsJob j, uint32_t *freq) {
+    SoupShape sh = j.sh;
+    pool_run(ops_hist_job, &j);
+    memset(freq, 0, (sh.half_len + 1) * sizeof(uint32_t));
+    for (int t = 0; t < pool_threads(); t++)
+        for (uint32_t v = 0; v <= sh.half_len; v++)
+            freq[v] += ops_part[t][v];
+}
+
+void soup_ops_hist(const uint64_t *cells, SoupShape sh, uint32_t *freq) {
+    ops_hist((CellsJob){ cells, NULL, sh, NULL }, freq);
+}
+
+void soup_ops_hist_map(const uint64_t *cells, SoupShape sh, uint32_t *freq, uint8_t *ops) {
+    ops_hist((CellsJob){ cells, NULL, sh, ops }, freq);
+}
+
+void soup_ops_hist32(const uint32_t *cells, SoupShape sh, uint32_t *freq) {
+    ops_hist((CellsJob){ NULL, cells, sh, NULL }, freq);
+}
+
+void soup_ops_hist_map32(const uint32_t *cells, SoupShape sh, uint32_t *freq, uint8_t *ops) {
+    ops_hist((CellsJob){ NULL, cells, sh, ops }, freq);
+}
+
+void soup_ops_mean_median(const uint32_t *freq, SoupShape sh, double *mean, double *median) {
+    uint64_t total = 0;
+    for (uint32_t v = 0; v <= sh.half_len; v++) total += (uint64_t)v * freq[v];
+    *mean = (double)total / sh.ntapes;
+
+    uint32_t pos_lo = sh.ntapes / 2 - 1;
+    uint32_t pos_hi = sh.ntapes / 2;
+    uint32_t cumul  = 0;
+    int lo_val = -1, hi_val = -1;
+    for (int v = 0; v <= (int)sh.half_len; v++) {
+        cumul += freq[v];
+        if (lo_val < 0 && cumul > pos_lo) lo_val = v;
+        if (hi_val < 0 && cumul > pos_hi) hi_val = v;
+        if (lo_val >= 0 && hi_val >= 0) break;
+    }
+    *median = (lo_val + hi_val) / 2.0;
+}
+
+/* -------------------------------------------------------------------------
+ * Lineage
+ * -------------------------------------------------------------------------*/
+/* Lineage key of cell n: the token id, or a compact token's handle */
+static inline uint32_t cell_key(const uint64_t *cells, const uint32_t *cells32, size_t n) {
+    return cells32 ? BFFO_CTOKEN_HANDLE(cells32[n]) : BFFO_TOKEN_ID(cells[n]);
+}
+
+static inline uint8_t cell_char(const uint64_t *cells, const uint32_t *cells32, size_t n) {
+    return cells32 ? BFFO_CTOKEN_CHAR(cells32[n]) : BFFO_TOKEN_CHAR(cells[n]);
+}
+
+static void lineage(const uint64_t *cells, const uint32_t *cells32, SoupShape sh, uint32_t *unique_out,
+                    uint32_t *modal_out, uint32_t *modal_count_out, uint8_t *rep_tape) {
+    /* 32 MB for the default soup, sorted in place: on THP (not hugetlb, as
+     * soup_orig branches call this after fork) */
+    static HugeMem ids_mem;
+    size_t ncells = soup_cells(sh);
+    if (ncells * sizeof(uint32_t) > ids_mem.bytes) {
+        huge_free(&ids_mem);
+        huge_alloc(&ids_mem, ncells * sizeof(uint32_t), HUGE_THP);
+    }
+    uint32_t *ids = ids_mem.ptr;
+    size_t n = 0;
+    for (size_t c = 0; c < ncells; c++)
+        ids[n++] = cell_key(cells, cells32, c);
+    qsort(ids, n, sizeof(uint32_t), cmp_uint32);
+    uint32_t unique = 0;
+    for (size_t i = 0; i < n; i++)
+        if (i == 0 || ids[i] != ids[i - 1]) unique++;
+    *unique_out = unique;
+
+    uint32_t modal_id = ids[0], modal_count = 0;
+    uint32_t cur_id = ids[0], cur_count = 1;
+    for (size_t i = 1; i < n; i++) {
+        if (ids[i] == cur_id) {
+            cur_count++;
+        } else {
+            if (cur_count > modal_count) { modal_count = cur_count; modal_id = cur_id; }
+            cur_id = ids[i];
+            cur_count = 1;
+        }
+    }
+    if (cur_count > modal_count) { modal_count = cur_count; modal_id = cur_id; }
+    *modal_out       = modal_id;
+    *modal_count_out = modal_count;
+
+    uint32_t best_tape = 0, best_count = 0;
+    for (uint32_t i = 0; i < sh.ntapes; i++) {
+        size_t   tape = (size_t)i * sh.half_len;
+        uint32_t cnt = 0;
+        for (uint32_t j = 0; j < sh.half_len; j++)
+            cnt += (cell_key(cells, cells32, tape + j) == modal_id);
+        if (cnt > best_count) { best_count = cnt; best_tape = i; }
+    }
+
+    for (uint32_t j = 0; j < sh.half_len; j++)
+        rep_tape[j] = cell_char(cells, cells32, (size_t)best_tape * sh.half_len + j);
+}
+
+void soup_lineage(const uint64_t *cells, SoupShape sh, uint32_t *unique_out, uint32_t *modal_id_out,
+                  uint32_t *modal_count_out, uint8_t *rep_tape) {
+    lineage(cells, NULL, sh, unique_out, modal_id_out, modal_count_out, rep_tape);
+}
+
+void soup_lineage32(const uint32_t *cells, SoupShape sh, uint32_t *unique_out, uint32_t *modal_handle_out,
+                    uint32_t *modal_count_out, uint8_t *rep_tape) {
+    lineage(NULL, cells, sh, unique_out, modal_handle_out, modal_count_out, rep_tape);
+}
+
+/* -------------------------------------------------------------------------
+ * Complexity
+ *
+ * The char plane is cut into fixed shards of CPLX_SHARD_BYTES chars (or one
+ * shard for a smaller soup) so the result does not depend on the thread
+ * count; shards are compressed independently on the worker pool.  The LZ
+ * window is 64 KiB, so little is lost by not compressing across shard
+ * boundaries.
+ * -------------------------------------------------------------------------*/
+#define CPLX_SHARD_BYTES  (4096 * 64)                   /* 256 KiB of chars */
+
+typedef struct {
+    uint32_t hist[256];
+    size_t   compressed;
+} CplxShard;
+
+typedef struct {
+    const uint64_t *cells;
+    const uint32_t *cells32;      /* compact soup instead */
+    size_t          shard_bytes;
+    size_t          nshards;
+    CplxShard      *shards;
+    atomic_int      failed;       /* a worker could not allocate its scratch */
+} CplxJob;
+
+/* Per-worker shard buffers and match tables, kept across calls */
+typedef struct {
+    uint8_t  buf[CPLX_SHARD_BYTES];
+    uint8_t  out[CPLX_SHARD_BYTES + CPLX_SHARD_BYTES / 255 + 16];   /* lz_bound */
+    LzTables lz;
+} CplxScratch;
+
+static CplxScratch *cplx_scratch[POOL_MAX_THREADS];
+
+static void complexity_job(void *ctx, int tid, int nthreads) {
+    CplxJob *j = ctx;
+    if (!cplx_scratch[tid] && !(cplx_scratch[tid] = malloc(sizeof(CplxScratch)))) {
+        atomic_store(&j->failed, 1);
+        return;
+    }
+    CplxScratch *sc = cplx_scratch[tid];
+
+    for (size_t s = (size_t)tid; s < j->nshards; s += (size_t)nthreads) {
+        CplxShard *sh = &j->shards[s];
+        memset(sh->hist, 0, sizeof(sh->hist));
+        size_t first = s * j->shard_bytes;
+        for (size_t n = 0; n < j->shard_bytes; n++) {
+            uint8_t ch = cell_char(j->cells, j->cells32, first + n);
+            sc->buf[n] = ch;
+            sh->hist[ch]++;
+        }
+        sh->compressed = lz_compress_depth(sc->buf, j->shard_bytes, sc->out, LZ_CHAIN_DEPTH, &sc->lz);
+    }
+}
+
+/* Add the soup's char histogram and compressed size into cx */
+static void complexity_add(ComplexitySum *cx, const uint64_t *cells, const uint32_t *cells32, SoupShape sh) {
+    static CplxShard *shards;
+    static size_t     shards_cap;
+    size_t ncells = soup_cells(sh);
+    CplxJob j = { cells, cells32, ncells < CPLX_SHARD_BYTES ? ncells : CPLX_SHARD_BYTES, 0, NULL, 0 };
+    j.nshards = ncells / j.shard_bytes;
+    if (j.nshards > shards_cap) {
+        free(shards);
+        shards     = malloc(j.nshards * sizeof(CplxShard));
+        shards_cap = shards ? j.nshards : 0;
+    }
+    if (shards) {
+        j.shards = shards;
+        pool_run(complexity_job, &j);
+    }
+    if (!shards || atomic_load(&j.failed)) {
+        cx->failed = 1;
+        return;
+    }
+    for (size_t s = 0; s < j.nshards; s++) {
+        for (int c = 0; c < 256; c++) cx->hist[c] += shards[s].hist[c];
+        cx->compressed += shards[s].compressed;
+    }
+    cx->ncells += ncells;
+}
+
+void soup_complexity_add(ComplexitySum *cx, const uint64_t *cells, SoupShape sh) {
+    complexity_add(cx, cells, NULL, sh);
+}
+
+void soup_complexity_finish(const ComplexitySum *cx, double *entropy_out, double *lz_bpb_out) {
+    if (cx->failed || !cx->ncells) {
+        *entropy_out = *lz_bpb_out = NAN;
+        return;
+    }
+    double h = 0.0;
+    for (int c = 0; c < 256; c++) {
+        if (!cx->hist[c]) continue;
+        double p = (double)cx->hist[c] / (double)cx->ncells;
+        h -= p * log2(p);
+    }
+    *entropy_out = h;
+    *lz_bpb_out  = 8.0 * (double)cx->compressed / (double)cx->ncells;
+}
+
+static void complexity(const uint64_t *cells, const uint32_t *cells32, SoupShape sh,
+                       double *entropy_out, double *lz_bpb_out) {
+    ComplexitySum cx;
+    memset(&cx, 0, sizeof(cx));
+    complexity_add(&cx, cells, cells32, sh);
+    soup_complexity_finish(&cx, entropy_out, lz_bpb_out);
+}
+
+void soup_complexity(const uint64_t *cells, SoupShape sh, double *entropy_out, double *lz_bpb_out) {
+    complexity(cells, NULL, sh, entropy_out, lz_bpb_out);
+}
+
+void soup_complexity32(const uint32_t *cells, SoupShape sh, double *entropy_out, double *lz_bpb_out) {
+    complexity(NULL, cells, sh, entropy_out, lz_bpb_out);
+}
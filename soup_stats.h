@@ -0,0 +1,89 @@
+#pragma once
+
+#include "bff_orig.h"
+#include "soup_core.h"
+
+#include <stdint.h>
+
+/*
+ * Whole-soup statistics shared by soup_orig and the soup library (soup_api.h).
+ *
+ * cells is a soup of sh.ntapes tapes of sh.half_len tokens, back to back
+ * (soup_shape for the global soup); steps is one epoch's step
+ * counts.  The ops histogram and complexity run on the worker pool (pool.h,
+ * started by the caller) and, like the epoch itself, do not depend on the
+ * thread count.  The functions share
+ * static scratch, so only one may run at a time.  The *32 variants take a
+ * compact soup (soup_core.h).
+ */
+
+/*
+ * Step-count summary of one epoch's pairs.
+ *
+ * Percentiles are exact (nearest rank) from a counting histogram over every
+ * possible step count 0..BFFO_MAX_STEPS.  The log histogram has bucket 0 for
+ * zero steps, bucket k for [2^(k-1), 2^k) and a final bucket for pairs that
+ * hit BFFO_MAX_STEPS.  bffo_run counts the first fetched instruction, so
+ * zero-step pairs only appear if that ever changes.
+ */
+#define STEP_LOG_BUCKETS  15   /* 0, [1,2), [2,4), ..., [4096,8192), 8192 */
+
+typedef struct {
+    uint32_t pairs;                /* pairs summarised (fewer than NPAIRS on a grid) */
+    uint64_t total;
+    uint32_t max;
+    uint32_t zero;
+    uint32_t at_max;
+    uint32_t p50, p90, p99;
+    uint32_t hist[STEP_LOG_BUCKETS];
+} StepSummary;
+
+void soup_step_summary(const uint32_t *steps, uint32_t npairs, StepSummary *ss);
+
+/* Histogram of instruction counts per tape (sh.half_len + 1 bins), and its mean and median. */
+void soup_ops_hist(const uint64_t *cells, SoupShape sh, uint32_t *freq);
+void soup_ops_hist32(const uint32_t *cells, SoupShape sh, uint32_t *freq);
+void soup_ops_mean_median(const uint32_t *freq, SoupShape sh, double *mean, double *median);
+
+/* soup_ops_hist() that also stores each tape's instruction count in ops[tape]
+ * (soup_orig --density), at no extra pass over the soup. */
+void soup_ops_hist_map(const uint64_t *cells, SoupShape sh, uint32_t *freq, uint8_t *ops);
+void soup_ops_hist_map32(const uint32_t *cells, SoupShape sh, uint32_t *freq, uint8_t *ops);
+
+/*
+ * Lineage statistics: unique token IDs, the modal (most-copied) ID and the
+ * chars of the tape carrying the most cells of it.
+ */
+void soup_lineage(const uint64_t *cells, SoupShape sh, uint32_t *unique_out, uint32_t *modal_id_out,
+                  uint32_t *modal_count_out, uint8_t *rep_tape);
+
+/* soup_lineage of a compact soup, by handle: handles_id() (handles.h) gives
+ * the modal handle's id.  Distinct handles are distinct ids. */
+void soup_lineage32(const uint32_t *cells, SoupShape sh, uint32_t *unique_out, uint32_t *modal_handle_out,
+                    uint32_t *modal_count_out, uint8_t *rep_tape);
+
+/*
+ * Complexity: order-0 Shannon entropy and LZ-compressed size of the char
+ * plane, both in bits per byte.
+ *
+ * The paper's "high-order entropy" is H0 minus the normalised compressed
+ * size: ~0 for uniform random bytes, rising as the soup fills with repeated
+ * structure that an order-0 model cannot see.  Both are NaN if the
+ * per-worker scratch (kept across calls) cannot be allocated.
+ */
+void soup_complexity(const uint64_t *cells, SoupShape sh, double *entropy_out, double *lz_bpb_out);
+void soup_complexity32(const uint32_t *cells, SoupShape sh, double *entropy_out, double *lz_bpb_out);
+
+/* soup_complexity() of a soup seen a part at a time (bigsoup.h): zero a
+ * ComplexitySum, add every part, then finish.  Parts are compressed in
+ * shards as a whole soup is, so the result matches soup_complexity() of the
+ * parts laid end to end whenever each part is a whole number of shards. */
+typedef struct {
+    uint64_t hist[256];
+    uint64_t compressed;
+    uint64_t ncells;
+    int      failed;
+} ComplexitySum;
+
+void soup_complexity_add(ComplexitySum *cx, const uint64_t *cells, SoupShape sh);
+void soup_complexity_finish(const ComplexitySum *cx, double *entropy_out, double *lz_bpb_out);
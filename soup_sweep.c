@@ -0,0 +1,306 @@
+#define _POSIX_C_SOURCE 200809L
+
+/*
+ * Successive-halving sweep over soup configurations (seed x mutation rate x
+ * step limit), searching for runs that reach the replicator transition.
+ *
+ * Usage:
+ *   ./soup_sweep [--seeds LIST] [--mutation LIST] [--max-steps LIST]
+ *                [--budget E] [--eta N] [--max-epochs E] [--sample N]
+ *                [--batch B] [--threads T] [--tapes N] [--tape-len L] [--compact]
+ *                [--dir DIR]
+ *
+ * LIST is comma separated; --seeds also takes ranges (1-16,40).  Every
+ * configuration first runs to --budget epochs.  Each rung then scores the
+ * epochs it ran, keeps the best 1/eta (rounded up), and runs those eta
+ * times further, until --max-epochs.  A run's soup is checkpointed to
+ * DIR/cNNN.ckpt at the end of every rung it takes part in, and a promoted
+ * run resumes from there (soup_restore), so no epoch is computed twice.
+ * `soup_orig --resume DIR/cNNN.ckpt` or soup_restore() continues any of
+ * them by hand.
+ *
+ * Score of a rung (from, to], higher = closer to or past the transition:
+ *
+ *   ops_slope  least-squares slope of mean_ops per 1000 epochs, sampled
+ *              every --sample epochs (replicators are op-dense)
+ *   collapse   log2(unique_ids at from / at to): lineages dying out
+ *   growth     log2(modal_count at to / at from): one lineage spreading
+ *   score      ops_slope + collapse + growth
+ *
+ * One row per run per rung goes to DIR/results.tsv, with every component,
+ * so a sweep can be re-ranked afterwards.  Up to --batch soups (~70 MB
+ * each at the default shape) are in memory at once and run in lockstep on
+ * one worker pool (soup_run_epochs_many).  --tapes and --tape-len give every
+ * run a smaller or larger soup (SoupParams.ntapes, tape_len) to screen a grid
+ * cheaply; the shape is kept in each checkpoint.  --compact runs every soup
+ * with 32-bit tokens (SoupParams.compact), for twice the runs per --batch in
+ * the same memory; the scores are the same.
+ */
+
+#include "soup_api.h"
+#include "soup_core.h"
+#include "soup_stats.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define MAX_CONFIGS 4096
+#define MAX_LIST    256
+
+typedef struct {
+    uint64_t seed;
+    double   mutation_rate;
+    uint32_t max_steps;
+    int      epoch;               /* epochs run so far */
+    double   mean_ops;            /* at epoch */
+    uint32_t unique_ids;
+    uint32_t modal_count;
+    double   ops_slope, collapse, growth, score;   /* of the last rung */
+} Config;
+
+static Config   configs[MAX_CONFIGS];
+static int      nconfigs;
+static uint32_t sweep_tapes, sweep_tape_len;   /* 0: library defaults */
+static int      sweep_compact;
+
+/* -------------------------------------------------------------------------
+ * Grid parsing
+ * -------------------------------------------------------------------------*/
+static int parse_u64_list(const char *s, uint64_t *out, int max) {
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "%s", s);
+    int n = 0;
+    for (char *save = NULL, *t = strtok_r(buf, ",", &save); t; t = strtok_r(NULL, ",", &save)) {
+        char *end;
+        uint64_t lo = strtoull(t, &end, 10), hi = lo;
+        if (*end == '-') hi = strtoull(end + 1, &end, 10);
+        if (*end || hi < lo) return -1;
+        for (uint64_t v = lo; v <= hi; v++) {
+            if (n == max) return -1;
+            out[n++] = v;
+        }
+    }
+    return n;
+}
+
+static int parse_f64_list(const char *s, double *out, int max) {
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "%s", s);
+    int n = 0;
+    for (char *save = NULL, *t = strtok_r(buf, ",", &save); t; t = strtok_r(NULL, ",", &save)) {
+        char *end;
+        if (n == max) return -1;
+        out[n++] = strtod(t, &end);
+        if (*end || out[n - 1] < 0.0) return -1;
+    }
+    return n;
+}
+
+/* -------------------------------------------------------------------------
+ * One rung for a batch of runs
+ * -------------------------------------------------------------------------*/
+static SoupShape shape_of(const Soup *s) {
+    SoupShape sh;
+    soup_get_shape(s, &sh.ntapes, &sh.half_len);
+    return sh;
+}
+
+static double soup_mean_ops(const Soup *s) {
+    uint32_t freq[BFFO_MAX_HALF_LEN + 1];
+    double mean, median;
+    if (soup_view_tokens32(s)) soup_ops_hist32(soup_view_tokens32(s), shape_of(s), freq);
+    else                       soup_ops_hist(soup_view_tapes(s), shape_of(s), freq);
+    soup_ops_mean_median(freq, shape_of(s), &mean, &median);
+    return mean;
+}
+
+static void ckpt_path(char *path, size_t len, const char *dir, int k) {
+    snprintf(path, len, "%s/c%03d.ckpt", dir, k);
+}
+
+/* Run configs idx[0..n) from their epoch to target and score them.  Returns 0 or -1. */
+static int run_batch(const int *idx, int n, int target, int sample, const char *dir) {
+    Soup  *soups[MAX_LIST];
+    double sx[MAX_LIST], sy[MAX_LIST], sxx[MAX_LIST], sxy[MAX_LIST], last_ops[MAX_LIST];
+    int    from = configs[idx[0]].epoch;
+    char   path[1024];
+
+    for (int b = 0; b < n; b++) {
+        Config *c = &configs[idx[b]];
+        if (c->epoch == 0) {
+            SoupParams p = { .seed = c->seed, .mutation_rate = c->mutation_rate, .max_steps = c->max_steps,
+                             .ntapes = sweep_tapes, .tape_len = sweep_tape_len, .compact = sweep_compact };
+            soups[b] = soup_create(&p);
+            if (soups[b]) {
+                c->mean_ops    = soup_mean_ops(soups[b]);
+                c->unique_ids  = (uint32_t)soup_cells(shape_of(soups[b]));   /* every token is fresh */
+                c->modal_count = 1;
+            }
+        } else {
+            ckpt_path(path, sizeof(path), dir, idx[b]);
+            soups[b] = soup_restore(path, c->mutation_rate);
+        }
+        if (!soups[b]) { perror("soup"); return -1; }
+        sx[b] = sy[b] = sxx[b] = sxy[b] = 0.0;
+    }
+
+    /* Sample mean_ops from the rung's first epoch to its last */
+    int npts = 0;
+    for (int e = from;; ) {
+        for (int b = 0; b < n; b++) {
+            double x = (e - from) / 1000.0;
+            double y = e == from ? configs[idx[b]].mean_ops : soup_mean_ops(soups[b]);
+            sx[b] += x; sy[b] += y; sxx[b] += x * x; sxy[b] += x * y;
+            last_ops[b] = y;
+        }
+        npts++;
+        if (e == target) break;
+        int step = target - e < sample ? target - e : sample;
+        if (soup_run_epochs_many(soups, n, step) < 0) { perror("soup_run_epochs_many"); return -1; }
+        e += step;
+    }
+
+    for (int b = 0; b < n; b++) {
+        Config  *c = &configs[idx[b]];
+        uint32_t unique, modal_id, modal_count;
+        uint8_t  rep[BFFO_MAX_HALF_LEN];
+        if (soup_view_tokens32(soups[b]))
+            soup_lineage32(soup_view_tokens32(soups[b]), shape_of(soups[b]), &unique, &modal_id, &modal_count, rep);
+        else
+            soup_lineage(soup_view_tapes(soups[b]), shape_of(soups[b]), &unique, &modal_id, &modal_count, rep);
+
+        double den   = npts * sxx[b] - sx[b] * sx[b];
+        c->ops_slope = den > 0.0 ? (npts * sxy[b] - sx[b] * sy[b]) / den : 0.0;
+        c->collapse  = log2((double)c->unique_ids / unique);
+        c->growth    = log2((double)modal_count / c->modal_count);
+        c->score     = c->ops_slope + c->collapse + c->growth;
+        c->mean_ops    = last_ops[b];
+        c->unique_ids  = unique;
+        c->modal_count = modal_count;
+        c->epoch       = target;
+
+        ckpt_path(path, sizeof(path), dir, idx[b]);
+        if (soup_checkpoint(soups[b], path) < 0) { perror(path); return -1; }
+        soup_destroy(soups[b]);
+    }
+    return 0;
+}
+
+/* Descending score, then config order */
+static int cmp_score(const void *a, const void *b) {
+    const Config *x = &configs[*(const int *)a], *y = &configs[*(const int *)b];
+    if (x->score != y->score) return x->score < y->score ? 1 : -1;
+    return *(const int *)a - *(const int *)b;
+}
+
+static int usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--seeds LIST] [--mutation LIST] [--max-steps LIST] [--budget E] [--eta N] "
+                    "[--max-epochs E] [--sample N] [--batch B] [--threads T] [--tapes N] [--tape-len L] "
+                    "[--compact] [--dir DIR]\n", prog);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *seeds_arg = "1-8", *mut_arg = "0", *steps_arg = "8192", *dir = "sweep";
+    int budget = 500, eta = 3, max_epochs = 30000, sample = 0, batch = 8, nthreads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--compact")) { sweep_compact = 1; continue; }
+        if (i + 1 >= argc) return usage(argv[0]);
+        if      (!strcmp(argv[i], "--seeds"))      seeds_arg  = argv[++i];
+        else if (!strcmp(argv[i], "--mutation"))   mut_arg    = argv[++i];
+        else if (!strcmp(argv[i], "--max-steps"))  steps_arg  = argv[++i];
+        else if (!strcmp(argv[i], "--budget"))     budget     = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--eta"))        eta        = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--max-epochs")) max_epochs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--sample"))     sample     = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--batch"))      batch      = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads"))    nthreads   = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--tapes"))      sweep_tapes    = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--tape-len"))   sweep_tape_len = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--dir"))        dir        = argv[++i];
+        else return usage(argv[0]);
+    }
+    if (budget < 1 || eta < 2 || max_epochs < budget || batch < 1 ||
+        !soup_shape_valid((SoupShape){ sweep_tapes ? sweep_tapes : SOUP_SIZE,
+                                       sweep_tape_len ? sweep_tape_len : BFFO_HALF_LEN }))
+        return usage(argv[0]);
+    if (batch > MAX_LIST) batch = MAX_LIST;
+    if (sample < 1) sample = budget / 10 > 0 ? budget / 10 : 1;
+
+    uint64_t seeds[MAX_CONFIGS], steps[MAX_LIST];
+    double   rates[MAX_LIST];
+    int nseeds = parse_u64_list(seeds_arg, seeds, MAX_CONFIGS);
+    int nrates = parse_f64_list(mut_arg, rates, MAX_LIST);
+    int nsteps = parse_u64_list(steps_arg, steps, MAX_LIST);
+    if (nseeds < 1 || nrates < 1 || nsteps < 1 || (long)nseeds * nrates * nsteps > MAX_CONFIGS) {
+        fprintf(stderr, "Bad grid (at most %d configurations)\n", MAX_CONFIGS);
+        return 1;
+    }
+    for (int s = 0; s < nseeds; s++)
+        for (int r = 0; r < nrates; r++)
+            for (int x = 0; x < nsteps; x++) {
+                if (!seeds[s] || !steps[x] || steps[x] > BFFO_MAX_STEPS) {
+                    fprintf(stderr, "Seeds must be > 0 and step limits 1..%d\n", BFFO_MAX_STEPS);
+                    return 1;
+                }
+                Config *c = &configs[nconfigs++];
+                c->seed          = seeds[s];
+                c->mutation_rate = rates[r];
+                c->max_steps     = (uint32_t)steps[x];
+            }
+
+    if (mkdir(dir, 0777) < 0 && errno != EEXIST) { perror(dir); return 1; }
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/results.tsv", dir);
+    FILE *out = fopen(path, "w");
+    if (!out) { perror(path); return 1; }
+    fprintf(out, "rung\tconfig\tseed\tmutation\tmax_steps\tfrom\tto\tmean_ops\tunique_ids\tmodal_count"
+                 "\tops_slope\tcollapse\tgrowth\tscore\tpromoted\n");
+
+    nthreads = soup_lib_start(nthreads);
+    fprintf(stderr, "Sweep: %d configurations, budget %d, eta %d, to %d epochs, %d threads, batches of %d, "
+                    "into %s\n", nconfigs, budget, eta, max_epochs, nthreads, batch, dir);
+
+    int alive[MAX_CONFIGS], nalive = nconfigs;
+    for (int k = 0; k < nconfigs; k++) alive[k] = k;
+    long long epochs_run = 0;
+    for (int rung = 0, target = budget;; rung++) {
+        int from = configs[alive[0]].epoch;
+        for (int b = 0; b < nalive; b += batch)
+            if (run_batch(alive + b, nalive - b < batch ? nalive - b : batch, target, sample, dir) < 0)
+                return 1;
+        epochs_run += (long long)nalive * (target - from);
+
+        qsort(alive, (size_t)nalive, sizeof(int), cmp_score);
+        int last  = target >= max_epochs;
+        int nkeep = last ? 0 : (nalive + eta - 1) / eta;
+        for (int r = 0; r < nalive; r++) {
+            const Config *c = &configs[alive[r]];
+            fprintf(out, "%d\tc%03d\t%llu\t%g\t%u\t%d\t%d\t%.4f\t%u\t%u\t%.4f\t%.4f\t%.4f\t%.4f\t%d\n",
+                    rung, alive[r], (unsigned long long)c->seed, c->mutation_rate, c->max_steps, from,
+                    target, c->mean_ops, c->unique_ids, c->modal_count, c->ops_slope, c->collapse,
+                    c->growth, c->score, r < nkeep);
+        }
+        fflush(out);
+        const Config *best = &configs[alive[0]];
+        fprintf(stderr, "Rung %d: %d runs to epoch %d; best c%03d (seed %llu, mutation %g, max_steps %u) "
+                        "score %.3f, mean_ops %.2f\n", rung, nalive, target, alive[0],
+                (unsigned long long)best->seed, best->mutation_rate, best->max_steps, best->score, best->mean_ops);
+        if (last || nkeep == 0) break;
+
+        nalive = nkeep;
+        long long next = (long long)target * eta;
+        target = next < max_epochs ? (int)next : max_epochs;
+    }
+    fclose(out);
+    soup_lib_stop();
+
+    fprintf(stderr, "Sweep: %lld soup-epochs (%.1f%% of running every configuration to %d); results in %s\n",
+            epochs_run, 100.0 * (double)epochs_run / ((double)nconfigs * max_epochs), max_epochs, path);
+    return 0;
+}
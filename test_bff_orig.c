@@ -0,0 +1,705 @@
+#define _DEFAULT_SOURCE
+
+#include "bff_orig.h"
+#include "checkpoint.h"
+#include "handles.h"
+#include "lz.h"
+#include "pool.h"
+#include "soup_core.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Heads start well away from the program area and each other. */
+#define H0_POS 50
+#define H1_POS 70
+
+static int passed = 0, failed = 0;
+
+static void check(const char *name, int cond) {
+    if (cond) { printf("PASS: %s\n", name); passed++; }
+    else       { printf("FAIL: %s\n", name); failed++; }
+}
+
+/* Zero the tape and write program starting at IP 0. */
+static void make_tape(uint64_t tape[BFFO_TAPE_LEN], const char *prog) {
+    for (int i = 0; i < BFFO_TAPE_LEN; i++) tape[i] = BFFO_MAKE_TOKEN(0, 0, 0);
+    for (int i = 0; prog[i] && i < BFFO_TAPE_LEN; i++)
+        tape[i] = BFFO_MAKE_TOKEN(0, 0, (uint8_t)prog[i]);
+}
+
+/* Deterministic pseudo-random tape for equivalence checks. */
+static void random_tape(uint64_t tape[BFFO_TAPE_LEN], uint64_t *s) {
+    static const char ops[] = "<>{}+-.,[]";
+    for (int i = 0; i < BFFO_TAPE_LEN; i++) {
+        *s ^= *s << 13; *s ^= *s >> 7; *s ^= *s << 17;
+        uint8_t ch = (*s >> 8) % 3 ? (uint8_t)ops[*s % 10] : (uint8_t)(*s >> 16);
+        tape[i] = BFFO_MAKE_TOKEN(i, 0, ch);
+    }
+}
+
+/* Soup of ncells random tokens; step() mutates a few cells as an epoch would. */
+#define TRACE_TEST_CELLS   1024
+#define TRACE_TEST_PAIRS   8
+#define TRACE_TEST_EPOCHS  8
+
+static void trace_test_step(uint64_t *cells, int epoch, uint64_t *s) {
+    for (int m = 0; m < (epoch ? 5 : TRACE_TEST_CELLS); m++) {
+        *s ^= *s << 13; *s ^= *s >> 7; *s ^= *s << 17;
+        uint32_t pos = epoch ? (uint32_t)(*s >> 40) % TRACE_TEST_CELLS : (uint32_t)m;
+        cells[pos] = BFFO_MAKE_TOKEN(*s >> 32, epoch, *s);
+    }
+}
+
+/* TraceEpoch of test epoch e, its steps and heads derived from e */
+static void trace_test_epoch(TraceEpoch *ep, int e, uint32_t *steps, uint8_t *heads) {
+    for (int i = 0; i < TRACE_TEST_PAIRS; i++) {
+        steps[i]                    = (uint32_t)(e * 1000 + i);
+        heads[i]                    = (uint8_t)(e + i);
+        heads[TRACE_TEST_PAIRS + i] = (uint8_t)(e * 3 + i);
+    }
+    TraceEpoch t = { e, 0x1000 + (uint64_t)e, 0x2000 + (uint64_t)e, 0x3000 + (uint64_t)e,
+                     e ? TRACE_TEST_PAIRS : 0, e ? steps : NULL, e ? heads : NULL };
+    *ep = t;
+}
+
+/* Append a hand-built chunk: a zeroed epoch prefix with nsteps, nheads = 0,
+ * then word (nruns of a delta) unless it is 0; nothing more.  A well-formed
+ * chunk would go on to hold the sections these counts promise. */
+static int trace_test_append(const char *dir, uint32_t epoch, uint32_t kind, uint32_t nsteps, uint32_t word) {
+    uint8_t raw[40] = { 0 }, comp[64];
+    size_t  n = 32;
+    for (int b = 0; b < 4; b++) raw[24 + b] = (uint8_t)(nsteps >> (8 * b));
+    if (word) {
+        for (int b = 0; b < 4; b++) raw[32 + b] = (uint8_t)(word >> (8 * b));
+        n += 4;
+    }
+    size_t c = lz_compress(raw, n, comp);
+    char   path[64];
+    snprintf(path, sizeof(path), "%s/trace.bin", dir);
+    FILE *bin = fopen(path, "ab");
+    snprintf(path, sizeof(path), "%s/trace.idx", dir);
+    FILE *idx = fopen(path, "ab");
+    int ok = bin && idx && fseek(bin, 0, SEEK_END) == 0;
+    TraceIndexEntry e = { epoch, kind, ok ? (uint64_t)ftell(bin) : 0, c, n };
+    ok = ok && fwrite(comp, 1, c, bin) == c && fwrite(&e, sizeof(e), 1, idx) == 1;
+    if (bin) fclose(bin);
+    if (idx) fclose(idx);
+    return ok;
+}
+
+/* A 128 x 64 torus, so width and height mixed up would show */
+#define GRID_TEST_W       128
+#define GRID_TEST_H       64
+#define GRID_TEST_TAPES   (GRID_TEST_W * GRID_TEST_H)
+#define GRID_TEST_EPOCHS  4
+
+/* Chebyshev distance of tapes a and b on the test torus */
+static uint32_t grid_test_dist(uint32_t a, uint32_t b) {
+    uint32_t dx = (a % GRID_TEST_W - b % GRID_TEST_W) & (GRID_TEST_W - 1);
+    uint32_t dy = (a / GRID_TEST_W - b / GRID_TEST_W) & (GRID_TEST_H - 1);
+    if (dx > GRID_TEST_W / 2) dx = GRID_TEST_W - dx;
+    if (dy > GRID_TEST_H / 2) dy = GRID_TEST_H - dy;
+    return dx > dy ? dx : dy;
+}
+
+/* Pair up a grid soup for GRID_TEST_EPOCHS epochs on nthreads workers; perms
+ * gets each epoch's pairs.  1 if every pairing is a matching within radius. */
+static int grid_test_run(int nthreads, uint32_t radius, uint32_t perms[][GRID_TEST_TAPES], uint32_t *npairs) {
+    SoupGrid grid;
+    SoupCore c;
+    static uint32_t perm[GRID_TEST_TAPES], steps[GRID_TEST_TAPES / 2];
+    static uint8_t  seen[GRID_TEST_TAPES];
+    memset(&c, 0, sizeof(c));
+    c.shape = (SoupShape){ GRID_TEST_TAPES, BFFO_HALF_LEN };
+    if (soup_grid_init(&grid, c.shape, GRID_TEST_W, GRID_TEST_H, radius) < 0) return 0;
+    c.grid  = &grid;
+    c.perm  = perm;
+    c.steps = steps;
+    c.rng   = 0x5eed0000ULL + radius;
+    pool_start(nthreads);
+
+    int ok = 1;
+    for (int e = 0; e < GRID_TEST_EPOCHS; e++) {
+        soup_core_pair_up(&c);
+        uint32_t half = GRID_TEST_TAPES / 2;
+        memset(seen, 0, sizeof(seen));
+        memcpy(perms[e], perm, sizeof(perm));
+        npairs[e] = c.npairs;
+        ok &= c.npairs > half / 2 && c.npairs <= half;
+        for (uint32_t i = 0; ok && i < c.npairs; i++) {
+            uint32_t a = perm[i], b = perm[half + i];
+            ok &= a < GRID_TEST_TAPES && b < GRID_TEST_TAPES && !seen[a]++ && !seen[b]++;
+            ok &= a != b && grid_test_dist(a, b) <= radius;
+        }
+    }
+    pool_stop();
+    soup_grid_free(&grid);
+    return ok;
+}
+
+/* 1 if ep (read back) matches test epoch e */
+static int trace_test_match(const TraceEpoch *ep, int e) {
+    uint32_t steps[TRACE_TEST_PAIRS];
+    uint8_t  heads[2 * TRACE_TEST_PAIRS];
+    TraceEpoch want;
+    trace_test_epoch(&want, e, steps, heads);
+    if (ep->epoch != e || ep->rng_state != want.rng_state || ep->rng_after != want.rng_after ||
+        ep->next_id != want.next_id || ep->nsteps != want.nsteps)
+        return 0;
+    return !e || (ep->steps && ep->heads && !memcmp(ep->steps, steps, sizeof(steps)) &&
+                  !memcmp(ep->heads, heads, sizeof(heads)));
+}
+
+int main(void) {
+    uint64_t t[BFFO_TAPE_LEN];
+
+    /* -----------------------------------------------------------------------
+     * Basic instructions
+     * ----------------------------------------------------------------------- */
+
+    make_tape(t, "+]");
+    bffo_run(t, H0_POS, H1_POS);
+    check("'+' increments tape[head0]", BFFO_TOKEN_CHAR(t[H0_POS]) == 1);
+
+    make_tape(t, "-]");
+    bffo_run(t, H0_POS, H1_POS);
+    check("'-' decrements tape[head0] (wraps to 255)", BFFO_TOKEN_CHAR(t[H0_POS]) == 255);
+
+    make_tape(t, "}.]");
+    t[H0_POS] = BFFO_MAKE_TOKEN(5, 1, 33);
+    bffo_run(t, H0_POS, H1_POS);
+    check("'}' moves head1, '.' copies full token head0 -> head1",
+          BFFO_TOKEN_ID(t[H1_POS + 1]) == 5 && BFFO_TOKEN_CHAR(t[H1_POS + 1]) == 33);
+
+    make_tape(t, ",]");
+    t[H1_POS] = BFFO_MAKE_TOKEN(9, 2, 44);
+    bffo_run(t, H0_POS, H1_POS);
+    check("',' copies full token head1 -> head0",
+          BFFO_TOKEN_ID(t[H0_POS]) == 9 && BFFO_TOKEN_CHAR(t[H0_POS]) == 44);
+
+    /* -----------------------------------------------------------------------
+     * Termination
+     * ----------------------------------------------------------------------- */
+
+    make_tape(t, "]+");
+    check("']' with empty stack terminates after one step", bffo_run(t, H0_POS, H1_POS) == 1);
+
+    make_tape(t, "");
+    check("IP terminates past position 127 (128 no-op steps)", bffo_run(t, H0_POS, H1_POS) == 128);
+
+    make_tape(t, "[]");
+    t[H0_POS] = BFFO_MAKE_TOKEN(0, 0, 1);
+    check("infinite loop stops at BFFO_MAX_STEPS", bffo_run(t, H0_POS, H1_POS) == BFFO_MAX_STEPS);
+
+    /* -----------------------------------------------------------------------
+     * Pause / resume
+     * ----------------------------------------------------------------------- */
+
+    uint64_t rs = 0x1234567;
+    int same = 1, resumed_ok = 1;
+    for (int trial = 0; trial < 200; trial++) {
+        uint64_t a[BFFO_TAPE_LEN], b[BFFO_TAPE_LEN];
+        random_tape(a, &rs);
+        memcpy(b, a, sizeof(a));
+        uint8_t h0 = (uint8_t)(rs & 127), h1 = (uint8_t)((rs >> 7) & 127);
+
+        uint32_t full = bffo_run(a, h0, h1);
+
+        BffoState st;
+        bffo_init(&st, h0, h1);
+        uint32_t stop = (uint32_t)(rs % 300);
+        bffo_resume(b, &st, stop);
+        resumed_ok &= st.halted || st.steps == stop;
+        uint32_t steps = bffo_resume(b, &st, BFFO_MAX_STEPS);
+        same &= steps == full && st.halted && !memcmp(a, b, sizeof(a));
+    }
+    check("paused run reaches the requested step", resumed_ok);
+    check("pause + resume matches bffo_run (tape and steps)", same);
+
+    /* -----------------------------------------------------------------------
+     * First-touch tracking
+     * ----------------------------------------------------------------------- */
+
+    uint32_t touch[BFFO_TAPE_LEN];
+    BffoState st;
+
+    make_tape(t, "++]");
+    memset(touch, 0xFF, sizeof(touch));
+    bffo_init(&st, H0_POS, H1_POS);
+    bffo_run_touch(t, &st, touch);
+    check("first touch: instruction cells at their fetch step",
+          touch[0] == 0 && touch[1] == 1 && touch[2] == 2);
+    check("first touch: head0 cell at the first '+'", touch[H0_POS] == 0);
+    check("first touch: untouched cells stay UINT32_MAX", touch[H1_POS] == UINT32_MAX);
+
+    /* Mutating a cell only changes the run from its first touch onwards:
+     * resuming the wildtype's checkpoint at that step with the cell flipped
+     * must give the same result as running the mutant from scratch. */
+    int prefix_ok = 1, tested = 0;
+    for (int trial = 0; trial < 500; trial++) {
+        uint64_t orig[BFFO_TAPE_LEN], wt[BFFO_TAPE_LEN], snap[BFFO_TAPE_LEN], mut[BFFO_TAPE_LEN];
+        random_tape(orig, &rs);
+        uint8_t h0 = (uint8_t)(rs & 127), h1 = (uint8_t)((rs >> 7) & 127);
+        int cell = (int)((rs >> 20) % BFFO_TAPE_LEN);
+
+        memcpy(wt, orig, sizeof(orig));
+        memset(touch, 0xFF, sizeof(touch));
+        bffo_init(&st, h0, h1);
+        bffo_run_touch(wt, &st, touch);
+        if (touch[cell] == UINT32_MAX) continue;
+
+        memcpy(mut, orig, sizeof(orig));
+        mut[cell] ^= 0x5A;
+        uint32_t mut_steps = bffo_run(mut, h0, h1);
+
+        BffoState ms;
+        memcpy(snap, orig, sizeof(orig));
+        bffo_init(&ms, h0, h1);
+        bffo_resume(snap, &ms, touch[cell]);
+        snap[cell] ^= 0x5A;
+        bffo_resume(snap, &ms, BFFO_MAX_STEPS);
+
+        prefix_ok &= ms.steps == mut_steps && !memcmp(snap, mut, sizeof(mut));
+        tested++;
+    }
+    check("mutant resumed from first-touch checkpoint matches a full run", prefix_ok && tested > 100);
+
+    /* -----------------------------------------------------------------------
+     * Copy flow
+     * ----------------------------------------------------------------------- */
+
+    BffoFlow flow;
+    make_tape(t, "..,]");
+    memset(&flow, 0, sizeof(flow));
+    bffo_init(&st, H0_POS, H1_POS);
+    bffo_resume_flow(t, &st, BFFO_MAX_STEPS, &flow);
+    check("flow: '.' counts head0 half -> head1 half, ',' the reverse",
+          flow.copies[0][1] == 2 && flow.copies[1][0] == 1 && flow.copies[0][0] == 0 &&
+          flow.copies[1][1] == 0);
+
+    make_tape(t, ".]");
+    memset(&flow, 0, sizeof(flow));
+    bffo_init(&st, H0_POS, H0_POS + 2);
+    bffo_resume_flow(t, &st, BFFO_MAX_STEPS, &flow);
+    check("flow: a copy within A is a self-copy", flow.copies[0][0] == 1 && flow.copies[0][1] == 0);
+
+    int flow_ok = 1;
+    for (int trial = 0; trial < 200; trial++) {
+        uint64_t a[BFFO_TAPE_LEN], b[BFFO_TAPE_LEN];
+        random_tape(a, &rs);
+        memcpy(b, a, sizeof(a));
+        uint8_t h0 = (uint8_t)(rs & 127), h1 = (uint8_t)((rs >> 7) & 127);
+        uint64_t c[BFFO_TAPE_LEN];
+        memcpy(c, a, sizeof(a));
+        uint32_t plain = bffo_run(a, h0, h1);
+        BffoFlow f2;
+        memset(&flow, 0, sizeof(flow));
+        memset(&f2, 0, sizeof(f2));
+        bffo_init(&st, h0, h1);
+        flow_ok &= bffo_resume_flow(b, &st, BFFO_MAX_STEPS, &flow) == plain && !memcmp(a, b, sizeof(a));
+        flow_ok &= bffo_run_flow(c, h0, h1, &f2) == plain && !memcmp(a, c, sizeof(a)) &&
+                   !memcmp(&flow, &f2, sizeof(f2));
+    }
+    check("flow: counting does not change the run", flow_ok);
+
+    /* -----------------------------------------------------------------------
+     * Step log and batches (libbff.so)
+     * ----------------------------------------------------------------------- */
+
+    BffoStep log[BFFO_MAX_STEPS];
+    make_tape(t, "[>,]]");
+    t[H1_POS] = BFFO_MAKE_TOKEN(7, 0, 0);
+    bffo_init(&st, H0_POS, H1_POS);
+    uint32_t nlog = bffo_resume_log(t, &st, BFFO_MAX_STEPS, log);
+    check("log: one entry per step, with the state each op ran in",
+          nlog == 5 && log[0].op == '[' && log[0].sp == 0 && log[1].op == '>' &&
+          log[1].head0 == H0_POS && log[2].head0 == H0_POS + 1 && BFFO_TOKEN_ID(log[2].token) == 7 &&
+          log[3].ip == 3 && log[3].sp == 1 && log[3].top == 0 && log[4].sp == 0);
+
+    int log_ok = 1;
+    for (int trial = 0; trial < 200; trial++) {
+        uint64_t a[BFFO_TAPE_LEN], b[BFFO_TAPE_LEN];
+        random_tape(a, &rs);
+        memcpy(b, a, sizeof(a));
+        uint8_t h0 = (uint8_t)(rs & 127), h1 = (uint8_t)((rs >> 7) & 127);
+        uint32_t plain = bffo_run(a, h0, h1);
+        bffo_init(&st, h0, h1);
+        log_ok &= bffo_resume_log(b, &st, BFFO_MAX_STEPS, log) == plain && !memcmp(a, b, sizeof(a)) &&
+                  log[0].ip == 0 && log[0].head0 == h0 && log[0].head1 == h1;
+    }
+    check("log: recording does not change the run", log_ok);
+
+    enum { NBATCH = 16 };
+    uint64_t batch[NBATCH][BFFO_TAPE_LEN], single[NBATCH][BFFO_TAPE_LEN];
+    uint8_t  bh0[NBATCH], bh1[NBATCH], bops[2 * NBATCH];
+    uint32_t bsteps[NBATCH];
+    BffoFlow bflow[NBATCH];
+    for (int i = 0; i < NBATCH; i++) {
+        random_tape(batch[i], &rs);
+        memcpy(single[i], batch[i], sizeof(batch[i]));
+        bh0[i] = (uint8_t)(rs & 127);
+        bh1[i] = (uint8_t)((rs >> 7) & 127);
+    }
+    bffo_count_ops_batch(&batch[0][0], 2 * NBATCH, bops);
+    bffo_run_batch(&batch[0][0], NBATCH, bh0, bh1, bsteps, bflow);
+    int batch_ok = 1;
+    for (int i = 0; i < NBATCH; i++) {
+        batch_ok &= bops[2 * i] == bffo_count_ops(single[i]) &&
+                    bops[2 * i + 1] == bffo_count_ops(single[i] + BFFO_HALF_LEN);
+        memset(&flow, 0, sizeof(flow));
+        batch_ok &= bffo_run_flow(single[i], bh0[i], bh1[i], &flow) == bsteps[i] &&
+                    !memcmp(single[i], batch[i], sizeof(batch[i])) && !memcmp(&flow, &bflow[i], sizeof(flow));
+    }
+    check("batch: run and op count match per-tape calls", batch_ok);
+
+    /* -----------------------------------------------------------------------
+     * Runtime shapes (bffo_run_shape)
+     * ----------------------------------------------------------------------- */
+
+    int shape_ok = 1;
+    for (int trial = 0; trial < 200; trial++) {
+        uint64_t a[BFFO_TAPE_LEN], b[BFFO_TAPE_LEN];
+        random_tape(a, &rs);
+        memcpy(b, a, sizeof(a));
+        uint8_t  h0 = (uint8_t)(rs & 127), h1 = (uint8_t)((rs >> 7) & 127);
+        BffoShape sh = { BFFO_TAPE_LEN, trial % 2 ? 100 : 0, 0 };
+        BffoFlow  fa, fb;
+        memset(&fa, 0, sizeof(fa));
+        memset(&fb, 0, sizeof(fb));
+        bffo_init(&st, h0, h1);
+        uint32_t plain = bffo_resume_flow(a, &st, sh.max_steps ? sh.max_steps : BFFO_MAX_STEPS, &fa);
+        shape_ok &= bffo_run_shape(b, &sh, h0, h1, trial % 4 < 2 ? &fb : NULL) == plain &&
+                    !memcmp(a, b, sizeof(a)) && (trial % 4 >= 2 || !memcmp(&fa, &fb, sizeof(fa)));
+    }
+    check("shape: the paper's shape runs exactly as bffo_run / bffo_resume_flow", shape_ok);
+
+    uint64_t big[BFFO_MAX_TAPE_LEN];
+    for (int i = 0; i < BFFO_MAX_TAPE_LEN; i++) big[i] = BFFO_MAKE_TOKEN(i, 0, 0);
+    big[0] = BFFO_MAKE_TOKEN(0, 0, '<');
+    big[1] = BFFO_MAKE_TOKEN(1, 0, '.');
+    BffoShape s32 = { 32, 0, 0 };
+    bffo_run_shape(big, &s32, 0, 5, &flow);
+    check("shape: 32-cell tape wraps head0 to 31 and stops at its end",
+          BFFO_TOKEN_ID(big[5]) == 31 && BFFO_TOKEN_ID(big[32]) == 32);
+
+    big[0] = BFFO_MAKE_TOKEN(0, 0, '.');
+    big[1] = BFFO_MAKE_TOKEN(1, 0, 0);
+    BffoShape s256 = { 256, 0, 0 };
+    memset(&flow, 0, sizeof(flow));
+    bffo_run_shape(big, &s256, 200, 3, &flow);
+    check("shape: 256-cell tape keeps heads past 127, halves split at 128",
+          BFFO_TOKEN_ID(big[3]) == 200 && flow.copies[1][0] == 1);
+
+    big[0] = big[1] = big[2] = BFFO_MAKE_TOKEN(0, 0, '[');
+    BffoShape s16 = { 16, 0, 2 };
+    check("shape: generic length with a shallow stack stops on overflow",
+          bffo_run_shape(big, &s16, 0, 0, NULL) == 3 && bffo_shape_valid(&s16) &&
+          !bffo_shape_valid(&(BffoShape){ 48, 0, 0 }));
+
+    /* -----------------------------------------------------------------------
+     * Compact tokens (bffo_run_shape32)
+     * ----------------------------------------------------------------------- */
+
+    int compact_ok = 1;
+    for (int trial = 0; trial < 200; trial++) {
+        uint64_t a[BFFO_TAPE_LEN];
+        uint32_t b[BFFO_TAPE_LEN];
+        random_tape(a, &rs);
+        for (int i = 0; i < BFFO_TAPE_LEN; i++)
+            b[i] = BFFO_MAKE_CTOKEN(BFFO_TOKEN_ID(a[i]), BFFO_TOKEN_CHAR(a[i]));
+        uint8_t  h0 = (uint8_t)(rs & 127), h1 = (uint8_t)((rs >> 7) & 127);
+        BffoShape sh = { BFFO_TAPE_LEN, 0, 0 };
+        BffoFlow  fa, fb;
+        memset(&fa, 0, sizeof(fa));
+        memset(&fb, 0, sizeof(fb));
+        compact_ok &= bffo_count_ops_n32(b, BFFO_HALF_LEN) == bffo_count_ops(a);
+        compact_ok &= bffo_run_shape(a, &sh, h0, h1, &fa) == bffo_run_shape32(b, &sh, h0, h1, &fb) &&
+                      !memcmp(&fa, &fb, sizeof(fa));
+        for (int i = 0; i < BFFO_TAPE_LEN; i++)
+            compact_ok &= BFFO_CTOKEN_CHAR(b[i]) == BFFO_TOKEN_CHAR(a[i]) &&
+                          BFFO_CTOKEN_HANDLE(b[i]) == BFFO_TOKEN_ID(a[i]);
+    }
+    check("compact: 32-bit tokens run as 64-bit ones, handles copied like ids", compact_ok);
+
+    /* -----------------------------------------------------------------------
+     * Tape text helpers
+     * ----------------------------------------------------------------------- */
+
+    uint8_t chars[BFFO_HALF_LEN];
+    char    s[BFFO_HALF_LEN + 1];
+    check("parse |tape| from a stats row",
+          bffo_parse_tape("10\t2.5\t|[[{.>]-]                                                        | (7)", chars)
+          && chars[0] == '[' && chars[7] == ']' && chars[8] == 0);
+    bffo_tape_str(chars, s);
+    check("format round-trips instruction chars", !strncmp(s, "[[{.>]-] ", 9));
+    check("parse rejects comments", !bffo_parse_tape("# nothing", chars));
+
+    /* -----------------------------------------------------------------------
+     * LZ round trip (lz.h)
+     * ----------------------------------------------------------------------- */
+
+    /* Runs, repeats further back than the window and noise */
+    size_t   lz_n   = 3 * LZ_WINDOW + 1234;
+    uint8_t *lz_src = malloc(lz_n), *lz_dst = malloc(lz_bound(lz_n)), *lz_out = malloc(lz_n);
+    LzTables *lz_t  = malloc(sizeof(LzTables));
+    uint64_t ls = 0x243f6a8885a308d3ULL;
+    for (size_t i = 0; i < lz_n; i++) {
+        ls ^= ls << 13; ls ^= ls >> 7; ls ^= ls << 17;
+        lz_src[i] = i % 5000 < 1000 ? (uint8_t)(i / 64) : i % 5000 < 3000 ? lz_src[i % 1000] : (uint8_t)ls;
+    }
+    size_t lz_c = lz_compress(lz_src, lz_n, lz_dst);
+    check("lz: round trip, and compresses repeated data",
+          lz_c < lz_n && lz_decompress(lz_dst, lz_c, lz_out, lz_n) == lz_n && !memcmp(lz_src, lz_out, lz_n));
+    int lz_depth_ok = 1;
+    for (int depth = 1; depth <= LZ_CHAIN_DEPTH; depth *= 2) {
+        size_t c = lz_compress_depth(lz_src, lz_n, lz_dst, depth, lz_t);
+        lz_depth_ok &= lz_decompress(lz_dst, c, lz_out, lz_n) == lz_n && !memcmp(lz_src, lz_out, lz_n);
+    }
+    check("lz: every chain depth with caller tables round-trips", lz_depth_ok);
+    lz_c = lz_compress(lz_src, 0, lz_dst);
+    check("lz: empty input round-trips", lz_decompress(lz_dst, lz_c, lz_out, lz_n) == 0);
+    lz_c = lz_compress(lz_src, lz_n, lz_dst);
+    check("lz: short output buffer or truncated input is rejected",
+          lz_decompress(lz_dst, lz_c, lz_out, lz_n - 1) == (size_t)-1 &&
+          lz_decompress(lz_dst, lz_c / 2, lz_out, lz_n) != lz_n);
+    free(lz_src); free(lz_dst); free(lz_out); free(lz_t);
+
+    /* -----------------------------------------------------------------------
+     * Trace write / read (trace.h)
+     * ----------------------------------------------------------------------- */
+
+    char dir[] = "/tmp/test_bff_orig.XXXXXX";
+    if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+    char path[64];
+
+    /* Every epoch's soup, to compare against; epochs 5.. are rewritten after trace_reopen */
+    static uint64_t soups[TRACE_TEST_EPOCHS][TRACE_TEST_CELLS], resumed[TRACE_TEST_EPOCHS][TRACE_TEST_CELLS];
+    static uint64_t cells[TRACE_TEST_CELLS];
+    uint32_t   tsteps[TRACE_TEST_PAIRS];
+    uint8_t    theads[2 * TRACE_TEST_PAIRS];
+    TraceEpoch ep;
+    TraceWriter tw;
+    uint64_t   ts = 0x9e3779b97f4a7c15ULL;
+    int trace_ok = trace_open(&tw, dir, TRACE_TEST_CELLS, TRACE_TEST_PAIRS, 3) == 0;
+    for (int e = 0; trace_ok && e < TRACE_TEST_EPOCHS; e++) {
+        trace_test_step(cells, e, &ts);
+        memcpy(soups[e], cells, sizeof(cells));
+        trace_test_epoch(&ep, e, tsteps, theads);
+        trace_ok &= trace_write(&tw, &ep, cells) > 0;
+    }
+    trace_close(&tw);
+    check("trace: write epochs 0..7", trace_ok);
+
+    TraceReader tr;
+    trace_ok = trace_reader_open(&tr, dir) == 0;
+    int kinds_ok = trace_ok && tr.nentries == TRACE_TEST_EPOCHS;
+    for (int e = 0; kinds_ok && e < TRACE_TEST_EPOCHS; e++)
+        kinds_ok &= (int)tr.entries[e].kind == (e % 3 ? TRACE_DELTA : TRACE_KEYFRAME);
+    check("trace: keyframe every 3 epochs, deltas in between",
+          kinds_ok && trace_keyframe_before(&tr, 5) == 3 && trace_has_epoch(&tr, 7) && !trace_has_epoch(&tr, 8));
+    int read_ok = trace_ok;
+    for (int e = TRACE_TEST_EPOCHS - 1; read_ok && e >= 0; e--)
+        read_ok &= trace_read(&tr, e, cells, &ep) == 0 && !memcmp(cells, soups[e], sizeof(cells)) &&
+                   trace_test_match(&ep, e);
+    check("trace: trace_read rebuilds every epoch's soup, RNG state, steps and heads", read_ok);
+    read_ok = trace_ok;
+    for (int e = 0, prev = -1; read_ok && e < TRACE_TEST_EPOCHS; prev = e++)
+        read_ok &= trace_read_after(&tr, prev, e, cells, &ep) == 0 && !memcmp(cells, soups[e], sizeof(cells)) &&
+                   trace_test_match(&ep, e);
+    check("trace: trace_read_after in epoch order matches", read_ok);
+    check("trace: an epoch past the end is an error", trace_read(&tr, TRACE_TEST_EPOCHS, cells, &ep) < 0);
+    if (trace_ok) trace_reader_close(&tr);
+
+    /* Resume after epoch 4: 5.. are dropped and rewritten from a fresh keyframe */
+    memcpy(resumed, soups, sizeof(soups));
+    memcpy(cells, soups[4], sizeof(cells));
+    ts = 0xdeadbeefULL;
+    trace_ok = trace_reopen(&tw, dir, TRACE_TEST_CELLS, TRACE_TEST_PAIRS, 4) == 0;
+    for (int e = 5; trace_ok && e < 7; e++) {
+        trace_test_step(cells, e, &ts);
+        memcpy(resumed[e], cells, sizeof(cells));
+        trace_test_epoch(&ep, e, tsteps, theads);
+        trace_ok &= trace_write(&tw, &ep, cells) > 0;
+    }
+    if (trace_ok) trace_close(&tw);
+    trace_ok = trace_ok && trace_reader_open(&tr, dir) == 0;
+    read_ok  = trace_ok && tr.nentries == 7 && tr.hdr.keyframe_interval == 3 &&
+               tr.entries[5].kind == TRACE_KEYFRAME;
+    for (int e = 0; read_ok && e < 7; e++)
+        read_ok &= trace_read(&tr, e, cells, &ep) == 0 && !memcmp(cells, resumed[e], sizeof(cells)) &&
+                   trace_test_match(&ep, e);
+    check("trace: trace_reopen drops later epochs and appends from a keyframe", read_ok);
+    if (trace_ok) trace_reader_close(&tr);
+    check("trace: trace_reopen rejects a different soup size",
+          trace_reopen(&tw, dir, TRACE_TEST_CELLS / 2, TRACE_TEST_PAIRS, 4) < 0 && errno == EINVAL);
+
+    /* Chunks that decompress to their stated size but are too short for what they declare */
+    trace_ok = trace_test_append(dir, 7, TRACE_DELTA, 0, 3) &&
+               trace_test_append(dir, 8, TRACE_KEYFRAME, 0, 0) &&
+               trace_test_append(dir, 9, TRACE_KEYFRAME, TRACE_TEST_PAIRS, 0) &&
+               trace_reader_open(&tr, dir) == 0;
+    check("trace: truncated delta runs, keyframe planes and steps are errors",
+          trace_ok && tr.nentries == 10 && trace_read(&tr, 6, cells, &ep) == 0 &&
+          trace_read(&tr, 7, cells, &ep) < 0 && trace_read(&tr, 8, cells, &ep) < 0 &&
+          trace_read(&tr, 9, cells, &ep) < 0);
+    if (trace_ok) trace_reader_close(&tr);
+    snprintf(path, sizeof(path), "%s/trace.idx", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/trace.bin", dir);
+    unlink(path);
+
+    /* -----------------------------------------------------------------------
+     * Checkpoint write / read / map (checkpoint.h)
+     * ----------------------------------------------------------------------- */
+
+    size_t   ck_bytes = TRACE_TEST_CELLS * sizeof(uint64_t);
+    uint8_t *ck_img   = calloc(1, CKPT_HEADER_BYTES + ck_bytes);
+    CheckpointHeader *ck = (CheckpointHeader *)ck_img;
+    ckpt_header_init(ck, TRACE_TEST_CELLS / BFFO_HALF_LEN, BFFO_HALF_LEN);
+    ck->epoch         = 42;
+    ck->next_token_id = 123456;
+    ck->global_rng    = 0x0123456789abcdefULL;
+    ck->mutation_rate = 1e-4;
+    memcpy(ck_img + CKPT_HEADER_BYTES, soups[7], ck_bytes);
+    const char ck_tail[] = "handle table";
+    snprintf(path, sizeof(path), "%s/soup.ckpt", dir);
+
+    CheckpointHeader h;
+    uint64_t *ck_cells = mmap(NULL, ck_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    int ck_ok = ckpt_write_tail(path, ck_img, CKPT_HEADER_BYTES + ck_bytes, ck_tail, sizeof(ck_tail)) == 0 &&
+                ckpt_read_header(path, &h) == 0 && h.epoch == 42 && h.next_token_id == 123456 &&
+                h.global_rng == ck->global_rng && h.mutation_rate == 1e-4 && h.soup_bytes == ck_bytes &&
+                h.soup_size == TRACE_TEST_CELLS / BFFO_HALF_LEN;
+    check("checkpoint: header round-trips", ck_ok);
+    memset(cells, 0, sizeof(cells));
+    check("checkpoint: ckpt_read restores the soup",
+          ckpt_read(path, &h, cells, ck_bytes) == 0 && !memcmp(cells, soups[7], ck_bytes));
+    char tail[sizeof(ck_tail)];
+    check("checkpoint: the tail after the soup reads back",
+          ckpt_read_tail(path, &h, tail, sizeof(tail)) == 0 && !memcmp(tail, ck_tail, sizeof(tail)));
+    int map_ok = ck_cells != MAP_FAILED && ckpt_map(path, &h, ck_cells, ck_bytes) == 0 &&
+                 !memcmp(ck_cells, soups[7], ck_bytes);
+    if (map_ok) ck_cells[0] ^= 1;             /* copy-on-write: the file keeps its soup */
+    check("checkpoint: ckpt_map maps the soup copy-on-write",
+          map_ok && ckpt_read(path, &h, cells, ck_bytes) == 0 && !memcmp(cells, soups[7], ck_bytes));
+    check("checkpoint: a soup size mismatch is rejected",
+          ckpt_read(path, &h, cells, ck_bytes / 2) < 0 && errno == EINVAL &&
+          ckpt_map(path, &h, ck_cells, ck_bytes / 2) < 0 && errno == EINVAL);
+    if (ck_cells != MAP_FAILED) munmap(ck_cells, ck_bytes);
+    free(ck_img);
+    unlink(path);
+    rmdir(dir);
+
+    /* -----------------------------------------------------------------------
+     * Lineage handles of compact soups (handles.h)
+     * ----------------------------------------------------------------------- */
+
+    uint32_t hcells[BFFO_TAPE_LEN];
+    for (int i = 0; i < BFFO_TAPE_LEN; i++) hcells[i] = BFFO_MAKE_CTOKEN(i, 'a');
+    HandleTable ht, hr;
+    int h_ok = handles_init(&ht, BFFO_TAPE_LEN) == 0;
+    uint32_t ha = h_ok ? handles_new(&ht, 5) : 0, hb = h_ok ? handles_new(&ht, 6) : 0;
+    check("handles: initial handles are their ids, table handles start at the cell count",
+          h_ok && handles_id(&ht, 7) == 7 && handles_epoch(&ht, 7) == 0 &&
+          ha == BFFO_TAPE_LEN && handles_id(&ht, ha) == BFFO_TAPE_LEN && handles_epoch(&ht, ha) == 5 &&
+          hb == BFFO_TAPE_LEN + 1 && handles_id(&ht, hb) == BFFO_TAPE_LEN + 1 && handles_epoch(&ht, hb) == 6);
+
+    /* ha is overwritten, hb copied; hd and he are never stored */
+    hcells[3] = BFFO_MAKE_CTOKEN(hb, '+');
+    hcells[4] = BFFO_MAKE_CTOKEN(hb, '+');
+    uint32_t hd = h_ok ? handles_new(&ht, 7) : 0, he = h_ok ? handles_new(&ht, 7) : 0;
+    if (h_ok) handles_collect(&ht, hcells, BFFO_TAPE_LEN);
+    uint32_t h1 = h_ok ? handles_new(&ht, 9) : 0, h2 = h_ok ? handles_new(&ht, 9) : 0;
+    uint32_t h3 = h_ok ? handles_new(&ht, 9) : 0;
+    check("handles: collect frees unreferenced handles, lowest reused first, ids never reused",
+          h_ok && h1 == ha && h2 == hd && h3 == he && handles_id(&ht, h1) == BFFO_TAPE_LEN + 4 &&
+          handles_epoch(&ht, h1) == 9 && handles_id(&ht, hb) == BFFO_TAPE_LEN + 1 && ht.used == 4 &&
+          !ht.nfree);
+
+    /* Save and restore mid-run: both tables hand out the same next handle */
+    void *hbuf = h_ok ? malloc(handles_bytes(&ht) + 1) : NULL;
+    int hr_ok = hbuf && handles_init(&hr, BFFO_TAPE_LEN) == 0;
+    if (hr_ok) {
+        handles_save(&ht, hbuf);
+        hr_ok = handles_restore(&hr, hbuf, ht.used, ht.nfree, ht.limit, ht.next_id) == 0;
+        for (uint32_t h = BFFO_TAPE_LEN; hr_ok && h < BFFO_TAPE_LEN + ht.used; h++)
+            hr_ok &= handles_id(&hr, h) == handles_id(&ht, h) && handles_epoch(&hr, h) == handles_epoch(&ht, h);
+        hr_ok &= handles_new(&hr, 10) == handles_new(&ht, 10) && hr.next_id == ht.next_id;
+        handles_free(&hr);
+    }
+    check("handles: save / restore round-trips the table", hr_ok);
+    free(hbuf);
+
+    /* Collection comes due at the limit with nothing free, and frees every dead handle */
+    if (h_ok) {
+        while (ht.used < ht.limit) handles_new(&ht, 11);
+        h_ok = handles_due(&ht);
+        handles_collect(&ht, hcells, BFFO_TAPE_LEN);
+        h_ok &= !handles_due(&ht) && ht.nfree == ht.used - 1 && handles_new(&ht, 12) == ha &&
+                ht.limit == ht.used + 1 + HANDLE_SLACK;
+        handles_free(&ht);
+    }
+    check("handles: collection due at the limit frees all but the live handle", h_ok);
+
+    /* The largest compact soup with every table handle live: mutation still
+     * finds one free, the cell it replaces */
+    {
+        SoupCore hc;
+        memset(&hc, 0, sizeof(hc));
+        hc.shape   = (SoupShape){ HANDLE_LIMIT / 2 / BFFO_HALF_LEN, BFFO_HALF_LEN };
+        size_t hn  = soup_cells(hc.shape);
+        hc.cells32 = malloc(hn * sizeof(uint32_t));
+        hc.handles = &ht;
+        hc.rng     = 0x5eedULL;
+        int full_ok = hc.cells32 && handles_init(&ht, hn) == 0;
+        if (full_ok) {
+            for (size_t n = 0; n < hn; n++) hc.cells32[n] = BFFO_MAKE_CTOKEN(handles_new(&ht, 1), 'a');
+            full_ok = ht.used == HANDLE_LIMIT - ht.base && handles_due(&ht);
+            soup_core_mutate(&hc, 1e-5, 2);
+            uint32_t born = 0;
+            for (size_t n = 0; n < hn; n++)
+                born += handles_epoch(&ht, BFFO_CTOKEN_HANDLE(hc.cells32[n])) == 2;
+            full_ok &= hc.next_id > 0 && born > 0 && born <= hc.next_id && ht.used == HANDLE_LIMIT - ht.base;
+            handles_free(&ht);
+        }
+        check("handles: mutating a soup whose table is full reuses the replaced cell's handle", full_ok);
+        free(hc.cells32);
+    }
+
+    /* -----------------------------------------------------------------------
+     * Grid matching (soup_core.h SoupGrid)
+     * ----------------------------------------------------------------------- */
+
+    static uint32_t gperm[2][GRID_TEST_EPOCHS][GRID_TEST_TAPES];
+    uint32_t gpairs[2][GRID_TEST_EPOCHS];
+    int g_ok = 1, g_same = 1;
+    for (uint32_t radius = 1; radius <= GRID_MAX_RADIUS; radius *= 2) {
+        g_ok &= grid_test_run(1, radius, gperm[0], gpairs[0]);
+        for (int nthreads = 2; nthreads <= 5; nthreads += 3) {
+            g_ok &= grid_test_run(nthreads, radius, gperm[1], gpairs[1]);
+            for (int e = 0; e < GRID_TEST_EPOCHS; e++)
+                g_same &= gpairs[0][e] == gpairs[1][e] &&
+                          !memcmp(gperm[0][e], gperm[1][e], gpairs[0][e] * sizeof(uint32_t)) &&
+                          !memcmp(gperm[0][e] + GRID_TEST_TAPES / 2, gperm[1][e] + GRID_TEST_TAPES / 2,
+                                  gpairs[0][e] * sizeof(uint32_t));
+        }
+    }
+    check("grid: each tape in at most one pair, partners within the radius", g_ok);
+    check("grid: the pairing is the same for 1, 2 and 5 threads", g_same);
+    check("grid: a torus that does not hold the soup is rejected",
+          soup_grid_valid((SoupShape){ GRID_TEST_TAPES, BFFO_HALF_LEN }, GRID_TEST_H, GRID_TEST_H, 1) == 0 &&
+          soup_grid_valid((SoupShape){ GRID_TEST_TAPES, BFFO_HALF_LEN }, GRID_TEST_W, GRID_TEST_H,
+                          GRID_MAX_RADIUS + 1) == 0);
+
+    /* -----------------------------------------------------------------------
+     * Summary
+     * ----------------------------------------------------------------------- */
+    printf("\n%d passed, %d failed\n", passed, failed);
+    return failed > 0 ? 1 : 0;
+}
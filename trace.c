@@ -0,0 +1,410 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+#include "lz.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Hash-chain depth for chunk compression: depth 1 is ~3x faster than the
+ * default and costs ~4% in size, which keeps the writer ahead of the soup. */
+#define TRACE_LZ_DEPTH 1
+
+/* Byte planes: byte 0 of all n values, then byte 1, ... */
+static uint8_t *put_planes32(uint8_t *op, const uint32_t *v, size_t n) {
+    for (int b = 0; b < 4; b++)
+        for (size_t i = 0; i < n; i++)
+            *op++ = (uint8_t)(v[i] >> (8 * b));
+    return op;
+}
+
+static uint8_t *put_planes64(uint8_t *op, const uint64_t *v, size_t n) {
+    for (int b = 0; b < 8; b++)
+        for (size_t i = 0; i < n; i++)
+            *op++ = (uint8_t)(v[i] >> (8 * b));
+    return op;
+}
+
+static uint8_t *put_u32(uint8_t *op, uint32_t v) {
+    for (int b = 0; b < 4; b++) *op++ = (uint8_t)(v >> (8 * b));
+    return op;
+}
+
+static uint8_t *put_u64(uint8_t *op, uint64_t v) {
+    for (int b = 0; b < 8; b++) *op++ = (uint8_t)(v >> (8 * b));
+    return op;
+}
+
+static int trace_alloc(TraceWriter *tw, size_t ncells, uint32_t npairs, int keyframe_interval) {
+    memset(tw, 0, sizeof(*tw));
+    tw->ncells            = ncells;
+    tw->npairs            = npairs;
+    tw->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : 1;
+
+    /* Header + steps + heads + the larger of a keyframe and the biggest delta we keep */
+    tw->raw_cap = 32 + 6 * (size_t)npairs + 8 * ncells;
+    tw->prev    = malloc(ncells * sizeof(uint64_t));
+    tw->raw     = malloc(tw->raw_cap);
+    tw->comp    = malloc(lz_bound(tw->raw_cap));
+    tw->lz      = malloc(sizeof(LzTables));
+    if (!tw->prev || !tw->raw || !tw->comp || !tw->lz) { trace_close(tw); errno = ENOMEM; return -1; }
+    return 0;
+}
+
+int trace_open(TraceWriter *tw, const char *dir, size_t ncells, uint32_t npairs,
+               int keyframe_interval) {
+    char path[512];
+    if (trace_alloc(tw, ncells, npairs, keyframe_interval) < 0) return -1;
+
+    snprintf(path, sizeof(path), "%s/trace.bin", dir);
+    tw->data = fopen(path, "wb");
+    snprintf(path, sizeof(path), "%s/trace.idx", dir);
+    tw->index = tw->data ? fopen(path, "wb") : NULL;
+    if (!tw->index) { trace_close(tw); return -1; }
+
+    TraceIndexHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "BFFTRACE", 8);
+    h.version           = TRACE_VERSION;
+    h.keyframe_interval = (uint32_t)tw->keyframe_interval;
+    h.ncells            = ncells;
+    h.npairs            = npairs;
+    fwrite(&h, sizeof(h), 1, tw->index);
+    return 0;
+}
+
+int trace_reopen(TraceWriter *tw, const char *dir, size_t ncells, uint32_t npairs, int epoch) {
+    char path[512];
+    TraceIndexHeader h;
+    snprintf(path, sizeof(path), "%s/trace.idx", dir);
+    FILE *index = fopen(path, "r+b");
+    if (!index) return -1;
+    if (fread(&h, sizeof(h), 1, index) != 1 || memcmp(h.magic, "BFFTRACE", 8) ||
+        h.version != TRACE_VERSION || h.ncells != ncells || h.npairs != npairs) {
+        fclose(index);
+        errno = EINVAL;
+        return -1;
+    }
+    if (trace_alloc(tw, ncells, npairs, (int)h.keyframe_interval) < 0) { fclose(index); return -1; }
+    tw->index = index;
+
+    /* Keep the chunks up to epoch; the next one starts a new delta chain */
+    TraceIndexEntry e;
+    while (fread(&e, sizeof(e), 1, index) == 1 && (int)e.epoch <= epoch) {
+        tw->offset     = e.offset + e.comp_bytes;
+        tw->raw_total += 8 * (uint64_t)ncells + (e.epoch ? 12 * (uint64_t)npairs : 0);
+        tw->nchunks++;
+    }
+    tw->need_keyframe = 1;
+
+    snprintf(path, sizeof(path), "%s/trace.bin", dir);
+    tw->data = fopen(path, "r+b");
+    off_t index_end = (off_t)(sizeof(h) + (size_t)tw->nchunks * sizeof(e));
+    if (!tw->data ||
+        ftruncate(fileno(tw->index), index_end) < 0 || fseeko(tw->index, index_end, SEEK_SET) < 0 ||
+        ftruncate(fileno(tw->data), (off_t)tw->offset) < 0 ||
+        fseeko(tw->data, (off_t)tw->offset, SEEK_SET) < 0) {
+        trace_close(tw);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Encode the soup as a delta against tw->prev into op, updating prev.
+ * Returns the end of the section, or NULL if a keyframe would be smaller
+ * (prev is left untouched in that case).
+ */
+static uint8_t *put_delta(TraceWriter *tw, uint8_t *op, const uint64_t *cells) {
+    const uint64_t *prev = tw->prev;
+    size_t n = tw->ncells;
+
+    /* Pass 1: size the delta */
+    size_t nruns = 0, nchanged = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (cells[i] == prev[i]) continue;
+        nruns += i == 0 || cells[i - 1] == prev[i - 1];
+        nchanged++;
+    }
+    if (4 + 8 * nruns + 8 * nchanged >= 8 * n) return NULL;
+
+    /* Pass 2: runs into skip/len planes, XOR values into the value planes */
+    uint8_t *skip = op + 4;
+    uint8_t *len  = skip + 4 * nruns;
+    uint8_t *xv   = len + 4 * nruns;
+    size_t   r = 0, k = 0, last_end = 0;
+    op = put_u32(op, (uint32_t)nruns);
+    for (size_t i = 0; i < n; ) {
+        if (cells[i] == prev[i]) { i++; continue; }
+        size_t start = i;
+        while (i < n && cells[i] != prev[i]) {
+            uint64_t x = cells[i] ^ prev[i];
+            for (int b = 0; b < 8; b++) xv[b * nchanged + k] = (uint8_t)(x >> (8 * b));
+            tw->prev[i] = cells[i];
+            i++;
+            k++;
+        }
+        uint32_t s = (uint32_t)(start - last_end), l = (uint32_t)(i - start);
+        for (int b = 0; b < 4; b++) {
+            skip[b * nruns + r] = (uint8_t)(s >> (8 * b));
+            len[b * nruns + r]  = (uint8_t)(l >> (8 * b));
+        }
+        last_end = i;
+        r++;
+    }
+    return xv + 8 * nchanged;
+}
+
+/* Cut both files back to the last complete chunk after a failed append; the
+ * next chunk is a keyframe since prev no longer matches what was stored. */
+static void write_failed(TraceWriter *tw) {
+    int   err       = errno ? errno : EIO;
+    off_t index_end = (off_t)(sizeof(TraceIndexHeader) + (size_t)tw->nchunks * sizeof(TraceIndexEntry));
+    clearerr(tw->data);
+    clearerr(tw->index);
+    if (ftruncate(fileno(tw->data), (off_t)tw->offset) == 0) fseeko(tw->data, (off_t)tw->offset, SEEK_SET);
+    if (ftruncate(fileno(tw->index), index_end) == 0) fseeko(tw->index, index_end, SEEK_SET);
+    tw->need_keyframe = 1;
+    errno = err;
+}
+
+size_t trace_write(TraceWriter *tw, const TraceEpoch *ep, const uint64_t *cells) {
+    int      epoch  = ep->epoch;
+    uint32_t nsteps = ep->steps ? ep->nsteps : 0;
+    uint8_t *op = tw->raw;
+    op = put_u64(op, ep->rng_state);
+    op = put_u64(op, ep->rng_after);
+    op = put_u64(op, ep->next_id);
+    op = put_u32(op, nsteps);
+    op = put_planes32(op, ep->steps, nsteps);
+    op = put_u32(op, ep->heads ? nsteps : 0);
+    if (ep->heads) {
+        memcpy(op, ep->heads, 2 * (size_t)nsteps);
+        op += 2 * (size_t)nsteps;
+    }
+
+    uint32_t kind = TRACE_KEYFRAME;
+    if (tw->nchunks > 0 && !tw->need_keyframe && epoch % tw->keyframe_interval != 0) {
+        uint8_t *end = put_delta(tw, op, cells);
+        if (end) { op = end; kind = TRACE_DELTA; }
+    }
+    if (kind == TRACE_KEYFRAME) {
+        op = put_planes64(op, cells, tw->ncells);
+        memcpy(tw->prev, cells, tw->ncells * sizeof(uint64_t));
+        tw->need_keyframe = 0;
+    }
+
+    size_t raw  = (size_t)(op - tw->raw);
+    size_t comp = lz_compress_depth(tw->raw, raw, tw->comp, TRACE_LZ_DEPTH, tw->lz);
+    /* payload reaches the file before its index entry */
+    TraceIndexEntry e = { (uint32_t)epoch, kind, tw->offset, comp, raw };
+    errno = 0;
+    if (fwrite(tw->comp, 1, comp, tw->data) != comp || fflush(tw->data) ||
+        fwrite(&e, sizeof(e), 1, tw->index) != 1 || fflush(tw->index)) {
+        write_failed(tw);
+        return 0;
+    }
+
+    tw->offset    += comp;
+    /* What the per-epoch soup/perm/steps files would have taken */
+    tw->raw_total += 8 * (uint64_t)tw->ncells;
+    if (nsteps) tw->raw_total += 4 * (uint64_t)nsteps + 8 * (uint64_t)tw->npairs;
+    tw->nchunks++;
+    return comp;
+}
+
+void trace_close(TraceWriter *tw) {
+    if (tw->data)  fclose(tw->data);
+    if (tw->index) fclose(tw->index);
+    free(tw->prev);
+    free(tw->raw);
+    free(tw->comp);
+    free(tw->lz);
+    memset(tw, 0, sizeof(*tw));
+}
+
+/* -------------------------------------------------------------------------
+ * Reading
+ * -------------------------------------------------------------------------*/
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    return (uint64_t)get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+/* Value i of an n-value byte-plane section starting at p */
+static uint64_t plane_val(const uint8_t *p, size_t n, size_t i, int width) {
+    uint64_t v = 0;
+    for (int b = 0; b < width; b++) v |= (uint64_t)p[b * n + i] << (8 * b);
+    return v;
+}
+
+int trace_reader_open(TraceReader *tr, const char *dir) {
+    char path[512];
+    memset(tr, 0, sizeof(*tr));
+
+    snprintf(path, sizeof(path), "%s/trace.idx", dir);
+    FILE *idx = fopen(path, "rb");
+    if (!idx) return -1;
+    if (fread(&tr->hdr, sizeof(tr->hdr), 1, idx) != 1 || memcmp(tr->hdr.magic, "BFFTRACE", 8) ||
+        tr->hdr.version != TRACE_VERSION) {
+        fclose(idx);
+        errno = EINVAL;
+        return -1;
+    }
+    int cap = 1024;
+    tr->entries = malloc((size_t)cap * sizeof(TraceIndexEntry));
+    while (tr->entries && fread(&tr->entries[tr->nentries], sizeof(TraceIndexEntry), 1, idx) == 1)
+        if (++tr->nentries == cap) {
+            TraceIndexEntry *grown = realloc(tr->entries, (size_t)cap * 2 * sizeof(TraceIndexEntry));
+            if (!grown) { free(tr->entries); tr->entries = NULL; break; }
+            tr->entries = grown;
+            cap *= 2;
+        }
+    fclose(idx);
+
+    tr->raw_cap = 32 + 6 * (size_t)tr->hdr.npairs + 8 * tr->hdr.ncells;
+    tr->raw   = malloc(tr->raw_cap);
+    tr->steps = malloc((size_t)tr->hdr.npairs * sizeof(uint32_t));
+    tr->heads = malloc(2 * (size_t)tr->hdr.npairs);
+    if (!tr->entries || !tr->raw || !tr->steps || !tr->heads) {
+        trace_reader_close(tr);
+        return -1;
+    }
+
+    /* Chunks are decompressed straight from the mapping */
+    snprintf(path, sizeof(path), "%s/trace.bin", dir);
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0) close(fd);
+        trace_reader_close(tr);
+        return -1;
+    }
+    tr->map_bytes = (size_t)st.st_size;
+    if (tr->map_bytes) {
+        void *m = mmap(NULL, tr->map_bytes, PROT_READ, MAP_SHARED, fd, 0);
+        if (m == MAP_FAILED) {
+            close(fd);
+            trace_reader_close(tr);
+            return -1;
+        }
+        tr->map = m;
+    }
+    close(fd);
+    return 0;
+}
+
+static int find_entry(const TraceReader *tr, int epoch) {
+    for (int i = tr->nentries - 1; i >= 0; i--)
+        if ((int)tr->entries[i].epoch == epoch) return i;
+    return -1;
+}
+
+int trace_has_epoch(const TraceReader *tr, int epoch) {
+    return find_entry(tr, epoch) >= 0;
+}
+
+int trace_keyframe_before(const TraceReader *tr, int epoch) {
+    for (int i = tr->nentries - 1; i >= 0; i--)
+        if ((int)tr->entries[i].epoch <= epoch && tr->entries[i].kind == TRACE_KEYFRAME)
+            return (int)tr->entries[i].epoch;
+    return -1;
+}
+
+/* Decompress chunk i and apply it to cells; fills ep (steps and heads only if last). */
+static int apply_chunk(TraceReader *tr, int i, uint64_t *cells, TraceEpoch *ep, int last) {
+    const TraceIndexEntry *e = &tr->entries[i];
+    if (e->raw_bytes > tr->raw_cap || e->offset > tr->map_bytes ||
+        e->comp_bytes > tr->map_bytes - e->offset ||
+        lz_decompress(tr->map + e->offset, e->comp_bytes, tr->raw, tr->raw_cap) != e->raw_bytes)
+        return -1;
+
+    /* Every section is bounded by the chunk's raw size before it is read */
+    const uint8_t *p   = tr->raw;
+    const uint8_t *end = tr->raw + e->raw_bytes;
+#define TRACE_NEED(q, bytes) if ((size_t)(end - (q)) < (bytes)) return -1
+    TRACE_NEED(p, 28);
+    memset(ep, 0, sizeof(*ep));
+    ep->epoch     = (int)e->epoch;
+    ep->rng_state = get_u64(p);
+    ep->rng_after = get_u64(p + 8);
+    ep->next_id   = get_u64(p + 16);
+    ep->nsteps    = get_u32(p + 24);
+    if (ep->nsteps > tr->hdr.npairs) return -1;
+    p += 28;
+    TRACE_NEED(p, 4 * (size_t)ep->nsteps + 4);
+    if (last && ep->nsteps) {
+        for (uint32_t k = 0; k < ep->nsteps; k++) tr->steps[k] = (uint32_t)plane_val(p, ep->nsteps, k, 4);
+        ep->steps = tr->steps;
+    }
+    p += 4 * (size_t)ep->nsteps;
+    uint32_t nheads = get_u32(p);
+    if (nheads > tr->hdr.npairs) return -1;
+    TRACE_NEED(p + 4, 2 * (size_t)nheads);
+    if (last && nheads) {
+        memcpy(tr->heads, p + 4, 2 * (size_t)nheads);
+        ep->heads = tr->heads;
+    }
+    p += 4 + 2 * (size_t)nheads;
+
+    size_t n = tr->hdr.ncells;
+    if (e->kind == TRACE_KEYFRAME) {
+        TRACE_NEED(p, 8 * n);
+        for (size_t c = 0; c < n; c++) cells[c] = plane_val(p, n, c, 8);
+        return 0;
+    }
+    TRACE_NEED(p, 4);
+    uint32_t       nruns = get_u32(p);
+    if (nruns > n) return -1;
+    TRACE_NEED(p + 4, 8 * (size_t)nruns);
+    const uint8_t *skip  = p + 4;
+    const uint8_t *len   = skip + 4 * (size_t)nruns;
+    size_t nchanged = 0;
+    for (uint32_t r = 0; r < nruns; r++) nchanged += plane_val(len, nruns, r, 4);
+    if (nchanged > n) return -1;
+    const uint8_t *xv = len + 4 * (size_t)nruns;
+    TRACE_NEED(xv, 8 * nchanged);
+#undef TRACE_NEED
+
+    size_t c = 0, k = 0;
+    for (uint32_t r = 0; r < nruns; r++) {
+        c += plane_val(skip, nruns, r, 4);
+        size_t l = plane_val(len, nruns, r, 4);
+        if (c + l > n) return -1;
+        for (size_t j = 0; j < l; j++, c++, k++) cells[c] ^= plane_val(xv, nchanged, k, 8);
+    }
+    return 0;
+}
+
+int trace_read(TraceReader *tr, int epoch, uint64_t *cells, TraceEpoch *ep) {
+    return trace_read_after(tr, -1, epoch, cells, ep);
+}
+
+int trace_read_after(TraceReader *tr, int prev, int epoch, uint64_t *cells, TraceEpoch *ep) {
+    int target = find_entry(tr, epoch);
+    int key    = trace_keyframe_before(tr, epoch);
+    if (target < 0 || key < 0) return -1;
+    int from = find_entry(tr, key);
+    int have = prev >= 0 ? find_entry(tr, prev) : -1;
+    if (have >= from && have < target) from = have + 1;
+    for (int i = from; i <= target; i++)
+        if (apply_chunk(tr, i, cells, ep, i == target) < 0) return -1;
+    return 0;
+}
+
+void trace_reader_close(TraceReader *tr) {
+    if (tr->map) munmap((void *)tr->map, tr->map_bytes);
+    free(tr->entries);
+    free(tr->raw);
+    free(tr->steps);
+    free(tr->heads);
+    memset(tr, 0, sizeof(*tr));
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Delta-compressed soup trace (soup --trace-dir).
+ *
+ * A trace directory holds two files:
+ *
+ *   trace.idx  TraceIndexHeader, then one TraceIndexEntry per written epoch
+ *   trace.bin  the LZ-compressed chunk payloads, back to back
+ *
+ * Every chunk payload (before lz_compress) is
+ *
+ *   uint64  rng_state   shuffle RNG state before this epoch's Fisher-Yates
+ *                       pass; perm is regenerated from it (0 at epoch 0)
+ *   uint64  rng_after   RNG state after the epoch, mutation included
+ *   uint64  next_id     next token id after the epoch
+ *                       (with the soup, the state to resume or replay from)
+ *   uint32  nsteps      pair step counts that follow (0 at epoch 0)
+ *   steps               nsteps uint32, as 4 byte planes
+ *   uint32  nheads      pairs with recorded start heads (0 if the interpreter
+ *                       derives them from the tape, as bff.c does)
+ *   heads               nheads head0 bytes, then nheads head1 bytes
+ *
+ * followed by the soup, either as a keyframe
+ *
+ *   cells               ncells uint64 tokens, as 8 byte planes
+ *
+ * or as a delta against the previous chunk's soup
+ *
+ *   uint32  nruns
+ *   skip                nruns uint32 (unchanged cells before each run), 4 byte planes
+ *   len                 nruns uint32 (changed cells in each run), 4 byte planes
+ *   xor                 sum(len) uint64 (new ^ old), 8 byte planes
+ *
+ * All integers are little-endian.  "Byte planes" store byte 0 of every value,
+ * then byte 1, and so on, so that the slowly varying id/epoch bytes form long
+ * runs the LZ stage can collapse.  A keyframe is written every
+ * keyframe_interval epochs, and whenever a delta would be larger than one, so
+ * any epoch is rebuilt from at most keyframe_interval - 1 deltas.
+ *
+ * A sparse trace holds keyframes only; the epochs in between are recomputed
+ * by soup_replay from a keyframe's soup, rng_after and next_id.
+ */
+#define TRACE_VERSION   3       /* 1: no heads; 2: no rng_after / next_id */
+#define TRACE_KEYFRAME  0
+#define TRACE_DELTA     1
+
+typedef struct {
+    char     magic[8];            /* "BFFTRACE" */
+    uint32_t version;
+    uint32_t keyframe_interval;
+    uint64_t ncells;
+    uint32_t npairs;
+    uint32_t reserved;
+} TraceIndexHeader;
+
+typedef struct {
+    uint32_t epoch;
+    uint32_t kind;                /* TRACE_KEYFRAME or TRACE_DELTA */
+    uint64_t offset;              /* payload offset in trace.bin */
+    uint64_t comp_bytes;
+    uint64_t raw_bytes;
+} TraceIndexEntry;
+
+/* One epoch's record, minus the soup */
+typedef struct {
+    int             epoch;
+    uint64_t        rng_state;
+    uint64_t        rng_after;
+    uint64_t        next_id;
+    uint32_t        nsteps;      /* 0 for the initial soup */
+    const uint32_t *steps;       /* nsteps values, or NULL (trace_read: valid until the next read) */
+    const uint8_t  *heads;       /* nsteps head0 then nsteps head1, or NULL */
+} TraceEpoch;
+
+typedef struct {
+    FILE     *data;
+    FILE     *index;
+    uint64_t *prev;               /* soup as of the last written chunk */
+    uint8_t  *raw;                /* payload scratch */
+    uint8_t  *comp;               /* compressed payload scratch */
+    struct LzTables *lz;          /* match tables for comp */
+    size_t    raw_cap;
+    size_t    ncells;
+    uint32_t  npairs;
+    int       keyframe_interval;
+    int       nchunks;
+    int       need_keyframe;      /* set by trace_reopen: prev is not valid */
+    uint64_t  offset;             /* bytes written to trace.bin */
+    uint64_t  raw_total;          /* bytes the per-epoch raw files would have taken */
+} TraceWriter;
+
+/* Create dir/trace.idx and dir/trace.bin.  Returns 0, or -1 with errno set. */
+int  trace_open(TraceWriter *tw, const char *dir, size_t ncells, uint32_t npairs,
+                int keyframe_interval);
+
+/*
+ * Reopen an existing trace for appending after epoch (a run resumed from a
+ * checkpoint): chunks past epoch are dropped and the next chunk is written as
+ * a keyframe.  The keyframe interval is taken from the existing index.
+ * Returns 0, or -1 (errno set; EINVAL for a different format or soup size).
+ */
+int  trace_reopen(TraceWriter *tw, const char *dir, size_t ncells, uint32_t npairs, int epoch);
+
+/*
+ * Append one epoch; cells is the soup after it.  Returns the chunk's
+ * compressed size, or 0 with errno set if it could not be written (the files
+ * are cut back to the last complete chunk and the next one is a keyframe).
+ */
+size_t trace_write(TraceWriter *tw, const TraceEpoch *ep, const uint64_t *cells);
+
+void trace_close(TraceWriter *tw);
+
+/* -------------------------------------------------------------------------
+ * Reading
+ * -------------------------------------------------------------------------*/
+typedef struct {
+    const uint8_t   *map;        /* trace.bin, mapped read-only */
+    size_t           map_bytes;
+    TraceIndexHeader hdr;
+    TraceIndexEntry *entries;    /* in epoch order */
+    int              nentries;
+    uint8_t         *raw;
+    size_t           raw_cap;
+    uint32_t        *steps;      /* the last epoch read's steps and heads */
+    uint8_t         *heads;
+} TraceReader;
+
+/*
+ * Open dir/trace.idx and map dir/trace.bin (chunks appended later are not
+ * visible).  Returns 0, or -1 (errno set, or EINVAL for a bad index).
+ */
+int  trace_reader_open(TraceReader *tr, const char *dir);
+
+/* Latest epoch <= epoch written as a keyframe, or -1. */
+int  trace_keyframe_before(const TraceReader *tr, int epoch);
+
+/* 1 if the index holds epoch (as a keyframe or a delta), else 0. */
+int  trace_has_epoch(const TraceReader *tr, int epoch);
+
+/*
+ * Rebuild the soup after a written epoch into cells (ncells tokens), applying
+ * deltas forward from the nearest keyframe, and fill ep.
+ * Returns 0, or -1 if the epoch is not in the trace or a chunk is corrupt.
+ */
+int  trace_read(TraceReader *tr, int epoch, uint64_t *cells, TraceEpoch *ep);
+
+/*
+ * trace_read for cells that already hold an earlier written epoch prev (-1
+ * for none): only the chunks after prev are applied when prev is at or past
+ * epoch's keyframe, so reading epochs in order decodes each chunk once.
+ */
+int  trace_read_after(TraceReader *tr, int prev, int epoch, uint64_t *cells, TraceEpoch *ep);
+
+void trace_reader_close(TraceReader *tr);